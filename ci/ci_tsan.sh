@@ -0,0 +1,9 @@
+#!/bin/sh
+# Build the storage tests with ThreadSanitizer and run them
+rm -rf build_tsan
+mkdir build_tsan || exit 1
+cd build_tsan || exit 1
+cmake -G "Unix Makefiles" -DSANITIZE_THREAD=ON -DBUILD_UNITTEST=ON -DBUILD_ALL=ON .. || exit 1
+make storage_unittest || exit 1
+cd .. || exit 1
+./build_tsan/bin/storage_unittest
@@ -1,3 +1,8 @@
 #!/bin/sh
 # Run unittest
-./build/bin/domain_unittest
+./build/bin/domain_unittest || exit 1
+./build/bin/storage_unittest || exit 1
+./build/bin/bulkload_unittest || exit 1
+./build/bin/arrowexport_unittest || exit 1
+./build/bin/datagen_unittest || exit 1
+./build/bin/backup_unittest || exit 1
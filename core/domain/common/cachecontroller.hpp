@@ -21,7 +21,9 @@
 #ifndef CORE_DOMAIN_COMMON_CACHECONTROLLER_HPP_
 #define CORE_DOMAIN_COMMON_CACHECONTROLLER_HPP_
 #include <functional>
+#include <iterator>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace domain {
@@ -39,8 +41,31 @@ class CacheController {
     /**
      *  Sets cached data
      */
-    void fill(const std::vector<EntityType>& list) {
-        mCachedList = list;
+    void fill(std::vector<EntityType> list) {
+        mCachedList = std::move(list);
+        mIsPartial = false;
+    }
+
+    /**
+     *  Caches a page of data; the first page replaces the cached data
+     *  The cache is partial until the last page is added
+     */
+    void fillPage(std::vector<EntityType> page, bool isFirst, bool isLast) {
+        if (isFirst) {
+            mCachedList = std::move(page);
+        } else {
+            mCachedList.insert(mCachedList.end(), std::make_move_iterator(page.begin()),
+                               std::make_move_iterator(page.end()));
+        }
+        mIsPartial = !isLast;
+    }
+
+    /**
+     *  Checks if only some pages of the data are cached
+     *  An entity that is not found in a partial cache may still exist in the database
+     */
+    bool isPartial() const {
+        return mIsPartial;
     }
 
     /**
@@ -114,6 +139,7 @@ class CacheController {
 
  private:
     std::vector<EntityType> mCachedList;
+    bool mIsPartial = false;
     // The function that returns the key ID of the entity
     std::function<std::string(const EntityType&)> mEntiyKeyFn;
 };
@@ -32,6 +32,26 @@ enum class API_STATUS {
     NOT_FOUND     = 0x03
 };
 
+/**
+ *  Request for one page of a list
+ *  - token: empty for the first page, else the nextToken of the previous page
+ *  - sortKey: the field to order by (e.g. "name"); empty or unknown orders by the ID
+ */
+struct PageRequest {
+    size_t size = 50;
+    std::string token;
+    std::string sortKey;
+};
+
+/**
+ *  One page of a list; nextToken is empty on the last page
+ */
+template <typename EntityType>
+struct Page {
+    std::vector<EntityType> items;
+    std::string nextToken;
+};
+
 // Types for accounting domain
 namespace accounting {
 
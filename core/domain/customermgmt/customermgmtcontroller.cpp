@@ -48,12 +48,30 @@ std::vector<entity::Customer> CustomerMgmtController::list() {
     return mCachedList.get();
 }
 
+Page<entity::Customer> CustomerMgmtController::listPage(const PageRequest& request) {
+    LOG_DEBUG("Retrieving a page of customers data");
+    Page<entity::Customer> page = mDataProvider->getCustomerPage(request);
+    mCachedList.fillPage(page.items, request.token.empty(), page.nextToken.empty());
+    if (request.token.empty() && page.items.empty()) {
+        LOG_WARN("There are no customers on record");
+        mView->showListIsEmptyPopup();
+        return page;
+    }
+    LOG_INFO("Successfully retrieved %d customers", page.items.size());
+    return page;
+}
+
 entity::Customer CustomerMgmtController::get(const std::string& id) {
     LOG_DEBUG("Getting customer %s data", id.c_str());
     const std::vector<entity::Customer>::iterator& iter = mCachedList.find(id);
     if (iter == mCachedList.endOfData()) {
-        LOG_ERROR("Requested customer was not found");
-        return entity::Customer{};
+        // The customer may be in the pages that are not listed yet
+        const entity::Customer customer = mCachedList.isPartial() ?
+                                          mDataProvider->findCustomer(id) : entity::Customer{};
+        if (customer.ID().empty()) {
+            LOG_ERROR("Requested customer was not found");
+        }
+        return customer;
     }
     LOG_INFO("Found customer %s", id.c_str());
     return *iter;
@@ -97,7 +115,7 @@ CUSTOMERMGMTAPISTATUS CustomerMgmtController::save(const entity::Customer& custo
         return CUSTOMERMGMTAPISTATUS::FAILED;
     }
     // Decide if it's a create or update request
-    if (mCachedList.isExists(customer.ID())) {
+    if (mCachedList.isExists(customer.ID()) || isStoredOnly(customer.ID())) {
         update(customer);
     } else {
         create(customer);
@@ -137,14 +155,19 @@ void CustomerMgmtController::update(const entity::Customer& customer) {
     mDataProvider->update(customer);
     // Update cache list
     const std::vector<entity::Customer>::iterator it = mCachedList.find(customer.ID());
-    *it = customer;
+    if (it != mCachedList.endOfData()) {
+        *it = customer;
+    } else {
+        // Not listed yet
+        mCachedList.insert(customer);
+    }
     LOG_INFO("Customer %s information updated", customer.ID().c_str());
 }
 
 CUSTOMERMGMTAPISTATUS CustomerMgmtController::remove(const std::string& id) {
     LOG_DEBUG("Removing customer %s", id.c_str());
     const std::vector<entity::Customer>::iterator it = mCachedList.find(id);
-    if (it == mCachedList.endOfData()) {
+    if (it == mCachedList.endOfData() && !isStoredOnly(id)) {
         LOG_ERROR("Customer with ID %s was not found in the cache list", id.c_str());
         mView->showDataNotReadyScreen();
         return CUSTOMERMGMTAPISTATUS::NOT_FOUND;
@@ -155,11 +178,17 @@ CUSTOMERMGMTAPISTATUS CustomerMgmtController::remove(const std::string& id) {
      * E.g. failure: mDataprovider lost db connection
     */
     // Remove from cache
-    mCachedList.erase(it);
+    if (it != mCachedList.endOfData()) {
+        mCachedList.erase(it);
+    }
     mView->showSuccessfullyRemoved(id);
     return CUSTOMERMGMTAPISTATUS::SUCCESS;
 }
 
+bool CustomerMgmtController::isStoredOnly(const std::string& id) {
+    return mCachedList.isPartial() && !mDataProvider->findCustomer(id).ID().empty();
+}
+
 CustomerMgmtCtrlPtr createCustomerMgmtModule(
                     const CustomerMgmtDataPtr& data,
                     const CustomerMgmtViewPtr& view) {
@@ -42,6 +42,7 @@ class CustomerMgmtController : public CustomerManagementControlInterface,
     ~CustomerMgmtController() = default;
 
     std::vector<entity::Customer> list() override;
+    Page<entity::Customer> listPage(const PageRequest& request) override;
     entity::Customer get(const std::string& id) override;
     CUSTOMERMGMTAPISTATUS save(const entity::Customer& customer,
                                std::map<std::string, std::string>* validationResult) override;
@@ -50,6 +51,8 @@ class CustomerMgmtController : public CustomerManagementControlInterface,
  private:
     void create(const entity::Customer& customer);
     void update(const entity::Customer& customer);
+    // True if the customer is not in the listed pages but is in the database
+    bool isStoredOnly(const std::string& id);
 };
 
 }  // namespace customermgmt
@@ -23,6 +23,7 @@
 #include <string>
 #include <vector>
 #include <entity/customer.hpp>
+#include <domain/common/types.hpp>
 
 namespace domain {
 namespace customermgmt {
@@ -36,6 +37,16 @@ class CustomerManagementDataInterface {
      *  Retrieves the all customers from the database
      */
     virtual std::vector<entity::Customer> getCustomers() = 0;
+    /**
+     *  Retrieves one page of the customers; see PageRequest
+     *  - sortKey: "firstname" or "lastname"
+     */
+    virtual Page<entity::Customer> getCustomerPage(const PageRequest& request) = 0;
+    /**
+     *  Retrieves the customer with the ID
+     *  - Returns an empty customer if the ID is not found
+     */
+    virtual entity::Customer findCustomer(const std::string& id) = 0;
     /**
      *  Create a customer
      */
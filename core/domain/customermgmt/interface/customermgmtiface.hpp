@@ -47,6 +47,12 @@ class CustomerManagementControlInterface {
      *  Gets the list of all customers
      */
     virtual std::vector<entity::Customer> list() = 0;
+    /**
+     *  Gets one page of the customers; see PageRequest
+     *  The pages are cached like list(); the customers that are not listed yet are read from
+     *  the database when they are used.
+     */
+    virtual Page<entity::Customer> listPage(const PageRequest& request) = 0;
     /**
      *  Retrieves a customer
      */
@@ -54,12 +54,31 @@ std::vector<entity::Employee> EmployeeMgmtController::list() {
     return mCachedList.get();
 }
 
+Page<entity::Employee> EmployeeMgmtController::listPage(const PageRequest& request) {
+    LOG_DEBUG("Retrieving a page of employees data");
+    Page<entity::Employee> page = mDataProvider->getEmployeePage(request);
+    mCachedList.fillPage(page.items, request.token.empty(), page.nextToken.empty());
+    if (request.token.empty() && page.items.empty()) {
+        LOG_WARN("There are no employees on record");
+        mView->showEmployeesEmptyPopup();
+        return page;
+    }
+    LOG_INFO("Successfully retrieved %d employees", page.items.size());
+    return page;
+}
+
 entity::Employee EmployeeMgmtController::getEmployee(const std::string& employeeID) {
     LOG_DEBUG("Getting employee %s", employeeID.c_str());
     const std::vector<entity::Employee>::iterator& iter = mCachedList.find(employeeID);
     if (iter == mCachedList.endOfData()) {
-        LOG_ERROR("Employee was not found");
-        return entity::Employee{};
+        // The employee may be in the pages that are not listed yet
+        const entity::Employee employee = mCachedList.isPartial() ?
+                                          mDataProvider->findEmployee(employeeID) :
+                                          entity::Employee{};
+        if (employee.ID().empty()) {
+            LOG_ERROR("Employee was not found");
+        }
+        return employee;
     }
     LOG_INFO("Found employee %s", employeeID.c_str());
     return *iter;
@@ -106,7 +125,7 @@ void EmployeeMgmtController::createUser(const entity::Employee& employee,
     LOG_INFO("User %s added", newUser.userID().c_str());
 }
 
-// Note: Before calling this, make sure the employee is already in the cache list
+// Note: Before calling this, make sure the employee is already in the database
 void EmployeeMgmtController::update(const SaveEmployeeData& data) {
     const entity::Employee& employee = data.employee;
     LOG_DEBUG("Updating employee %s", employee.ID().c_str());
@@ -120,7 +139,12 @@ void EmployeeMgmtController::update(const SaveEmployeeData& data) {
     }
     // Update cache list
     const std::vector<entity::Employee>::iterator it = mCachedList.find(employee.ID());
-    *it = employee;
+    if (it != mCachedList.endOfData()) {
+        *it = employee;
+    } else {
+        // Not listed yet
+        mCachedList.insert(employee);
+    }
     LOG_INFO("Employee %s information updated", employee.ID().c_str());
 }
 
@@ -135,12 +159,13 @@ EMPLMGMTSTATUS EmployeeMgmtController::save(const SaveEmployeeData& employeeData
     employeeData.validationResult->clear();
     // Fill the validation results
     *(employeeData.validationResult) = validateDetails(employee);
+    const bool isExisting = mCachedList.isExists(employee.ID()) || isStoredOnly(employee.ID());
     /*!
      * Todo (code) - the second check will determine if we're creating or updating.
      *               if we're updating, we don't need to validate PIN
      *               until we support User Information update
     */
-    if (employee.isSystemUser() && !mCachedList.isExists(employee.ID())) {
+    if (employee.isSystemUser() && !isExisting) {
         // Validate PIN only
         entity::validator::UserValidator validator(
                 entity::User("Proxy", "Proxy", employeeData.PIN,
@@ -153,7 +178,7 @@ EMPLMGMTSTATUS EmployeeMgmtController::save(const SaveEmployeeData& employeeData
         return EMPLMGMTSTATUS::FAILED;
     }
     // Decide if it's a create or update request
-    if (mCachedList.isExists(employee.ID())) {
+    if (isExisting) {
         update(employeeData);
     } else {
         create(employeeData);
@@ -164,7 +189,7 @@ EMPLMGMTSTATUS EmployeeMgmtController::save(const SaveEmployeeData& employeeData
 EMPLMGMTSTATUS EmployeeMgmtController::remove(const std::string& employeeID) {
     LOG_DEBUG("Removing employee with ID %s", employeeID.c_str());
     const std::vector<entity::Employee>::iterator it = mCachedList.find(employeeID);
-    if (it == mCachedList.endOfData()) {
+    if (it == mCachedList.endOfData() && !isStoredOnly(employeeID)) {
         LOG_ERROR("Employee with ID %s was not found in the cache list", employeeID.c_str());
         mView->showDataNotReadyScreen();
         return EMPLMGMTSTATUS::NOT_FOUND;
@@ -175,12 +200,18 @@ EMPLMGMTSTATUS EmployeeMgmtController::remove(const std::string& employeeID) {
      * E.g. failure: mDataprovider lost db connection
     */
     // Remove from cache
-    mCachedList.erase(it);
+    if (it != mCachedList.endOfData()) {
+        mCachedList.erase(it);
+    }
     mView->showSuccessfullyRemoved(employeeID);
     LOG_INFO("Successfully removed employee with ID %s", employeeID.c_str());
     return EMPLMGMTSTATUS::SUCCESS;
 }
 
+bool EmployeeMgmtController::isStoredOnly(const std::string& employeeID) {
+    return mCachedList.isPartial() && !mDataProvider->findEmployee(employeeID).ID().empty();
+}
+
 std::vector<entity::Employee> EmployeeMgmtController::findByName(const std::string& fname,
                                                                  const std::string& lname) {
     /*
@@ -45,6 +45,7 @@ class EmployeeMgmtController : public EmployeeMgmtControlInterface,
     ~EmployeeMgmtController() = default;
 
     std::vector<entity::Employee> list() override;
+    Page<entity::Employee> listPage(const PageRequest& request) override;
     entity::Employee getEmployee(const std::string& employeeID) override;
     entity::User getUser(const std::string& employeeID) override;
     EMPLMGMTSTATUS save(const SaveEmployeeData& employeeData) override;
@@ -58,6 +59,8 @@ class EmployeeMgmtController : public EmployeeMgmtControlInterface,
     void create(const SaveEmployeeData& data);
     void createUser(const entity::Employee& employee, const std::string& pin) const;
     void update(const SaveEmployeeData& data);
+    // True if the employee is not in the listed pages but is in the database
+    bool isStoredOnly(const std::string& employeeID);
 };
 
 }  // namespace empmgmt
@@ -24,6 +24,7 @@
 #include <vector>
 #include <entity/employee.hpp>
 #include <entity/user.hpp>
+#include <domain/common/types.hpp>
 
 namespace domain {
 namespace empmgmt {
@@ -37,6 +38,16 @@ class EmployeeMgmtDataInterface {
      * Retrieves the all the employees
     */
     virtual std::vector<entity::Employee> getEmployees() = 0;
+    /*!
+     * Retrieves one page of the employees; see PageRequest
+     * - sortKey: "firstname", "lastname", "position" or "status"
+    */
+    virtual Page<entity::Employee> getEmployeePage(const PageRequest& request) = 0;
+    /*!
+     * Retrieves the employee with the ID
+     * - Returns an empty employee if the ID is not found
+    */
+    virtual entity::Employee findEmployee(const std::string& employeeID) = 0;
     /*!
      * Retrieves the user data of the employee
     */
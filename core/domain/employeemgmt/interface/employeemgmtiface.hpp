@@ -57,6 +57,12 @@ class EmployeeMgmtControlInterface {
      * Gets the list of all employees
     */
     virtual std::vector<entity::Employee> list() = 0;
+    /*!
+     * Gets one page of the employees; see PageRequest
+     * The pages are cached like list(); the employees that are not listed yet are read from
+     * the database when they are used.
+    */
+    virtual Page<entity::Employee> listPage(const PageRequest& request) = 0;
     /*!
      * Returns the info of the requested employee
     */
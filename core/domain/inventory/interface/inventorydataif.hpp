@@ -20,10 +20,12 @@
 **************************************************************************************************/
 #ifndef CORE_DOMAIN_INVENTORY_INTERFACE_INVENTORYDATAIF_HPP_
 #define CORE_DOMAIN_INVENTORY_INTERFACE_INVENTORYDATAIF_HPP_
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <entity/product.hpp>
 #include <entity/uom.hpp>
+#include <domain/common/types.hpp>
 
 namespace domain {
 namespace inventory {
@@ -37,6 +39,16 @@ class InventoryDataInterface {
      *  Retrieves the all the products from the database
      */
     virtual std::vector<entity::Product> getProducts() = 0;
+    /**
+     *  Retrieves one page of the products; see PageRequest
+     *  - sortKey: "name", "sku", "category", "brand", "status" or "supplier"
+     */
+    virtual Page<entity::Product> getProductPage(const PageRequest& request) = 0;
+    /**
+     *  Retrieves the product with the barcode
+     *  - Returns an empty product if the barcode is not found
+     */
+    virtual entity::Product findProduct(const std::string& barcode) = 0;
     /**
      *  Create a product
      */
@@ -49,6 +61,17 @@ class InventoryDataInterface {
      *  Removes the product from the database
      */
     virtual void removeWithBarcode(const std::string& barcode) = 0;
+    /**
+     *  Takes the quantity from the stock of the product, e.g. when it is sold
+     *  - Returns false, and takes nothing, if the product is not found or has less in stock
+     *  - Does not rewrite the product; concurrent sales of one product do not wait for each other
+     */
+    virtual bool takeStock(const std::string& barcode, size_t quantity) = 0;
+    /**
+     *  Puts the quantity back into the stock of the product, e.g. a returned item
+     *  - Returns false if the product is not found
+     */
+    virtual bool returnStock(const std::string& barcode, size_t quantity) = 0;
     /**
      *  Returns all the registered UOMs
      */
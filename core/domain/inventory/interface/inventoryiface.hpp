@@ -46,6 +46,12 @@ class InventoryControlInterface {
      *  Gets the list of all products
      */
     virtual std::vector<entity::Product> list() = 0;
+    /**
+     *  Gets one page of the products; see PageRequest
+     *  The first page replaces the cached list and the next ones are added to it, so the
+     *  products that are not listed yet are read from the database when they are used.
+     */
+    virtual Page<entity::Product> listPage(const PageRequest& request) = 0;
     /**
      *  Retrieves a product with the barcode
      */
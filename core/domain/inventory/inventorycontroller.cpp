@@ -45,16 +45,36 @@ std::vector<entity::Product> InventoryController::list() {
     return mCachedList.get();
 }
 
+Page<entity::Product> InventoryController::listPage(const PageRequest& request) {
+    LOG_DEBUG("Retrieving a page of products data");
+    Page<entity::Product> page = mDataProvider->getProductPage(request);
+    mCachedList.fillPage(page.items, request.token.empty(), page.nextToken.empty());
+    if (request.token.empty() && page.items.empty()) {
+        LOG_WARN("There are no products on record");
+        mView->showProductsEmptyPopup();
+        return page;
+    }
+    LOG_INFO("Successfully retrieved %d products.", page.items.size());
+    return page;
+}
+
 entity::Product InventoryController::getProduct(const std::string& barcode) {
     LOG_DEBUG("Getting product %s", barcode.c_str());
     const std::vector<entity::Product>::iterator& iter = mCachedList.find(barcode);
     if (iter != mCachedList.endOfData()) {
         LOG_INFO("Found product %s", barcode.c_str());
         return *iter;
-    } else {
-        LOG_ERROR("Product was not found");
-        return entity::Product{};
     }
+    if (mCachedList.isPartial()) {
+        // The product may be in the pages that are not listed yet
+        const entity::Product product = mDataProvider->findProduct(barcode);
+        if (!product.barcode().empty()) {
+            LOG_INFO("Found product %s", barcode.c_str());
+            return product;
+        }
+    }
+    LOG_ERROR("Product was not found");
+    return entity::Product{};
 }
 
 INVENTORYAPISTATUS InventoryController::save(const entity::Product& product,
@@ -88,7 +108,7 @@ INVENTORYAPISTATUS InventoryController::save(const entity::Product& product,
         return INVENTORYAPISTATUS::FAILED;
     }
     // Decide if it's a create or update request
-    if (mCachedList.isExists(product.barcode())) {
+    if (mCachedList.isExists(product.barcode()) || isStoredOnly(product.barcode())) {
         update(product);
     } else {
         create(product);
@@ -118,7 +138,12 @@ void InventoryController::update(const entity::Product& product) {
     */
     // Update cache list
     const std::vector<entity::Product>::iterator it = mCachedList.find(product.barcode());
-    *it = product;
+    if (it != mCachedList.endOfData()) {
+        *it = product;
+    } else {
+        // Not listed yet
+        mCachedList.insert(product);
+    }
     LOG_INFO("Product %s information updated", product.name().c_str());
 }
 
@@ -126,7 +151,7 @@ INVENTORYAPISTATUS InventoryController::remove(const std::string& barcode) {
     LOG_DEBUG("Removing product %s", barcode.c_str());
     const std::vector<entity::Product>::iterator it =
                      mCachedList.find(barcode);
-    if (it == mCachedList.endOfData()) {
+    if (it == mCachedList.endOfData() && !isStoredOnly(barcode)) {
         LOG_ERROR("Product %s was not found in the cache list", barcode.c_str());
         mView->showDataNotReadyScreen();
         return INVENTORYAPISTATUS::NOT_FOUND;
@@ -137,12 +162,18 @@ INVENTORYAPISTATUS InventoryController::remove(const std::string& barcode) {
      * E.g. failure: mDataprovider lost db connection
     */
     // Remove from cache
-    mCachedList.erase(it);
+    if (it != mCachedList.endOfData()) {
+        mCachedList.erase(it);
+    }
     mView->showSuccessfullyRemoved(barcode);
     LOG_INFO("Successfully removed product %s", barcode.c_str());
     return INVENTORYAPISTATUS::SUCCESS;
 }
 
+bool InventoryController::isStoredOnly(const std::string& barcode) {
+    return mCachedList.isPartial() && !mDataProvider->findProduct(barcode).barcode().empty();
+}
+
 std::vector<entity::UnitOfMeasurement> InventoryController::getMeasurementList() {
     mCachedUOMs.fill(mDataProvider->getUOMs());
     return mCachedUOMs.get();
@@ -44,6 +44,7 @@ class InventoryController : public InventoryControlInterface,
     ~InventoryController() = default;
 
     std::vector<entity::Product> list() override;
+    Page<entity::Product> listPage(const PageRequest& request) override;
     entity::Product getProduct(const std::string& barcode) override;
     INVENTORYAPISTATUS save(const entity::Product& product,
                             std::map<std::string, std::string>* validationResult) override;
@@ -58,6 +59,8 @@ class InventoryController : public InventoryControlInterface,
  private:
     void create(const entity::Product& product);
     void update(const entity::Product& product);
+    // True if the product is not in the listed pages but is in the database
+    bool isStoredOnly(const std::string& barcode);
     CacheController<entity::UnitOfMeasurement> mCachedUOMs;
 };
 
@@ -36,6 +36,8 @@ class CustomerManagementDataMock : public CustomerManagementDataInterface {
     ~CustomerManagementDataMock() = default;
 
     MOCK_METHOD(std::vector<entity::Customer>, getCustomers, ());
+    MOCK_METHOD(Page<entity::Customer>, getCustomerPage, (const PageRequest& request));
+    MOCK_METHOD(entity::Customer, findCustomer, (const std::string& id));
     MOCK_METHOD(void, create, (const entity::Customer& customer));
     MOCK_METHOD(void, update, (const entity::Customer& customer));
     MOCK_METHOD(void, remove, (const std::string& id));
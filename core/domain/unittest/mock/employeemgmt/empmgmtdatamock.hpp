@@ -37,6 +37,8 @@ class EmployeeMgmtDataMock : public EmployeeMgmtDataInterface {
     ~EmployeeMgmtDataMock() = default;
 
     MOCK_METHOD(std::vector<entity::Employee>, getEmployees, ());
+    MOCK_METHOD(Page<entity::Employee>, getEmployeePage, (const PageRequest& request));
+    MOCK_METHOD(entity::Employee, findEmployee, (const std::string&));
     MOCK_METHOD(entity::User, getUserData, (const std::string&));
     MOCK_METHOD(void, create, (const entity::Employee&));
     MOCK_METHOD(void, create, (const entity::User&));
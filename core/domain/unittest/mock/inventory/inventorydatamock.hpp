@@ -35,7 +35,11 @@ class InventoryDataMock : public InventoryDataInterface {
     ~InventoryDataMock() = default;
 
     MOCK_METHOD(std::vector<entity::Product>, getProducts, ());
+    MOCK_METHOD(Page<entity::Product>, getProductPage, (const PageRequest& request));
+    MOCK_METHOD(entity::Product, findProduct, (const std::string& barcode));
     MOCK_METHOD(void, removeWithBarcode, (const std::string& barcode));
+    MOCK_METHOD(bool, takeStock, (const std::string& barcode, size_t quantity));
+    MOCK_METHOD(bool, returnStock, (const std::string& barcode, size_t quantity));
     MOCK_METHOD(void, create, (const entity::Product& product));
     MOCK_METHOD(void, update, (const entity::Product& product));
     MOCK_METHOD(std::vector<entity::UnitOfMeasurement>, getUOMs, ());
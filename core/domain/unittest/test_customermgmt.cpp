@@ -106,6 +106,19 @@ TEST_F(TestCustomerMgmt, TestGetCustomerDataNotFound) {
     ASSERT_TRUE(controller.get(requestedID).ID().empty());
 }
 
+TEST_F(TestCustomerMgmt, TestGetCustomerDataNotListedYet) {
+    const std::string requestedID = "CMAA95TZ45";
+    // Only the first page is listed; the customer is on a next page
+    EXPECT_CALL(*dpMock, getCustomerPage(_))
+        .WillOnce(Return(Page<entity::Customer>{ {}, "NEXT-TOKEN" }));
+    controller.listPage(PageRequest{});
+    EXPECT_CALL(*dpMock, findCustomer(requestedID))
+        .WillOnce(Return(entity::Customer(requestedID, "DummyFName", "DummyMName",
+                                          "DummyLName", "DummyBDate", "DummyGender")));
+    // Should be read from the database
+    ASSERT_EQ(controller.get(requestedID).ID(), requestedID);
+}
+
 TEST_F(TestCustomerMgmt, TestSaveWithNullValidationContainer) {
     ASSERT_EQ(controller.save(entity::Customer(), nullptr),
               CUSTOMERMGMTAPISTATUS::UNINITIALIZED);
@@ -162,6 +162,34 @@ TEST_F(TestInventory, TestRemoveProductNotFound) {
     ASSERT_EQ(inventoryController.remove(requestedBarcode), INVENTORYAPISTATUS::NOT_FOUND);
 }
 
+TEST_F(TestInventory, TestGetProductsPage) {
+    const std::string listedBarcode = "111111999999";
+    // Fake that there are more products after the first page
+    EXPECT_CALL(*dpMock, getProductPage(_))
+        .WillOnce(Return(Page<entity::Product>{
+            { entity::Product(listedBarcode, "DUMMY-SKU", "", "", "", "", "", "", "",
+                              "", "", "", "") }, "NEXT-TOKEN" }));
+    const Page<entity::Product> page = inventoryController.listPage(PageRequest{});
+    ASSERT_EQ(page.items.size(), 1);
+    ASSERT_EQ(page.nextToken, "NEXT-TOKEN");
+    // The listed product is cached
+    ASSERT_EQ(inventoryController.getProduct(listedBarcode).sku(), "DUMMY-SKU");
+}
+
+TEST_F(TestInventory, TestRemoveProductNotListedYet) {
+    const std::string requestedBarcode = "124412222020";
+    // Only the first page is listed; the product is on a next page
+    EXPECT_CALL(*dpMock, getProductPage(_))
+        .WillOnce(Return(Page<entity::Product>{ {}, "NEXT-TOKEN" }));
+    inventoryController.listPage(PageRequest{});
+    EXPECT_CALL(*dpMock, findProduct(requestedBarcode))
+        .WillOnce(Return(entity::Product(requestedBarcode, "DUMMY-SKU", "", "", "", "", "", "",
+                                         "", "", "", "", "")));
+    EXPECT_CALL(*viewMock, showSuccessfullyRemoved(_));
+    EXPECT_CALL(*dpMock, removeWithBarcode(requestedBarcode));
+    ASSERT_EQ(inventoryController.remove(requestedBarcode), INVENTORYAPISTATUS::SUCCESS);
+}
+
 TEST_F(TestInventory, TestSaveWithNullValidationContainer) {
     ASSERT_EQ(inventoryController.save(entity::Product(), nullptr),
               INVENTORYAPISTATUS::UNINITIALIZED);
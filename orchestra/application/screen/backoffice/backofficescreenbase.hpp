@@ -21,6 +21,7 @@
 #ifndef ORCHESTRA_APPLICATION_SCREEN_BACKOFFICE_BACKOFFICESCREENBASE_HPP_
 #define ORCHESTRA_APPLICATION_SCREEN_BACKOFFICE_BACKOFFICESCREENBASE_HPP_
 #include <iostream>
+#include <string>
 #include <screencommon.hpp>
 
 namespace screen {
@@ -37,7 +38,13 @@ class BackOfficeScreenBase {
     }
     virtual void showOptions() const {
         std::cout << std::endl << std::endl;
-        SCREENCOMMON().printColumns({"[b] - Back", "[c] - Create", "[0] - Logout"}, true, false);
+        if (mNextPageToken.empty()) {
+            SCREENCOMMON().printColumns({"[b] - Back", "[c] - Create", "[0] - Logout"},
+                                        true, false);
+        } else {
+            SCREENCOMMON().printColumns({"[b] - Back", "[c] - Create", "[n] - Next page",
+                                         "[0] - Logout"}, true, false);
+        }
         std::cout << std::endl;
     }
     // Screen options - this represents the buttons in a GUI
@@ -53,6 +60,7 @@ class BackOfficeScreenBase {
         OP_READ,
         OP_UPDATE,
         OP_DELETE,
+        OP_NEXT_PAGE,
         // add more enums here
         LOGOUT,
         APP_EXIT,
@@ -61,6 +69,8 @@ class BackOfficeScreenBase {
         // New enum values must be added before LOGOUT
     };
     ControllerType mCoreController;
+    // The list screens show one page at a time; empty on the last page
+    std::string mNextPageToken;
 };
 
 }  // namespace screen
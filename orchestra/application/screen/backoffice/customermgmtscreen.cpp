@@ -89,8 +89,13 @@ void CustomerMgmtScreen::showLandingScreen() const {
     showOptions();
 }
 
-void CustomerMgmtScreen::queryCustomersList() {
-    mTableHelper.setData(mCoreController->list());
+void CustomerMgmtScreen::queryCustomersList(const std::string& pageToken) {
+    domain::PageRequest request;
+    request.token = pageToken;
+    request.sortKey = "lastname";
+    const domain::Page<entity::Customer> page = mCoreController->listPage(request);
+    mTableHelper.setData(page.items);
+    mNextPageToken = page.nextToken;
 }
 
 void CustomerMgmtScreen::showCustomers() const {
@@ -202,6 +207,8 @@ CustomerMgmtScreen::Options CustomerMgmtScreen::getUserSelection() {
             mTableHelper.setCurrentIndex(input);
             return Options::OP_READ;
         }
+    } else if (userInput == "n" && !isShowingDetailsScreen && !mNextPageToken.empty()) {
+        return Options::OP_NEXT_PAGE;
     } else if (userInput == "c" && !isShowingDetailsScreen) {
         return Options::OP_CREATE;
     } else if (userInput == "u" && isShowingDetailsScreen) {
@@ -227,6 +234,10 @@ bool CustomerMgmtScreen::action(Options option, std::promise<defines::display>*
         case Options::INVALID:
             invalidOptionSelected();
             break;
+        case Options::OP_NEXT_PAGE:
+            queryCustomersList(mNextPageToken);
+            showLandingScreen();
+            break;
         case Options::OP_READ:
             showCustomerDetails();
             isShowingDetailsScreen = true;  // Must set to true
@@ -52,7 +52,8 @@ class CustomerMgmtScreen : public screen::ScreenInterface,
 
  private:
     void showLandingScreen() const;
-    void queryCustomersList();
+    // Shows the page that starts at [pageToken]; the first one by default
+    void queryCustomersList(const std::string& pageToken = "");
     void showCustomers() const;
     void showCustomerDetails(bool showIndex = false) const;
     void createCustomer();
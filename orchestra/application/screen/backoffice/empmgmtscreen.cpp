@@ -91,8 +91,13 @@ void EmployeeMgmtScreen::showLandingScreen() const {
     showOptions();
 }
 
-void EmployeeMgmtScreen::queryEmployeesList() {
-    mTableHelper.setData(mCoreController->list());
+void EmployeeMgmtScreen::queryEmployeesList(const std::string& pageToken) {
+    domain::PageRequest request;
+    request.token = pageToken;
+    request.sortKey = "lastname";
+    const domain::Page<entity::Employee> page = mCoreController->listPage(request);
+    mTableHelper.setData(page.items);
+    mNextPageToken = page.nextToken;
 }
 
 void EmployeeMgmtScreen::showEmployees() const {
@@ -275,6 +280,8 @@ EmployeeMgmtScreen::Options EmployeeMgmtScreen::getUserSelection() {
             mTableHelper.setCurrentIndex(input);
             return Options::OP_READ;
         }
+    } else if (userInput == "n" && !isShowingDetailsScreen && !mNextPageToken.empty()) {
+        return Options::OP_NEXT_PAGE;
     } else if (userInput == "c" && !isShowingDetailsScreen) {
         return Options::OP_CREATE;
     } else if (userInput == "u" && isShowingDetailsScreen) {
@@ -300,6 +307,10 @@ bool EmployeeMgmtScreen::action(Options option, std::promise<defines::display>*
         case Options::INVALID:
             invalidOptionSelected();
             break;
+        case Options::OP_NEXT_PAGE:
+            queryEmployeesList(mNextPageToken);
+            showLandingScreen();
+            break;
         case Options::OP_READ:
             showEmployeeDetails();
             isShowingDetailsScreen = true;  // Must set to true
@@ -61,7 +61,8 @@ class EmployeeMgmtScreen : public ScreenInterface,
     Options getUserSelection();
     bool action(Options option, std::promise<defines::display>* nextScreen);
     void showEmployeeDetails(bool showIndex = false) const;
-    void queryEmployeesList();
+    // Shows the page that starts at [pageToken]; the first one by default
+    void queryEmployeesList(const std::string& pageToken = "");
     void createEmployee();
     void updateEmployee();
     void removeEmployee();
@@ -91,8 +91,13 @@ void InventoryScreen::showLandingScreen() const {
     showOptions();
 }
 
-void InventoryScreen::queryProductsList() {
-    mTableHelper.setData(mCoreController->list());
+void InventoryScreen::queryProductsList(const std::string& pageToken) {
+    domain::PageRequest request;
+    request.token = pageToken;
+    request.sortKey = "name";
+    const domain::Page<entity::Product> page = mCoreController->listPage(request);
+    mTableHelper.setData(page.items);
+    mNextPageToken = page.nextToken;
 }
 
 void InventoryScreen::showProducts() const {
@@ -199,6 +204,8 @@ InventoryScreen::Options InventoryScreen::getUserSelection() {
         }
     } else if (userInput == "d" && isShowingDetailsScreen) {
             return Options::OP_DELETE;
+    } else if (userInput == "n" && !isShowingDetailsScreen && !mNextPageToken.empty()) {
+            return Options::OP_NEXT_PAGE;
     } else if (userInput == "c" && !isShowingDetailsScreen) {
             return Options::OP_CREATE;
     } else if (userInput == "u" && isShowingDetailsScreen) {
@@ -222,6 +229,10 @@ bool InventoryScreen::action(Options option, std::promise<defines::display>* nex
         case Options::INVALID:
             invalidOptionSelected();
             break;
+        case Options::OP_NEXT_PAGE:
+            queryProductsList(mNextPageToken);
+            showLandingScreen();
+            break;
         case Options::OP_READ:
             showProductDetails();
             isShowingDetailsScreen = true;  // Must set to true
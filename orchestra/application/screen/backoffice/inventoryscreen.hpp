@@ -53,7 +53,8 @@ class InventoryScreen : public screen::ScreenInterface,
 
  private:
     void showLandingScreen() const;
-    void queryProductsList();
+    // Shows the page that starts at [pageToken]; the first one by default
+    void queryProductsList(const std::string& pageToken = "");
     void showProducts() const;
     Options getUserSelection();
     bool action(Options option, std::promise<defines::display>* nextScreen);
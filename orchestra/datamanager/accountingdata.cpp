@@ -19,32 +19,57 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "accountingdata.hpp"
-#include <storage/stackdb.hpp>
+#include <limits>
+#include <storage/salescolumns.hpp>
+#include <storage/storageengine.hpp>
 
 namespace dataprovider {
 namespace accounting {
 
-using utility::DateTimeComparator;
+namespace {
+
+/*!
+ * [temp] is the row buffer; a report passes the same one for every sale, so its strings are
+ * allocated once
+*/
+std::vector<entity::SaleItem> itemsOf(const std::string& transactionID,
+                                      db::SalesItemTableItem* temp) {
+    std::vector<entity::SaleItem> items;
+    const auto cursor = STORAGE().salesItems().scanOf(transactionID);
+    while (cursor->next(temp)) {
+        items.emplace_back(entity::SaleItem(
+            temp->saleID,
+            temp->productID,
+            temp->product_name,
+            temp->unit_price,
+            temp->quantity,
+            temp->total_price));
+    }
+    return items;
+}
+
+}  // namespace
 
 std::vector<entity::Sale> AccountingDataProvider::getSales(const std::string& startDate,
                                                            const std::string& endDate) {
-    // SELECT Sales
+    // SELECT Sales JOIN SaleItems - the cursor reads one version of the sales, so the report
+    // does not change halfway; the items of a sale are committed with it, so they are there
+    // when they are read afterwards
+    // An invalid date does not filter anything, same as the old string compare
+    int64_t start = std::numeric_limits<int64_t>::min();
+    int64_t end = std::numeric_limits<int64_t>::max();
+    db::parseDateTime(startDate, &start);
+    db::parseDateTime(endDate, &end);
+
+    // Only the sales in range are visited
     std::vector<entity::Sale> sales;
-    for (const db::SalesTableItem& temp : DATABASE().SELECT_SALES_TABLE()) {
-        /*!
-         * If temp.date_time < startDate || temp.date_time > endDate ; continue;
-        */
-        if ((mDateTimeComparator(temp.date_time).compare(startDate)
-            == DateTimeComparator::Result::LESSER_THAN) ||
-            (mDateTimeComparator(temp.date_time).compare(endDate)
-            == DateTimeComparator::Result::GREATER_THAN)) {
-            continue;
-        }
-        const std::vector<entity::SaleItem>& items = getSaleDetails(temp.ID);
+    db::SalesItemTableItem item;
+    const auto cursor = STORAGE().sales().scanTime(start, end);
+    for (db::SalesTableItem temp; cursor->next(&temp);) {
         sales.emplace_back(entity::Sale(
             temp.ID,
             temp.date_time,
-            items,
+            itemsOf(temp.ID, &item),
             temp.subtotal,
             temp.taxable_amount,
             temp.vat,
@@ -62,20 +87,8 @@ std::vector<entity::Sale> AccountingDataProvider::getSales(const std::string& st
 std::vector<entity::SaleItem>
 AccountingDataProvider::getSaleDetails(const std::string& transactionID) {
     // SELECT SaleItems
-    std::vector<entity::SaleItem> items;
-    for (const db::SalesItemTableItem& temp : DATABASE().SELECT_SALES_ITEM_TABLE()) {
-        if (temp.saleID != transactionID) {
-            continue;
-        }
-        items.emplace_back(entity::SaleItem(
-            temp.saleID,
-            temp.productID,
-            temp.product_name,
-            temp.unit_price,
-            temp.quantity,
-            temp.total_price));
-    }
-    return items;
+    db::SalesItemTableItem item;
+    return itemsOf(transactionID, &item);
 }
 }  // namespace accounting
 }  // namespace dataprovider
\ No newline at end of file
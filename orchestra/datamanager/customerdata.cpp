@@ -19,233 +19,199 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "customerdata.hpp"
-#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 #include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include "persondata.hpp"
+#include "queryarena.hpp"
 
 namespace dataprovider {
 namespace customermgmt {
 
+namespace {
+
+/*!
+ * The column of a sort key of PageRequest; null (customer ID order) if it is not sortable
+*/
+db::Field<db::CustomerTableItem> sortField(const std::string& sortKey) {
+    if (sortKey == "firstname") {
+        return &db::CustomerTableItem::firstname;
+    } else if (sortKey == "lastname") {
+        return &db::CustomerTableItem::lastname;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
 std::vector<entity::Customer> CustomerDataProvider::getCustomers() {
-    // SELECT Customers
+    // SELECT the fields of entity::Customer
     std::vector<entity::Customer> customers;
-    for (const db::CustomerTableItem& temp : DATABASE().SELECT_CUSTOMER_TABLE()) {
-        entity::Customer customer(
+    customers.reserve(STORAGE().customers().size());
+    const auto cursor = db::scan(STORAGE().customers())
+        .select({ &db::CustomerTableItem::customerID, &db::CustomerTableItem::firstname,
+                  &db::CustomerTableItem::middlename, &db::CustomerTableItem::lastname,
+                  &db::CustomerTableItem::birthdate, &db::CustomerTableItem::gender }).cursor();
+    for (db::CustomerTableItem temp; cursor->next(&temp);) {
+        customers.emplace_back(
             temp.customerID,
             temp.firstname,
             temp.middlename,
             temp.lastname,
             temp.birthdate,
             temp.gender);
-        fillOtherDetails(&customer);
-        customers.emplace_back(customer);
     }
+    // Join the details of all customers at once
+    QueryArena arena(customers.size());
+    person::PersonMap persons(&arena);
+    persons.reserve(customers.size());
+    for (entity::Customer& customer : customers) {
+        persons.emplace(arena.copy(customer.ID()), &customer);
+    }
+    person::fillDetails(persons);
     return customers;
 }
+
+domain::Page<entity::Customer>
+CustomerDataProvider::getCustomerPage(const domain::PageRequest& request) {
+    // SELECT * ORDER BY sortKey, customerID LIMIT size (after the token)
+    db::PageQuery<db::CustomerTableItem> query;
+    query.key = &db::CustomerTableItem::customerID;
+    query.sortBy = sortField(request.sortKey);
+    query.size = request.size;
+    query.token = request.token;
+    db::RowPage<db::CustomerTableItem> rows = STORAGE().customers().page(query);
+    domain::Page<entity::Customer> page;
+    page.items.reserve(rows.rows.size());
+    for (const db::CustomerTableItem& temp : rows.rows) {
+        page.items.emplace_back(
+            temp.customerID,
+            temp.firstname,
+            temp.middlename,
+            temp.lastname,
+            temp.birthdate,
+            temp.gender);
+        // A page is small; the person-ID index beats a pass over the detail tables
+        fillOtherDetails(&page.items.back());
+    }
+    page.nextToken = std::move(rows.nextToken);
+    return page;
+}
+
+entity::Customer CustomerDataProvider::findCustomer(const std::string& id) {
+    // SELECT * WHERE customerID = id
+    db::CustomerTableItem temp;
+    if (!STORAGE().customers().get(id, &temp)) {
+        return entity::Customer();
+    }
+    entity::Customer customer(
+        temp.customerID,
+        temp.firstname,
+        temp.middlename,
+        temp.lastname,
+        temp.birthdate,
+        temp.gender);
+    fillOtherDetails(&customer);
+    return customer;
+}
+
 void CustomerDataProvider::writeOtherDetails(const entity::Customer& customer) const {
-    DATABASE().SELECT_ADDRESS_TABLE().emplace_back(db::AddressTableItem {
+    STORAGE().addresses().insert(db::AddressTableItem {
             customer.ID(),
             customer.address().line1(),
             customer.address().line2(),
             customer.address().cityTown(),
             customer.address().province(),
             customer.address().zip()});
-    DATABASE().SELECT_CONTACTS_TABLE().emplace_back(db::ContactDetailsTableItem {
+    STORAGE().contacts().insert(db::ContactDetailsTableItem {
             customer.ID(),
             customer.contactDetails().email(),
             customer.contactDetails().phone1(),
             customer.contactDetails().phone2()});
     for (unsigned int i = 0; i < customer.personalIds().size(); i++) {
-        DATABASE().SELECT_PERSONAL_ID_TABLE().emplace_back(db::PersonalIdTableItem {
+        STORAGE().personalIds().insert(db::PersonalIdTableItem {
                 customer.ID(),
                 customer.personalIds()[i].type(),
                 customer.personalIds()[i].number()});
     }
 }
 void CustomerDataProvider::create(const entity::Customer& customer) {
-    if (std::find_if(DATABASE().SELECT_CUSTOMER_TABLE().begin(),
-                            DATABASE().SELECT_CUSTOMER_TABLE().end(),
-                            [&customer](const db::CustomerTableItem& c) {
-                               return c.customerID == customer.ID();
-                            }) != DATABASE().SELECT_CUSTOMER_TABLE().end()) {
-        // If ID exists, don't proceed!
-        return;
-    }
-    DATABASE().SELECT_CUSTOMER_TABLE().emplace_back(db::CustomerTableItem {
+    const db::Transaction transaction;
+    const bool isInserted = STORAGE().customers().insert(db::CustomerTableItem {
             customer.ID(),
             customer.firstName(),
             customer.middleName(),
             customer.lastName(),
             customer.birthdate(),
             customer.gender()});
-
+    if (!isInserted) {
+        // If ID exists, don't proceed!
+        return;
+    }
     writeOtherDetails(customer);
 }
 
 void CustomerDataProvider::update(const entity::Customer& customer) {
+    const db::Transaction transaction;
     // Updating customer basic info
-    {
-        std::vector<db::CustomerTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_CUSTOMER_TABLE().begin(),
-                                    DATABASE().SELECT_CUSTOMER_TABLE().end(),
-                                    [&customer](const db::CustomerTableItem& c) {
-                                        // We only match the customer ID for updating
-                                        return c.customerID == customer.ID();
-                                    });
-        if (it == DATABASE().SELECT_CUSTOMER_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::CustomerTableItem {
-                customer.ID(),
-                customer.firstName(),
-                customer.middleName(),
-                customer.lastName(),
-                customer.birthdate(),
-                customer.gender()};
+    const bool isUpdated = STORAGE().customers().update(db::CustomerTableItem {
+            customer.ID(),
+            customer.firstName(),
+            customer.middleName(),
+            customer.lastName(),
+            customer.birthdate(),
+            customer.gender()});
+    if (!isUpdated) {
+        // Not found
+        return;
     }
-    // Updating customer address
-    {
-        std::vector<db::AddressTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                                    DATABASE().SELECT_ADDRESS_TABLE().end(),
-                                    [&customer](const db::AddressTableItem& e) {
-                                        // We only match the ID for updating
-                                        return e.ID == customer.ID();
-                                    });
-        if (it == DATABASE().SELECT_ADDRESS_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::AddressTableItem {
+    // Updating customer address - we only match the ID for updating
+    if (!STORAGE().addresses().update(db::AddressTableItem {
             customer.ID(),
             customer.address().line1(),
             customer.address().line2(),
             customer.address().cityTown(),
             customer.address().province(),
-            customer.address().zip()};
+            customer.address().zip()})) {
+        // Not found
+        return;
     }
-    // Updating customer contacts
-    {
-        std::vector<db::ContactDetailsTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                                    DATABASE().SELECT_CONTACTS_TABLE().end(),
-                                    [&customer](const db::ContactDetailsTableItem& e) {
-                                        // We only match the customer ID for updating
-                                        return e.ID == customer.ID();
-                                    });
-        if (it == DATABASE().SELECT_CONTACTS_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::ContactDetailsTableItem {
+    // Updating customer contacts - we only match the customer ID for updating
+    if (!STORAGE().contacts().update(db::ContactDetailsTableItem {
             customer.ID(),
             customer.contactDetails().email(),
             customer.contactDetails().phone1(),
-            customer.contactDetails().phone2()};
+            customer.contactDetails().phone2()})) {
+        // Not found
+        return;
     }
     // Updating customer personal ID
-    {
-        // Todo (code) - currently supports updating the first personal ID only
-        std::vector<db::PersonalIdTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_PERSONAL_ID_TABLE().begin(),
-                                    DATABASE().SELECT_PERSONAL_ID_TABLE().end(),
-                                    [&customer](const db::PersonalIdTableItem& e) {
-                                        // We only match the customer ID for updating
-                                        return e.ID == customer.ID();
-                                    });
-        if (it == DATABASE().SELECT_PERSONAL_ID_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::PersonalIdTableItem {
-                customer.ID(),
-                customer.personalIds()[0].type(),
-                customer.personalIds()[0].number()};
+    // Todo (code) - currently supports updating the first personal ID only
+    if (customer.personalIds().empty()) {
+        return;
     }
+    STORAGE().personalIds().update(db::PersonalIdTableItem {
+            customer.ID(),
+            customer.personalIds()[0].type(),
+            customer.personalIds()[0].number()});
 }
 
 void CustomerDataProvider::remove(const std::string& id) {
+    const db::Transaction transaction;
     // Delete customer
-    DATABASE().SELECT_CUSTOMER_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_CUSTOMER_TABLE().begin(),
-                    DATABASE().SELECT_CUSTOMER_TABLE().end(),
-                    [&](const db::CustomerTableItem& c) {
-                        return c.customerID == id;
-                    }),
-        DATABASE().SELECT_CUSTOMER_TABLE().end());
+    STORAGE().customers().remove(id);
     // Delete the Address
-    DATABASE().SELECT_ADDRESS_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                    DATABASE().SELECT_ADDRESS_TABLE().end(),
-                    [&](const db::AddressTableItem& e) {
-                        return e.ID == id;
-                    }),
-        DATABASE().SELECT_ADDRESS_TABLE().end());
+    STORAGE().addresses().remove(id);
     // Delete the Contacts
-    DATABASE().SELECT_CONTACTS_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                    DATABASE().SELECT_CONTACTS_TABLE().end(),
-                    [&](const db::ContactDetailsTableItem& e) {
-                        return e.ID == id;
-                    }),
-        DATABASE().SELECT_CONTACTS_TABLE().end());
+    STORAGE().contacts().remove(id);
     // Delete the Personal ID
-    DATABASE().SELECT_PERSONAL_ID_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_PERSONAL_ID_TABLE().begin(),
-                    DATABASE().SELECT_PERSONAL_ID_TABLE().end(),
-                    [&](const db::PersonalIdTableItem& e) {
-                        return e.ID == id;
-                    }),
-        DATABASE().SELECT_PERSONAL_ID_TABLE().end());
+    STORAGE().personalIds().remove(id);
 }
 
 void CustomerDataProvider::fillOtherDetails(entity::Customer* customer) const {
-        // Get Address
-        [&customer]() {
-            const std::vector<db::AddressTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                            DATABASE().SELECT_ADDRESS_TABLE().end(),
-                            [&customer](const db::AddressTableItem& e) {
-                               return e.ID == customer->ID();
-                            });
-            if (it != DATABASE().SELECT_ADDRESS_TABLE().end()) {
-                customer->setAddress({
-                    it->line1,
-                    it->line2,
-                    it->city_town,
-                    it->province,
-                    it->zip,
-                });
-            }
-        }();
-        // Get Contact details
-        [&customer]() {
-            const std::vector<db::ContactDetailsTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                                DATABASE().SELECT_CONTACTS_TABLE().end(),
-                                [&customer](const db::ContactDetailsTableItem& e) {
-                                    return e.ID == customer->ID();
-                                });
-            if (it != DATABASE().SELECT_CONTACTS_TABLE().end()) {
-                customer->setPhoneNumbers(it->phone_number_1, it->phone_number_2);
-                customer->setEmail(it->email);
-            }
-        }();
-        // Get personal IDs
-        [&customer]() {
-            for (const db::PersonalIdTableItem& e :
-                 DATABASE().SELECT_PERSONAL_ID_TABLE()) {
-                if (e.ID == customer->ID()) {
-                    customer->addPersonalId(e.type, e.id_number);
-                }
-            }
-        }();
+    person::fillDetails(customer->ID(), customer);
 }
 
 }  // namespace customermgmt
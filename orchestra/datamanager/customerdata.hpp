@@ -33,6 +33,8 @@ class CustomerDataProvider : public domain::customermgmt::CustomerManagementData
     virtual ~CustomerDataProvider() = default;
 
     std::vector<entity::Customer> getCustomers() override;
+    domain::Page<entity::Customer> getCustomerPage(const domain::PageRequest& request) override;
+    entity::Customer findCustomer(const std::string& id) override;
     void create(const entity::Customer& customer) override;
     void update(const entity::Customer& customer) override;
     void remove(const std::string& id) override;
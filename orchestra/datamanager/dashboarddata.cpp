@@ -19,85 +19,39 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "dashboarddata.hpp"
-#include <algorithm>
-#include <vector>
-#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include "persondata.hpp"
 
 namespace dataprovider {
 namespace dashboard {
 
 entity::User DashboardDataProvider::getUserByID(const std::string& userID) {
-    const entity::User user = [userID]() {
-        for (const db::UserTableItem& temp : DATABASE().SELECT_USERS_TABLE()) {
-            if (temp.userID == userID) {
-                return entity::User(temp.userID, temp.role, temp.PIN,
-                                    temp.createdAt, temp.employeeID);
-            }
-        }
+    db::UserTableItem temp;
+    if (!STORAGE().users().get(userID, &temp)) {
         // Return empty if not found
         return entity::User();
-    }();
-    return user;
+    }
+    return entity::User(temp.userID, temp.role, temp.PIN, temp.createdAt, temp.employeeID);
 }
 
 entity::Employee DashboardDataProvider::getEmployeeInformation(const std::string& employeeID) {
-    for (const db::EmployeeTableItem &temp : DATABASE().SELECT_EMPLOYEES_TABLE()) {
-        if (temp.employeeID == employeeID) {
-            entity::Employee employee(
-                temp.employeeID,
-                temp.firstname,
-                temp.middlename,
-                temp.lastname,
-                temp.birthdate,
-                temp.gender,
-                temp.position,
-                temp.status,
-                temp.isSystemUser);
-            // Get Address
-            [&employee]() {
-                const std::vector<db::AddressTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                                 DATABASE().SELECT_ADDRESS_TABLE().end(),
-                                 [&employee](const db::AddressTableItem &e) {
-                                     return e.ID == employee.ID();
-                                 });
-                if (it != DATABASE().SELECT_ADDRESS_TABLE().end()) {
-                    employee.setAddress({
-                        it->line1,
-                        it->line2,
-                        it->city_town,
-                        it->province,
-                        it->zip,
-                    });
-                }
-            }();
-            // Get Contact details
-            [&employee]() {
-                const std::vector<db::ContactDetailsTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                                 DATABASE().SELECT_CONTACTS_TABLE().end(),
-                                 [&employee](const db::ContactDetailsTableItem &e) {
-                                     return e.ID == employee.ID();
-                                 });
-                if (it != DATABASE().SELECT_CONTACTS_TABLE().end()) {
-                    employee.setPhoneNumbers(it->phone_number_1, it->phone_number_2);
-                    employee.setEmail(it->email);
-                }
-            }();
-            // Get personal IDs
-            [&employee]() {
-                for (const db::PersonalIdTableItem& e :
-                     DATABASE().SELECT_PERSONAL_ID_TABLE()) {
-                    if (e.ID == employee.ID()) {
-                        employee.addPersonalId(e.type, e.id_number);
-                    }
-                }
-            }();
-            return employee;
-        }
+    db::EmployeeTableItem temp;
+    if (!STORAGE().employees().get(employeeID, &temp)) {
+        // Return empty if not found
+        return entity::Employee();
     }
-    // Return empty if not found
-    return entity::Employee();
+    entity::Employee employee(
+        temp.employeeID,
+        temp.firstname,
+        temp.middlename,
+        temp.lastname,
+        temp.birthdate,
+        temp.gender,
+        temp.position,
+        temp.status,
+        temp.isSystemUser);
+    person::fillDetails(employee.ID(), &employee);
+    return employee;
 }
 
 }  // namespace dashboard
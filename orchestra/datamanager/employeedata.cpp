@@ -19,21 +19,51 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "employeedata.hpp"
-#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 #include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include "persondata.hpp"
+#include "queryarena.hpp"
 
 namespace dataprovider {
 namespace empmgmt {
 
+namespace {
+
+/*!
+ * The column of a sort key of PageRequest; null (employee ID order) if it is not sortable
+*/
+db::Field<db::EmployeeTableItem> sortField(const std::string& sortKey) {
+    if (sortKey == "firstname") {
+        return &db::EmployeeTableItem::firstname;
+    } else if (sortKey == "lastname") {
+        return &db::EmployeeTableItem::lastname;
+    } else if (sortKey == "position") {
+        return &db::EmployeeTableItem::position;
+    } else if (sortKey == "status") {
+        return &db::EmployeeTableItem::status;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
 std::vector<entity::Employee> EmployeeDataProvider::getEmployees() {
     // SELECT UNION(employeestable, addresstable, contactstable, personalIDtable)
     std::vector<entity::Employee> employees;
+    employees.reserve(STORAGE().employees().size());
 
-    // Gather all employees
-    for (const db::EmployeeTableItem& temp : DATABASE().SELECT_EMPLOYEES_TABLE()) {
-        entity::Employee employee(
+    // Gather all employees, with the fields of entity::Employee
+    const auto cursor = db::scan(STORAGE().employees())
+        .select({ &db::EmployeeTableItem::employeeID, &db::EmployeeTableItem::firstname,
+                  &db::EmployeeTableItem::middlename, &db::EmployeeTableItem::lastname,
+                  &db::EmployeeTableItem::birthdate, &db::EmployeeTableItem::gender,
+                  &db::EmployeeTableItem::position, &db::EmployeeTableItem::status },
+                { &db::EmployeeTableItem::isSystemUser }).cursor();
+    for (db::EmployeeTableItem temp; cursor->next(&temp);) {
+        employees.emplace_back(
                 temp.employeeID,
                 temp.firstname,
                 temp.middlename,
@@ -43,36 +73,79 @@ std::vector<entity::Employee> EmployeeDataProvider::getEmployees() {
                 temp.position,
                 temp.status,
                 temp.isSystemUser);
-        fillEmployeeDetails(&employee);
-        employees.emplace_back(employee);
     }
+    // Join the details of all employees at once
+    QueryArena arena(employees.size());
+    person::PersonMap persons(&arena);
+    persons.reserve(employees.size());
+    for (entity::Employee& employee : employees) {
+        persons.emplace(arena.copy(employee.ID()), &employee);
+    }
+    person::fillDetails(persons);
     return employees;
 }
 
+domain::Page<entity::Employee>
+EmployeeDataProvider::getEmployeePage(const domain::PageRequest& request) {
+    // SELECT * ORDER BY sortKey, employeeID LIMIT size (after the token)
+    db::PageQuery<db::EmployeeTableItem> query;
+    query.key = &db::EmployeeTableItem::employeeID;
+    query.sortBy = sortField(request.sortKey);
+    query.size = request.size;
+    query.token = request.token;
+    db::RowPage<db::EmployeeTableItem> rows = STORAGE().employees().page(query);
+    domain::Page<entity::Employee> page;
+    page.items.reserve(rows.rows.size());
+    for (const db::EmployeeTableItem& temp : rows.rows) {
+        page.items.emplace_back(
+                temp.employeeID,
+                temp.firstname,
+                temp.middlename,
+                temp.lastname,
+                temp.birthdate,
+                temp.gender,
+                temp.position,
+                temp.status,
+                temp.isSystemUser);
+        // A page is small; the person-ID index beats a pass over the detail tables
+        fillEmployeeDetails(&page.items.back());
+    }
+    page.nextToken = std::move(rows.nextToken);
+    return page;
+}
+
+entity::Employee EmployeeDataProvider::findEmployee(const std::string& employeeID) {
+    // SELECT * WHERE EMPLOYEEID = employeeID
+    db::EmployeeTableItem temp;
+    if (!STORAGE().employees().get(employeeID, &temp)) {
+        return entity::Employee();
+    }
+    entity::Employee employee(
+            temp.employeeID,
+            temp.firstname,
+            temp.middlename,
+            temp.lastname,
+            temp.birthdate,
+            temp.gender,
+            temp.position,
+            temp.status,
+            temp.isSystemUser);
+    fillEmployeeDetails(&employee);
+    return employee;
+}
+
 entity::User EmployeeDataProvider::getUserData(const std::string& employeeID) {
     // SELECT * WHERE EMPLOYEEID = employeeID
-    const entity::User user = [employeeID]() {
-        for (const db::UserTableItem& temp : DATABASE().SELECT_USERS_TABLE()) {
-            if (temp.employeeID == employeeID) {
-                return entity::User(temp.userID, temp.role, temp.PIN,
-                                    temp.createdAt, temp.employeeID);
-            }
-        }
+    db::UserTableItem temp;
+    if (!STORAGE().users().scanOf(employeeID)->next(&temp)) {
         return entity::User();
-    }();
-    return user;
+    }
+    return entity::User(temp.userID, temp.role, temp.PIN, temp.createdAt, temp.employeeID);
 }
 
 void EmployeeDataProvider::create(const entity::Employee& employee) {
-    if (std::find_if(DATABASE().SELECT_EMPLOYEES_TABLE().begin(),
-                            DATABASE().SELECT_EMPLOYEES_TABLE().end(),
-                            [&employee](const db::EmployeeTableItem& e) {
-                               return e.employeeID == employee.ID();
-                            }) != DATABASE().SELECT_EMPLOYEES_TABLE().end()) {
-        // If employee ID exists, don't proceed!
-        return;
-    }
-    DATABASE().SELECT_EMPLOYEES_TABLE().emplace_back(db::EmployeeTableItem {
+    const db::Transaction transaction;
+    const bool isInserted = STORAGE().employees().insert(db::EmployeeTableItem {
             employee.ID(),
             employee.firstName(),
             employee.middleName(),
@@ -82,20 +155,17 @@ void EmployeeDataProvider::create(const entity::Employee& employee) {
             employee.position(),
             employee.status(),
             employee.isSystemUser()});
-
+    if (!isInserted) {
+        // If employee ID exists, don't proceed!
+        return;
+    }
     writeEmployeeDetails(employee);
 }
 
 void EmployeeDataProvider::create(const entity::User& user) {
-    if (std::find_if(DATABASE().SELECT_USERS_TABLE().begin(),
-                            DATABASE().SELECT_USERS_TABLE().end(),
-                            [&user](const db::UserTableItem& e) {
-                               return e.userID == user.userID();
-                            }) != DATABASE().SELECT_USERS_TABLE().end()) {
-        // If User ID exists, don't proceed!
-        return;
-    }
-    DATABASE().SELECT_USERS_TABLE().emplace_back(db::UserTableItem {
+    const db::AutoCommit autoCommit;
+    // Insert is rejected if User ID exists
+    STORAGE().users().insert(db::UserTableItem {
             user.userID(),
             user.role(),
             user.pin(),
@@ -104,126 +174,81 @@ void EmployeeDataProvider::create(const entity::User& user) {
 }
 
 void EmployeeDataProvider::update(const entity::Employee& employee) {
+    const db::Transaction transaction;
     // Updating employee basic info
-    {
-        std::vector<db::EmployeeTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_EMPLOYEES_TABLE().begin(),
-                                    DATABASE().SELECT_EMPLOYEES_TABLE().end(),
-                                    [&employee](const db::EmployeeTableItem& e) {
-                                        // We only match the employee ID for updating
-                                        return e.employeeID == employee.ID();
-                                    });
-        if (it == DATABASE().SELECT_EMPLOYEES_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::EmployeeTableItem {
-                employee.ID(),
-                employee.firstName(),
-                employee.middleName(),
-                employee.lastName(),
-                employee.birthdate(),
-                employee.gender(),
-                employee.position(),
-                employee.status(),
-                employee.isSystemUser()};
+    const bool isUpdated = STORAGE().employees().update(db::EmployeeTableItem {
+            employee.ID(),
+            employee.firstName(),
+            employee.middleName(),
+            employee.lastName(),
+            employee.birthdate(),
+            employee.gender(),
+            employee.position(),
+            employee.status(),
+            employee.isSystemUser()});
+    if (!isUpdated) {
+        // Not found
+        return;
     }
-    // Updating employee address
-    {
-        std::vector<db::AddressTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                                    DATABASE().SELECT_ADDRESS_TABLE().end(),
-                                    [&employee](const db::AddressTableItem& e) {
-                                        // We only match the employee ID for updating
-                                        return e.ID == employee.ID();
-                                    });
-        if (it == DATABASE().SELECT_ADDRESS_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::AddressTableItem {
+    // Updating employee address - we only match the employee ID for updating
+    if (!STORAGE().addresses().update(db::AddressTableItem {
             employee.ID(),
             employee.address().line1(),
             employee.address().line2(),
             employee.address().cityTown(),
             employee.address().province(),
-            employee.address().zip()};
+            employee.address().zip()})) {
+        // Not found
+        return;
     }
-    // Updating employee contacts
-    {
-        std::vector<db::ContactDetailsTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                                    DATABASE().SELECT_CONTACTS_TABLE().end(),
-                                    [&employee](const db::ContactDetailsTableItem& e) {
-                                        // We only match the employee ID for updating
-                                        return e.ID == employee.ID();
-                                    });
-        if (it == DATABASE().SELECT_CONTACTS_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::ContactDetailsTableItem {
+    // Updating employee contacts - we only match the employee ID for updating
+    if (!STORAGE().contacts().update(db::ContactDetailsTableItem {
             employee.ID(),
             employee.contactDetails().email(),
             employee.contactDetails().phone1(),
-            employee.contactDetails().phone2()};
+            employee.contactDetails().phone2()})) {
+        // Not found
+        return;
     }
     // Updating employee personal ID
-    {
-        // Todo (code) - currently supports updating the first personal ID only
-        std::vector<db::PersonalIdTableItem>::iterator it =
-            std::find_if(DATABASE().SELECT_PERSONAL_ID_TABLE().begin(),
-                                    DATABASE().SELECT_PERSONAL_ID_TABLE().end(),
-                                    [&employee](const db::PersonalIdTableItem& e) {
-                                        // We only match the employee ID for updating
-                                        return e.ID == employee.ID();
-                                    });
-        if (it == DATABASE().SELECT_PERSONAL_ID_TABLE().end()) {
-            // Not found
-            return;
-        }
-        // Actual update
-        *it = db::PersonalIdTableItem {
-                employee.ID(),
-                employee.personalIds()[0].type(),
-                employee.personalIds()[0].number()};
+    // Todo (code) - currently supports updating the first personal ID only
+    if (employee.personalIds().empty()) {
+        return;
     }
+    STORAGE().personalIds().update(db::PersonalIdTableItem {
+            employee.ID(),
+            employee.personalIds()[0].type(),
+            employee.personalIds()[0].number()});
 }
 
 void EmployeeDataProvider::update(const entity::User& user) {
-    std::vector<db::UserTableItem>::iterator it =
-        std::find_if(DATABASE().SELECT_USERS_TABLE().begin(),
-                                DATABASE().SELECT_USERS_TABLE().end(),
-                                [&user](const db::UserTableItem& e) {
-                                    // We only match the employee ID for updating
-                                    return e.employeeID == user.employeeID();
-                                });
-    if (it == DATABASE().SELECT_USERS_TABLE().end()) {
+    const db::AutoCommit autoCommit;
+    // We only match the employee ID for updating
+    db::UserTableItem temp;
+    if (!STORAGE().users().scanOf(user.employeeID())->next(&temp)) {
         // Not found
         return;
     }
     // Update the role only
-    it->role = user.role();
+    temp.role = user.role();
+    STORAGE().users().update(temp);
 }
 
 void EmployeeDataProvider::writeEmployeeDetails(const entity::Employee& employee) const {
-    DATABASE().SELECT_ADDRESS_TABLE().emplace_back(db::AddressTableItem {
+    STORAGE().addresses().insert(db::AddressTableItem {
             employee.ID(),
             employee.address().line1(),
             employee.address().line2(),
             employee.address().cityTown(),
             employee.address().province(),
             employee.address().zip()});
-    DATABASE().SELECT_CONTACTS_TABLE().emplace_back(db::ContactDetailsTableItem {
+    STORAGE().contacts().insert(db::ContactDetailsTableItem {
             employee.ID(),
             employee.contactDetails().email(),
             employee.contactDetails().phone1(),
             employee.contactDetails().phone2()});
     for (unsigned int i = 0; i < employee.personalIds().size(); i++) {
-        DATABASE().SELECT_PERSONAL_ID_TABLE().emplace_back(db::PersonalIdTableItem {
+        STORAGE().personalIds().insert(db::PersonalIdTableItem {
                 employee.ID(),
                 employee.personalIds()[i].type(),
                 employee.personalIds()[i].number()});
@@ -231,89 +256,21 @@ void EmployeeDataProvider::writeEmployeeDetails(const entity::Employee& employee
 }
 
 void EmployeeDataProvider::removeWithID(const std::string& employeeID) {
+    const db::Transaction transaction;
     // Delete in EMPLOYEES
-    DATABASE().SELECT_EMPLOYEES_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_EMPLOYEES_TABLE().begin(),
-                    DATABASE().SELECT_EMPLOYEES_TABLE().end(),
-                    [&](const db::EmployeeTableItem& e) {
-                        return e.employeeID == employeeID;
-                    }),
-        DATABASE().SELECT_EMPLOYEES_TABLE().end());
+    STORAGE().employees().remove(employeeID);
     // Delete the Address
-    DATABASE().SELECT_ADDRESS_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                    DATABASE().SELECT_ADDRESS_TABLE().end(),
-                    [&](const db::AddressTableItem& e) {
-                        return e.ID == employeeID;
-                    }),
-        DATABASE().SELECT_ADDRESS_TABLE().end());
+    STORAGE().addresses().remove(employeeID);
     // Delete the Contacts
-    DATABASE().SELECT_CONTACTS_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                    DATABASE().SELECT_CONTACTS_TABLE().end(),
-                    [&](const db::ContactDetailsTableItem& e) {
-                        return e.ID == employeeID;
-                    }),
-        DATABASE().SELECT_CONTACTS_TABLE().end());
+    STORAGE().contacts().remove(employeeID);
     // Delete the Personal ID
-    DATABASE().SELECT_PERSONAL_ID_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_PERSONAL_ID_TABLE().begin(),
-                    DATABASE().SELECT_PERSONAL_ID_TABLE().end(),
-                    [&](const db::PersonalIdTableItem& e) {
-                        return e.ID == employeeID;
-                    }),
-        DATABASE().SELECT_PERSONAL_ID_TABLE().end());
+    STORAGE().personalIds().remove(employeeID);
     // Delete associated user account
-    DATABASE().SELECT_USERS_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_USERS_TABLE().begin(),
-                    DATABASE().SELECT_USERS_TABLE().end(),
-                    [&](const db::UserTableItem& e) {
-                        return e.employeeID == employeeID;
-                    }),
-        DATABASE().SELECT_USERS_TABLE().end());
+    STORAGE().users().removeOf(employeeID);
 }
 
 void EmployeeDataProvider::fillEmployeeDetails(entity::Employee* employee) const {
-        // Get Address
-        [&employee]() {
-            const std::vector<db::AddressTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_ADDRESS_TABLE().begin(),
-                            DATABASE().SELECT_ADDRESS_TABLE().end(),
-                            [&employee](const db::AddressTableItem& e) {
-                               return e.ID == employee->ID();
-                            });
-            if (it != DATABASE().SELECT_ADDRESS_TABLE().end()) {
-                employee->setAddress({
-                    it->line1,
-                    it->line2,
-                    it->city_town,
-                    it->province,
-                    it->zip,
-                });
-            }
-        }();
-        // Get Contact details
-        [&employee]() {
-            const std::vector<db::ContactDetailsTableItem>::iterator it =
-                    std::find_if(DATABASE().SELECT_CONTACTS_TABLE().begin(),
-                                DATABASE().SELECT_CONTACTS_TABLE().end(),
-                                [&employee](const db::ContactDetailsTableItem& e) {
-                                    return e.ID == employee->ID();
-                                });
-            if (it != DATABASE().SELECT_CONTACTS_TABLE().end()) {
-                employee->setPhoneNumbers(it->phone_number_1, it->phone_number_2);
-                employee->setEmail(it->email);
-            }
-        }();
-        // Get personal IDs
-        [&employee]() {
-            for (const db::PersonalIdTableItem& e :
-                 DATABASE().SELECT_PERSONAL_ID_TABLE()) {
-                if (e.ID == employee->ID()) {
-                    employee->addPersonalId(e.type, e.id_number);
-                }
-            }
-        }();
+    person::fillDetails(employee->ID(), employee);
 }
 }  // namespace empmgmt
 }  // namespace dataprovider
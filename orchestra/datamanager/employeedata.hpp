@@ -33,6 +33,8 @@ class EmployeeDataProvider : public domain::empmgmt::EmployeeMgmtDataInterface {
     virtual ~EmployeeDataProvider() = default;
 
     std::vector<entity::Employee> getEmployees() override;
+    domain::Page<entity::Employee> getEmployeePage(const domain::PageRequest& request) override;
+    entity::Employee findEmployee(const std::string& employeeID) override;
     entity::User getUserData(const std::string& employeeID) override;
     void create(const entity::Employee& employee) override;
     void create(const entity::User& user) override;
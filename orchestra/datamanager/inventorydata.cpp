@@ -19,40 +19,112 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "inventorydata.hpp"
-#include <algorithm>
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 #include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
 
 namespace dataprovider {
 namespace inventory {
 
+namespace {
+
+entity::Product toProduct(const db::ProductTableItem& temp) {
+    // The stock counter is ahead of the row until it is flushed
+    int64_t stock = 0;
+    const bool isCounted = STORAGE().stock().read(temp.barcode, &stock);
+    return entity::Product(
+        temp.barcode,
+        temp.sku,
+        temp.name,
+        temp.description,
+        temp.category,
+        temp.brand,
+        temp.uom,
+        isCounted ? std::to_string(stock) : temp.stock,
+        temp.status,
+        temp.original_price,
+        temp.sell_price,
+        temp.supplier_name,
+        temp.supplier_code);
+}
+
+/*!
+ * The column of a sort key of PageRequest; null (barcode order) if it is not sortable
+ * The numeric columns are stored as text, so they are not offered.
+*/
+db::Field<db::ProductTableItem> sortField(const std::string& sortKey) {
+    if (sortKey == "name") {
+        return &db::ProductTableItem::name;
+    } else if (sortKey == "sku") {
+        return &db::ProductTableItem::sku;
+    } else if (sortKey == "category") {
+        return &db::ProductTableItem::category;
+    } else if (sortKey == "brand") {
+        return &db::ProductTableItem::brand;
+    } else if (sortKey == "status") {
+        return &db::ProductTableItem::status;
+    } else if (sortKey == "supplier") {
+        return &db::ProductTableItem::supplier_name;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
 std::vector<entity::Product> InventoryDataProvider::getProducts() {
-    // SELECT PRODUCTS
+    // SELECT the fields of entity::Product
     std::vector<entity::Product> products;
-    for (const db::ProductTableItem& temp : DATABASE().SELECT_PRODUCT_TABLE()) {
-        entity::Product product(
-            temp.barcode,
-            temp.sku,
-            temp.name,
-            temp.description,
-            temp.category,
-            temp.brand,
-            temp.uom,
-            temp.stock,
-            temp.status,
-            temp.original_price,
-            temp.sell_price,
-            temp.supplier_name,
-            temp.supplier_code);
-        products.emplace_back(product);
+    const auto cursor = db::scan(STORAGE().products())
+        .select({ &db::ProductTableItem::barcode, &db::ProductTableItem::sku,
+                  &db::ProductTableItem::name, &db::ProductTableItem::description,
+                  &db::ProductTableItem::category, &db::ProductTableItem::brand,
+                  &db::ProductTableItem::uom, &db::ProductTableItem::stock,
+                  &db::ProductTableItem::status, &db::ProductTableItem::original_price,
+                  &db::ProductTableItem::sell_price, &db::ProductTableItem::supplier_name,
+                  &db::ProductTableItem::supplier_code }).cursor();
+    for (db::ProductTableItem temp; cursor->next(&temp);) {
+        products.emplace_back(toProduct(temp));
     }
     return products;
 }
 
+domain::Page<entity::Product>
+InventoryDataProvider::getProductPage(const domain::PageRequest& request) {
+    // SELECT * ORDER BY sortKey, barcode LIMIT size (after the token)
+    db::PageQuery<db::ProductTableItem> query;
+    query.key = &db::ProductTableItem::barcode;
+    query.sortBy = sortField(request.sortKey);
+    query.size = request.size;
+    query.token = request.token;
+    db::RowPage<db::ProductTableItem> rows = STORAGE().products().page(query);
+    domain::Page<entity::Product> page;
+    page.items.reserve(rows.rows.size());
+    for (const db::ProductTableItem& temp : rows.rows) {
+        page.items.emplace_back(toProduct(temp));
+    }
+    page.nextToken = std::move(rows.nextToken);
+    return page;
+}
+
+entity::Product InventoryDataProvider::findProduct(const std::string& barcode) {
+    // SELECT * WHERE barcode = barcode
+    db::ProductTableItem temp;
+    if (!STORAGE().products().get(barcode, &temp)) {
+        return entity::Product();
+    }
+    return toProduct(temp);
+}
+
 void InventoryDataProvider::create(const entity::Product& product) {
+    const db::AutoCommit autoCommit;
     // INSERT INTO to the database
-    DATABASE().SELECT_PRODUCT_TABLE().emplace_back(db::ProductTableItem {
+    // A counter left from a removed product with this barcode
+    STORAGE().stock().forget(product.barcode());
+    STORAGE().products().insert(db::ProductTableItem {
             product.barcode(),
             product.sku(),
             product.name(),
@@ -69,31 +141,36 @@ void InventoryDataProvider::create(const entity::Product& product) {
 }
 
 void InventoryDataProvider::removeWithBarcode(const std::string& barcode) {
+    const db::AutoCommit autoCommit;
     // Delete in PRODUCTS
-    DATABASE().SELECT_PRODUCT_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_PRODUCT_TABLE().begin(),
-                    DATABASE().SELECT_PRODUCT_TABLE().end(),
-                    [&](const db::ProductTableItem& e) {
-                        return e.barcode == barcode;
-                    }),
-        DATABASE().SELECT_PRODUCT_TABLE().end());
+    STORAGE().products().remove(barcode);
+    STORAGE().stock().forget(barcode);
+}
+
+bool InventoryDataProvider::takeStock(const std::string& barcode, size_t quantity) {
+    const db::AutoCommit autoCommit;
+    // UPDATE stock = stock - quantity WHERE barcode = barcode AND stock >= quantity
+    if (quantity > static_cast<size_t>(std::numeric_limits<int64_t>::max())) {
+        return false;
+    }
+    return STORAGE().stock().take(barcode, static_cast<int64_t>(quantity));
+}
+
+bool InventoryDataProvider::returnStock(const std::string& barcode, size_t quantity) {
+    const db::AutoCommit autoCommit;
+    // UPDATE stock = stock + quantity WHERE barcode = barcode
+    if (quantity > static_cast<size_t>(std::numeric_limits<int64_t>::max())) {
+        return false;
+    }
+    return STORAGE().stock().add(barcode, static_cast<int64_t>(quantity));
 }
 
 void InventoryDataProvider::update(const entity::Product& product) {
+    const db::AutoCommit autoCommit;
     // UPDATE data in the database
-    std::vector<db::ProductTableItem>::iterator it =
-        std::find_if(DATABASE().SELECT_PRODUCT_TABLE().begin(),
-                     DATABASE().SELECT_PRODUCT_TABLE().end(),
-                     [&product](const db::ProductTableItem& e) {
-                                // We only match the product barcode for updating
-                                return e.barcode == product.barcode();
-                     });
-    if (it == DATABASE().SELECT_PRODUCT_TABLE().end()) {
-        // Not found
-        return;
-    }
-    // Actual update
-    *it = db::ProductTableItem {
+    // We only match the product barcode for updating; nothing happens if it's not found
+    // Through the stock counters, so the counter of the product takes the new stock
+    STORAGE().stock().write(db::ProductTableItem {
             product.barcode(),
             product.sku(),
             product.name(),
@@ -106,57 +183,55 @@ void InventoryDataProvider::update(const entity::Product& product) {
             product.originalPrice(),
             product.sellPrice(),
             product.supplierName(),
-            product.supplierCode() };
+            product.supplierCode() });
 }
 
 std::vector<entity::UnitOfMeasurement> InventoryDataProvider::getUOMs() {
     // SELECT UOMs
     std::vector<entity::UnitOfMeasurement> uoms;
-    for (const db::UOMTableItem& temp : DATABASE().SELECT_UOM_TABLE()) {
+    const auto cursor = STORAGE().uoms().scan();
+    for (db::UOMTableItem temp; cursor->next(&temp);) {
         uoms.emplace_back(entity::UnitOfMeasurement(temp.ID, temp.unit_name, temp.abbreviation));
     }
     return uoms;
 }
 
 void InventoryDataProvider::createUOM(const entity::UnitOfMeasurement& uom) {
+    const db::AutoCommit autoCommit;
     // INSERT INTO to the database
-    DATABASE().SELECT_UOM_TABLE().emplace_back(
+    STORAGE().uoms().insert(
         db::UOMTableItem{uom.ID(), uom.name(), uom.abbreviation()});
 }
 
 void InventoryDataProvider::removeUOM(const std::string& id) {
+    const db::AutoCommit autoCommit;
     // Delete in UOMs
-    DATABASE().SELECT_UOM_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_UOM_TABLE().begin(),
-                    DATABASE().SELECT_UOM_TABLE().end(),
-                    [&](const db::UOMTableItem& e) {
-                        return e.ID == id;
-                    }),
-        DATABASE().SELECT_UOM_TABLE().end());
+    STORAGE().uoms().remove(id);
 }
 
 std::vector<std::string> InventoryDataProvider::getCategories() {
+    // SELECT category_name
     std::vector<std::string> categories;
-    for (const db::CategoryTableItem& temp : DATABASE().SELECT_CATEGORY_TABLE()) {
+    const auto cursor = db::scan(STORAGE().categories())
+        .select({ &db::CategoryTableItem::category_name }).cursor();
+    for (db::CategoryTableItem temp; cursor->next(&temp);) {
         categories.emplace_back(temp.category_name);
     }
     return categories;
 }
 
 void InventoryDataProvider::createCategory(const std::string& category) {
+    const db::AutoCommit autoCommit;
     // new id = category_table_size + 1
-    const std::string newID = std::to_string(DATABASE().SELECT_CATEGORY_TABLE().size() + 1);
-    DATABASE().SELECT_CATEGORY_TABLE().emplace_back(db::CategoryTableItem{newID, category});
+    const std::string newID = std::to_string(STORAGE().categories().size() + 1);
+    STORAGE().categories().insert(db::CategoryTableItem{newID, category});
 }
 
 void InventoryDataProvider::removeCategory(const std::string& category) {
-    DATABASE().SELECT_CATEGORY_TABLE().erase(
-        std::remove_if(DATABASE().SELECT_CATEGORY_TABLE().begin(),
-                    DATABASE().SELECT_CATEGORY_TABLE().end(),
-                    [&](const db::CategoryTableItem& e) {
-                        return e.category_name == category;
-                    }),
-    DATABASE().SELECT_CATEGORY_TABLE().end());
+    const db::AutoCommit autoCommit;
+    STORAGE().categories().removeIf([&](const db::CategoryTableItem& e) {
+        return e.category_name == category;
+    });
 }
 
 }  // namespace inventory
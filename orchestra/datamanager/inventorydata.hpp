@@ -33,8 +33,12 @@ class InventoryDataProvider : public domain::inventory::InventoryDataInterface {
     virtual ~InventoryDataProvider() = default;
 
     std::vector<entity::Product> getProducts() override;
+    domain::Page<entity::Product> getProductPage(const domain::PageRequest& request) override;
+    entity::Product findProduct(const std::string& barcode) override;
     void create(const entity::Product& product) override;
     void removeWithBarcode(const std::string& barcode) override;
+    bool takeStock(const std::string& barcode, size_t quantity) override;
+    bool returnStock(const std::string& barcode, size_t quantity) override;
     void update(const entity::Product& product) override;
     std::vector<entity::UnitOfMeasurement> getUOMs() override;
     void createUOM(const entity::UnitOfMeasurement& uom) override;
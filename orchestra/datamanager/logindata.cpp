@@ -19,22 +19,17 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "logindata.hpp"
-#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
 
 namespace dataprovider {
 namespace login {
 entity::User LoginDataProvider::findUserByID(const std::string& id) {
     // SELECT * WHERE userID = id
-    const entity::User user = [id]() {
-        for (const db::UserTableItem& temp : DATABASE().SELECT_USERS_TABLE()) {
-            if (temp.userID == id) {
-                return entity::User(temp.userID, temp.role, temp.PIN,
-                                    temp.createdAt, temp.employeeID);
-            }
-        }
+    db::UserTableItem temp;
+    if (!STORAGE().users().get(id, &temp)) {
         return entity::User();
-    }();
-    return user;
+    }
+    return entity::User(temp.userID, temp.role, temp.PIN, temp.createdAt, temp.employeeID);
 }
 
 }  // namespace login
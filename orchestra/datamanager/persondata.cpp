@@ -0,0 +1,105 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "persondata.hpp"
+#include <string>
+#include <string_view>
+#include <storage/storageengine.hpp>
+
+namespace dataprovider {
+namespace person {
+
+void fillDetails(const std::string& personID, entity::Person* person) {
+    if (!person) {
+        return;
+    }
+    // Get Address
+    db::AddressTableItem address;
+    if (STORAGE().addresses().get(personID, &address)) {
+        person->setAddress({
+            address.line1,
+            address.line2,
+            address.city_town,
+            address.province,
+            address.zip,
+        });
+    }
+    // Get Contact details
+    db::ContactDetailsTableItem contacts;
+    if (STORAGE().contacts().get(personID, &contacts)) {
+        person->setPhoneNumbers(contacts.phone_number_1, contacts.phone_number_2);
+        person->setEmail(contacts.email);
+    }
+    // Get personal IDs
+    const auto personalIds = STORAGE().personalIds().scanOf(personID);
+    for (db::PersonalIdTableItem e; personalIds->next(&e);) {
+        person->addPersonalId(e.type, e.id_number);
+    }
+}
+
+void fillDetails(const PersonMap& persons) {
+    if (persons.empty()) {
+        return;
+    }
+    // Only the rows of the listed persons are copied out of the tables
+    const auto isListed = [&persons](const std::string& id) { return persons.count(id) > 0; };
+    // Only the first address and contact row of a person is used (same as the single query)
+    ArenaSet<std::string_view> hasAddress(persons.get_allocator());
+    ArenaSet<std::string_view> hasContacts(persons.get_allocator());
+    // Probe the address table
+    const auto addresses = db::scan(STORAGE().addresses())
+        .where(db::column(&db::AddressTableItem::ID).matches(isListed)).cursor();
+    for (db::AddressTableItem e; addresses->next(&e);) {
+        const auto it = persons.find(e.ID);
+        if (it == persons.end() || !hasAddress.emplace(it->first).second) {
+            continue;
+        }
+        it->second->setAddress({
+            e.line1,
+            e.line2,
+            e.city_town,
+            e.province,
+            e.zip,
+        });
+    }
+    // Probe the contacts table
+    const auto contacts = db::scan(STORAGE().contacts())
+        .where(db::column(&db::ContactDetailsTableItem::ID).matches(isListed)).cursor();
+    for (db::ContactDetailsTableItem e; contacts->next(&e);) {
+        const auto it = persons.find(e.ID);
+        if (it == persons.end() || !hasContacts.emplace(it->first).second) {
+            continue;
+        }
+        it->second->setPhoneNumbers(e.phone_number_1, e.phone_number_2);
+        it->second->setEmail(e.email);
+    }
+    // Probe the personal ID table
+    const auto personalIds = db::scan(STORAGE().personalIds())
+        .where(db::column(&db::PersonalIdTableItem::ID).matches(isListed)).cursor();
+    for (db::PersonalIdTableItem e; personalIds->next(&e);) {
+        const auto it = persons.find(e.ID);
+        if (it != persons.end()) {
+            it->second->addPersonalId(e.type, e.id_number);
+        }
+    }
+}
+
+}  // namespace person
+}  // namespace dataprovider
@@ -0,0 +1,50 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_DATAMANAGER_PERSONDATA_HPP_
+#define ORCHESTRA_DATAMANAGER_PERSONDATA_HPP_
+#include <string>
+#include <string_view>
+#include <entity/person.hpp>
+#include "queryarena.hpp"
+
+namespace dataprovider {
+namespace person {
+
+// person ID -> person entity to fill; lives in the QueryArena of the list query
+typedef ArenaMap<std::string_view, entity::Person*> PersonMap;
+
+/*!
+ * Fills the address, contact details and personal IDs of a single person
+ * Uses the person-ID index of the detail tables
+*/
+extern void fillDetails(const std::string& personID, entity::Person* person);
+
+/*!
+ * Batched form of fillDetails() for list queries
+ * Hash-joins the persons with each detail table in a single pass per table,
+ * so the cost is linear to the number of persons plus detail rows
+ * Its own join state is allocated from the arena of [persons].
+*/
+extern void fillDetails(const PersonMap& persons);
+
+}  // namespace person
+}  // namespace dataprovider
+#endif  // ORCHESTRA_DATAMANAGER_PERSONDATA_HPP_
@@ -0,0 +1,148 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_DATAMANAGER_QUERYARENA_HPP_
+#define ORCHESTRA_DATAMANAGER_QUERYARENA_HPP_
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+
+/*!
+ * Monotonic arena for the scratch data of one query, e.g. the join maps of a list
+ *
+ * Memory is handed out from a few large blocks and freed all at once when the query returns,
+ * so a list of thousands of rows costs a few allocations instead of one per map node and key.
+ * The ArenaMap/ArenaSet containers take the arena; key them with views of copy().
+ * e.g. QueryArena arena(customers.size());
+ *      person::PersonMap persons(&arena);
+ *      persons.emplace(arena.copy(customer.ID()), &customer);
+*/
+class QueryArena {
+ public:
+    /*!
+     * [expectedItems] sizes the first block, e.g. the number of rows the query reads
+    */
+    explicit QueryArena(size_t expectedItems)
+        : mNextBlockSize(std::max(expectedItems, MIN_ITEMS) * BYTES_PER_ITEM) {}
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+
+    /*!
+     * [size] bytes aligned to [alignment]; freed with the arena
+    */
+    void* allocate(size_t size, size_t alignment) {
+        char* data = alignedFree(alignment);
+        if (!data || (data + size > mBlockEnd)) {
+            // Each block is twice the last one, and fits the request
+            const size_t blockSize = std::max(mNextBlockSize, size + alignment);
+            mNextBlockSize = blockSize * 2;
+            mBlocks.emplace_back(new char[blockSize]);
+            mFree = mBlocks.back().get();
+            mBlockEnd = mFree + blockSize;
+            data = alignedFree(alignment);
+        }
+        mFree = data + size;
+        return data;
+    }
+
+    /*!
+     * Copies [text] into the arena; the view is valid as long as the arena
+    */
+    std::string_view copy(std::string_view text) {
+        char* data = static_cast<char*>(allocate(std::max<size_t>(text.size(), 1), 1));
+        std::memcpy(data, text.data(), text.size());
+        return std::string_view(data, text.size());
+    }
+
+ private:
+    static constexpr size_t MIN_ITEMS = 16;
+    // a hash node, its bucket and a short key
+    static constexpr size_t BYTES_PER_ITEM = 96;
+
+    std::vector<std::unique_ptr<char[]>> mBlocks;
+    size_t mNextBlockSize;
+    // the unused end of the last block
+    char* mFree = nullptr;
+    char* mBlockEnd = nullptr;
+
+    inline char* alignedFree(size_t alignment) const {
+        if (!mFree) {
+            return nullptr;
+        }
+        const uintptr_t address = reinterpret_cast<uintptr_t>(mFree);
+        return mFree + (((address + alignment - 1) & ~(alignment - 1)) - address);
+    }
+};
+
+/*!
+ * Allocator of the containers that live in a QueryArena; deallocate() is a no-op
+*/
+template <typename T>
+class ArenaAllocator {
+ public:
+    typedef T value_type;
+
+    ArenaAllocator(QueryArena* arena) : mArena(arena) {}  // NOLINT(runtime/explicit)
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.arena()) {}  // NOLINT
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(mArena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    inline QueryArena* arena() const {
+        return mArena;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return mArena == other.arena();
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return mArena != other.arena();
+    }
+
+ private:
+    QueryArena* mArena;
+};
+
+template <typename Key, typename Value>
+using ArenaMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>,
+                                    ArenaAllocator<std::pair<const Key, Value>>>;
+template <typename Key>
+using ArenaSet = std::unordered_set<Key, std::hash<Key>, std::equal_to<Key>,
+                                    ArenaAllocator<Key>>;
+
+}  // namespace dataprovider
+#endif  // ORCHESTRA_DATAMANAGER_QUERYARENA_HPP_
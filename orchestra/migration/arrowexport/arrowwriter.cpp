@@ -0,0 +1,291 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "arrowwriter.hpp"
+#include <string>
+#include <vector>
+#include "flatbuilder.hpp"
+
+namespace dataprovider {
+namespace arrowexport {
+
+namespace {
+
+// Arrow format constants (format/Schema.fbs, Message.fbs and File.fbs)
+constexpr char MAGIC[] = "ARROW1";
+constexpr uint32_t CONTINUATION = 0xFFFFFFFF;
+constexpr int16_t METADATA_V5 = 4;
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+constexpr uint8_t TYPE_INT = 2;
+constexpr uint8_t TYPE_UTF8 = 5;
+constexpr uint8_t TYPE_DECIMAL = 7;
+constexpr uint8_t TYPE_TIMESTAMP = 10;
+constexpr int16_t UNIT_SECOND = 0;
+constexpr size_t ALIGNMENT = 8;
+constexpr size_t DECIMAL_BYTES = 16;
+
+template <typename T>
+void appendLittleEndian(std::string* bytes, T value) {
+    const uint64_t bits = static_cast<uint64_t>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        *bytes += static_cast<char>((bits >> (i * 8)) & 0xFF);
+    }
+}
+
+void padTo(std::string* bytes, size_t alignment) {
+    bytes->append((alignment - (bytes->size() % alignment)) % alignment, '\0');
+}
+
+FlatBuilder::Offset addType(FlatBuilder* builder, ArrowType type) {
+    builder->startTable();
+    switch (type) {
+        case ArrowType::INT64:
+            builder->addScalar<int32_t>(0, 64);     // bitWidth
+            builder->addScalar<uint8_t>(1, 1);      // is_signed
+            break;
+        case ArrowType::TIMESTAMP:
+            builder->addScalar<int16_t>(0, UNIT_SECOND);
+            break;
+        case ArrowType::MONEY:
+            builder->addScalar<int32_t>(0, 18);     // precision
+            builder->addScalar<int32_t>(1, 2);      // scale
+            builder->addScalar<int32_t>(2, DECIMAL_BYTES * 8);
+            break;
+        case ArrowType::UTF8:
+            break;
+    }
+    return builder->endTable();
+}
+
+uint8_t typeID(ArrowType type) {
+    switch (type) {
+        case ArrowType::INT64:
+            return TYPE_INT;
+        case ArrowType::TIMESTAMP:
+            return TYPE_TIMESTAMP;
+        case ArrowType::MONEY:
+            return TYPE_DECIMAL;
+        case ArrowType::UTF8:
+            return TYPE_UTF8;
+    }
+    return 0;
+}
+
+FlatBuilder::Offset addSchema(FlatBuilder* builder, const std::vector<ArrowField>& schema) {
+    std::vector<FlatBuilder::Offset> fields;
+    for (const ArrowField& field : schema) {
+        const FlatBuilder::Offset name = builder->addString(field.name);
+        const FlatBuilder::Offset type = addType(builder, field.type);
+        // Readers expect the children vector even if it is empty
+        const FlatBuilder::Offset children = builder->addOffsetVector({});
+        builder->startTable();
+        builder->addOffset(0, name);
+        builder->addScalar<uint8_t>(1, 0);          // nullable
+        builder->addScalar<uint8_t>(2, typeID(field.type));
+        builder->addOffset(3, type);
+        builder->addOffset(5, children);
+        fields.push_back(builder->endTable());
+    }
+    const FlatBuilder::Offset fieldVector = builder->addOffsetVector(fields);
+    builder->startTable();
+    builder->addScalar<int16_t>(0, 0);              // little endian
+    builder->addOffset(1, fieldVector);
+    return builder->endTable();
+}
+
+std::string messageOf(uint8_t headerType, FlatBuilder* builder, FlatBuilder::Offset header,
+                      int64_t bodyLength) {
+    builder->startTable();
+    builder->addScalar<int16_t>(0, METADATA_V5);
+    builder->addScalar<uint8_t>(1, headerType);
+    builder->addOffset(2, header);
+    builder->addScalar<int64_t>(3, bodyLength);
+    return builder->finish(builder->endTable());
+}
+
+}  // namespace
+
+ArrowWriter::ArrowWriter(const std::string& path, const std::vector<ArrowField>& schema,
+                         size_t batchRows)
+    : mBatchRows(batchRows ? batchRows : DEFAULT_BATCH_ROWS) {
+    for (const ArrowField& field : schema) {
+        mColumns.push_back(Column { field, std::string(), std::vector<int32_t>() });
+    }
+    resetColumns();
+    mFile = std::fopen(path.c_str(), "wb");
+    if (!mFile) {
+        return;
+    }
+    std::string magic(MAGIC);
+    padTo(&magic, ALIGNMENT);
+    write(magic);
+    FlatBuilder builder;
+    writeMessage(messageOf(HEADER_SCHEMA, &builder, addSchema(&builder, schema), 0),
+                 std::string());
+}
+
+ArrowWriter::~ArrowWriter() {
+    if (mFile) {
+        close();
+    }
+}
+
+void ArrowWriter::append(size_t column, int64_t value) {
+    std::string* values = &mColumns[column].values;
+    appendLittleEndian(values, value);
+    if (mColumns[column].field.type == ArrowType::MONEY) {
+        // Two's complement over 128 bits
+        appendLittleEndian<int64_t>(values, (value < 0) ? -1 : 0);
+    }
+}
+
+void ArrowWriter::append(size_t column, const std::string& value) {
+    Column& target = mColumns[column];
+    target.values += value;
+    target.offsets.push_back(static_cast<int32_t>(target.values.size()));
+}
+
+void ArrowWriter::endRow() {
+    if (++mRows == mBatchRows) {
+        writeBatch();
+    }
+}
+
+bool ArrowWriter::close() {
+    if (!mFile) {
+        return false;
+    }
+    if (mRows > 0) {
+        writeBatch();
+    }
+    // End of the stream, then the footer that indexes the batches
+    std::string end;
+    appendLittleEndian(&end, CONTINUATION);
+    appendLittleEndian<int32_t>(&end, 0);
+    write(end);
+
+    FlatBuilder builder;
+    std::vector<ArrowField> schema;
+    for (const Column& column : mColumns) {
+        schema.push_back(column.field);
+    }
+    const FlatBuilder::Offset schemaOffset = addSchema(&builder, schema);
+    std::string blocks;
+    for (const Block& block : mBlocks) {
+        appendLittleEndian(&blocks, block.offset);
+        appendLittleEndian(&blocks, block.metadataLength);
+        appendLittleEndian<int32_t>(&blocks, 0);   // padding
+        appendLittleEndian(&blocks, block.bodyLength);
+    }
+    const FlatBuilder::Offset dictionaries = builder.addStructVector(std::string(), 24, 8);
+    const FlatBuilder::Offset batches = builder.addStructVector(blocks, 24, 8);
+    builder.startTable();
+    builder.addScalar<int16_t>(0, METADATA_V5);
+    builder.addOffset(1, schemaOffset);
+    builder.addOffset(2, dictionaries);
+    builder.addOffset(3, batches);
+    std::string footer = builder.finish(builder.endTable());
+    appendLittleEndian<int32_t>(&footer, static_cast<int32_t>(footer.size()));
+    footer += MAGIC;
+    write(footer);
+
+    if (std::fclose(mFile) != 0) {
+        mIsFailed = true;
+    }
+    mFile = nullptr;
+    return !mIsFailed;
+}
+
+void ArrowWriter::writeBatch() {
+    std::string body;
+    std::string nodes;
+    std::string buffers;
+    const auto addBuffer = [&body, &buffers](const std::string& bytes) {
+        appendLittleEndian<int64_t>(&buffers, body.size());
+        appendLittleEndian<int64_t>(&buffers, bytes.size());
+        body += bytes;
+        padTo(&body, ALIGNMENT);
+    };
+    for (const Column& column : mColumns) {
+        appendLittleEndian<int64_t>(&nodes, mRows);
+        appendLittleEndian<int64_t>(&nodes, 0);    // null count
+        // No validity bitmap: every value is set
+        addBuffer(std::string());
+        if (column.field.type == ArrowType::UTF8) {
+            std::string offsets;
+            offsets.reserve(column.offsets.size() * sizeof(int32_t));
+            for (const int32_t offset : column.offsets) {
+                appendLittleEndian(&offsets, offset);
+            }
+            addBuffer(offsets);
+        }
+        addBuffer(column.values);
+    }
+
+    FlatBuilder builder;
+    const FlatBuilder::Offset nodeVector = builder.addStructVector(nodes, 16, 8);
+    const FlatBuilder::Offset bufferVector = builder.addStructVector(buffers, 16, 8);
+    builder.startTable();
+    builder.addScalar<int64_t>(0, mRows);
+    builder.addOffset(1, nodeVector);
+    builder.addOffset(2, bufferVector);
+    const FlatBuilder::Offset batch = builder.endTable();
+    mBlocks.push_back(writeMessage(messageOf(HEADER_RECORD_BATCH, &builder, batch, body.size()),
+                                   body));
+    mRows = 0;
+    resetColumns();
+}
+
+ArrowWriter::Block ArrowWriter::writeMessage(const std::string& metadata,
+                                             const std::string& body) {
+    std::string message;
+    appendLittleEndian(&message, CONTINUATION);
+    // Metadata size includes the padding, so the body starts aligned
+    std::string padded(metadata);
+    padTo(&padded, ALIGNMENT);
+    appendLittleEndian<int32_t>(&message, static_cast<int32_t>(padded.size()));
+    message += padded;
+    const Block block { mPosition, static_cast<int32_t>(message.size()),
+                        static_cast<int64_t>(body.size()) };
+    write(message);
+    write(body);
+    return block;
+}
+
+void ArrowWriter::write(const std::string& bytes) {
+    if (!mFile || bytes.empty()) {
+        return;
+    }
+    if (std::fwrite(bytes.data(), 1, bytes.size(), mFile) != bytes.size()) {
+        mIsFailed = true;
+    }
+    mPosition += bytes.size();
+}
+
+void ArrowWriter::resetColumns() {
+    for (Column& column : mColumns) {
+        column.values.clear();
+        column.offsets.assign(1, 0);
+    }
+}
+
+}  // namespace arrowexport
+}  // namespace dataprovider
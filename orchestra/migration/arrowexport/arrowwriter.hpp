@@ -0,0 +1,118 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_ARROWEXPORT_ARROWWRITER_HPP_
+#define ORCHESTRA_MIGRATION_ARROWEXPORT_ARROWWRITER_HPP_
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace dataprovider {
+namespace arrowexport {
+
+enum class ArrowType {
+    INT64,
+    // seconds since the epoch, without a time zone
+    TIMESTAMP,
+    // decimal(18, 2), appended as cents
+    MONEY,
+    UTF8
+};
+
+struct ArrowField {
+    std::string name;
+    ArrowType type;
+};
+
+/*!
+ * Writes rows to a file in the Apache Arrow IPC file format (Feather V2, ".arrow")
+ *
+ * Rows are buffered column by column and written as a record batch every [batchRows] rows,
+ * so memory stays bounded however many rows are written. No column has nulls.
+ * e.g. ArrowWriter writer(path, { { "id", ArrowType::UTF8 }, { "total", ArrowType::MONEY } });
+ *      writer.append(0, id);
+ *      writer.append(1, cents);
+ *      writer.endRow();
+ *      ...
+ *      writer.close();
+*/
+class ArrowWriter {
+ public:
+    static constexpr size_t DEFAULT_BATCH_ROWS = 64 * 1024;
+
+    ArrowWriter(const std::string& path, const std::vector<ArrowField>& schema,
+                size_t batchRows = DEFAULT_BATCH_ROWS);
+    ~ArrowWriter();
+
+    inline bool isOpen() const {
+        return mFile != nullptr;
+    }
+
+    /*!
+     * Sets a column of the current row; INT64, TIMESTAMP and MONEY take a number
+    */
+    void append(size_t column, int64_t value);
+    void append(size_t column, const std::string& value);
+    /*!
+     * Ends the current row; every column must have been set
+    */
+    void endRow();
+    /*!
+     * Writes the remaining rows and the file footer
+     * Returns false if a write failed; the file is not usable then
+    */
+    bool close();
+
+ private:
+    struct Column {
+        ArrowField field;
+        // fixed-width values, or the UTF-8 bytes
+        std::string values;
+        // UTF8 only; starts with 0
+        std::vector<int32_t> offsets;
+    };
+
+    struct Block {
+        int64_t offset;
+        int32_t metadataLength;
+        int64_t bodyLength;
+    };
+
+    std::FILE* mFile = nullptr;
+    std::vector<Column> mColumns;
+    const size_t mBatchRows;
+    size_t mRows = 0;
+    int64_t mPosition = 0;
+    std::vector<Block> mBlocks;
+    bool mIsFailed = false;
+
+    void writeBatch();
+    /*!
+     * Writes an encapsulated message: continuation marker, metadata size, metadata, body
+    */
+    Block writeMessage(const std::string& metadata, const std::string& body);
+    void write(const std::string& bytes);
+    void resetColumns();
+};
+
+}  // namespace arrowexport
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_ARROWEXPORT_ARROWWRITER_HPP_
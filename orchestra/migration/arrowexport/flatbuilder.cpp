@@ -0,0 +1,113 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "flatbuilder.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace dataprovider {
+namespace arrowexport {
+
+void FlatBuilder::prep(size_t alignment, size_t extra) {
+    mMinAlign = std::max(mMinAlign, alignment);
+    const size_t padding = (alignment - ((mBytes.size() + extra) % alignment)) % alignment;
+    mBytes.append(padding, '\0');
+}
+
+void FlatBuilder::prependOffset(Offset offset) {
+    prep(sizeof(Offset), 0);
+    // Relative to the position of the offset itself
+    prependBytes<Offset>(size() + sizeof(Offset) - offset);
+}
+
+FlatBuilder::Offset FlatBuilder::addString(const std::string& value) {
+    prep(sizeof(Offset), value.size() + 1);
+    mBytes += '\0';
+    mBytes.append(value.rbegin(), value.rend());
+    prependBytes<uint32_t>(static_cast<uint32_t>(value.size()));
+    return size();
+}
+
+FlatBuilder::Offset FlatBuilder::addOffsetVector(const std::vector<Offset>& offsets) {
+    prep(sizeof(Offset), offsets.size() * sizeof(Offset));
+    for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+        prependOffset(*it);
+    }
+    prependBytes<uint32_t>(static_cast<uint32_t>(offsets.size()));
+    return size();
+}
+
+FlatBuilder::Offset FlatBuilder::addStructVector(const std::string& structs, size_t structSize,
+                                                 size_t alignment) {
+    prep(sizeof(uint32_t), structs.size());
+    prep(alignment, structs.size());
+    mBytes.append(structs.rbegin(), structs.rend());
+    prependBytes<uint32_t>(static_cast<uint32_t>(structs.size() / structSize));
+    return size();
+}
+
+void FlatBuilder::startTable() {
+    mFields.clear();
+    mTableStart = size();
+}
+
+void FlatBuilder::addOffset(uint16_t field, Offset offset) {
+    prependOffset(offset);
+    mFields.emplace_back(field, size());
+}
+
+FlatBuilder::Offset FlatBuilder::endTable() {
+    // soffset to the vtable, patched below
+    prepend<int32_t>(0);
+    const Offset table = size();
+    uint16_t fieldCount = 0;
+    for (const auto& field : mFields) {
+        fieldCount = std::max<uint16_t>(fieldCount, field.first + 1);
+    }
+    std::vector<uint16_t> vtable(fieldCount, 0);
+    for (const auto& field : mFields) {
+        vtable[field.first] = static_cast<uint16_t>(table - field.second);
+    }
+    for (auto it = vtable.rbegin(); it != vtable.rend(); ++it) {
+        prepend<uint16_t>(*it);
+    }
+    prepend<uint16_t>(static_cast<uint16_t>(table - mTableStart));
+    prepend<uint16_t>(static_cast<uint16_t>((fieldCount + 2) * sizeof(uint16_t)));
+    // The vtable is before the table: table - soffset = vtable
+    const int32_t soffset = static_cast<int32_t>(size() - table);
+    for (size_t i = 0; i < sizeof(soffset); ++i) {
+        mBytes[table - 1 - i] = static_cast<char>((soffset >> (i * 8)) & 0xFF);
+    }
+    mFields.clear();
+    return table;
+}
+
+std::string FlatBuilder::finish(Offset root) {
+    prep(mMinAlign, sizeof(Offset));
+    prependOffset(root);
+    std::string buffer(mBytes.rbegin(), mBytes.rend());
+    mBytes.clear();
+    mMinAlign = 1;
+    return buffer;
+}
+
+}  // namespace arrowexport
+}  // namespace dataprovider
@@ -0,0 +1,110 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_ARROWEXPORT_FLATBUILDER_HPP_
+#define ORCHESTRA_MIGRATION_ARROWEXPORT_FLATBUILDER_HPP_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+namespace arrowexport {
+
+/*!
+ * Minimal FlatBuffers builder, enough for the Arrow IPC metadata
+ *
+ * Like the reference builder, the buffer is built back to front: children first, so every
+ * offset points forward. An object is referred to by its distance from the end of the buffer
+ * (the returned Offset). Table fields are always written, defaults included.
+ * e.g. const Offset name = builder.addString("id");
+ *      builder.startTable();
+ *      builder.addOffset(0, name);
+ *      builder.addScalar<uint8_t>(1, 1);
+ *      builder.finish(builder.endTable());
+*/
+class FlatBuilder {
+ public:
+    typedef uint32_t Offset;
+
+    FlatBuilder() = default;
+    ~FlatBuilder() = default;
+
+    Offset addString(const std::string& value);
+    Offset addOffsetVector(const std::vector<Offset>& offsets);
+    /*!
+     * Vector of structs; [structs] holds the little-endian bytes of all elements
+    */
+    Offset addStructVector(const std::string& structs, size_t structSize, size_t alignment);
+
+    void startTable();
+    template <typename T>
+    void addScalar(uint16_t field, T value) {
+        prepend(value);
+        mFields.emplace_back(field, size());
+    }
+    void addOffset(uint16_t field, Offset offset);
+    Offset endTable();
+
+    /*!
+     * Returns the finished buffer; the builder is empty afterwards
+    */
+    std::string finish(Offset root);
+
+ private:
+    // bytes in reverse order; the last byte of the buffer is first
+    std::string mBytes;
+    size_t mMinAlign = 1;
+    size_t mTableStart = 0;
+    // field id -> distance from the end when it was written
+    std::vector<std::pair<uint16_t, Offset>> mFields;
+
+    inline Offset size() const {
+        return static_cast<Offset>(mBytes.size());
+    }
+
+    /*!
+     * Pads so that the buffer is aligned to [alignment] after [extra] more bytes
+    */
+    void prep(size_t alignment, size_t extra);
+    void prependOffset(Offset offset);
+
+    template <typename T>
+    void prepend(T value) {
+        prep(sizeof(T), 0);
+        prependBytes(value);
+    }
+
+    template <typename T>
+    void prependBytes(T value) {
+        // Little-endian, reversed
+        uint64_t bits = 0;
+        static_assert(sizeof(T) <= sizeof(bits), "scalar too large");
+        std::memcpy(&bits, &value, sizeof(T));
+        for (size_t i = sizeof(T); i > 0; --i) {
+            mBytes += static_cast<char>((bits >> ((i - 1) * 8)) & 0xFF);
+        }
+    }
+};
+
+}  // namespace arrowexport
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_ARROWEXPORT_FLATBUILDER_HPP_
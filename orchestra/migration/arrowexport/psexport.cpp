@@ -0,0 +1,45 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "salesexport.hpp"
+
+/*!
+ * Exports the sales of the database configured in psdb.cfg to Arrow files
+ * e.g. psexport sales.arrow sale_items.arrow "2021-01-01 00:00:00" "2021-12-31 23:59:59"
+ *      psexport sales.arrow sale_items.arrow 2021-01-01 2021-12-31
+*/
+int main(int argc, char* argv[]) {
+    const std::string startDate = (argc == 5) ? argv[3] : "";
+    const std::string endDate = (argc == 5) ? argv[4] : "";
+    int64_t start = 0;
+    int64_t end = 0;
+    if (((argc != 3) && (argc != 5))
+        || !dataprovider::arrowexport::parseBound(startDate, false, &start)
+        || !dataprovider::arrowexport::parseBound(endDate, true, &end)) {
+        std::cerr << "Usage: psexport <sales.arrow> <sale_items.arrow> [start end]" << std::endl
+                  << "  start and end: \"YYYY-MM-DD HH:MM:SS\" or YYYY-MM-DD (the whole day)"
+                  << std::endl;
+        return 1;
+    }
+    return dataprovider::arrowexport::exportSales(argv[1], argv[2], startDate, endDate) ? 0 : 2;
+}
@@ -0,0 +1,190 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "salesexport.hpp"
+#include <limits>
+#include <memory>
+#include <string>
+#include <logger/loghelper.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+
+namespace dataprovider {
+namespace arrowexport {
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+/*!
+ * Writes the sales of the time range and their items from one StackDB snapshot
+*/
+void exportFromSnapshot(int64_t start, int64_t end, ArrowWriter* sales, ArrowWriter* items,
+                        size_t* saleCount, size_t* itemCount) {
+    // Items are read by sale, from the same snapshot, so both files match
+    const auto snapshot = DATABASE().snapshot();
+    const db::SalesColumns& columns = snapshot.SELECT_SALES_TABLE().columns();
+    const db::SalesItemColumns& itemColumns = snapshot.SELECT_SALES_ITEM_TABLE().columns();
+    const size_t last = columns.upperBound(end);
+    for (size_t first = columns.lowerBound(start); first < last; ++first) {
+        const size_t i = columns.byTime[first];
+        sales->append(0, columns.id[i]);
+        sales->append(1, columns.dateTime[i]);
+        sales->append(2, columns.subtotal[i]);
+        sales->append(3, columns.taxableAmount[i]);
+        sales->append(4, columns.vat[i]);
+        sales->append(5, columns.discount[i]);
+        sales->append(6, columns.total[i]);
+        sales->append(7, columns.amountPaid[i]);
+        sales->append(8, columns.paymentTypes.decode(columns.paymentType[i]));
+        sales->append(9, columns.change[i]);
+        sales->append(10, columns.cashiers.decode(columns.cashier[i]));
+        sales->append(11, columns.customers.decode(columns.customer[i]));
+        sales->endRow();
+        ++*saleCount;
+
+        for (const size_t item : itemColumns.findSale(columns.id[i])) {
+            items->append(0, itemColumns.saleID[item]);
+            items->append(1, itemColumns.productID[item]);
+            items->append(2, itemColumns.productName[item]);
+            items->append(3, itemColumns.unitPrice[item]);
+            items->append(4, itemColumns.quantity[item]);
+            items->append(5, itemColumns.totalPrice[item]);
+            items->endRow();
+            ++*itemCount;
+        }
+    }
+}
+
+/*!
+ * Writes the sales of the time range and their items through STORAGE(), e.g. from the LSM
+ * sales engine; they are not read from one snapshot then
+*/
+void exportFromEngine(int64_t start, int64_t end, ArrowWriter* sales, ArrowWriter* items,
+                      size_t* saleCount, size_t* itemCount) {
+    int64_t dateTime = 0;
+    const std::unique_ptr<db::Cursor<db::SalesTableItem>> rows =
+        STORAGE().sales().scanTime(start, end);
+    for (db::SalesTableItem sale; rows->next(&sale);) {
+        db::parseDateTime(sale.date_time, &dateTime);
+        sales->append(0, sale.ID);
+        sales->append(1, dateTime);
+        sales->append(2, db::parseCents(sale.subtotal));
+        sales->append(3, db::parseCents(sale.taxable_amount));
+        sales->append(4, db::parseCents(sale.vat));
+        sales->append(5, db::parseCents(sale.discount));
+        sales->append(6, db::parseCents(sale.total));
+        sales->append(7, db::parseCents(sale.amount_paid));
+        sales->append(8, sale.payment_type);
+        sales->append(9, db::parseCents(sale.change));
+        sales->append(10, sale.cashierID);
+        sales->append(11, sale.customerID);
+        sales->endRow();
+        ++*saleCount;
+
+        const std::unique_ptr<db::Cursor<db::SalesItemTableItem>> saleItems =
+            STORAGE().salesItems().scanOf(sale.ID);
+        for (db::SalesItemTableItem item; saleItems->next(&item);) {
+            items->append(0, item.saleID);
+            items->append(1, item.productID);
+            items->append(2, item.product_name);
+            items->append(3, db::parseCents(item.unit_price));
+            items->append(4, db::parseInteger(item.quantity));
+            items->append(5, db::parseCents(item.total_price));
+            items->endRow();
+            ++*itemCount;
+        }
+    }
+}
+
+}  // namespace
+
+bool exportSales(const std::string& salesPath, const std::string& itemsPath,
+                 const std::string& startDate, const std::string& endDate, size_t batchRows) {
+    ArrowWriter sales(salesPath, {
+        { "id", ArrowType::UTF8 },
+        { "date_time", ArrowType::TIMESTAMP },
+        { "subtotal", ArrowType::MONEY },
+        { "taxable_amount", ArrowType::MONEY },
+        { "vat", ArrowType::MONEY },
+        { "discount", ArrowType::MONEY },
+        { "total", ArrowType::MONEY },
+        { "amount_paid", ArrowType::MONEY },
+        { "payment_type", ArrowType::UTF8 },
+        { "change", ArrowType::MONEY },
+        { "cashier_id", ArrowType::UTF8 },
+        { "customer_id", ArrowType::UTF8 } }, batchRows);
+    ArrowWriter items(itemsPath, {
+        { "sale_id", ArrowType::UTF8 },
+        { "product_id", ArrowType::UTF8 },
+        { "product_name", ArrowType::UTF8 },
+        { "unit_price", ArrowType::MONEY },
+        { "quantity", ArrowType::INT64 },
+        { "total_price", ArrowType::MONEY } }, batchRows);
+    if (!sales.isOpen() || !items.isOpen()) {
+        LOG_ERROR("Cannot create %s or %s", salesPath.c_str(), itemsPath.c_str());
+        return false;
+    }
+
+    int64_t start = 0;
+    int64_t end = 0;
+    if (!parseBound(startDate, false, &start) || !parseBound(endDate, true, &end)) {
+        LOG_ERROR("Invalid date range %s to %s", startDate.c_str(), endDate.c_str());
+        return false;
+    }
+    size_t saleCount = 0;
+    size_t itemCount = 0;
+    if (STORAGE().isInStackDB()) {
+        exportFromSnapshot(start, end, &sales, &items, &saleCount, &itemCount);
+    } else {
+        exportFromEngine(start, end, &sales, &items, &saleCount, &itemCount);
+    }
+    const bool isSalesWritten = sales.close();
+    const bool isItemsWritten = items.close();
+    LOG_INFO("Exported %s sales and %s sale items", std::to_string(saleCount).c_str(),
+             std::to_string(itemCount).c_str());
+    return isSalesWritten && isItemsWritten;
+}
+
+bool parseBound(const std::string& bound, bool isEnd, int64_t* seconds) {
+    if (bound.empty()) {
+        *seconds = isEnd ? std::numeric_limits<int64_t>::max()
+                         : std::numeric_limits<int64_t>::min();
+        return true;
+    }
+    if (db::parseDateTime(bound, seconds)) {
+        // "YYYY/MM/DD" is read as midnight
+        if (isEnd && (bound.size() == 10)) {
+            *seconds += SECONDS_PER_DAY - 1;
+        }
+        return true;
+    }
+    std::string day = bound;
+    if ((day.size() != 10) || (day[4] != '-') || (day[7] != '-')) {
+        return false;
+    }
+    day[4] = '/';
+    day[7] = '/';
+    return parseBound(day, isEnd, seconds);
+}
+
+}  // namespace arrowexport
+}  // namespace dataprovider
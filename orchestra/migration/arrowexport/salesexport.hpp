@@ -0,0 +1,54 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_ARROWEXPORT_SALESEXPORT_HPP_
+#define ORCHESTRA_MIGRATION_ARROWEXPORT_SALESEXPORT_HPP_
+#include <cstdint>
+#include <string>
+#include "arrowwriter.hpp"
+
+namespace dataprovider {
+namespace arrowexport {
+
+/*!
+ * Exports the sales from [startDate] to [endDate] and their items to two Arrow files
+ *
+ * Reads SALES_TABLE and SALES_ITEM_TABLE from one database snapshot, in time order, and
+ * streams them out in record batches of [batchRows]; only one batch per file is in memory.
+ * When psdb.cfg puts tables in another engine, they are read through STORAGE() instead.
+ * Money columns are decimal(18, 2); date_time is a timestamp in seconds. The dates are read
+ * by parseBound(); an empty one does not limit the range.
+ * Returns false if a date is invalid or a file cannot be written.
+*/
+bool exportSales(const std::string& salesPath, const std::string& itemsPath,
+                 const std::string& startDate, const std::string& endDate,
+                 size_t batchRows = ArrowWriter::DEFAULT_BATCH_ROWS);
+
+/*!
+ * Reads a bound of the export range into [seconds]: "YYYY-MM-DD HH:MM:SS", or a day
+ * "YYYY-MM-DD" (or "YYYY/MM/DD"), which is included whole; e.g. the [isEnd] bound "2021-01-02"
+ * is "2021-01-02 23:59:59". An empty bound is the start or the end of time.
+ * Returns false if [bound] is none of these
+*/
+bool parseBound(const std::string& bound, bool isEnd, int64_t* seconds);
+
+}  // namespace arrowexport
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_ARROWEXPORT_SALESEXPORT_HPP_
@@ -0,0 +1,160 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// code under test
+#include <arrowexport/arrowwriter.hpp>
+#include <arrowexport/salesexport.hpp>
+#include <storage/salescolumns.hpp>
+
+namespace dataprovider {
+namespace arrowexport {
+namespace test {
+
+constexpr char ARROW_PATH[] = "test_writer.arrow";
+constexpr char SALES_PATH[] = "test_sales.arrow";
+constexpr char ITEMS_PATH[] = "test_sale_items.arrow";
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+uint64_t readLittleEndian(const std::string& bytes, size_t pos, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = size; i > 0; --i) {
+        value = (value << 8) | static_cast<uint8_t>(bytes[pos + i - 1]);
+    }
+    return value;
+}
+
+/*!
+ * Position of the field [id] of the flatbuffer table at [table]; 0 if it is not set
+*/
+size_t fieldOf(const std::string& bytes, size_t table, size_t id) {
+    const int32_t soffset = static_cast<int32_t>(readLittleEndian(bytes, table, 4));
+    const size_t vtable = table - soffset;
+    if (4 + (2 * id) >= readLittleEndian(bytes, vtable, 2)) {
+        return 0;
+    }
+    const size_t offset = readLittleEndian(bytes, vtable + 4 + (2 * id), 2);
+    return offset ? (table + offset) : 0;
+}
+
+size_t follow(const std::string& bytes, size_t pos) {
+    return pos + readLittleEndian(bytes, pos, 4);
+}
+
+class TestArrowWriter : public testing::Test {
+ public:
+    TestArrowWriter() = default;
+    ~TestArrowWriter() = default;
+    void SetUp() {}
+    void TearDown() {
+        std::remove(ARROW_PATH);
+        std::remove(SALES_PATH);
+        std::remove(ITEMS_PATH);
+    }
+};
+
+TEST_F(TestArrowWriter, FooterIndexesEveryBatch) {
+    ArrowWriter writer(ARROW_PATH, { { "id", ArrowType::UTF8 }, { "total", ArrowType::MONEY } },
+                       2);
+    ASSERT_TRUE(writer.isOpen());
+    for (int i = 0; i < 5; ++i) {
+        writer.append(0, "S" + std::to_string(i));
+        writer.append(1, static_cast<int64_t>(-i));
+        writer.endRow();
+    }
+    ASSERT_TRUE(writer.close());
+
+    const std::string bytes = readFile(ARROW_PATH);
+    ASSERT_GT(bytes.size(), 16);
+    EXPECT_EQ(bytes.substr(0, 6), "ARROW1");
+    EXPECT_EQ(bytes.substr(bytes.size() - 6), "ARROW1");
+    const size_t footerSize = readLittleEndian(bytes, bytes.size() - 10, 4);
+    const size_t footer = follow(bytes, bytes.size() - 10 - footerSize);
+
+    // Footer.recordBatches: Block { offset, metaDataLength, bodyLength }
+    const size_t blocks = follow(bytes, fieldOf(bytes, footer, 3));
+    ASSERT_EQ(readLittleEndian(bytes, blocks, 4), 3);
+    const std::vector<uint64_t> lengths { 2, 2, 1 };
+    for (size_t i = 0; i < lengths.size(); ++i) {
+        const size_t block = blocks + 4 + (i * 24);
+        const size_t offset = readLittleEndian(bytes, block, 8);
+        EXPECT_EQ(offset % 8, 0);
+        EXPECT_EQ(readLittleEndian(bytes, offset, 4), 0xFFFFFFFF);
+        // Message.header is a RecordBatch; its first field is the row count
+        const size_t message = follow(bytes, offset + 8);
+        const size_t batch = follow(bytes, fieldOf(bytes, message, 2));
+        EXPECT_EQ(readLittleEndian(bytes, fieldOf(bytes, batch, 0), 8), lengths[i]);
+    }
+}
+
+TEST_F(TestArrowWriter, EmptyFileHasTheSchemaOnly) {
+    ArrowWriter writer(ARROW_PATH, { { "id", ArrowType::UTF8 } });
+    ASSERT_TRUE(writer.close());
+    const std::string bytes = readFile(ARROW_PATH);
+    const size_t footerSize = readLittleEndian(bytes, bytes.size() - 10, 4);
+    const size_t footer = follow(bytes, bytes.size() - 10 - footerSize);
+    EXPECT_EQ(readLittleEndian(bytes, follow(bytes, fieldOf(bytes, footer, 3)), 4), 0);
+    EXPECT_NE(fieldOf(bytes, footer, 1), 0);
+}
+
+TEST_F(TestArrowWriter, ExportsTheSales) {
+    ASSERT_TRUE(exportSales(SALES_PATH, ITEMS_PATH, "", ""));
+    for (const char* path : { SALES_PATH, ITEMS_PATH }) {
+        const std::string bytes = readFile(path);
+        ASSERT_GT(bytes.size(), 16);
+        EXPECT_EQ(bytes.substr(0, 6), "ARROW1");
+        EXPECT_EQ(bytes.substr(bytes.size() - 6), "ARROW1");
+    }
+    EXPECT_FALSE(exportSales("missing/dir/sales.arrow", ITEMS_PATH, "", ""));
+    // A bad date is not an open range
+    EXPECT_FALSE(exportSales(SALES_PATH, ITEMS_PATH, "2021-13-01", ""));
+    EXPECT_FALSE(exportSales(SALES_PATH, ITEMS_PATH, "", "yesterday"));
+}
+
+TEST_F(TestArrowWriter, DayBoundsCoverTheWholeDay) {
+    int64_t start = 0;
+    int64_t end = 0;
+    int64_t midnight = 0;
+    ASSERT_TRUE(parseBound("2021-01-01", false, &start));
+    ASSERT_TRUE(parseBound("2021-01-02", true, &end));
+    ASSERT_TRUE(db::parseDateTime("2021-01-01 00:00:00", &midnight));
+    EXPECT_EQ(start, midnight);
+    EXPECT_EQ(end, midnight + 2 * 24 * 60 * 60 - 1);
+    ASSERT_TRUE(parseBound("2021/01/02", true, &end));
+    EXPECT_EQ(end, midnight + 2 * 24 * 60 * 60 - 1);
+    ASSERT_TRUE(parseBound("2021-01-02 10:00:00", true, &end));
+    EXPECT_EQ(end, midnight + 34 * 60 * 60);
+    EXPECT_FALSE(parseBound("2021-01-02T10:00:00", false, &start));
+}
+
+}  // namespace test
+}  // namespace arrowexport
+}  // namespace dataprovider
@@ -0,0 +1,132 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "checkoutload.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace backup {
+
+namespace {
+
+// unique over all loads of the process
+std::atomic<uint64_t> gNextSale { 0 };
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+bool isLoadSale(const std::string& id) {
+    return id.compare(0, sizeof(CheckoutLoad::LOAD_SALE_PREFIX) - 1,
+                      CheckoutLoad::LOAD_SALE_PREFIX) == 0;
+}
+
+}  // namespace
+
+constexpr char CheckoutLoad::LOAD_SALE_PREFIX[];
+
+CheckoutLoad::CheckoutLoad(unsigned registers, unsigned itemsPerSale, bool isTransactional)
+    : mRegisters(std::max(registers, 1U)), mItemsPerSale(itemsPerSale),
+      mIsTransactional(isTransactional) {}
+
+CheckoutLoad::~CheckoutLoad() {
+    stop();
+}
+
+void CheckoutLoad::start() {
+    stop();
+    mLatencies.assign(mRegisters, {});
+    {
+        // Decodes the tables from the checkpoint, so the first checkouts do not pay for it
+        const db::Transaction transaction;
+    }
+    mIsRunning = true;
+    for (unsigned i = 0; i < mRegisters; ++i) {
+        mThreads.emplace_back(&CheckoutLoad::run, this, i);
+    }
+}
+
+LatencyReport CheckoutLoad::stop() {
+    mIsRunning = false;
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+    mThreads.clear();
+
+    std::vector<double> latencies;
+    for (const std::vector<double>& ofRegister : mLatencies) {
+        latencies.insert(latencies.end(), ofRegister.begin(), ofRegister.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    LatencyReport report;
+    report.checkouts = latencies.size();
+    report.p50Ms = percentile(latencies, 0.50);
+    report.p99Ms = percentile(latencies, 0.99);
+    report.maxMs = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+void CheckoutLoad::run(unsigned index) {
+    std::vector<double>& latencies = mLatencies[index];
+    while (mIsRunning) {
+        const std::string id = LOAD_SALE_PREFIX + std::to_string(gNextSale++);
+        const auto start = std::chrono::steady_clock::now();
+        if (mIsTransactional) {
+            const db::Transaction transaction;
+            writeSale(id);
+        } else {
+            const db::AutoCommit autoCommit;
+            writeSale(id);
+        }
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        latencies.emplace_back(elapsed.count());
+    }
+}
+
+void CheckoutLoad::writeSale(const std::string& id) {
+    STORAGE().sales().insert(db::SalesTableItem {
+        id, db::formatDateTime(std::time(nullptr)), "3.00", "2.68", "0.32", "0", "3.00", "3.00",
+        "Cash", "0", "", "" });
+    for (unsigned item = 0; item < mItemsPerSale; ++item) {
+        STORAGE().salesItems().insert(db::SalesItemTableItem {
+            id, "LOAD-ITEM-" + std::to_string(item), "load item", "1.00", "1", "1.00" });
+    }
+}
+
+size_t CheckoutLoad::removeSales() {
+    const db::AutoCommit autoCommit;
+    STORAGE().salesItems().removeIf([](const db::SalesItemTableItem& item) {
+        return isLoadSale(item.saleID);
+    });
+    return STORAGE().sales().removeIf([](const db::SalesTableItem& sale) {
+        return isLoadSale(sale.ID);
+    });
+}
+
+}  // namespace backup
+}  // namespace dataprovider
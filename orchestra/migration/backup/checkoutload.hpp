@@ -0,0 +1,86 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_BACKUP_CHECKOUTLOAD_HPP_
+#define ORCHESTRA_MIGRATION_BACKUP_CHECKOUTLOAD_HPP_
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dataprovider {
+namespace backup {
+
+struct LatencyReport {
+    size_t checkouts = 0;
+    double p50Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+};
+
+/*!
+ * Registers that check out sales back to back, to measure the checkout latency
+ *
+ * A checkout is one db::Transaction with the sale and its items, committed like the data
+ * providers commit theirs; its latency is measured until the commit returns. Without
+ * [isTransactional] the sale and its items are written one by one under db::AutoCommit, so
+ * the registers do not wait for each other's transactions (e.g. with sharded sales tables).
+ * The sale IDs start with LOAD_SALE_PREFIX, so removeSales() can clean them up.
+ * e.g. CheckoutLoad load(4);
+ *      load.start();
+ *      DATABASE().backup(path, rate);
+ *      const LatencyReport during = load.stop();
+*/
+class CheckoutLoad {
+ public:
+    static constexpr char LOAD_SALE_PREFIX[] = "LOAD-";
+
+    explicit CheckoutLoad(unsigned registers, unsigned itemsPerSale = 3,
+                          bool isTransactional = true);
+    ~CheckoutLoad();
+
+    void start();
+    /*!
+     * Stops the registers; returns the latencies of the checkouts since start()
+    */
+    LatencyReport stop();
+
+    /*!
+     * Removes the sales and sale items that the loads wrote; returns the number of sales
+    */
+    static size_t removeSales();
+
+ private:
+    const unsigned mRegisters;
+    const unsigned mItemsPerSale;
+    const bool mIsTransactional;
+    std::atomic<bool> mIsRunning { false };
+    std::vector<std::thread> mThreads;
+    // milliseconds, per register
+    std::vector<std::vector<double>> mLatencies;
+
+    void run(unsigned index);
+    void writeSale(const std::string& id);
+};
+
+}  // namespace backup
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_BACKUP_CHECKOUTLOAD_HPP_
@@ -0,0 +1,88 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include "checkoutload.hpp"
+
+namespace {
+
+constexpr auto BASELINE_TIME = std::chrono::seconds(2);
+
+void print(const std::string& phase, const dataprovider::backup::LatencyReport& report) {
+    std::printf("%-9s %8zu checkouts  p50 %7.3f ms  p99 %7.3f ms  max %8.3f ms\n",
+                phase.c_str(), report.checkouts, report.p50Ms, report.p99Ms, report.maxMs);
+}
+
+}  // namespace
+
+/*!
+ * Backs up the database configured in psdb.cfg while registers keep checking out
+ * Prints the checkout latencies before and during the backup, e.g. to tune the rate. The max
+ * also has the checkpoints that the committers write every checkpoint_records log records.
+ * It refuses to run when psdb.cfg puts the products or the sales in another engine.
+ * e.g. psbackup /backup/stackdb.ckpt 8192 4
+ *      (at most 8192 KB/s, with 4 registers; 0 registers backs up without the load)
+*/
+int main(int argc, char* argv[]) {
+    if ((argc < 2) || (argc > 4)) {
+        std::cerr << "Usage: psbackup <file> [KB per second, 0 is unlimited] [registers]"
+                  << std::endl;
+        return 1;
+    }
+    const size_t bytesPerSecond = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) * 1024 : 0;
+    const unsigned registers = (argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 4;
+    using dataprovider::backup::CheckoutLoad;
+    // The image has the StackDB tables only
+    if (!STORAGE().isInStackDB()) {
+        std::cerr << "Cannot back up: product_engine or sales_engine in psdb.cfg is not stackdb"
+                  << std::endl;
+        return 3;
+    }
+
+    // A checkpoint triggered by the log would stall the committer that writes it
+    DATABASE().checkpoint();
+    CheckoutLoad load(registers);
+    if (registers > 0) {
+        load.start();
+        std::this_thread::sleep_for(BASELINE_TIME);
+        print("baseline", load.stop());
+        load.start();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const bool isWritten = DATABASE().backup(argv[1], bytesPerSecond);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (registers > 0) {
+        print("backup", load.stop());
+        CheckoutLoad::removeSales();
+    }
+    if (!isWritten) {
+        std::cerr << "Failed to write " << argv[1] << std::endl;
+        return 2;
+    }
+    std::printf("backup written to %s in %.2f s\n", argv[1], elapsed.count());
+    return 0;
+}
@@ -0,0 +1,65 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <storage/stackdb.hpp>
+#include "checkoutload.hpp"
+
+/*!
+ * Measures how the checkout throughput scales with the registers
+ * Runs 1, 2, 4... registers up to the given count, each for the given seconds, and prints the
+ * checkouts per second and the speed-up over one register. The checkouts write without a
+ * db::Transaction, so with sales_engine=sharded in psdb.cfg the registers commit side by side.
+ * e.g. pscheckout 5 8
+*/
+int main(int argc, char* argv[]) {
+    if (argc > 3) {
+        std::cerr << "Usage: pscheckout [seconds per step] [registers, default one per core]"
+                  << std::endl;
+        return 1;
+    }
+    const unsigned seconds = (argc > 1) ? std::max(std::strtoul(argv[1], nullptr, 10), 1UL) : 3;
+    const unsigned maxRegisters = (argc > 2) ? std::strtoul(argv[2], nullptr, 10)
+                                             : std::max(std::thread::hardware_concurrency(), 1U);
+    using dataprovider::backup::CheckoutLoad;
+
+    // Opens the tables first, so the first step does not pay for it
+    STORAGE();
+    double baseline = 0;
+    for (unsigned registers = 1; registers <= maxRegisters; registers *= 2) {
+        CheckoutLoad load(registers, 3, false);
+        load.start();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        const dataprovider::backup::LatencyReport report = load.stop();
+        const double perSecond = static_cast<double>(report.checkouts) / seconds;
+        if (registers == 1) {
+            baseline = perSecond;
+        }
+        std::printf("%3u registers %10.0f checkouts/s  x%5.2f  p99 %7.3f ms\n", registers,
+                    perSecond, (baseline > 0) ? perSecond / baseline : 0.0, report.p99Ms);
+    }
+    CheckoutLoad::removeSales();
+    return 0;
+}
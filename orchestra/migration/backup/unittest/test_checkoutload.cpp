@@ -0,0 +1,120 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// code under test
+#include <backup/checkoutload.hpp>
+#include <storage/checkpoint.hpp>
+#include <storage/shardedtables.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace backup {
+namespace test {
+
+constexpr char BACKUP_FILE[] = "checkoutload_test.ckpt";
+
+class TestCheckoutLoad : public testing::Test {
+ public:
+    TestCheckoutLoad() = default;
+    ~TestCheckoutLoad() = default;
+    void SetUp() {}
+    void TearDown() {
+        CheckoutLoad::removeSales();
+        std::remove(BACKUP_FILE);
+    }
+};
+
+TEST_F(TestCheckoutLoad, ReportsTheCheckoutLatencies) {
+    const size_t salesBefore = STORAGE().sales().size();
+    CheckoutLoad load(2);
+    load.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const LatencyReport report = load.stop();
+    ASSERT_GT(report.checkouts, 0U);
+    EXPECT_LE(report.p50Ms, report.p99Ms);
+    EXPECT_LE(report.p99Ms, report.maxMs);
+    EXPECT_EQ(STORAGE().sales().size(), salesBefore + report.checkouts);
+
+    EXPECT_EQ(CheckoutLoad::removeSales(), report.checkouts);
+    EXPECT_EQ(STORAGE().sales().size(), salesBefore);
+}
+
+TEST_F(TestCheckoutLoad, CheckoutsGoOnDuringTheBackup) {
+    CheckoutLoad load(2);
+    load.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_TRUE(DATABASE().backup(BACKUP_FILE, 256 * 1024));
+    const LatencyReport report = load.stop();
+    EXPECT_GT(report.checkouts, 0U);
+
+    // The image has whole checkouts only
+    const db::CheckpointImage image(BACKUP_FILE);
+    ASSERT_TRUE(image.isValid());
+    const db::CheckpointSection* sales = image.section(db::TableID::SALES);
+    const db::CheckpointSection* items = image.section(db::TableID::SALES_ITEM);
+    ASSERT_NE(sales, nullptr);
+    ASSERT_NE(items, nullptr);
+    db::ColumnTable<db::SalesColumns> restored;
+    image.load(&restored);
+    size_t loadSales = 0;
+    for (const db::SalesTableItem& sale : restored) {
+        loadSales += (sale.ID.compare(0, 5, CheckoutLoad::LOAD_SALE_PREFIX) == 0) ? 1 : 0;
+    }
+    db::ColumnTable<db::SalesItemColumns> restoredItems;
+    image.load(&restoredItems);
+    size_t loadItems = 0;
+    for (const db::SalesItemTableItem& item : restoredItems) {
+        loadItems += (item.saleID.compare(0, 5, CheckoutLoad::LOAD_SALE_PREFIX) == 0) ? 1 : 0;
+    }
+    EXPECT_EQ(loadItems, loadSales * 3);
+}
+
+TEST_F(TestCheckoutLoad, RegistersWriteShardedSalesSideBySide) {
+    db::ShardOptions options;
+    options.count = 4;
+    const auto shards = std::make_shared<db::ShardedSalesEngine::Shards>("", options, nullptr,
+                                                                         nullptr);
+    db::ReplacedTables replaced;
+    replaced.sales.reset(new db::ShardedSalesEngine(shards));
+    replaced.salesItems.reset(new db::ShardedSalesItemEngine(shards));
+    db::StorageEngine::install(std::unique_ptr<db::StorageEngine>(
+        new db::StackDBEngine(std::move(replaced))));
+
+    CheckoutLoad load(4, 3, false);
+    load.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const LatencyReport report = load.stop();
+    ASSERT_GT(report.checkouts, 0U);
+    EXPECT_EQ(STORAGE().sales().size(), report.checkouts);
+    EXPECT_EQ(STORAGE().salesItems().size(), report.checkouts * 3);
+    EXPECT_EQ(CheckoutLoad::removeSales(), report.checkouts);
+    EXPECT_EQ(STORAGE().salesItems().size(), 0U);
+    db::StorageEngine::install(nullptr);
+}
+
+}  // namespace test
+}  // namespace backup
+}  // namespace dataprovider
@@ -0,0 +1,388 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "bulkloader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "csv.hpp"
+#include <entity/customer.hpp>
+#include <entity/product.hpp>
+#include <generalutils.hpp>  // pscore utility
+#include <logger/loghelper.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include <validator/addressvalidator.hpp>
+#include <validator/contactdetailsvalidator.hpp>
+#include <validator/personvalidator.hpp>
+#include <validator/productvalidator.hpp>
+
+namespace dataprovider {
+namespace bulkload {
+
+namespace {
+
+// records per unit of work; large enough that threads rarely meet on the batch counter
+constexpr size_t BATCH_ROWS = 1024;
+// the header is line 1
+constexpr size_t FIRST_LINE = 2;
+
+typedef std::vector<std::string> Fields;
+
+struct CustomerRecord {
+    db::CustomerTableItem customer;
+    db::AddressTableItem address;
+    db::ContactDetailsTableItem contacts;
+};
+
+/*!
+ * Parsed rows of the records, with the line each row came from
+*/
+template <typename Row>
+struct Parsed {
+    std::vector<Row> rows;
+    std::vector<size_t> lines;
+    std::vector<Rejection> rejected;
+};
+
+/*!
+ * Runs [parse] on every record, in batches spread over [threads] threads
+ * parse(fields, &row, &reason) returns false to reject the record.
+*/
+template <typename Row, typename Parse>
+Parsed<Row> parseAll(const std::vector<std::string>& records, unsigned threads, Parse parse) {
+    const size_t batchCount = (records.size() + BATCH_ROWS - 1) / BATCH_ROWS;
+    std::vector<Parsed<Row>> batches(batchCount);
+    std::atomic<size_t> nextBatch { 0 };
+    const auto work = [&records, &parse, &batches, &nextBatch, batchCount]() {
+        for (size_t batch = nextBatch++; batch < batchCount; batch = nextBatch++) {
+            Parsed<Row>& parsed = batches[batch];
+            const size_t first = batch * BATCH_ROWS;
+            const size_t last = std::min(first + BATCH_ROWS, records.size());
+            parsed.rows.reserve(last - first);
+            for (size_t i = first; i < last; ++i) {
+                Row row;
+                std::string reason;
+                if (parse(splitCsvLine(records[i]), &row, &reason)) {
+                    parsed.rows.emplace_back(std::move(row));
+                    parsed.lines.push_back(i + FIRST_LINE);
+                } else {
+                    parsed.rejected.push_back(Rejection { i + FIRST_LINE, reason });
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    const size_t workerCount = std::min<size_t>(threads, batchCount);
+    for (size_t i = 1; i < workerCount; ++i) {
+        workers.emplace_back(work);
+    }
+    // This thread is one of the workers
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    // Batches are in file order
+    Parsed<Row> all;
+    all.rows.reserve(records.size());
+    all.lines.reserve(records.size());
+    for (Parsed<Row>& parsed : batches) {
+        std::move(parsed.rows.begin(), parsed.rows.end(), std::back_inserter(all.rows));
+        all.lines.insert(all.lines.end(), parsed.lines.begin(), parsed.lines.end());
+        std::move(parsed.rejected.begin(), parsed.rejected.end(),
+                  std::back_inserter(all.rejected));
+    }
+    return all;
+}
+
+bool hasFieldCount(const Fields& fields, size_t count, std::string* reason) {
+    if (fields.size() != count) {
+        *reason = "Expected " + std::to_string(count) + " fields, found "
+                  + std::to_string(fields.size());
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * Returns false with the first error of [result] as the reason
+*/
+bool isValid(const entity::validator::Errors& result, std::string* reason) {
+    if (result.empty()) {
+        return true;
+    }
+    *reason = result.begin()->second;
+    return false;
+}
+
+bool isAmount(const std::string& value) {
+    return !value.empty() && utility::isDouble(value);
+}
+
+void addDuplicates(const std::vector<size_t>& duplicates, const std::vector<size_t>& lines,
+                   std::vector<Rejection>* rejected) {
+    for (const size_t duplicate : duplicates) {
+        rejected->push_back(Rejection { lines[duplicate], "Duplicate key" });
+    }
+}
+
+void finish(const std::string& what, std::chrono::steady_clock::time_point start,
+            ImportReport* report) {
+    report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                    - start).count();
+    std::sort(report->rejected.begin(), report->rejected.end(),
+              [](const Rejection& left, const Rejection& right) {
+                  return left.line < right.line;
+              });
+    LOG_INFO("Loaded %s of %s %s in %s s (%s rows/s), %s rejected",
+             std::to_string(report->loaded).c_str(), std::to_string(report->rows).c_str(),
+             what.c_str(), utility::toString(report->seconds).c_str(),
+             std::to_string(static_cast<size_t>(report->rowsPerSecond())).c_str(),
+             std::to_string(report->rejected.size()).c_str());
+}
+
+}  // namespace
+
+BulkLoader::BulkLoader(unsigned threads)
+    : mThreads(threads ? threads : std::max(1U, std::thread::hardware_concurrency())) {}
+
+ImportReport BulkLoader::loadProducts(const std::string& path) const {
+    const auto start = std::chrono::steady_clock::now();
+    ImportReport report;
+    std::vector<std::string> records;
+    if (!readCsvLines(path, &records)) {
+        LOG_ERROR("Cannot open %s", path.c_str());
+        return report;
+    }
+    report.rows = records.size();
+
+    // Fetched once for the whole file
+    std::vector<std::string> uoms;
+    for (const db::UOMTableItem& uom : DATABASE().SELECT_UOM_TABLE()) {
+        uoms.emplace_back(uom.abbreviation);
+    }
+    std::vector<std::string> categories;
+    for (const db::CategoryTableItem& category : DATABASE().SELECT_CATEGORY_TABLE()) {
+        categories.emplace_back(category.category_name);
+    }
+    Parsed<db::ProductTableItem> parsed = parseAll<db::ProductTableItem>(records, mThreads,
+        [&uoms, &categories](const Fields& fields, db::ProductTableItem* row,
+                             std::string* reason) {
+            if (!hasFieldCount(fields, 13, reason)) {
+                return false;
+            }
+            const entity::Product product(fields[0], fields[1], fields[2], fields[3],
+                                          fields[4], fields[5], fields[6], fields[7],
+                                          fields[8], fields[9], fields[10], fields[11],
+                                          fields[12]);
+            entity::validator::ProductValidator validator(product, uoms, categories);
+            if (!isValid(validator.result(), reason)) {
+                return false;
+            }
+            *row = db::ProductTableItem { fields[0], fields[1], fields[2], fields[3],
+                                          fields[4], fields[5], fields[6], fields[7],
+                                          fields[8], fields[9], fields[10], fields[11],
+                                          fields[12] };
+            return true;
+        });
+    report.rejected = std::move(parsed.rejected);
+
+    std::vector<size_t> duplicates;
+    {
+        const db::Transaction transaction;
+        report.loaded = STORAGE().products().insertAll(parsed.rows, &duplicates);
+    }
+    // The product engine can keep its own files
+    STORAGE().commit();
+    addDuplicates(duplicates, parsed.lines, &report.rejected);
+    finish("products", start, &report);
+    return report;
+}
+
+ImportReport BulkLoader::loadCustomers(const std::string& path) const {
+    const auto start = std::chrono::steady_clock::now();
+    ImportReport report;
+    std::vector<std::string> records;
+    if (!readCsvLines(path, &records)) {
+        LOG_ERROR("Cannot open %s", path.c_str());
+        return report;
+    }
+    report.rows = records.size();
+
+    Parsed<CustomerRecord> parsed = parseAll<CustomerRecord>(records, mThreads,
+        [](const Fields& fields, CustomerRecord* row, std::string* reason) {
+            if (!hasFieldCount(fields, 14, reason)) {
+                return false;
+            }
+            if (fields[0].empty()) {
+                *reason = "Customer ID cannot be empty.";
+                return false;
+            }
+            const entity::Customer customer(fields[0], fields[1], fields[2], fields[3],
+                                            fields[4], fields[5]);
+            const entity::Address address(fields[6], fields[7], fields[8], fields[9],
+                                          fields[10]);
+            const entity::ContactDetails contacts(fields[11], fields[12], fields[13]);
+            if (!isValid(entity::validator::PersonValidator(customer).result(), reason)
+                || !isValid(entity::validator::AddressValidator(address).result(), reason)
+                || !isValid(entity::validator::ContactDetailsValidator(contacts).result(),
+                            reason)) {
+                return false;
+            }
+            *row = CustomerRecord {
+                db::CustomerTableItem { fields[0], fields[1], fields[2], fields[3], fields[4],
+                                        fields[5] },
+                db::AddressTableItem { fields[0], fields[6], fields[7], fields[8], fields[9],
+                                       fields[10] },
+                db::ContactDetailsTableItem { fields[0], fields[11], fields[12], fields[13] } };
+            return true;
+        });
+    report.rejected = std::move(parsed.rejected);
+
+    std::vector<db::CustomerTableItem> customers;
+    customers.reserve(parsed.rows.size());
+    for (const CustomerRecord& record : parsed.rows) {
+        customers.emplace_back(record.customer);
+    }
+    std::vector<size_t> duplicates;
+    {
+        const db::Transaction transaction;
+        report.loaded = DATABASE().SELECT_CUSTOMER_TABLE().insertAll(customers, &duplicates);
+        // The details of the rejected duplicates would belong to the existing customer
+        std::vector<db::AddressTableItem> addresses;
+        std::vector<db::ContactDetailsTableItem> contacts;
+        addresses.reserve(report.loaded);
+        contacts.reserve(report.loaded);
+        for (size_t i = 0, duplicate = 0; i < parsed.rows.size(); ++i) {
+            if ((duplicate < duplicates.size()) && (duplicates[duplicate] == i)) {
+                ++duplicate;
+                continue;
+            }
+            addresses.emplace_back(std::move(parsed.rows[i].address));
+            contacts.emplace_back(std::move(parsed.rows[i].contacts));
+        }
+        DATABASE().SELECT_ADDRESS_TABLE().insertAll(addresses);
+        DATABASE().SELECT_CONTACTS_TABLE().insertAll(contacts);
+    }
+    addDuplicates(duplicates, parsed.lines, &report.rejected);
+    finish("customers", start, &report);
+    return report;
+}
+
+ImportReport BulkLoader::loadSales(const std::string& salesPath,
+                                   const std::string& itemsPath) const {
+    const auto start = std::chrono::steady_clock::now();
+    ImportReport report;
+    std::vector<std::string> saleRecords;
+    std::vector<std::string> itemRecords;
+    if (!readCsvLines(salesPath, &saleRecords) || !readCsvLines(itemsPath, &itemRecords)) {
+        LOG_ERROR("Cannot open %s or %s", salesPath.c_str(), itemsPath.c_str());
+        return report;
+    }
+    report.rows = saleRecords.size() + itemRecords.size();
+
+    Parsed<db::SalesTableItem> sales = parseAll<db::SalesTableItem>(saleRecords, mThreads,
+        [](const Fields& fields, db::SalesTableItem* row, std::string* reason) {
+            if (!hasFieldCount(fields, 12, reason)) {
+                return false;
+            }
+            int64_t seconds = 0;
+            if (fields[0].empty()) {
+                *reason = "Sale ID cannot be empty.";
+                return false;
+            }
+            if (!db::parseDateTime(fields[1], &seconds)) {
+                *reason = "Invalid date and time.";
+                return false;
+            }
+            // subtotal .. amount_paid, and change
+            for (const size_t amount : { 2, 3, 4, 5, 6, 7, 9 }) {
+                if (!isAmount(fields[amount])) {
+                    *reason = "Invalid amount " + fields[amount] + ".";
+                    return false;
+                }
+            }
+            *row = db::SalesTableItem { fields[0], fields[1], fields[2], fields[3], fields[4],
+                                        fields[5], fields[6], fields[7], fields[8], fields[9],
+                                        fields[10], fields[11] };
+            return true;
+        });
+    Parsed<db::SalesItemTableItem> items = parseAll<db::SalesItemTableItem>(itemRecords,
+        mThreads,
+        [](const Fields& fields, db::SalesItemTableItem* row, std::string* reason) {
+            if (!hasFieldCount(fields, 6, reason)) {
+                return false;
+            }
+            if (fields[0].empty() || fields[1].empty()) {
+                *reason = "Sale ID and product ID cannot be empty.";
+                return false;
+            }
+            if (!isAmount(fields[3]) || !isAmount(fields[5]) || !utility::isNumber(fields[4])) {
+                *reason = "Invalid price or quantity.";
+                return false;
+            }
+            *row = db::SalesItemTableItem { fields[0], fields[1], fields[2], fields[3],
+                                            fields[4], fields[5] };
+            return true;
+        });
+    report.rejected = std::move(sales.rejected);
+    for (Rejection& rejection : items.rejected) {
+        rejection.reason = "Sale item: " + rejection.reason;
+        report.rejected.emplace_back(std::move(rejection));
+    }
+
+    std::vector<size_t> duplicates;
+    {
+        const db::Transaction transaction;
+        report.loaded = STORAGE().sales().insertAll(sales.rows, &duplicates);
+        std::unordered_set<std::string> saleIDs;
+        saleIDs.reserve(sales.rows.size());
+        for (const db::SalesTableItem& sale : sales.rows) {
+            saleIDs.insert(sale.ID);
+        }
+        std::vector<db::SalesItemTableItem> validItems;
+        validItems.reserve(items.rows.size());
+        for (size_t i = 0; i < items.rows.size(); ++i) {
+            const std::string& saleID = items.rows[i].saleID;
+            // Loaded now, or before
+            if ((saleIDs.count(saleID) == 0) && !STORAGE().sales().get(saleID, nullptr)) {
+                report.rejected.push_back(Rejection { items.lines[i],
+                                                      "Sale item: Unknown sale " + saleID });
+                continue;
+            }
+            validItems.emplace_back(std::move(items.rows[i]));
+        }
+        report.loaded += STORAGE().salesItems().insertAll(validItems);
+    }
+    STORAGE().commit();
+    addDuplicates(duplicates, sales.lines, &report.rejected);
+    finish("sales and sale items", start, &report);
+    return report;
+}
+
+}  // namespace bulkload
+}  // namespace dataprovider
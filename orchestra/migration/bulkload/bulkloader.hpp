@@ -0,0 +1,89 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_BULKLOAD_BULKLOADER_HPP_
+#define ORCHESTRA_MIGRATION_BULKLOAD_BULKLOADER_HPP_
+#include <string>
+#include <vector>
+
+namespace dataprovider {
+namespace bulkload {
+
+/*!
+ * A CSV record that was not loaded; [line] counts the header as line 1
+*/
+struct Rejection {
+    size_t line;
+    std::string reason;
+};
+
+struct ImportReport {
+    // records read, without the header
+    size_t rows = 0;
+    size_t loaded = 0;
+    // in file order
+    std::vector<Rejection> rejected;
+    double seconds = 0;
+
+    inline double rowsPerSecond() const {
+        return (seconds > 0) ? rows / seconds : 0;
+    }
+};
+
+/*!
+ * Loads CSV exports into StackDB, e.g. a supplier catalog when onboarding a store
+ *
+ * The records are parsed and validated in batches on all cores, the same way the
+ * controllers validate a single save (ProductValidator, PersonValidator, ...). The valid
+ * rows are then appended to each table at once, in one transaction: readers see the whole
+ * file or nothing of it, and so does recovery after a crash. A record whose key already
+ * exists (in the table or earlier in the file) is rejected.
+ *
+ * Columns, in this order after a header line:
+ *   products:  barcode, sku, name, description, category, brand, uom, stock, status,
+ *              original_price, sell_price, supplier_name, supplier_code
+ *   customers: ID, firstname, middlename, lastname, birthdate, gender, line1, line2,
+ *              city_town, province, zip, email, phone1, phone2
+ *   sales:     ID, date_time, subtotal, taxable_amount, vat, discount, total, amount_paid,
+ *              payment_type, change, cashierID, customerID
+ *   sale items: saleID, productID, product_name, unit_price, quantity, total_price
+*/
+class BulkLoader {
+ public:
+    /*!
+     * [threads] is the number of parser threads; 0 is one per core
+    */
+    explicit BulkLoader(unsigned threads = 0);
+    ~BulkLoader() = default;
+
+    ImportReport loadProducts(const std::string& path) const;
+    ImportReport loadCustomers(const std::string& path) const;
+    /*!
+     * Items of a sale that is neither in [salesPath] nor in the database are rejected
+    */
+    ImportReport loadSales(const std::string& salesPath, const std::string& itemsPath) const;
+
+ private:
+    unsigned mThreads;
+};
+
+}  // namespace bulkload
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_BULKLOAD_BULKLOADER_HPP_
@@ -0,0 +1,73 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "csv.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace dataprovider {
+namespace bulkload {
+
+std::vector<std::string> splitCsvLine(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool isQuoted = false;
+    for (size_t pos = 0; pos < line.size(); ++pos) {
+        const char c = line[pos];
+        if (isQuoted) {
+            if (c != '"') {
+                fields.back() += c;
+            } else if ((pos + 1 < line.size()) && (line[pos + 1] == '"')) {
+                fields.back() += '"';
+                ++pos;
+            } else {
+                isQuoted = false;
+            }
+        } else if (c == '"') {
+            isQuoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+bool readCsvLines(const std::string& path, std::vector<std::string>* lines) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string line;
+    // Skip the header
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        // Files written on Windows
+        if (!line.empty() && (line.back() == '\r')) {
+            line.pop_back();
+        }
+        lines->emplace_back(std::move(line));
+    }
+    return true;
+}
+
+}  // namespace bulkload
+}  // namespace dataprovider
@@ -0,0 +1,44 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_BULKLOAD_CSV_HPP_
+#define ORCHESTRA_MIGRATION_BULKLOAD_CSV_HPP_
+#include <string>
+#include <vector>
+
+namespace dataprovider {
+namespace bulkload {
+
+/*!
+ * Splits one CSV record into its fields
+ * A field can be quoted to contain commas; "" inside quotes is a literal quote.
+ * A record cannot span lines.
+*/
+std::vector<std::string> splitCsvLine(const std::string& line);
+
+/*!
+ * Reads the records of a CSV file, without its header line
+ * Returns false if the file cannot be opened
+*/
+bool readCsvLines(const std::string& path, std::vector<std::string>* lines);
+
+}  // namespace bulkload
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_BULKLOAD_CSV_HPP_
@@ -0,0 +1,53 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <iostream>
+#include <string>
+#include "bulkloader.hpp"
+
+/*!
+ * Loads CSV exports into the database configured in psdb.cfg
+ * e.g. psimport products catalog.csv
+ *      psimport sales sales.csv sale_items.csv
+*/
+int main(int argc, char* argv[]) {
+    const std::string what = (argc > 1) ? argv[1] : "";
+    const dataprovider::bulkload::BulkLoader loader;
+    dataprovider::bulkload::ImportReport report;
+    if ((what == "products") && (argc == 3)) {
+        report = loader.loadProducts(argv[2]);
+    } else if ((what == "customers") && (argc == 3)) {
+        report = loader.loadCustomers(argv[2]);
+    } else if ((what == "sales") && (argc == 4)) {
+        report = loader.loadSales(argv[2], argv[3]);
+    } else {
+        std::cerr << "Usage: psimport products <file.csv>\n"
+                  << "       psimport customers <file.csv>\n"
+                  << "       psimport sales <sales.csv> <sale_items.csv>" << std::endl;
+        return 1;
+    }
+    std::cout << "Loaded " << report.loaded << " of " << report.rows << " rows in "
+              << report.seconds << " s (" << static_cast<size_t>(report.rowsPerSecond())
+              << " rows/s)" << std::endl;
+    for (const dataprovider::bulkload::Rejection& rejection : report.rejected) {
+        std::cout << "Rejected line " << rejection.line << ": " << rejection.reason << std::endl;
+    }
+    return report.rejected.empty() ? 0 : 2;
+}
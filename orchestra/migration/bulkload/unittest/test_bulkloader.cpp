@@ -0,0 +1,135 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// code under test
+#include <bulkload/bulkloader.hpp>
+#include <bulkload/csv.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace bulkload {
+namespace test {
+
+constexpr char PRODUCTS_PATH[] = "test_products.csv";
+constexpr char SALES_PATH[] = "test_sales.csv";
+constexpr char ITEMS_PATH[] = "test_sale_items.csv";
+
+class TestBulkLoader : public testing::Test {
+ public:
+    TestBulkLoader() = default;
+    ~TestBulkLoader() = default;
+    void SetUp() {}
+    void TearDown() {
+        for (const char* barcode : { "BULK-1", "BULK-2", "BULK-3" }) {
+            DATABASE().SELECT_PRODUCT_TABLE().erase(barcode);
+        }
+        DATABASE().SELECT_SALES_TABLE().erase("BULK-S1");
+        DATABASE().SELECT_SALES_ITEM_TABLE().eraseIf([](const db::SalesItemTableItem& item) {
+            return item.saleID == "BULK-S1";
+        });
+        std::remove(PRODUCTS_PATH);
+        std::remove(SALES_PATH);
+        std::remove(ITEMS_PATH);
+    }
+
+    void write(const std::string& path, const std::vector<std::string>& lines) const {
+        std::ofstream file(path);
+        for (const std::string& line : lines) {
+            file << line << "\n";
+        }
+    }
+
+    // more threads than batches
+    const BulkLoader loader { 4 };
+};
+
+TEST(TestCsv, SplitsQuotedFields) {
+    EXPECT_EQ(splitCsvLine("a,\"b, c\",,\"say \"\"hi\"\"\""),
+              std::vector<std::string>({ "a", "b, c", "", "say \"hi\"" }));
+    EXPECT_EQ(splitCsvLine(""), std::vector<std::string>({ "" }));
+}
+
+TEST_F(TestBulkLoader, ProductsAreValidatedAndDuplicatesRejected) {
+    write(PRODUCTS_PATH, {
+        "barcode,sku,name,description,category,brand,uom,stock,status,original_price,"
+        "sell_price,supplier_name,supplier_code",
+        "BULK-1,SKU1,Water,,Beverage,Brand,L,10,ACTIVE,1.00,2.00,Supplier,S1",
+        "BULK-2,SKU2,Juice,\"Orange, 1L\",Beverage,Brand,L,5,ACTIVE,3.00,2.00,Supplier,S1",
+        "BULK-2,SKU2,Juice,\"Orange, 1L\",Beverage,Brand,L,5,ACTIVE,2.00,3.00,Supplier,S1",
+        "BULK-3,SKU3,Tea,,Toys,Brand,pc,1,ACTIVE,1.00,1.00,Supplier,S1",
+        "BULK-1,SKU1,Water,,Beverage,Brand,L,10,ACTIVE,1.00,2.00,Supplier,S1",
+        "BULK-4,too,few,fields" });
+    const ImportReport report = loader.loadProducts(PRODUCTS_PATH);
+
+    EXPECT_EQ(report.rows, 6);
+    EXPECT_EQ(report.loaded, 2);
+    ASSERT_EQ(report.rejected.size(), 4);
+    // sell price below the original price; unknown category; duplicate; field count
+    EXPECT_EQ(report.rejected[0].line, 3);
+    EXPECT_EQ(report.rejected[1].line, 5);
+    EXPECT_EQ(report.rejected[2].line, 6);
+    EXPECT_EQ(report.rejected[2].reason, "Duplicate key");
+    EXPECT_EQ(report.rejected[3].line, 7);
+
+    db::ProductTableItem product;
+    ASSERT_TRUE(DATABASE().SELECT_PRODUCT_TABLE().find("BULK-2", &product));
+    EXPECT_EQ(product.description, "Orange, 1L");
+    EXPECT_EQ(product.sell_price, "3.00");
+    EXPECT_FALSE(DATABASE().SELECT_PRODUCT_TABLE().contains("BULK-3"));
+}
+
+TEST_F(TestBulkLoader, ItemsOfUnknownSalesAreRejected) {
+    write(SALES_PATH, {
+        "ID,date_time,subtotal,taxable_amount,vat,discount,total,amount_paid,payment_type,"
+        "change,cashierID,customerID",
+        "BULK-S1,2021-05-16 10:11:20,2.00,1.79,0.21,0,2.00,5.00,Cash,3.00,C1,CU1",
+        "BULK-S2,2021-13-16 10:11:20,2.00,1.79,0.21,0,2.00,5.00,Cash,3.00,C1,CU1" });
+    write(ITEMS_PATH, {
+        "saleID,productID,product_name,unit_price,quantity,total_price",
+        "BULK-S1,P1,Water,1.00,2,2.00",
+        "BULK-S2,P1,Water,1.00,2,2.00",
+        "BULK-S1,P2,Juice,1.00,x,1.00" });
+    const ImportReport report = loader.loadSales(SALES_PATH, ITEMS_PATH);
+
+    EXPECT_EQ(report.rows, 5);
+    EXPECT_EQ(report.loaded, 2);
+    EXPECT_EQ(report.rejected.size(), 3);
+    EXPECT_TRUE(DATABASE().SELECT_SALES_TABLE().contains("BULK-S1"));
+    EXPECT_FALSE(DATABASE().SELECT_SALES_TABLE().contains("BULK-S2"));
+    const auto items = DATABASE().SELECT_SALES_ITEM_TABLE().snapshot();
+    EXPECT_EQ(items.columns().findSale("BULK-S1").size(), 1U);
+    EXPECT_EQ(items.columns().findSale("BULK-S2").size(), 0U);
+}
+
+TEST_F(TestBulkLoader, MissingFileLoadsNothing) {
+    const ImportReport report = loader.loadProducts("missing.csv");
+    EXPECT_EQ(report.rows, 0);
+    EXPECT_EQ(report.loaded, 0);
+}
+
+}  // namespace test
+}  // namespace bulkload
+}  // namespace dataprovider
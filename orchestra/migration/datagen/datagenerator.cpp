@@ -0,0 +1,473 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "datagenerator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <generalutils.hpp>  // pscore utility
+#include <generator/chargenerator.hpp>
+#include <logger/loghelper.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+
+namespace dataprovider {
+namespace datagen {
+
+namespace {
+
+// rows per unit of work of a thread
+constexpr size_t CHUNK_ROWS = 4096;
+constexpr int64_t SECONDS_PER_DAY = 86400;
+constexpr int64_t VAT_PERCENT = 12;
+
+enum class Stream : uint64_t {
+    PRODUCT = 1,
+    CUSTOMER = 2,
+    EMPLOYEE = 3,
+    SALE = 4
+};
+
+const std::vector<std::string> FIRST_NAMES { "Juan", "Maria", "Jose", "Ana", "Pedro", "Rosa",
+    "Carlo", "Liza", "Mark", "Grace", "Paolo", "Joy", "Ramon", "Bea", "Miguel", "Kristine",
+    "Andres", "Camille", "Rafael", "Nina" };
+const std::vector<std::string> LAST_NAMES { "Santos", "Reyes", "Cruz", "Bautista", "Garcia",
+    "Mendoza", "Torres", "Flores", "Villanueva", "Ramos", "Castillo", "Aquino", "Navarro",
+    "Dela Cruz", "Gonzales", "Lopez" };
+// city, province, ZIP
+const std::vector<std::vector<std::string>> CITIES { { "Cebu City", "Cebu", "6000" },
+    { "Lapu-Lapu City", "Cebu", "6015" }, { "Davao City", "Davao", "8000" },
+    { "Quezon City", "Metro Manila", "1100" }, { "Makati", "Metro Manila", "1200" },
+    { "Iloilo City", "Iloilo", "5000" }, { "Baguio", "Benguet", "2600" } };
+const std::vector<std::string> STREETS { "Petunia St", "Mabini St", "Rizal Ave", "Osmena Blvd",
+    "Luna St", "Bonifacio St", "Magsaysay Ave" };
+const std::vector<std::string> POSITIONS { "Cashier", "Cashier", "Cashier", "Manager",
+    "Stock Clerk", "Bagger" };
+// category -> product nouns; the unit of measurement is per category
+const std::vector<std::vector<std::string>> CATEGORIES {
+    { "Grocery", "pc", "Rice", "Noodles", "Sardines", "Corned Beef", "Vinegar", "Soy Sauce" },
+    { "Beverage", "L", "Cola", "Juice", "Iced Tea", "Water", "Coffee", "Energy Drink" },
+    { "Snacks", "pc", "Chips", "Crackers", "Cookies", "Peanuts", "Candy", "Chocolate" },
+    { "Medicine", "pc", "Paracetamol", "Ibuprofen", "Cough Syrup", "Vitamins", "Antacid" },
+    { "Personal Care", "pc", "Shampoo", "Soap", "Toothpaste", "Lotion", "Deodorant" },
+    { "Household", "pc", "Detergent", "Bleach", "Dishwashing Liquid", "Trash Bags" },
+    { "Dairy", "mL", "Milk", "Yogurt", "Cheese", "Butter", "Cream" },
+    { "Frozen", "kg", "Chicken", "Pork", "Fish", "Hotdog", "Ice Cream" } };
+const std::vector<std::string> SIZES { "Small", "Regular", "Large", "Family Size", "Value Pack" };
+const std::vector<std::string> BRANDS { "Lucky Me", "Del Monte", "Nestle", "Unilever",
+    "Universal Robina", "San Miguel", "Monde", "Century", "Purefoods", "Rebisco", "Jack n Jill",
+    "Colgate", "Unilab", "Magnolia" };
+// share of the sales in each hour from 08:00 to 21:59
+const std::vector<double> HOUR_WEIGHTS { 3, 4, 5, 7, 10, 9, 6, 5, 6, 8, 11, 10, 7, 4 };
+constexpr int64_t OPENING_HOUR = 8;
+// share of the baskets with 1, 2, ... items
+const std::vector<double> BASKET_WEIGHTS { 30, 22, 15, 10, 7, 5, 4, 3, 2, 1, 0.5, 0.5 };
+const std::vector<std::string> PAYMENT_TYPES { "Cash", "Cash", "Cash", "Cash", "Cash", "Cash",
+    "Cash", "Card", "Card", "E-Wallet" };
+const std::vector<std::string> ID_TYPES { "SSS", "UMID", "Driver's License", "Passport" };
+
+/*!
+ * SplitMix64; cheap to seed, so every row gets its own engine
+ * Satisfies UniformRandomBitGenerator, so it also works with utility::chargenerator.
+*/
+class RowEngine {
+ public:
+    typedef uint64_t result_type;
+
+    RowEngine(uint64_t seed, Stream stream, size_t index)
+        : mState(seed ^ (static_cast<uint64_t>(stream) << 56)) {
+        mState = (*this)() ^ index;
+    }
+
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    static constexpr result_type max() {
+        return UINT64_MAX;
+    }
+
+    result_type operator()() {
+        uint64_t z = (mState += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /*!
+     * Uniform in [0, count); the modulo bias is negligible for the small counts used here
+    */
+    size_t below(size_t count) {
+        return static_cast<size_t>((*this)() % count);
+    }
+
+    /*!
+     * Uniform in [0, 1)
+    */
+    double unit() {
+        return ((*this)() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    template <typename T>
+    const T& pick(const std::vector<T>& values) {
+        return values[below(values.size())];
+    }
+
+ private:
+    uint64_t mState;
+};
+
+/*!
+ * Index of [weights] for a quantile [q] in [0, 1); [fraction] gets the position inside it
+*/
+size_t weightedIndex(const std::vector<double>& weights, double q, double* fraction = nullptr) {
+    double total = 0;
+    for (const double weight : weights) {
+        total += weight;
+    }
+    double target = q * total;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        if (target < weights[i]) {
+            if (fraction) {
+                *fraction = target / weights[i];
+            }
+            return i;
+        }
+        target -= weights[i];
+    }
+    if (fraction) {
+        *fraction = 0;
+    }
+    return weights.size() - 1;
+}
+
+std::string toBase36(size_t value, size_t width) {
+    static constexpr char DIGITS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::string text(width, '0');
+    for (size_t i = width; (i > 0) && (value > 0); --i, value /= 36) {
+        text[i - 1] = DIGITS[value % 36];
+    }
+    return text;
+}
+
+std::string digits(RowEngine* engine, size_t count) {
+    std::string text;
+    for (size_t i = 0; i < count; ++i) {
+        text += static_cast<char>('0' + engine->below(10));
+    }
+    return text;
+}
+
+std::string birthdate(RowEngine* engine) {
+    // Adults, YYYY/MM/DD like the sample data
+    const size_t year = 1950 + engine->below(55);
+    const size_t month = 1 + engine->below(12);
+    const size_t day = 1 + engine->below(28);
+    std::string text = std::to_string(year) + "/";
+    text += (month < 10 ? "0" : "") + std::to_string(month) + "/";
+    text += (day < 10 ? "0" : "") + std::to_string(day);
+    return text;
+}
+
+template <typename PersonRow>
+void fillPersonDetails(const std::string& id, RowEngine* engine, PersonRows<PersonRow>* rows) {
+    const std::vector<std::string>& city = engine->pick(CITIES);
+    rows->address = db::AddressTableItem { id,
+        "Lot " + std::to_string(1 + engine->below(30)) + ", Blk "
+            + std::to_string(1 + engine->below(50)) + ", " + engine->pick(STREETS),
+        "", city[0], city[1], city[2] };
+    rows->contacts = db::ContactDetailsTableItem { id,
+        utility::toLower(id) + "@example.com", "09" + digits(engine, 9), "" };
+    rows->personalId = db::PersonalIdTableItem { id, engine->pick(ID_TYPES),
+        utility::chargenerator::generateChars(12, engine) };
+}
+
+/*!
+ * Generates rows [0, count) in chunks on [threads] threads, then calls insert(chunk) for each
+ * chunk in order; one round of chunks is in memory at a time
+*/
+template <typename Chunk, typename Generate, typename Insert>
+void generateInRounds(size_t count, unsigned threads, Generate generate, Insert insert) {
+    const size_t roundRows = CHUNK_ROWS * threads;
+    for (size_t first = 0; first < count; first += roundRows) {
+        const size_t last = std::min(first + roundRows, count);
+        std::vector<Chunk> chunks((last - first + CHUNK_ROWS - 1) / CHUNK_ROWS);
+        const auto work = [&generate, &chunks, first, last](size_t chunk) {
+            const size_t begin = first + (chunk * CHUNK_ROWS);
+            const size_t end = std::min(begin + CHUNK_ROWS, last);
+            for (size_t i = begin; i < end; ++i) {
+                generate(i, &chunks[chunk]);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t chunk = 1; chunk < chunks.size(); ++chunk) {
+            workers.emplace_back(work, chunk);
+        }
+        work(0);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        const db::Transaction transaction;
+        for (Chunk& chunk : chunks) {
+            insert(&chunk);
+        }
+    }
+}
+
+template <typename PersonRow>
+struct PersonChunk {
+    std::vector<PersonRow> persons;
+    std::vector<db::AddressTableItem> addresses;
+    std::vector<db::ContactDetailsTableItem> contacts;
+    std::vector<db::PersonalIdTableItem> personalIds;
+
+    void add(PersonRows<PersonRow>&& rows) {
+        persons.emplace_back(std::move(rows.person));
+        addresses.emplace_back(std::move(rows.address));
+        contacts.emplace_back(std::move(rows.contacts));
+        personalIds.emplace_back(std::move(rows.personalId));
+    }
+};
+
+template <typename PersonRow>
+size_t insertPersons(PersonChunk<PersonRow>* chunk,
+                     size_t (*insertPerson)(const std::vector<PersonRow>&)) {
+    return insertPerson(chunk->persons)
+        + DATABASE().SELECT_ADDRESS_TABLE().insertAll(chunk->addresses)
+        + DATABASE().SELECT_CONTACTS_TABLE().insertAll(chunk->contacts)
+        + DATABASE().SELECT_PERSONAL_ID_TABLE().insertAll(chunk->personalIds);
+}
+
+struct SaleChunk {
+    std::vector<db::SalesTableItem> sales;
+    std::vector<db::SalesItemTableItem> items;
+};
+
+/*!
+ * Adds the categories and units of measurement the products use, if they are missing
+*/
+size_t addLookupTables() {
+    std::vector<std::string> categories;
+    for (const db::CategoryTableItem& category : DATABASE().SELECT_CATEGORY_TABLE()) {
+        categories.push_back(category.category_name);
+    }
+    std::vector<std::string> uoms;
+    for (const db::UOMTableItem& uom : DATABASE().SELECT_UOM_TABLE()) {
+        uoms.push_back(uom.abbreviation);
+    }
+    const db::Transaction transaction;
+    size_t rows = 0;
+    for (const std::vector<std::string>& category : CATEGORIES) {
+        if (std::find(categories.begin(), categories.end(), category[0]) == categories.end()) {
+            categories.push_back(category[0]);
+            // new id = category_table_size + 1, same as InventoryDataProvider::createCategory
+            rows += DATABASE().SELECT_CATEGORY_TABLE().insert(db::CategoryTableItem {
+                std::to_string(categories.size()), category[0] });
+        }
+        if (std::find(uoms.begin(), uoms.end(), category[1]) == uoms.end()) {
+            uoms.push_back(category[1]);
+            rows += DATABASE().SELECT_UOM_TABLE().insert(db::UOMTableItem {
+                "GEN-" + category[1], category[1], category[1] });
+        }
+    }
+    return rows;
+}
+
+}  // namespace
+
+DataGenerator::DataGenerator(uint64_t seed, unsigned threads)
+    : mSeed(seed),
+      mThreads(threads ? threads : std::max(1U, std::thread::hardware_concurrency())) {}
+
+std::string DataGenerator::productID(size_t index) {
+    // EAN-13 sized, with the Philippine prefix
+    return std::to_string(4800000000000ULL + index);
+}
+
+std::string DataGenerator::customerID(size_t index) {
+    return "CM" + toBase36(index, 9);
+}
+
+std::string DataGenerator::employeeID(size_t index) {
+    return std::to_string(30000000ULL + index);
+}
+
+std::string DataGenerator::saleID(size_t index) {
+    return std::to_string(1000000000ULL + index);
+}
+
+db::ProductTableItem DataGenerator::product(size_t index) const {
+    RowEngine engine(mSeed, Stream::PRODUCT, index);
+    const std::vector<std::string>& category = engine.pick(CATEGORIES);
+    const std::string& noun = category[2 + engine.below(category.size() - 2)];
+    const std::string& brand = engine.pick(BRANDS);
+    // Mostly cheap items: 5.00 to 1,000.00, skewed low
+    const double u = engine.unit();
+    const int64_t originalCents = 500 + static_cast<int64_t>(u * u * 99500);
+    const int64_t sellCents = originalCents + (originalCents * (5 + engine.below(36)) / 100);
+    const size_t supplier = engine.below(200);
+    return db::ProductTableItem {
+        productID(index),
+        utility::chargenerator::generateChars(8, &engine),
+        brand + " " + noun + " " + engine.pick(SIZES),
+        "",
+        category[0],
+        brand,
+        category[1],
+        std::to_string(engine.below(500)),
+        engine.below(20) ? "ACTIVE" : "INACTIVE",
+        db::formatCents(originalCents),
+        db::formatCents(sellCents),
+        "Supplier " + std::to_string(supplier),
+        "SP" + toBase36(supplier, 4) };
+}
+
+PersonRows<db::CustomerTableItem> DataGenerator::customer(size_t index) const {
+    RowEngine engine(mSeed, Stream::CUSTOMER, index);
+    PersonRows<db::CustomerTableItem> rows;
+    const std::string id = customerID(index);
+    rows.person = db::CustomerTableItem { id, engine.pick(FIRST_NAMES), engine.pick(LAST_NAMES),
+                                          engine.pick(LAST_NAMES), birthdate(&engine),
+                                          engine.below(2) ? "M" : "F" };
+    fillPersonDetails(id, &engine, &rows);
+    return rows;
+}
+
+PersonRows<db::EmployeeTableItem> DataGenerator::employee(size_t index) const {
+    RowEngine engine(mSeed, Stream::EMPLOYEE, index);
+    PersonRows<db::EmployeeTableItem> rows;
+    const std::string id = employeeID(index);
+    const std::string& position = engine.pick(POSITIONS);
+    rows.person = db::EmployeeTableItem { id, engine.pick(FIRST_NAMES), engine.pick(LAST_NAMES),
+                                          engine.pick(LAST_NAMES), birthdate(&engine),
+                                          engine.below(2) ? "M" : "F", position,
+                                          engine.below(10) ? "ACTIVE" : "ON-LEAVE",
+                                          (position == "Cashier") || (position == "Manager") };
+    fillPersonDetails(id, &engine, &rows);
+    return rows;
+}
+
+db::SalesTableItem DataGenerator::sale(size_t index, const DatasetScale& scale,
+                                       std::vector<db::SalesItemTableItem>* items) const {
+    RowEngine engine(mSeed, Stream::SALE, index);
+    // Even days; inside a day the sales follow HOUR_WEIGHTS and stay in time order
+    const size_t days = std::max<size_t>(scale.days, 1);
+    const size_t perDay = (scale.sales + days - 1) / days;
+    const size_t day = index / perDay;
+    const size_t salesOfDay = std::min(perDay, scale.sales - (day * perDay));
+    double fraction = 0;
+    const double quantile = ((index % perDay) + 0.5) / salesOfDay;
+    const size_t hour = weightedIndex(HOUR_WEIGHTS, quantile, &fraction);
+    int64_t firstDay = 0;
+    db::parseDateTime(scale.firstDay, &firstDay);
+    const int64_t dateTime = firstDay + (static_cast<int64_t>(day) * SECONDS_PER_DAY)
+                             + ((OPENING_HOUR + static_cast<int64_t>(hour)) * 3600)
+                             + static_cast<int64_t>(fraction * 3600);
+
+    const std::string id = saleID(index);
+    const size_t itemCount = 1 + weightedIndex(BASKET_WEIGHTS, engine.unit());
+    int64_t subtotal = 0;
+    for (size_t i = 0; (i < itemCount) && (scale.products > 0); ++i) {
+        // Popular products are picked more often
+        const double u = engine.unit();
+        const db::ProductTableItem item = product(static_cast<size_t>(u * u * u
+                                                                      * scale.products));
+        const int64_t quantity = (engine.below(10) < 7) ? 1 : 2 + engine.below(4);
+        const int64_t unitPrice = db::parseCents(item.sell_price);
+        subtotal += unitPrice * quantity;
+        items->push_back(db::SalesItemTableItem { id, item.barcode, item.name, item.sell_price,
+                                                  std::to_string(quantity),
+                                                  db::formatCents(unitPrice * quantity) });
+    }
+    // Prices include VAT
+    const int64_t discount = engine.below(20) ? 0 : subtotal * 5 / 100;
+    const int64_t total = subtotal - discount;
+    const int64_t taxable = (total * 100 + (100 + VAT_PERCENT) / 2) / (100 + VAT_PERCENT);
+    const std::string& paymentType = engine.pick(PAYMENT_TYPES);
+    // Cash is paid up to the next 100.00
+    const int64_t paid = (paymentType == "Cash") ? ((total + 9999) / 10000) * 10000 : total;
+    return db::SalesTableItem {
+        id,
+        db::formatDateTime(dateTime),
+        db::formatCents(subtotal),
+        db::formatCents(taxable),
+        db::formatCents(total - taxable),
+        db::formatCents(discount),
+        db::formatCents(total),
+        db::formatCents(paid),
+        paymentType,
+        db::formatCents(paid - total),
+        (scale.employees > 0) ? employeeID(engine.below(scale.employees)) : "",
+        (scale.customers > 0) ? customerID(engine.below(scale.customers)) : "" };
+}
+
+GenerateReport DataGenerator::fill(const DatasetScale& scale) const {
+    const auto start = std::chrono::steady_clock::now();
+    GenerateReport report;
+    report.rows += addLookupTables();
+
+    generateInRounds<PersonChunk<db::EmployeeTableItem>>(scale.employees, mThreads,
+        [this](size_t i, PersonChunk<db::EmployeeTableItem>* chunk) {
+            chunk->add(employee(i));
+        },
+        [&report](PersonChunk<db::EmployeeTableItem>* chunk) {
+            report.rows += insertPersons<db::EmployeeTableItem>(chunk,
+                [](const std::vector<db::EmployeeTableItem>& rows) {
+                    return DATABASE().SELECT_EMPLOYEES_TABLE().insertAll(rows);
+                });
+        });
+    generateInRounds<PersonChunk<db::CustomerTableItem>>(scale.customers, mThreads,
+        [this](size_t i, PersonChunk<db::CustomerTableItem>* chunk) {
+            chunk->add(customer(i));
+        },
+        [&report](PersonChunk<db::CustomerTableItem>* chunk) {
+            report.rows += insertPersons<db::CustomerTableItem>(chunk,
+                [](const std::vector<db::CustomerTableItem>& rows) {
+                    return DATABASE().SELECT_CUSTOMER_TABLE().insertAll(rows);
+                });
+        });
+    generateInRounds<std::vector<db::ProductTableItem>>(scale.products, mThreads,
+        [this](size_t i, std::vector<db::ProductTableItem>* chunk) {
+            chunk->emplace_back(product(i));
+        },
+        [&report](std::vector<db::ProductTableItem>* chunk) {
+            report.rows += STORAGE().products().insertAll(*chunk);
+        });
+    generateInRounds<SaleChunk>(scale.sales, mThreads,
+        [this, &scale](size_t i, SaleChunk* chunk) {
+            chunk->sales.emplace_back(sale(i, scale, &chunk->items));
+        },
+        [&report](SaleChunk* chunk) {
+            report.rows += STORAGE().sales().insertAll(chunk->sales);
+            report.rows += STORAGE().salesItems().insertAll(chunk->items);
+        });
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                   - start).count();
+    LOG_INFO("Generated %s rows in %s s", std::to_string(report.rows).c_str(),
+             utility::toString(report.seconds).c_str());
+    return report;
+}
+
+}  // namespace datagen
+}  // namespace dataprovider
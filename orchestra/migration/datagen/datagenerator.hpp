@@ -0,0 +1,105 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_DATAGEN_DATAGENERATOR_HPP_
+#define ORCHESTRA_MIGRATION_DATAGEN_DATAGENERATOR_HPP_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <storage/table.hpp>
+
+namespace dataprovider {
+namespace datagen {
+
+struct DatasetScale {
+    size_t employees = 20;
+    size_t customers = 1000;
+    size_t products = 10000;
+    size_t sales = 100000;
+    // the sales are spread evenly over this many days, starting at firstDay
+    size_t days = 365;
+    std::string firstDay = "2021/01/01";
+};
+
+struct GenerateReport {
+    // rows inserted, all tables together
+    size_t rows = 0;
+    double seconds = 0;
+};
+
+/*!
+ * Person rows of one employee or customer
+*/
+template <typename PersonRow>
+struct PersonRows {
+    PersonRow person;
+    db::AddressTableItem address;
+    db::ContactDetailsTableItem contacts;
+    db::PersonalIdTableItem personalId;
+};
+
+/*!
+ * Fills StackDB with synthetic data, e.g. for benchmarks
+ *
+ * Every row is a function of the seed and its index only: it is generated from its own
+ * random engine, so the same seed gives the same data however many threads generate it.
+ * The rows reference each other (sale items are products, cashiers are employees), and
+ * products use the categories and units of measurement that fill() adds.
+ * Sales follow store hours (busiest at lunch and after work), in time order, with mostly
+ * small baskets; popular products are picked more often.
+ * e.g. DatasetScale scale;
+ *      scale.sales = 10000000;
+ *      DataGenerator(42).fill(scale);
+*/
+class DataGenerator {
+ public:
+    /*!
+     * [threads] is the number of generator threads; 0 is one per core
+    */
+    explicit DataGenerator(uint64_t seed, unsigned threads = 0);
+    ~DataGenerator() = default;
+
+    /*!
+     * Inserts [scale] rows into every table, in one transaction per round of chunks
+    */
+    GenerateReport fill(const DatasetScale& scale) const;
+
+    db::ProductTableItem product(size_t index) const;
+    PersonRows<db::CustomerTableItem> customer(size_t index) const;
+    PersonRows<db::EmployeeTableItem> employee(size_t index) const;
+    /*!
+     * Returns the sale and appends its items to [items]
+    */
+    db::SalesTableItem sale(size_t index, const DatasetScale& scale,
+                            std::vector<db::SalesItemTableItem>* items) const;
+
+    static std::string productID(size_t index);
+    static std::string customerID(size_t index);
+    static std::string employeeID(size_t index);
+    static std::string saleID(size_t index);
+
+ private:
+    const uint64_t mSeed;
+    const unsigned mThreads;
+};
+
+}  // namespace datagen
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_DATAGEN_DATAGENERATOR_HPP_
@@ -0,0 +1,76 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <storage/stackdb.hpp>
+#include <storage/storageengine.hpp>
+#include "datagenerator.hpp"
+
+/*!
+ * Fills the database configured in psdb.cfg with synthetic data
+ * e.g. psgen --seed 7 --sales 10000000 --threads 8
+*/
+int main(int argc, char* argv[]) {
+    uint64_t seed = 1;
+    unsigned threads = 0;
+    dataprovider::datagen::DatasetScale scale;
+    for (int i = 1; i < argc; i += 2) {
+        const std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << std::endl;
+            return 1;
+        }
+        const std::string value = argv[i + 1];
+        const size_t number = std::strtoull(value.c_str(), nullptr, 10);
+        if (option == "--seed") {
+            seed = number;
+        } else if (option == "--threads") {
+            threads = static_cast<unsigned>(number);
+        } else if (option == "--employees") {
+            scale.employees = number;
+        } else if (option == "--customers") {
+            scale.customers = number;
+        } else if (option == "--products") {
+            scale.products = number;
+        } else if (option == "--sales") {
+            scale.sales = number;
+        } else if (option == "--days") {
+            scale.days = number;
+        } else if (option == "--first-day") {
+            scale.firstDay = value;
+        } else {
+            std::cerr << "Usage: psgen [--seed N] [--threads N] [--employees N] [--customers N]"
+                      << " [--products N] [--sales N] [--days N] [--first-day YYYY/MM/DD]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    const dataprovider::datagen::GenerateReport report =
+        dataprovider::datagen::DataGenerator(seed, threads).fill(scale);
+    // The product and sales engines can keep their own files
+    STORAGE().commit();
+    DATABASE().checkpoint();
+    std::cout << "Generated " << report.rows << " rows in " << report.seconds << " s ("
+              << static_cast<size_t>(report.rows / (report.seconds > 0 ? report.seconds : 1))
+              << " rows/s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// code under test
+#include <datagen/datagenerator.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace datagen {
+namespace test {
+
+class TestDataGenerator : public testing::Test {
+ public:
+    TestDataGenerator() {
+        scale.employees = 3;
+        scale.customers = 5;
+        scale.products = 50;
+        scale.sales = 200;
+        scale.days = 4;
+        scale.firstDay = "2031/01/01";
+    }
+    ~TestDataGenerator() = default;
+    void SetUp() {}
+    void TearDown() {
+        for (size_t i = 0; i < scale.employees; ++i) {
+            eraseRows(DataGenerator::employeeID(i));
+            DATABASE().SELECT_EMPLOYEES_TABLE().erase(DataGenerator::employeeID(i));
+        }
+        for (size_t i = 0; i < scale.customers; ++i) {
+            eraseRows(DataGenerator::customerID(i));
+            DATABASE().SELECT_CUSTOMER_TABLE().erase(DataGenerator::customerID(i));
+        }
+        for (size_t i = 0; i < scale.products; ++i) {
+            DATABASE().SELECT_PRODUCT_TABLE().erase(DataGenerator::productID(i));
+        }
+        for (size_t i = 0; i < scale.sales; ++i) {
+            DATABASE().SELECT_SALES_TABLE().erase(DataGenerator::saleID(i));
+        }
+        const std::string firstSale = DataGenerator::saleID(0);
+        const std::string lastSale = DataGenerator::saleID(scale.sales - 1);
+        DATABASE().SELECT_SALES_ITEM_TABLE().eraseIf(
+            [&firstSale, &lastSale](const db::SalesItemTableItem& item) {
+                return (item.saleID.size() == firstSale.size()) && (item.saleID >= firstSale)
+                       && (item.saleID <= lastSale);
+            });
+    }
+
+    void eraseRows(const std::string& id) const {
+        DATABASE().SELECT_ADDRESS_TABLE().eraseAllOf(id);
+        DATABASE().SELECT_CONTACTS_TABLE().eraseAllOf(id);
+        DATABASE().SELECT_PERSONAL_ID_TABLE().eraseAllOf(id);
+    }
+
+    DatasetScale scale;
+};
+
+TEST_F(TestDataGenerator, SameSeedGivesSameRows) {
+    const DataGenerator first(7);
+    const DataGenerator second(7, 1);
+    const DataGenerator other(8);
+    EXPECT_EQ(first.product(3).name, second.product(3).name);
+    EXPECT_EQ(first.product(3).sell_price, second.product(3).sell_price);
+    EXPECT_EQ(first.customer(4).person.lastname, second.customer(4).person.lastname);
+    EXPECT_EQ(first.customer(4).personalId.id_number, second.customer(4).personalId.id_number);
+
+    std::vector<db::SalesItemTableItem> firstItems;
+    std::vector<db::SalesItemTableItem> secondItems;
+    std::vector<db::SalesItemTableItem> otherItems;
+    EXPECT_EQ(first.sale(10, scale, &firstItems).total, second.sale(10, scale, &secondItems).total);
+    ASSERT_EQ(firstItems.size(), secondItems.size());
+    for (size_t i = 0; i < firstItems.size(); ++i) {
+        EXPECT_EQ(firstItems[i].productID, secondItems[i].productID);
+    }
+    EXPECT_NE(first.product(3).sku, other.product(3).sku);
+}
+
+TEST_F(TestDataGenerator, SalesAreInTimeOrderWithinStoreHours) {
+    const DataGenerator generator(1);
+    int64_t previous = 0;
+    for (size_t i = 0; i < scale.sales; ++i) {
+        std::vector<db::SalesItemTableItem> items;
+        int64_t seconds = 0;
+        ASSERT_TRUE(db::parseDateTime(generator.sale(i, scale, &items).date_time, &seconds));
+        EXPECT_LE(previous, seconds);
+        const int64_t hour = (seconds % 86400) / 3600;
+        EXPECT_GE(hour, 8);
+        EXPECT_LT(hour, 22);
+        previous = seconds;
+    }
+}
+
+TEST_F(TestDataGenerator, SaleAmountsAddUp) {
+    const DataGenerator generator(3);
+    for (size_t i = 0; i < scale.sales; ++i) {
+        std::vector<db::SalesItemTableItem> items;
+        const db::SalesTableItem sale = generator.sale(i, scale, &items);
+        ASSERT_FALSE(items.empty());
+        int64_t itemsTotal = 0;
+        for (const db::SalesItemTableItem& item : items) {
+            EXPECT_EQ(item.saleID, sale.ID);
+            EXPECT_EQ(db::parseCents(item.total_price),
+                      db::parseCents(item.unit_price) * std::stoll(item.quantity));
+            itemsTotal += db::parseCents(item.total_price);
+        }
+        EXPECT_EQ(db::parseCents(sale.subtotal), itemsTotal);
+        EXPECT_EQ(db::parseCents(sale.total),
+                  db::parseCents(sale.subtotal) - db::parseCents(sale.discount));
+        EXPECT_EQ(db::parseCents(sale.taxable_amount) + db::parseCents(sale.vat),
+                  db::parseCents(sale.total));
+        EXPECT_EQ(db::parseCents(sale.amount_paid) - db::parseCents(sale.change),
+                  db::parseCents(sale.total));
+    }
+}
+
+TEST_F(TestDataGenerator, FillInsertsLinkedRows) {
+    const GenerateReport report = DataGenerator(5, 3).fill(scale);
+    EXPECT_GE(report.rows, scale.employees * 4 + scale.customers * 4 + scale.products
+                           + scale.sales * 2);
+
+    db::ProductTableItem product;
+    EXPECT_TRUE(DATABASE().SELECT_PRODUCT_TABLE().find(DataGenerator::productID(0), &product));
+    EXPECT_TRUE(DATABASE().SELECT_CUSTOMER_TABLE().find(DataGenerator::customerID(4), nullptr));
+    db::AddressTableItem address;
+    EXPECT_TRUE(DATABASE().SELECT_ADDRESS_TABLE().findFirstOf(DataGenerator::employeeID(2),
+                                                               &address));
+
+    const auto snapshot = DATABASE().snapshot();
+    db::SalesTableItem sale;
+    ASSERT_TRUE(snapshot.SELECT_SALES_TABLE().find(DataGenerator::saleID(199), &sale));
+    EXPECT_EQ(sale.date_time.substr(0, 10), "2031-01-04");
+    EXPECT_FALSE(snapshot.SELECT_SALES_ITEM_TABLE().columns().findSale(sale.ID).empty());
+}
+
+}  // namespace test
+}  // namespace datagen
+}  // namespace dataprovider
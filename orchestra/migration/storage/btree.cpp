@@ -0,0 +1,480 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "btree.hpp"
+#include <algorithm>
+#include <cstring>
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr char TREE_MAGIC[] = "PSBTREE1";
+constexpr size_t MAGIC_SIZE = 8;
+constexpr PageID HEADER_PAGE = 0;
+// [u8 is leaf][u16 count][u32 link]
+constexpr size_t NODE_HEADER_SIZE = 7;
+
+void storeU16(uint16_t value, char* out) {
+    out[0] = static_cast<char>(value & 0xFF);
+    out[1] = static_cast<char>(value >> 8);
+}
+
+uint16_t loadU16(const char* data) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(data[0])
+                                 | (static_cast<uint8_t>(data[1]) << 8));
+}
+
+void storeU32(uint32_t value, char* out) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint32_t loadU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+}  // namespace
+
+/*!
+ * Decoded node page
+ * Leaf: keys[i] -> values[i]; link is the next leaf (0 at the end)
+ * Inner: link is the child of the keys < keys[0]; children[i] is the child of the keys
+ *        >= keys[i] (and < keys[i + 1])
+*/
+struct BTree::Node {
+    bool isLeaf = true;
+    PageID link = 0;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    std::vector<PageID> children;
+
+    size_t encodedSize() const {
+        size_t size = NODE_HEADER_SIZE;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            size += entrySize(i);
+        }
+        return size;
+    }
+
+    size_t entrySize(size_t i) const {
+        return isLeaf ? 4 + keys[i].size() + values[i].size() : 6 + keys[i].size();
+    }
+
+    inline PageID childOf(const std::string& key) const {
+        const size_t i = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+        return (i == 0) ? link : children[i - 1];
+    }
+
+    bool decode(const char* page) {
+        isLeaf = page[0] == 1;
+        const size_t count = loadU16(page + 1);
+        link = loadU32(page + 3);
+        keys.resize(count);
+        values.resize(isLeaf ? count : 0);
+        children.resize(isLeaf ? 0 : count);
+        size_t pos = NODE_HEADER_SIZE;
+        for (size_t i = 0; i < count; ++i) {
+            if (pos + 6 > PAGE_DATA_SIZE) {
+                return false;
+            }
+            const size_t keySize = loadU16(page + pos);
+            const size_t valueSize = isLeaf ? loadU16(page + pos + 2) : 0;
+            pos += isLeaf ? 4 : 2;
+            if (pos + keySize + valueSize + (isLeaf ? 0 : 4) > PAGE_DATA_SIZE) {
+                return false;
+            }
+            keys[i].assign(page + pos, keySize);
+            pos += keySize;
+            if (isLeaf) {
+                values[i].assign(page + pos, valueSize);
+                pos += valueSize;
+            } else {
+                children[i] = loadU32(page + pos);
+                pos += 4;
+            }
+        }
+        return true;
+    }
+
+    void encode(char* page) const {
+        page[0] = isLeaf ? 1 : 2;
+        storeU16(static_cast<uint16_t>(keys.size()), page + 1);
+        storeU32(link, page + 3);
+        size_t pos = NODE_HEADER_SIZE;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            storeU16(static_cast<uint16_t>(keys[i].size()), page + pos);
+            if (isLeaf) {
+                storeU16(static_cast<uint16_t>(values[i].size()), page + pos + 2);
+            }
+            pos += isLeaf ? 4 : 2;
+            std::memcpy(page + pos, keys[i].data(), keys[i].size());
+            pos += keys[i].size();
+            if (isLeaf) {
+                std::memcpy(page + pos, values[i].data(), values[i].size());
+                pos += values[i].size();
+            } else {
+                storeU32(children[i], page + pos);
+                pos += 4;
+            }
+        }
+        std::memset(page + pos, 0, PAGE_DATA_SIZE - pos);
+    }
+};
+
+struct BTree::Split {
+    bool isSplit = false;
+    // first key of the new right node
+    std::string separator;
+    PageID right = 0;
+};
+
+BTree::BTree(const std::string& path, size_t cachePages)
+    : mFile(path), mPool(&mFile, cachePages) {
+    if (!mFile.isOpen()) {
+        LOG_ERROR("Cannot open %s", path.c_str());
+        return;
+    }
+    if (mFile.pageCount() == 0) {
+        // New tree - the header and an empty root leaf
+        BufferPool::Page header = mPool.create();
+        PageID root = 0;
+        if (!header.isValid() || !createNode(Node(), &root)) {
+            return;
+        }
+        mRoot = root;
+        mIsOpen = true;
+        writeHeader();
+        return;
+    }
+    const BufferPool::Page header = mPool.fetch(HEADER_PAGE);
+    if (!header.isValid() || (std::memcmp(header.data(), TREE_MAGIC, MAGIC_SIZE) != 0)) {
+        LOG_ERROR("%s is not a B+tree file", path.c_str());
+        return;
+    }
+    mRoot = loadU32(header.data() + MAGIC_SIZE);
+    mSize = static_cast<uint64_t>(loadU32(header.data() + MAGIC_SIZE + 4))
+            | (static_cast<uint64_t>(loadU32(header.data() + MAGIC_SIZE + 8)) << 32);
+    mIsOpen = true;
+}
+
+BTree::~BTree() {
+    flush();
+}
+
+bool BTree::find(const std::string& key, std::string* value) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Node leaf;
+    PageID id = 0;
+    if (!mIsOpen || !leafOf(key, &leaf, &id)) {
+        return false;
+    }
+    const auto it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+    if ((it == leaf.keys.end()) || (*it != key)) {
+        return false;
+    }
+    if (value) {
+        *value = std::move(leaf.values[it - leaf.keys.begin()]);
+    }
+    return true;
+}
+
+bool BTree::insert(const std::string& key, const std::string& value) {
+    if (key.size() + value.size() > MAX_ENTRY_SIZE) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIsOpen) {
+        return false;
+    }
+    Split split;
+    const Result result = put(mRoot, key, value, Mode::INSERT, &split);
+    if (split.isSplit) {
+        // The root was split; the tree grows by one level
+        Node root;
+        root.isLeaf = false;
+        root.link = mRoot;
+        root.keys.push_back(split.separator);
+        root.children.push_back(split.right);
+        PageID id = 0;
+        if (createNode(root, &id)) {
+            mRoot = id;
+        }
+    }
+    if (result == Result::DONE) {
+        ++mSize;
+    }
+    writeHeader();
+    return result == Result::DONE;
+}
+
+bool BTree::update(const std::string& key, const std::string& value) {
+    if (key.size() + value.size() > MAX_ENTRY_SIZE) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIsOpen) {
+        return false;
+    }
+    Split split;
+    const Result result = put(mRoot, key, value, Mode::UPDATE, &split);
+    if (split.isSplit) {
+        Node root;
+        root.isLeaf = false;
+        root.link = mRoot;
+        root.keys.push_back(split.separator);
+        root.children.push_back(split.right);
+        PageID id = 0;
+        if (createNode(root, &id)) {
+            mRoot = id;
+            writeHeader();
+        }
+    }
+    return result == Result::DONE;
+}
+
+bool BTree::erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Node leaf;
+    PageID id = 0;
+    if (!mIsOpen || !leafOf(key, &leaf, &id)) {
+        return false;
+    }
+    const auto it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+    if ((it == leaf.keys.end()) || (*it != key)) {
+        return false;
+    }
+    const size_t pos = it - leaf.keys.begin();
+    leaf.keys.erase(leaf.keys.begin() + pos);
+    leaf.values.erase(leaf.values.begin() + pos);
+    if (!writeNode(id, leaf)) {
+        return false;
+    }
+    --mSize;
+    writeHeader();
+    return true;
+}
+
+size_t BTree::size() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return static_cast<size_t>(mSize);
+}
+
+BTree::Cursor BTree::seek(const std::string& first) const {
+    return Cursor(this, first);
+}
+
+bool BTree::flush() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPool.flush();
+}
+
+size_t BTree::pageReads() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPool.misses();
+}
+
+bool BTree::readNode(PageID id, Node* node) const {
+    const BufferPool::Page page = mPool.fetch(id);
+    if (!page.isValid() || !node->decode(page.data())) {
+        LOG_ERROR("B+tree page %s is damaged", std::to_string(id).c_str());
+        return false;
+    }
+    return true;
+}
+
+bool BTree::writeNode(PageID id, const Node& node) {
+    BufferPool::Page page = mPool.fetch(id);
+    if (!page.isValid()) {
+        return false;
+    }
+    node.encode(page.mutableData());
+    return true;
+}
+
+bool BTree::createNode(const Node& node, PageID* id) {
+    BufferPool::Page page = mPool.create();
+    if (!page.isValid()) {
+        return false;
+    }
+    node.encode(page.mutableData());
+    *id = page.id();
+    return true;
+}
+
+void BTree::writeHeader() {
+    BufferPool::Page page = mPool.fetch(HEADER_PAGE);
+    if (!page.isValid()) {
+        return;
+    }
+    char* header = page.mutableData();
+    std::memcpy(header, TREE_MAGIC, MAGIC_SIZE);
+    storeU32(mRoot, header + MAGIC_SIZE);
+    storeU32(static_cast<uint32_t>(mSize & 0xFFFFFFFF), header + MAGIC_SIZE + 4);
+    storeU32(static_cast<uint32_t>(mSize >> 32), header + MAGIC_SIZE + 8);
+}
+
+BTree::Result BTree::put(PageID id, const std::string& key, const std::string& value,
+                         Mode mode, Split* split) {
+    Node node;
+    if (!readNode(id, &node)) {
+        return Result::FAILED;
+    }
+    if (node.isLeaf) {
+        const auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+        const size_t pos = it - node.keys.begin();
+        const bool isFound = (it != node.keys.end()) && (*it == key);
+        if ((mode == Mode::INSERT) && isFound) {
+            return Result::EXISTS;
+        }
+        if ((mode == Mode::UPDATE) && !isFound) {
+            return Result::MISSING;
+        }
+        if (isFound) {
+            node.values[pos] = value;
+        } else {
+            node.keys.insert(node.keys.begin() + pos, key);
+            node.values.insert(node.values.begin() + pos, value);
+        }
+    } else {
+        const size_t pos = std::upper_bound(node.keys.begin(), node.keys.end(), key)
+                           - node.keys.begin();
+        Split childSplit;
+        const Result result = put(node.childOf(key), key, value, mode, &childSplit);
+        if (!childSplit.isSplit) {
+            return result;
+        }
+        node.keys.insert(node.keys.begin() + pos, childSplit.separator);
+        node.children.insert(node.children.begin() + pos, childSplit.right);
+        if (result != Result::DONE) {
+            // The child is split even so; keep the new node reachable
+            if (node.encodedSize() > PAGE_DATA_SIZE) {
+                return splitNode(id, &node, split) ? result : Result::FAILED;
+            }
+            return writeNode(id, node) ? result : Result::FAILED;
+        }
+    }
+    if (node.encodedSize() > PAGE_DATA_SIZE) {
+        return splitNode(id, &node, split) ? Result::DONE : Result::FAILED;
+    }
+    return writeNode(id, node) ? Result::DONE : Result::FAILED;
+}
+
+bool BTree::splitNode(PageID id, Node* node, Split* split) {
+    // Split at the middle byte, so both halves fit whatever the entry sizes
+    const size_t half = node->encodedSize() / 2;
+    size_t mid = 0;
+    for (size_t size = NODE_HEADER_SIZE; (mid < node->keys.size() - 1) && (size < half);
+         ++mid) {
+        size += node->entrySize(mid);
+    }
+    mid = std::max<size_t>(mid, 1);
+    Node right;
+    right.isLeaf = node->isLeaf;
+    if (node->isLeaf) {
+        right.keys.assign(node->keys.begin() + mid, node->keys.end());
+        right.values.assign(node->values.begin() + mid, node->values.end());
+        right.link = node->link;
+        split->separator = right.keys.front();
+        node->keys.resize(mid);
+        node->values.resize(mid);
+    } else {
+        // keys[mid] moves up; its child becomes the leftmost child of the right node
+        split->separator = node->keys[mid];
+        right.link = node->children[mid];
+        right.keys.assign(node->keys.begin() + mid + 1, node->keys.end());
+        right.children.assign(node->children.begin() + mid + 1, node->children.end());
+        node->keys.resize(mid);
+        node->children.resize(mid);
+    }
+    if (!createNode(right, &split->right)) {
+        return false;
+    }
+    if (node->isLeaf) {
+        node->link = split->right;
+    }
+    split->isSplit = true;
+    return writeNode(id, *node);
+}
+
+bool BTree::leafOf(const std::string& key, Node* leaf, PageID* id) const {
+    *id = mRoot;
+    for (;;) {
+        if (!readNode(*id, leaf)) {
+            return false;
+        }
+        if (leaf->isLeaf) {
+            return true;
+        }
+        *id = leaf->childOf(key);
+    }
+}
+
+BTree::Cursor::Cursor(const BTree* tree, std::string first)
+    : mTree(tree), mLastKey(std::move(first)) {}
+
+bool BTree::Cursor::next(std::string* key, std::string* value) {
+    while (mPos >= mEntries.size()) {
+        if (mIsDone) {
+            return false;
+        }
+        // Find the leaf of the last key again; the tree can have changed since
+        mEntries.clear();
+        mPos = 0;
+        std::lock_guard<std::mutex> lock(mTree->mMutex);
+        Node leaf;
+        PageID id = 0;
+        if (!mTree->mIsOpen || !mTree->leafOf(mLastKey, &leaf, &id)) {
+            mIsDone = true;
+            return false;
+        }
+        for (;;) {
+            for (size_t i = 0; i < leaf.keys.size(); ++i) {
+                const int order = leaf.keys[i].compare(mLastKey);
+                if ((order > 0) || ((order == 0) && !mIsStarted)) {
+                    mEntries.emplace_back(std::move(leaf.keys[i]), std::move(leaf.values[i]));
+                }
+            }
+            if (!mEntries.empty()) {
+                break;
+            }
+            if ((leaf.link == 0) || !mTree->readNode(leaf.link, &leaf)) {
+                mIsDone = true;
+                break;
+            }
+        }
+    }
+    *key = std::move(mEntries[mPos].first);
+    *value = std::move(mEntries[mPos].second);
+    ++mPos;
+    mLastKey = *key;
+    mIsStarted = true;
+    return true;
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,143 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_BTREE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_BTREE_HPP_
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bufferpool.hpp"
+#include "pagefile.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * On-disk B+tree of string keys and values
+ *
+ * Every node is one page of a PageFile, read through a BufferPool of [cachePages] pages, so
+ * only the recently used part of the tree is in memory. The leaves hold the values and are
+ * linked in key order for range scans. Page 0 holds the root and the row count.
+ * Erased entries leave their leaf smaller; nodes are not merged.
+ *
+ * The changes are written back when pages are evicted and at flush(). A crash between two
+ * flushes loses the changes since the last one: the PageFile journal rolls the pages written
+ * meanwhile back, so a half-done split is not seen. There is no log to replay them; the
+ * engine is not the default (see BTreeProductEngine).
+ * The calls are serialized by one mutex.
+*/
+class BTree {
+ public:
+    // key + value; larger entries are rejected so that a node always fits 4 entries
+    static constexpr size_t MAX_ENTRY_SIZE = (PAGE_DATA_SIZE - 16) / 4;
+
+    /*!
+     * Reads keys in order, one leaf at a time
+     * Every leaf is read as it is reached, so changes made meanwhile to the keys after the
+     * current leaf are seen.
+    */
+    class Cursor {
+     public:
+        /*!
+         * Copies the next entry into [key] and [value]; returns false at the end
+        */
+        bool next(std::string* key, std::string* value);
+
+     private:
+        friend class BTree;
+        Cursor(const BTree* tree, std::string first);
+
+        const BTree* mTree;
+        // entries of the current leaf that are not returned yet
+        std::vector<std::pair<std::string, std::string>> mEntries;
+        size_t mPos = 0;
+        // the next leaf starts after this key
+        std::string mLastKey;
+        bool mIsStarted = false;
+        bool mIsDone = false;
+    };
+
+    /*!
+     * Opens the tree file, or creates it
+    */
+    BTree(const std::string& path, size_t cachePages);
+    ~BTree();
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    inline bool isOpen() const {
+        return mIsOpen;
+    }
+
+    bool find(const std::string& key, std::string* value) const;
+    /*!
+     * Returns false if the key exists or the entry is larger than MAX_ENTRY_SIZE
+    */
+    bool insert(const std::string& key, const std::string& value);
+    /*!
+     * Returns false if the key is not found or the entry is larger than MAX_ENTRY_SIZE
+    */
+    bool update(const std::string& key, const std::string& value);
+    bool erase(const std::string& key);
+    size_t size() const;
+    /*!
+     * Entries with keys >= [first], in key order
+    */
+    Cursor seek(const std::string& first) const;
+    /*!
+     * Writes the changed pages to the disk
+    */
+    bool flush();
+    /*!
+     * Pages read from the disk so far
+    */
+    size_t pageReads() const;
+
+ private:
+    struct Node;
+    struct Split;
+    enum class Mode { INSERT, UPDATE };
+    enum class Result { DONE, EXISTS, MISSING, FAILED };
+
+    mutable std::mutex mMutex;
+    PageFile mFile;
+    mutable BufferPool mPool;
+    PageID mRoot = 0;
+    uint64_t mSize = 0;
+    bool mIsOpen = false;
+
+    bool readNode(PageID id, Node* node) const;
+    bool writeNode(PageID id, const Node& node);
+    bool createNode(const Node& node, PageID* id);
+    void writeHeader();
+    Result put(PageID id, const std::string& key, const std::string& value, Mode mode,
+               Split* split);
+    bool splitNode(PageID id, Node* node, Split* split);
+    /*!
+     * Reads the leaf where [key] belongs into [leaf]; [id] gets its page
+    */
+    bool leafOf(const std::string& key, Node* leaf, PageID* id) const;
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_BTREE_HPP_
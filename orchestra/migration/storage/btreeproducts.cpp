@@ -0,0 +1,198 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "btreeproducts.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "rowcodec.hpp"
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+/*!
+ * The fields after the barcode (the key), each as [u16 size][bytes]
+*/
+std::string encodeProduct(const ProductTableItem& row) {
+    const Fields fields = RowCodec<ProductTableItem>::encode(row);
+    std::string value;
+    for (size_t i = 1; i < fields.size(); ++i) {
+        const size_t size = std::min<size_t>(fields[i].size(), UINT16_MAX);
+        value += static_cast<char>(size & 0xFF);
+        value += static_cast<char>(size >> 8);
+        value.append(fields[i], 0, size);
+    }
+    return value;
+}
+
+bool decodeProduct(const std::string& key, const std::string& value, ProductTableItem* out) {
+    Fields fields { key };
+    size_t pos = 0;
+    while ((pos + 2 <= value.size()) && (fields.size() < RowCodec<ProductTableItem>::FIELD_COUNT)) {
+        const size_t size = static_cast<uint8_t>(value[pos])
+                            | (static_cast<size_t>(static_cast<uint8_t>(value[pos + 1])) << 8);
+        pos += 2;
+        if (pos + size > value.size()) {
+            return false;
+        }
+        fields.emplace_back(value, pos, size);
+        pos += size;
+    }
+    if (fields.size() != RowCodec<ProductTableItem>::FIELD_COUNT) {
+        return false;
+    }
+    *out = RowCodec<ProductTableItem>::decode(fields);
+    return true;
+}
+
+class TreeCursor : public Cursor<ProductTableItem> {
+ public:
+    TreeCursor(BTree::Cursor cursor, std::string last)
+        : mCursor(std::move(cursor)), mLast(std::move(last)) {}
+
+    bool next(ProductTableItem* out) override {
+        std::string key;
+        std::string value;
+        while (mCursor.next(&key, &value)) {
+            if (!mLast.empty() && (key > mLast)) {
+                return false;
+            }
+            if (decodeProduct(key, value, out)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    BTree::Cursor mCursor;
+    const std::string mLast;
+};
+
+}  // namespace
+
+BTreeProductEngine::BTreeProductEngine(const std::string& path, size_t cachePages)
+    : mTree(path, cachePages) {}
+
+bool BTreeProductEngine::get(const std::string& key, ProductTableItem* out) const {
+    std::string value;
+    if (!mTree.find(key, &value)) {
+        return false;
+    }
+    ProductTableItem row;
+    if (!decodeProduct(key, value, &row)) {
+        return false;
+    }
+    if (out) {
+        *out = std::move(row);
+    }
+    return true;
+}
+
+std::unique_ptr<Cursor<ProductTableItem>> BTreeProductEngine::scan() const {
+    return scanRange("", "");
+}
+
+std::unique_ptr<Cursor<ProductTableItem>>
+BTreeProductEngine::scanOf(const std::string& key) const {
+    std::vector<ProductTableItem> rows(1);
+    if (!get(key, &rows.front())) {
+        rows.clear();
+    }
+    return std::unique_ptr<Cursor<ProductTableItem>>(
+        new VectorCursor<ProductTableItem>(std::move(rows)));
+}
+
+std::unique_ptr<Cursor<ProductTableItem>>
+BTreeProductEngine::scanRange(const std::string& first, const std::string& last) const {
+    return std::unique_ptr<Cursor<ProductTableItem>>(new TreeCursor(mTree.seek(first), last));
+}
+
+RowPage<ProductTableItem>
+BTreeProductEngine::page(const PageQuery<ProductTableItem>& query) const {
+    if (query.key != &ProductTableItem::barcode || (query.sortBy && query.sortBy != query.key)) {
+        return ProductEngine::page(query);
+    }
+    std::string sortValue;
+    std::string after;
+    const bool hasStart = decodePageToken(query.token, &sortValue, &after);
+    const size_t size = std::max<size_t>(query.size, 1);
+    RowPage<ProductTableItem> page;
+    const std::unique_ptr<Cursor<ProductTableItem>> cursor = scanRange(after, "");
+    for (ProductTableItem row; cursor->next(&row);) {
+        if (hasStart && row.barcode == after) {
+            continue;
+        }
+        if (page.rows.size() == size) {
+            // one more row follows
+            const ProductTableItem& last = page.rows.back();
+            page.nextToken = encodePageToken(query.sortValue(last), last.barcode);
+            break;
+        }
+        page.rows.emplace_back(std::move(row));
+    }
+    return page;
+}
+
+bool BTreeProductEngine::insert(const ProductTableItem& row) {
+    return mTree.insert(row.barcode, encodeProduct(row));
+}
+
+bool BTreeProductEngine::update(const ProductTableItem& row) {
+    return mTree.update(row.barcode, encodeProduct(row));
+}
+
+size_t BTreeProductEngine::remove(const std::string& key) {
+    return mTree.erase(key) ? 1 : 0;
+}
+
+size_t BTreeProductEngine::removeOf(const std::string& key) {
+    return remove(key);
+}
+
+size_t BTreeProductEngine::removeIf(const Predicate& predicate) {
+    // Collect the keys first, so that the scan does not run into its own erases
+    std::vector<std::string> keys;
+    const std::unique_ptr<Cursor<ProductTableItem>> cursor = scan();
+    for (ProductTableItem row; cursor->next(&row);) {
+        if (predicate(row)) {
+            keys.push_back(row.barcode);
+        }
+    }
+    size_t count = 0;
+    for (const std::string& key : keys) {
+        count += remove(key);
+    }
+    return count;
+}
+
+size_t BTreeProductEngine::size() const {
+    return mTree.size();
+}
+
+bool BTreeProductEngine::flush() {
+    return mTree.flush();
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,78 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_BTREEPRODUCTS_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_BTREEPRODUCTS_HPP_
+#include <memory>
+#include <string>
+#include "btree.hpp"
+#include "storageengine.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Product table in an on-disk B+tree keyed by barcode
+ *
+ * Only the pages in the buffer pool are in memory, so the catalog can be larger than the RAM
+ * of the device. Lookups read one page per tree level; scans and scanRange() read the leaves
+ * in barcode order. Rows larger than BTree::MAX_ENTRY_SIZE are rejected.
+ * Enabled with product_engine=btree in psdb.cfg (see StorageEngine::current()).
+*/
+class BTreeProductEngine : public ProductEngine {
+ public:
+    BTreeProductEngine(const std::string& path, size_t cachePages);
+    ~BTreeProductEngine() override = default;
+
+    inline bool isOpen() const {
+        return mTree.isOpen();
+    }
+
+    /*!
+     * Pages read from the disk so far
+    */
+    inline size_t pageReads() const {
+        return mTree.pageReads();
+    }
+
+    bool get(const std::string& key, ProductTableItem* out) const override;
+    std::unique_ptr<Cursor<ProductTableItem>> scan() const override;
+    std::unique_ptr<Cursor<ProductTableItem>> scanOf(const std::string& key) const override;
+    std::unique_ptr<Cursor<ProductTableItem>> scanRange(const std::string& first,
+                                                        const std::string& last) const override;
+    /*!
+     * In barcode order, a page reads the leaves after its token only
+    */
+    RowPage<ProductTableItem> page(const PageQuery<ProductTableItem>& query) const override;
+    bool insert(const ProductTableItem& row) override;
+    bool update(const ProductTableItem& row) override;
+    size_t remove(const std::string& key) override;
+    size_t removeOf(const std::string& key) override;
+    size_t removeIf(const Predicate& predicate) override;
+    size_t size() const override;
+    bool flush() override;
+
+ private:
+    mutable BTree mTree;
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_BTREEPRODUCTS_HPP_
@@ -0,0 +1,189 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "bufferpool.hpp"
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+BufferPool::Page::Page(BufferPool* pool, size_t frame) : mPool(pool), mFrame(frame) {
+    mPool->pin(mFrame);
+}
+
+BufferPool::Page::~Page() {
+    release();
+}
+
+BufferPool::Page::Page(Page&& other) noexcept : mPool(other.mPool), mFrame(other.mFrame) {
+    other.mPool = nullptr;
+}
+
+BufferPool::Page& BufferPool::Page::operator=(Page&& other) noexcept {
+    if (this != &other) {
+        release();
+        mPool = other.mPool;
+        mFrame = other.mFrame;
+        other.mPool = nullptr;
+    }
+    return *this;
+}
+
+PageID BufferPool::Page::id() const {
+    return mPool->mFrames[mFrame].id;
+}
+
+const char* BufferPool::Page::data() const {
+    return mPool->mFrames[mFrame].data.get();
+}
+
+char* BufferPool::Page::mutableData() {
+    Frame& frame = mPool->mFrames[mFrame];
+    frame.isDirty = true;
+    return frame.data.get();
+}
+
+void BufferPool::Page::release() {
+    if (mPool) {
+        mPool->unpin(mFrame);
+        mPool = nullptr;
+    }
+}
+
+BufferPool::BufferPool(PageFile* file, size_t capacity)
+    : mFile(file), mFrames(capacity < 2 ? 2 : capacity) {
+    for (size_t i = mFrames.size(); i > 0; --i) {
+        mFrames[i - 1].data.reset(new char[PAGE_SIZE]);
+        mFreeFrames.push_back(i - 1);
+    }
+}
+
+BufferPool::~BufferPool() {
+    flush();
+}
+
+BufferPool::Page BufferPool::fetch(PageID id) {
+    const auto found = mPageTable.find(id);
+    if (found != mPageTable.end()) {
+        return Page(this, found->second);
+    }
+    ++mMisses;
+    size_t frame = 0;
+    if (!takeFrame(&frame)) {
+        LOG_ERROR("All %s pages of the buffer pool are in use",
+                  std::to_string(mFrames.size()).c_str());
+        return Page();
+    }
+    if (!mFile->read(id, mFrames[frame].data.get())) {
+        LOG_ERROR("Cannot read page %s", std::to_string(id).c_str());
+        mFreeFrames.push_back(frame);
+        return Page();
+    }
+    mFrames[frame].id = id;
+    mFrames[frame].isUsed = true;
+    mFrames[frame].isDirty = false;
+    mPageTable.emplace(id, frame);
+    return Page(this, frame);
+}
+
+BufferPool::Page BufferPool::create() {
+    size_t frame = 0;
+    if (!takeFrame(&frame)) {
+        LOG_ERROR("All %s pages of the buffer pool are in use",
+                  std::to_string(mFrames.size()).c_str());
+        return Page();
+    }
+    const PageID id = mFile->allocate();
+    std::memset(mFrames[frame].data.get(), 0, PAGE_SIZE);
+    mFrames[frame].id = id;
+    mFrames[frame].isUsed = true;
+    // Not on the disk yet
+    mFrames[frame].isDirty = true;
+    mPageTable.emplace(id, frame);
+    return Page(this, frame);
+}
+
+bool BufferPool::flush() {
+    // One sync of the journal for all of them, not one per page
+    std::vector<PageID> dirty;
+    for (const Frame& frame : mFrames) {
+        if (frame.isUsed && frame.isDirty) {
+            dirty.push_back(frame.id);
+        }
+    }
+    if (!mFile->journal(dirty)) {
+        LOG_ERROR("Cannot save %s pages to the journal", std::to_string(dirty.size()).c_str());
+        return false;
+    }
+    bool isFlushed = true;
+    for (Frame& frame : mFrames) {
+        if (frame.isUsed && frame.isDirty) {
+            frame.isDirty = !mFile->write(frame.id, frame.data.get());
+            isFlushed = isFlushed && !frame.isDirty;
+        }
+    }
+    return mFile->sync() && isFlushed;
+}
+
+bool BufferPool::takeFrame(size_t* frame) {
+    if (!mFreeFrames.empty()) {
+        *frame = mFreeFrames.back();
+        mFreeFrames.pop_back();
+        return true;
+    }
+    if (mLru.empty()) {
+        return false;
+    }
+    *frame = mLru.front();
+    Frame& victim = mFrames[*frame];
+    if (victim.isDirty && !mFile->write(victim.id, victim.data.get())) {
+        LOG_ERROR("Cannot write page %s", std::to_string(victim.id).c_str());
+        return false;
+    }
+    mLru.pop_front();
+    victim.isInLru = false;
+    mPageTable.erase(victim.id);
+    victim.isUsed = false;
+    victim.isDirty = false;
+    ++mEvictions;
+    return true;
+}
+
+void BufferPool::pin(size_t frame) {
+    Frame& target = mFrames[frame];
+    if ((target.pins++ == 0) && target.isInLru) {
+        mLru.erase(target.lru);
+        target.isInLru = false;
+    }
+}
+
+void BufferPool::unpin(size_t frame) {
+    Frame& target = mFrames[frame];
+    if (--target.pins == 0) {
+        target.lru = mLru.insert(mLru.end(), frame);
+        target.isInLru = true;
+    }
+}
+
+}  // namespace db
+}  // namespace dataprovider
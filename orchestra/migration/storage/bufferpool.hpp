@@ -0,0 +1,134 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_BUFFERPOOL_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_BUFFERPOOL_HPP_
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "pagefile.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Fixed number of page frames in front of a PageFile
+ *
+ * Pages are read into a frame on first use and stay there until the frame is needed for
+ * another page; then the least recently used unpinned page is evicted (written back first if
+ * it was changed). A page is pinned while a Page handle to it exists.
+ * Not thread-safe; the owner serializes the calls (see BTree).
+*/
+class BufferPool {
+ public:
+    /*!
+     * Pinned page of the pool; unpinned when it goes out of scope
+    */
+    class Page {
+     public:
+        Page() = default;
+        Page(BufferPool* pool, size_t frame);
+        ~Page();
+        Page(Page&& other) noexcept;
+        Page& operator=(Page&& other) noexcept;
+        Page(const Page&) = delete;
+        Page& operator=(const Page&) = delete;
+
+        inline bool isValid() const {
+            return mPool != nullptr;
+        }
+
+        PageID id() const;
+        const char* data() const;
+        /*!
+         * The page contents for changing; marks the page to be written back
+        */
+        char* mutableData();
+
+     private:
+        BufferPool* mPool = nullptr;
+        size_t mFrame = 0;
+
+        void release();
+    };
+
+    BufferPool(PageFile* file, size_t capacity);
+    ~BufferPool();
+
+    /*!
+     * Returns page [id]; an invalid Page if it cannot be read or every frame is pinned
+    */
+    Page fetch(PageID id);
+    /*!
+     * Returns a new, zeroed page at the end of the file
+    */
+    Page create();
+    /*!
+     * Writes the changed pages back and syncs the file, which ends its journal
+     * Call it between complete changes; a crash rolls the file back to the last flush().
+    */
+    bool flush();
+
+    inline size_t capacity() const {
+        return mFrames.size();
+    }
+
+    inline size_t misses() const {
+        return mMisses;
+    }
+
+    inline size_t evictions() const {
+        return mEvictions;
+    }
+
+ private:
+    struct Frame {
+        PageID id = 0;
+        bool isUsed = false;
+        bool isDirty = false;
+        size_t pins = 0;
+        std::unique_ptr<char[]> data;
+        // position in mLru while unpinned
+        bool isInLru = false;
+        std::list<size_t>::iterator lru;
+    };
+
+    PageFile* mFile;
+    std::vector<Frame> mFrames;
+    std::unordered_map<PageID, size_t> mPageTable;
+    // unpinned used frames, least recently used first
+    std::list<size_t> mLru;
+    std::vector<size_t> mFreeFrames;
+    size_t mMisses = 0;
+    size_t mEvictions = 0;
+
+    /*!
+     * Returns a frame for a new page, evicting one if needed; false if all are pinned
+    */
+    bool takeFrame(size_t* frame);
+    void pin(size_t frame);
+    void unpin(size_t frame);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_BUFFERPOOL_HPP_
@@ -0,0 +1,126 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "changefeed.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace dataprovider {
+namespace db {
+
+ChangeFeed::Subscription::Subscription(ChangeFeed* feed, std::vector<TableID> tables,
+                                       uint64_t position)
+    : mFeed(feed), mTables(std::move(tables)), mPosition(position) {}
+
+ChangeFeed::Subscription::~Subscription() {
+    mFeed->unsubscribe();
+}
+
+bool ChangeFeed::Subscription::isSubscribed(TableID table) const {
+    return mTables.empty() || (std::find(mTables.begin(), mTables.end(), table) != mTables.end());
+}
+
+bool ChangeFeed::Subscription::poll(std::vector<ChangeEvent>* out, size_t maxEvents,
+                                    std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mFeed->mMutex);
+    mFeed->mPublished.wait_for(lock, timeout, [this] {
+        return mFeed->mLastSequence > mPosition;
+    });
+    const std::deque<ChangeEvent>& events = mFeed->mEvents;
+    const uint64_t first = events.empty() ? mFeed->mLastSequence + 1 : events.front().sequence;
+    if (mPosition + 1 < first) {
+        mPosition = mFeed->mLastSequence;
+        return false;
+    }
+    size_t count = 0;
+    for (size_t i = mPosition + 1 - first; (i < events.size()) && (count < maxEvents); ++i) {
+        mPosition = events[i].sequence;
+        if (isSubscribed(events[i].table)) {
+            out->push_back(events[i]);
+            ++count;
+        }
+    }
+    return true;
+}
+
+ChangeFeed::ChangeFeed(size_t capacity, std::function<void()> onActivityChanged)
+    : mCapacity(std::max<size_t>(capacity, 1)), mOnActivityChanged(std::move(onActivityChanged)) {}
+
+std::unique_ptr<ChangeFeed::Subscription> ChangeFeed::subscribe(std::vector<TableID> tables) {
+    std::lock_guard<std::mutex> lock(mSubscribeMutex);
+    if ((mSubscriptionCount.fetch_add(1) == 0) && mOnActivityChanged) {
+        mOnActivityChanged();
+    }
+    return std::unique_ptr<Subscription>(new Subscription(this, std::move(tables),
+                                                          lastSequence()));
+}
+
+void ChangeFeed::unsubscribe() {
+    std::lock_guard<std::mutex> lock(mSubscribeMutex);
+    if (mSubscriptionCount.fetch_sub(1) != 1) {
+        return;
+    }
+    if (mOnActivityChanged) {
+        mOnActivityChanged();
+    }
+    // Nobody reads the journal until the next subscription, which starts after it
+    std::lock_guard<std::mutex> eventsLock(mMutex);
+    mEvents.clear();
+}
+
+uint64_t ChangeFeed::lastSequence() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLastSequence;
+}
+
+void ChangeFeed::publish(LogRecord record) {
+    if (!isActive()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        append(&record);
+    }
+    mPublished.notify_all();
+}
+
+void ChangeFeed::publish(std::vector<LogRecord> records) {
+    if (!isActive() || records.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (LogRecord& record : records) {
+            append(&record);
+        }
+    }
+    mPublished.notify_all();
+}
+
+void ChangeFeed::append(LogRecord* record) {
+    mEvents.push_back(ChangeEvent { ++mLastSequence, record->table, record->operation,
+                                    std::move(record->before), std::move(record->after) });
+    if (mEvents.size() > mCapacity) {
+        mEvents.pop_front();
+    }
+}
+
+}  // namespace db
+}  // namespace dataprovider
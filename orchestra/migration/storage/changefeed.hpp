@@ -0,0 +1,139 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_CHANGEFEED_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_CHANGEFEED_HPP_
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "wal.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * One committed mutation of a StackDB table
+ * [before] is empty for INSERT; [after] is empty for ERASE. The rows are decoded with the
+ * RowCodec of the table, e.g. RowCodec<ProductTableItem>::decode(event.after)
+*/
+struct ChangeEvent {
+    uint64_t sequence;
+    TableID table;
+    Mutation operation;
+    Fields before;
+    Fields after;
+};
+
+/*!
+ * Change-data-capture stream of the StackDB tables
+ *
+ * Every committed insert, update and erase gets the next sequence number and is kept in a
+ * bounded in-memory journal, where the subscribers read the events after the last one they
+ * applied. The order is the commit order; the writes of a Transaction appear together when it
+ * ends, and rolled back writes never appear. The sequence numbers start over with the process.
+ *
+ * The events are only recorded while a subscription is open, so the tables pay nothing for the
+ * feed otherwise. A subscriber should subscribe first, then load its data (e.g. list()), then
+ * apply the events as upserts and erases; a write may be in both.
+ * A subscriber that falls more than [capacity] events behind gets a gap (poll() returns false)
+ * and has to load its data again.
+*/
+class ChangeFeed {
+ public:
+    class Subscription {
+     public:
+        ~Subscription();
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+        /*!
+         * Copies up to [maxEvents] of the next events into [out], in order
+         * Waits up to [timeout] if there is none yet.
+         * Returns false if events were dropped before they were read; the subscription then
+         * continues after the latest event.
+        */
+        bool poll(std::vector<ChangeEvent>* out, size_t maxEvents,
+                  std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+        /*!
+         * Sequence of the last event read (or skipped by the table filter)
+        */
+        inline uint64_t position() const {
+            return mPosition;
+        }
+
+     private:
+        friend class ChangeFeed;
+        Subscription(ChangeFeed* feed, std::vector<TableID> tables, uint64_t position);
+
+        ChangeFeed* const mFeed;
+        // empty for every table
+        const std::vector<TableID> mTables;
+        uint64_t mPosition;
+
+        bool isSubscribed(TableID table) const;
+    };
+
+    /*!
+     * [onActivityChanged] is called when the first subscription opens and when the last one
+     * closes, e.g. to attach the table listeners
+    */
+    ChangeFeed(size_t capacity, std::function<void()> onActivityChanged);
+
+    /*!
+     * The events of [tables] (all if empty) committed from now on
+    */
+    std::unique_ptr<Subscription> subscribe(std::vector<TableID> tables = {});
+    inline bool isActive() const {
+        return mSubscriptionCount.load(std::memory_order_acquire) > 0;
+    }
+    uint64_t lastSequence() const;
+
+    /*!
+     * Appends committed mutations; ignored without subscribers
+     * Called with the writes of their tables locked, which keeps the order of each row.
+    */
+    void publish(LogRecord record);
+    void publish(std::vector<LogRecord> records);
+
+ private:
+    const size_t mCapacity;
+    const std::function<void()> mOnActivityChanged;
+    // serializes subscribe/unsubscribe with the listener changes they make
+    std::mutex mSubscribeMutex;
+    std::atomic<size_t> mSubscriptionCount {0};
+    mutable std::mutex mMutex;
+    std::condition_variable mPublished;
+    std::deque<ChangeEvent> mEvents;
+    uint64_t mLastSequence = 0;
+
+    void unsubscribe();
+    // Called with mMutex locked
+    void append(LogRecord* record);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_CHANGEFEED_HPP_
@@ -0,0 +1,318 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "wal.hpp"
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr char IMAGE_MAGIC[] = "PSDBIMG\n";
+constexpr size_t MAGIC_SIZE = sizeof(IMAGE_MAGIC) - 1;
+// Bump when the layout changes; older images are then ignored
+constexpr uint32_t IMAGE_VERSION = 2;
+constexpr size_t HEADER_SIZE = MAGIC_SIZE + 8;
+constexpr size_t DIRECTORY_ENTRY_SIZE = 48;
+constexpr size_t FOOTER_SIZE = 24 + MAGIC_SIZE;
+// A paced image is written in steps of this size, and synced every SYNC_STEP
+constexpr size_t PACING_STEP = 64 * 1024;
+constexpr uint64_t SYNC_STEP = 4 * 1024 * 1024;
+
+void storeU32(uint32_t value, char* out) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void storeU64(uint64_t value, char* out) {
+    storeU32(static_cast<uint32_t>(value & 0xFFFFFFFFU), out);
+    storeU32(static_cast<uint32_t>(value >> 32), out + 4);
+}
+
+uint32_t loadU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t loadU64(const char* data) {
+    return (static_cast<uint64_t>(loadU32(data + 4)) << 32) | loadU32(data);
+}
+
+bool isInside(uint64_t offset, uint64_t size, uint64_t fileSize) {
+    return (offset <= fileSize) && (size <= fileSize - offset);
+}
+
+}  // namespace
+
+CheckpointImage::CheckpointImage(const std::string& path) : mPath(path), mFile(path) {
+    if (!mFile.isOpen()) {
+        // No checkpoint yet
+        return;
+    }
+    mIsValid = readDirectory();
+    if (!mIsValid) {
+        LOG_ERROR("%s is not a valid checkpoint image", path.c_str());
+    }
+}
+
+bool CheckpointImage::readDirectory() {
+    const char* file = mFile.data();
+    const uint64_t fileSize = mFile.size();
+    if ((fileSize < HEADER_SIZE + FOOTER_SIZE)
+        || (std::memcmp(file, IMAGE_MAGIC, MAGIC_SIZE) != 0)
+        || (loadU32(file + MAGIC_SIZE) != IMAGE_VERSION)) {
+        return false;
+    }
+    const char* footer = file + fileSize - FOOTER_SIZE;
+    if (std::memcmp(footer + 24, IMAGE_MAGIC, MAGIC_SIZE) != 0) {
+        // Incomplete file
+        return false;
+    }
+    mLsn = loadU64(footer);
+    const uint64_t directoryOffset = loadU64(footer + 8);
+    const uint32_t tableCount = loadU32(footer + 16);
+    const uint64_t directorySize = static_cast<uint64_t>(tableCount) * DIRECTORY_ENTRY_SIZE;
+    if ((tableCount > TABLE_COUNT) || !isInside(directoryOffset, directorySize, fileSize)
+        || (crc32(file + directoryOffset, directorySize) != loadU32(footer + 20))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < tableCount; ++i) {
+        const char* entry = file + directoryOffset + i * DIRECTORY_ENTRY_SIZE;
+        const CheckpointSection section {
+            static_cast<TableID>(loadU32(entry)),
+            loadU32(entry + 4),
+            loadU64(entry + 8),
+            loadU64(entry + 16),
+            loadU64(entry + 24),
+            loadU64(entry + 32),
+            loadU32(entry + 40) };
+        const uint64_t fieldCount = section.rowCount * section.fieldCount;
+        if ((section.fieldCount != 0) && (fieldCount / section.fieldCount != section.rowCount)) {
+            return false;
+        }
+        if (!isInside(section.dataOffset, section.dataSize, fileSize)
+            || (fieldCount > fileSize / 8)
+            || !isInside(section.offsetsOffset, fieldCount * 8, fileSize)) {
+            return false;
+        }
+        mSections.emplace_back(section);
+    }
+    return true;
+}
+
+const CheckpointSection* CheckpointImage::section(TableID table) const {
+    for (const CheckpointSection& section : mSections) {
+        if (section.table == table) {
+            return &section;
+        }
+    }
+    return nullptr;
+}
+
+bool CheckpointImage::isIntact(const CheckpointSection& section) const {
+    uint32_t crc = crc32(data(section), section.dataSize);
+    crc = crc32(offsets(section), section.rowCount * section.fieldCount * 8, crc);
+    if (crc != section.crc) {
+        LOG_ERROR("Table %s of %s is corrupted; it is not loaded",
+                  std::to_string(static_cast<int>(section.table)).c_str(), mPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void CheckpointImage::readField(const CheckpointSection& section, uint64_t index,
+                                std::string* out) const {
+    const char* offsetTable = offsets(section);
+    const uint64_t fieldCount = section.rowCount * section.fieldCount;
+    const uint64_t start = loadU64(offsetTable + index * 8);
+    const uint64_t end = (index + 1 < fieldCount) ? loadU64(offsetTable + (index + 1) * 8)
+                                                  : section.dataSize;
+    if ((start > end) || (end > section.dataSize)) {
+        // Corrupted offsets; never read outside the table
+        out->clear();
+        return;
+    }
+    out->assign(data(section) + start, end - start);
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& path, uint64_t lsn)
+    : mPath(path), mTempPath(path + ".tmp"), mLsn(lsn) {
+    mFile = std::fopen(mTempPath.c_str(), "wb");
+    if (!mFile) {
+        LOG_ERROR("Cannot create %s", mTempPath.c_str());
+        return;
+    }
+    mIsGood = true;
+    char header[HEADER_SIZE] = {};
+    std::memcpy(header, IMAGE_MAGIC, MAGIC_SIZE);
+    storeU32(IMAGE_VERSION, header + MAGIC_SIZE);
+    writeBytes(header, sizeof(header));
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    if (mFile) {
+        // Not committed
+        std::fclose(mFile);
+        std::remove(mTempPath.c_str());
+    }
+}
+
+void CheckpointWriter::limitRate(size_t bytesPerSecond) {
+    mBytesPerSecond = bytesPerSecond;
+    mPacingStart = std::chrono::steady_clock::now();
+    mPacingOffset = mPosition;
+    mPacedPosition = mPosition;
+    mSyncedPosition = mPosition;
+}
+
+void CheckpointWriter::writeBytes(const char* data, size_t size) {
+    if (!mIsGood) {
+        return;
+    }
+    if (!mBytesPerSecond) {
+        mIsGood = std::fwrite(data, 1, size, mFile) == size;
+        mPosition += size;
+        return;
+    }
+    // In steps, so a large copied table is paced as well
+    while (mIsGood && (size > 0)) {
+        const size_t step = std::min(size, PACING_STEP - (mPosition - mPacedPosition));
+        mIsGood = std::fwrite(data, 1, step, mFile) == step;
+        mPosition += step;
+        data += step;
+        size -= step;
+        if ((mPosition - mPacedPosition) >= PACING_STEP) {
+            pace();
+        }
+    }
+}
+
+void CheckpointWriter::pace() {
+    mPacedPosition = mPosition;
+    if ((mPosition - mSyncedPosition) >= SYNC_STEP) {
+        // Otherwise the whole image would reach the disk at once in commit()
+        mIsGood = mIsGood && syncFile(mFile);
+        mSyncedPosition = mPosition;
+    }
+    const uint64_t written = mPosition - mPacingOffset;
+    std::this_thread::sleep_until(mPacingStart
+                                  + std::chrono::microseconds(written * 1000000 / mBytesPerSecond));
+}
+
+void CheckpointWriter::alignTo8() {
+    static const char padding[8] = {};
+    writeBytes(padding, (8 - (mPosition % 8)) % 8);
+}
+
+void CheckpointWriter::beginTable(TableID table, uint32_t fieldCount) {
+    mCurrent = CheckpointSection { table, fieldCount, 0, mPosition, 0, 0, 0 };
+    mFieldOffsets.clear();
+}
+
+void CheckpointWriter::writeField(const std::string& field) {
+    mFieldOffsets.emplace_back(mPosition - mCurrent.dataOffset);
+    mCurrent.crc = crc32(field.data(), field.size(), mCurrent.crc);
+    writeBytes(field.data(), field.size());
+}
+
+void CheckpointWriter::endTable() {
+    mCurrent.dataSize = mPosition - mCurrent.dataOffset;
+    alignTo8();
+    mCurrent.offsetsOffset = mPosition;
+    char buffer[8];
+    for (const uint64_t offset : mFieldOffsets) {
+        storeU64(offset, buffer);
+        mCurrent.crc = crc32(buffer, sizeof(buffer), mCurrent.crc);
+        writeBytes(buffer, sizeof(buffer));
+    }
+    mSections.emplace_back(mCurrent);
+}
+
+void CheckpointWriter::copy(const CheckpointImage& image, TableID table) {
+    const CheckpointSection* source = image.section(table);
+    if (!source) {
+        return;
+    }
+    // Offsets are relative to the table data, so both blocks (and their crc) are copied unchanged
+    CheckpointSection copied = *source;
+    copied.dataOffset = mPosition;
+    writeBytes(image.data(*source), source->dataSize);
+    alignTo8();
+    copied.offsetsOffset = mPosition;
+    writeBytes(image.offsets(*source), source->rowCount * source->fieldCount * 8);
+    mSections.emplace_back(copied);
+}
+
+bool CheckpointWriter::commit() {
+    if (!mFile) {
+        return false;
+    }
+    // Directory and footer
+    const uint64_t directoryOffset = mPosition;
+    std::string directory(mSections.size() * DIRECTORY_ENTRY_SIZE, '\0');
+    for (size_t i = 0; i < mSections.size(); ++i) {
+        char* entry = &directory[i * DIRECTORY_ENTRY_SIZE];
+        storeU32(static_cast<uint32_t>(mSections[i].table), entry);
+        storeU32(mSections[i].fieldCount, entry + 4);
+        storeU64(mSections[i].rowCount, entry + 8);
+        storeU64(mSections[i].dataOffset, entry + 16);
+        storeU64(mSections[i].dataSize, entry + 24);
+        storeU64(mSections[i].offsetsOffset, entry + 32);
+        storeU32(mSections[i].crc, entry + 40);
+    }
+    writeBytes(directory.data(), directory.size());
+    char footer[FOOTER_SIZE];
+    storeU64(mLsn, footer);
+    storeU64(directoryOffset, footer + 8);
+    storeU32(static_cast<uint32_t>(mSections.size()), footer + 16);
+    storeU32(crc32(directory.data(), directory.size()), footer + 20);
+    std::memcpy(footer + 24, IMAGE_MAGIC, MAGIC_SIZE);
+    writeBytes(footer, sizeof(footer));
+
+    mIsGood = mIsGood && syncFile(mFile);
+    std::fclose(mFile);
+    mFile = nullptr;
+    if (!mIsGood) {
+        LOG_ERROR("Failed to write the checkpoint %s", mTempPath.c_str());
+        std::remove(mTempPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on windows
+    std::remove(mPath.c_str());
+#endif
+    if (std::rename(mTempPath.c_str(), mPath.c_str()) != 0) {
+        LOG_ERROR("Cannot replace the checkpoint %s", mPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,207 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_CHECKPOINT_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_CHECKPOINT_HPP_
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "indexedtable.hpp"
+#include "mappedfile.hpp"
+#include "rowcodec.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Checkpoint image format (version 2), all integers little-endian
+ *
+ *   [magic 8][u32 version][u32 reserved]
+ *   per table: [field data][padding to 8][u64 field start offsets, one per field of every row]
+ *   directory: per table [u32 table ID][u32 field count][u64 rows][u64 data offset]
+ *                        [u64 data size][u64 offsets offset]
+ *                        [u32 crc32 of the field data and then the offsets][u32 reserved]
+ *   footer:    [u64 LSN][u64 directory offset][u32 table count][u32 directory crc32][magic 8]
+ *
+ * Any field of any row can be read in place without parsing the rest of the file,
+ * so the image is memory-mapped and a table is only decoded when it is first used.
+ * The directory is checked when the image is opened, a table when it is decoded.
+*/
+struct CheckpointSection {
+    TableID table;
+    uint32_t fieldCount;
+    uint64_t rowCount;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t offsetsOffset;
+    uint32_t crc;
+};
+
+/*!
+ * Memory-mapped checkpoint image
+*/
+class CheckpointImage {
+ public:
+    explicit CheckpointImage(const std::string& path);
+    ~CheckpointImage() = default;
+
+    inline bool isValid() const {
+        return mIsValid;
+    }
+
+    inline uint64_t lsn() const {
+        return mLsn;
+    }
+
+    /*!
+     * Returns null if the image has no such table
+    */
+    const CheckpointSection* section(TableID table) const;
+
+    inline const char* data(const CheckpointSection& section) const {
+        return mFile.data() + section.dataOffset;
+    }
+
+    inline const char* offsets(const CheckpointSection& section) const {
+        return mFile.data() + section.offsetsOffset;
+    }
+
+    /*!
+     * Returns false, and logs it, if the bytes of [section] do not match its checksum
+    */
+    bool isIntact(const CheckpointSection& section) const;
+
+    /*!
+     * Decodes the table rows from the image into [table], replacing its contents
+     * Returns false, and leaves [table] as it is, if its section is corrupted.
+    */
+    template <typename Table>
+    bool load(Table* table) const {
+        typedef typename Table::Row RowType;
+        typedef RowCodec<RowType> Codec;
+        const CheckpointSection* found = section(Codec::TABLE);
+        if (!found) {
+            // Not in the image: the table was empty
+            return true;
+        }
+        if ((found->fieldCount != Codec::FIELD_COUNT) || !isIntact(*found)) {
+            return false;
+        }
+        std::vector<RowType> rows;
+        rows.reserve(found->rowCount);
+        Fields fields(Codec::FIELD_COUNT);
+        uint64_t index = 0;
+        for (uint64_t row = 0; row < found->rowCount; ++row) {
+            for (size_t i = 0; i < Codec::FIELD_COUNT; ++i, ++index) {
+                readField(*found, index, &fields[i]);
+            }
+            rows.emplace_back(Codec::decode(fields));
+        }
+        table->assign(std::move(rows));
+        return true;
+    }
+
+ private:
+    const std::string mPath;
+    MappedFile mFile;
+    bool mIsValid = false;
+    uint64_t mLsn = 0;
+    std::vector<CheckpointSection> mSections;
+
+    bool readDirectory();
+    void readField(const CheckpointSection& section, uint64_t index, std::string* out) const;
+};
+
+/*!
+ * Writes a full image of the tables as of log sequence number [lsn]
+ *
+ * The image goes to a temporary file that replaces the previous checkpoint only in commit(),
+ * so a crash while writing leaves the old checkpoint (and its log) intact.
+ * e.g.
+ *     CheckpointWriter writer(path, lsn);
+ *     writer.write(PRODUCT_TABLE);
+ *     writer.commit();
+*/
+class CheckpointWriter {
+ public:
+    CheckpointWriter(const std::string& path, uint64_t lsn);
+    ~CheckpointWriter();
+
+    template <typename Table>
+    void write(const Table& table) {
+        typedef typename Table::Row RowType;
+        beginTable(RowCodec<RowType>::TABLE, RowCodec<RowType>::FIELD_COUNT);
+        for (const RowType& row : table) {
+            for (const std::string& field : RowCodec<RowType>::encode(row)) {
+                writeField(field);
+            }
+            ++mCurrent.rowCount;
+        }
+        endTable();
+    }
+
+    /*!
+     * Copies a table that was not changed as-is from the previous image
+    */
+    void copy(const CheckpointImage& image, TableID table);
+
+    /*!
+     * Paces the rest of the image to [bytesPerSecond] (0 is unlimited) and syncs it to the
+     * disk in steps, so a background image does not crowd out the other writes of the disk
+    */
+    void limitRate(size_t bytesPerSecond);
+
+    /*!
+     * Makes the image durable and replaces the previous checkpoint
+     * Returns false if anything failed; the previous checkpoint is kept then
+    */
+    bool commit();
+
+ private:
+    const std::string mPath;
+    const std::string mTempPath;
+    const uint64_t mLsn;
+    std::FILE* mFile = nullptr;
+    bool mIsGood = false;
+    uint64_t mPosition = 0;
+    std::vector<CheckpointSection> mSections;
+    CheckpointSection mCurrent {};
+    std::vector<uint64_t> mFieldOffsets;
+    // pacing, see limitRate()
+    size_t mBytesPerSecond = 0;
+    std::chrono::steady_clock::time_point mPacingStart;
+    uint64_t mPacingOffset = 0;
+    uint64_t mPacedPosition = 0;
+    uint64_t mSyncedPosition = 0;
+
+    void beginTable(TableID table, uint32_t fieldCount);
+    void writeField(const std::string& field);
+    void endTable();
+    void writeBytes(const char* data, size_t size);
+    void alignTo8();
+    void pace();
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_CHECKPOINT_HPP_
@@ -0,0 +1,580 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_COLUMNTABLE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_COLUMNTABLE_HPP_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "indexedtable.hpp"
+#include "persistentmap.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Table storage that keeps each field in its own typed array (see salescolumns.hpp)
+ *
+ * It has the same interface as IndexedTable so it can be logged, checkpointed and replayed
+ * the same way; iterating it builds the rows on the fly. Scans that only need a few fields
+ * should read snapshot().columns() directly instead.
+ *
+ * The columns are copy-on-write arrays, so versions are published the same way as in
+ * IndexedTable: readers are never blocked and always see one consistent version.
+ *
+ * erase() and eraseIf() leave a tombstone: the row is flagged and dropped from the indexes
+ * in O(1), and the other positions stay valid. compact() reclaims the erased rows (StackDB
+ * runs it in the background); scans of snapshot().columns() skip the rows where isErased() is
+ * true.
+ *
+ * [Columns] provides the arrays and the Row <-> columns conversion:
+ *     Row, PRIMARY_KEY (or nullptr), size(), key(pos), append(row), set(pos, row),
+ *     row(pos), read(pos, out) (into an existing row), move(from, to), resize(), reindex()
+ *     (rebuilds its own indexes after a move), unindex(pos) (drops an erased row from its own
+ *     indexes), isValid(row) (false if the typed columns cannot hold the row, e.g. an amount
+ *     that is not a number; such a row is not stored)
+*/
+template <typename Columns>
+class ColumnTable {
+    struct Version;
+
+ public:
+    typedef typename Columns::Row Row;
+    typedef std::string Row::*KeyField;
+    typedef std::function<void(Mutation, const Row* before, const Row* after)> Listener;
+
+    /*!
+     * Iterates the rows of one version; keeps that version alive while in use
+    */
+    class const_iterator {
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Row value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Row* pointer;
+        typedef Row reference;
+
+        /*!
+         * Creates the end iterator
+        */
+        const_iterator() = default;
+
+        explicit const_iterator(std::shared_ptr<const Version> version)
+            : mVersion(std::move(version)) {
+            skipErased();
+        }
+
+        inline Row operator*() const {
+            return mVersion->columns.row(mPos);
+        }
+
+        /*!
+         * Copies the row into [out], reusing the capacity of its strings
+        */
+        inline void read(Row* out) const {
+            mVersion->columns.read(mPos, out);
+        }
+
+        inline const_iterator& operator++() {
+            ++mPos;
+            skipErased();
+            return *this;
+        }
+
+        inline bool operator==(const const_iterator& other) const {
+            if (isEnd() || other.isEnd()) {
+                return isEnd() == other.isEnd();
+            }
+            return mPos == other.mPos;
+        }
+
+        inline bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+     private:
+        std::shared_ptr<const Version> mVersion;
+        size_t mPos = 0;
+
+        inline bool isEnd() const {
+            return !mVersion || (mPos >= mVersion->columns.size());
+        }
+
+        inline void skipErased() {
+            while (!isEnd() && mVersion->isErased(mPos)) {
+                ++mPos;
+            }
+        }
+    };
+
+    /*!
+     * Read-only view of the table at one point in time
+     * e.g.
+     *     const auto sales = DATABASE().SELECT_SALES_TABLE().snapshot();
+     *     const SalesColumns& columns = sales.columns();
+    */
+    class Snapshot {
+     public:
+        typedef typename Columns::Row Row;
+
+        explicit Snapshot(std::shared_ptr<const Version> version) : mVersion(std::move(version)) {}
+
+        inline const_iterator begin() const {
+            return const_iterator(mVersion);
+        }
+
+        inline const_iterator end() const {
+            return const_iterator();
+        }
+
+        inline size_t size() const {
+            return mVersion->rowCount();
+        }
+
+        inline bool empty() const {
+            return size() == 0;
+        }
+
+        /*!
+         * Typed column arrays, for scans; valid as long as the snapshot
+         * The columns still have the erased rows until the table is compacted.
+        */
+        inline const Columns& columns() const {
+            return mVersion->columns;
+        }
+
+        inline bool isErased(size_t pos) const {
+            return mVersion->isErased(pos);
+        }
+
+        inline bool contains(const std::string& key) const {
+            return mVersion->index.contains(key);
+        }
+
+        bool find(const std::string& key, Row* out) const {
+            const size_t* pos = mVersion->index.find(key);
+            if (!pos) {
+                return false;
+            }
+            if (out) {
+                mVersion->columns.read(*pos, out);
+            }
+            return true;
+        }
+
+     private:
+        std::shared_ptr<const Version> mVersion;
+    };
+
+    ColumnTable() = default;
+    ~ColumnTable() = default;
+
+    inline Snapshot snapshot() const {
+        return Snapshot(current());
+    }
+
+    inline const_iterator begin() const {
+        return const_iterator(current());
+    }
+
+    inline const_iterator end() const {
+        return const_iterator();
+    }
+
+    inline size_t size() const {
+        return current()->rowCount();
+    }
+
+    inline bool empty() const {
+        return size() == 0;
+    }
+
+    inline KeyField primaryKey() const {
+        return mPrimaryKey;
+    }
+
+    inline WriteLock lockWrites() const {
+        return WriteLock(mWriteMutex);
+    }
+
+    void setListener(const Listener& listener) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        mListener = listener;
+    }
+
+    /*!
+     * Keeps the writes from now on out of the published version until publishStaged()
+     * or discardStaged(); the writing thread must hold lockWrites() meanwhile
+     * Used by StackDB::Transaction to publish the changes of several tables together.
+     * The reads of the writing thread see the staged writes; the other threads do not.
+    */
+    void stageWrites() {
+        mStagingThread = std::this_thread::get_id();
+    }
+
+    void publishStaged() {
+        mStagingThread = std::thread::id();
+        if (mStaged) {
+            std::atomic_store(&mCurrent, std::move(mStaged));
+            mStaged.reset();
+        }
+    }
+
+    void discardStaged() {
+        mStagingThread = std::thread::id();
+        mStaged.reset();
+    }
+
+    /*!
+     * Share of the rows that are erased (0 to 1)
+    */
+    double erasedFraction() const {
+        const std::shared_ptr<const Version> version = current();
+        const size_t rows = version->columns.size();
+        return (rows == 0) ? 0 : static_cast<double>(version->erasedCount) / rows;
+    }
+
+    /*!
+     * Reclaims the erased rows; returns false if there were none
+     * Built from a snapshot without the write lock, like IndexedTable::compact()
+    */
+    bool compact() {
+        const std::shared_ptr<const Version> version = current();
+        if (version->erasedCount == 0) {
+            return false;
+        }
+        Version compacted = compactedOf(*version);
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        const std::shared_ptr<const Version> latestVersion = latest();
+        if (latestVersion != version) {
+            compacted = compactedOf(*latestVersion);
+        }
+        publish(std::move(compacted));
+        return true;
+    }
+
+    inline bool contains(const std::string& key) const {
+        return snapshot().contains(key);
+    }
+
+    inline bool find(const std::string& key, Row* out) const {
+        return snapshot().find(key, out);
+    }
+
+    bool insert(const Row& row) {
+        if (!Columns::isValid(row)) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        if (mPrimaryKey
+            && !next.index.insert(row.*mPrimaryKey, next.columns.size())) {
+            return false;
+        }
+        next.columns.append(row);
+        publish(std::move(next));
+        notify(Mutation::INSERT, nullptr, &row);
+        return true;
+    }
+
+    /*!
+     * Inserts the rows as one new version (bulk import); listeners still get every row
+     * A row whose key already exists is skipped and its position in [rows] is added to
+     * [duplicates]; an invalid row is skipped too. Returns how many rows were inserted.
+    */
+    size_t insertAll(const std::vector<Row>& rows, std::vector<size_t>* duplicates = nullptr) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        if (mPrimaryKey) {
+            next.index.reserve(next.index.size() + rows.size());
+        }
+        std::vector<const Row*> inserted;
+        inserted.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (!Columns::isValid(rows[i])) {
+                continue;
+            }
+            if (mPrimaryKey
+                && !next.index.insert(rows[i].*mPrimaryKey, next.columns.size())) {
+                if (duplicates) {
+                    duplicates->push_back(i);
+                }
+                continue;
+            }
+            next.columns.append(rows[i]);
+            inserted.push_back(&rows[i]);
+        }
+        if (inserted.empty()) {
+            return 0;
+        }
+        publish(std::move(next));
+        for (const Row* row : inserted) {
+            notify(Mutation::INSERT, nullptr, row);
+        }
+        return inserted.size();
+    }
+
+    bool update(const Row& row) {
+        if (!mPrimaryKey || !Columns::isValid(row)) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const size_t* pos = next.index.find(row.*mPrimaryKey);
+        if (!pos) {
+            return false;
+        }
+        replaceAt(&next, *pos, row);
+        return true;
+    }
+
+    template <typename Predicate>
+    bool updateIf(Predicate predicate, const Row& row) {
+        if (!Columns::isValid(row)) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        Row current;
+        for (size_t pos = 0; pos < next.columns.size(); ++pos) {
+            if (next.isErased(pos)) {
+                continue;
+            }
+            next.columns.read(pos, &current);
+            if (!predicate(current)) {
+                continue;
+            }
+            if (mPrimaryKey && (next.columns.key(pos) != row.*mPrimaryKey)) {
+                if (!next.index.insert(row.*mPrimaryKey, pos)) {
+                    return false;
+                }
+                next.index.erase(next.columns.key(pos));
+            }
+            replaceAt(&next, pos, row);
+            return true;
+        }
+        return false;
+    }
+
+    /*!
+     * Replaces all rows without notifying the listener (bulk load)
+    */
+    void assign(std::vector<Row> rows) {
+        Version next;
+        if (mPrimaryKey) {
+            next.index.reserve(rows.size());
+        }
+        for (const Row& row : rows) {
+            if (!Columns::isValid(row)) {
+                continue;
+            }
+            if (mPrimaryKey
+                && !next.index.insert(row.*mPrimaryKey, next.columns.size())) {
+                continue;
+            }
+            next.columns.append(row);
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        publish(std::move(next));
+    }
+
+    bool erase(const std::string& key) {
+        if (!mPrimaryKey) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const size_t* found = next.index.find(key);
+        if (!found) {
+            return false;
+        }
+        const size_t pos = *found;
+        const Row erased = next.columns.row(pos);
+        next.index.erase(key);
+        next.columns.unindex(pos);
+        markErased(&next, pos);
+        publish(std::move(next));
+        notify(Mutation::ERASE, &erased, nullptr);
+        return true;
+    }
+
+    /*!
+     * Erases the matching rows; they are left as tombstones, like erase()
+    */
+    template <typename Predicate>
+    size_t eraseIf(Predicate predicate) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        std::vector<Row> erased;
+        Row row;
+        for (size_t pos = 0; pos < next.columns.size(); ++pos) {
+            if (next.isErased(pos)) {
+                continue;
+            }
+            next.columns.read(pos, &row);
+            if (predicate(row)) {
+                if (mPrimaryKey) {
+                    next.index.erase(row.*mPrimaryKey);
+                }
+                next.columns.unindex(pos);
+                markErased(&next, pos);
+                erased.emplace_back(std::move(row));
+            }
+        }
+        if (erased.empty()) {
+            return 0;
+        }
+        publish(std::move(next));
+        for (const Row& row : erased) {
+            notify(Mutation::ERASE, &row, nullptr);
+        }
+        return erased.size();
+    }
+
+ private:
+    /*!
+     * Columns and index of one point in time; immutable once published
+    */
+    struct Version {
+        Columns columns;
+        // primary key -> row position
+        PersistentMap<size_t> index;
+        // 1 for an erased row; the rows after its end are not erased
+        PersistentVector<uint8_t> erased;
+        size_t erasedCount = 0;
+
+        inline bool isErased(size_t pos) const {
+            return (pos < erased.size()) && (erased[pos] != 0);
+        }
+
+        inline size_t rowCount() const {
+            return columns.size() - erasedCount;
+        }
+    };
+
+    const KeyField mPrimaryKey = Columns::PRIMARY_KEY;
+    Listener mListener;
+    // recursive, so a transaction can hold it across the write calls
+    mutable std::recursive_mutex mWriteMutex;
+    // only read and replaced through std::atomic_load/std::atomic_store
+    std::shared_ptr<const Version> mCurrent = std::make_shared<const Version>();
+    // while staging: the writes that are not published yet (null if there are none)
+    std::shared_ptr<const Version> mStaged;
+    // the thread that stages its writes (none if not staging); only it touches mStaged
+    std::atomic<std::thread::id> mStagingThread { std::thread::id() };
+
+    /*!
+     * The version the readers see: the published one, or the staged one on the staging thread
+    */
+    inline std::shared_ptr<const Version> current() const {
+        if ((mStagingThread.load() == std::this_thread::get_id()) && mStaged) {
+            return mStaged;
+        }
+        return std::atomic_load(&mCurrent);
+    }
+
+    /*!
+     * The version the next write starts from; call with the write lock held
+    */
+    inline std::shared_ptr<const Version> latest() const {
+        return mStaged ? mStaged : current();
+    }
+
+    inline void publish(Version&& next) {
+        std::shared_ptr<const Version> version = std::make_shared<const Version>(std::move(next));
+        if (mStagingThread.load() != std::thread::id()) {
+            mStaged = std::move(version);
+            return;
+        }
+        std::atomic_store(&mCurrent, std::move(version));
+    }
+
+    void notify(Mutation mutation, const Row* before, const Row* after) const {
+        if (mListener) {
+            mListener(mutation, before, after);
+        }
+    }
+
+    void replaceAt(Version* next, size_t pos, const Row& row) {
+        if (!mListener) {
+            next->columns.set(pos, row);
+            publish(std::move(*next));
+            return;
+        }
+        const Row before = next->columns.row(pos);
+        next->columns.set(pos, row);
+        publish(std::move(*next));
+        notify(Mutation::UPDATE, &before, &row);
+    }
+
+    static void markErased(Version* next, size_t pos) {
+        while (next->erased.size() <= pos) {
+            next->erased.push_back(0);
+        }
+        next->erased.set(pos, 1);
+        ++next->erasedCount;
+    }
+
+    /*!
+     * Returns [version] without its erased rows; the later rows move up, so positions change
+    */
+    Version compactedOf(const Version& version) const {
+        Version compacted(version);
+        size_t pos = 0;
+        for (size_t i = 0; i < version.columns.size(); ++i) {
+            if (version.isErased(i)) {
+                continue;
+            }
+            if (pos != i) {
+                compacted.columns.move(i, pos);
+            }
+            ++pos;
+        }
+        compacted.columns.resize(pos);
+        compacted.columns.reindex();
+        compacted.erased.clear();
+        compacted.erasedCount = 0;
+        reindex(&compacted);
+        return compacted;
+    }
+
+    void reindex(Version* next) const {
+        if (!mPrimaryKey) {
+            return;
+        }
+        next->index.clear();
+        next->index.reserve(next->columns.size());
+        for (size_t pos = 0; pos < next->columns.size(); ++pos) {
+            next->index.insert(next->columns.key(pos), pos);
+        }
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_COLUMNTABLE_HPP_
@@ -0,0 +1,41 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_DBCONFIG_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_DBCONFIG_HPP_
+#include <cstddef>
+#include <string>
+
+namespace dataprovider {
+namespace db {
+
+// the settings of the database and of its storage engines
+constexpr char DB_CONFIG[] = "psdb.cfg";
+constexpr size_t DEFAULT_CHECKPOINT_RECORDS = 10000;
+constexpr size_t DEFAULT_COMPACTION_PERCENT = 30;
+
+/*!
+ * The number in the setting [value]; [defaultValue] if it is empty or not a number
+*/
+size_t toNumber(const std::string& value, size_t defaultValue);
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_DBCONFIG_HPP_
@@ -0,0 +1,101 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_DICTIONARY_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_DICTIONARY_HPP_
+#include <cstdint>
+#include <string>
+#include "persistentmap.hpp"
+#include "persistentvector.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Maps the distinct values of a low-cardinality column to dense 32-bit codes
+ * Codes are never reused, so a code stays valid after the rows that used it are removed
+ * Copies share their storage, so a dictionary is copied with each table version for free.
+*/
+class Dictionary {
+ public:
+    Dictionary() = default;
+    ~Dictionary() = default;
+
+    /*!
+     * Returns the code of [value], adding it if it is new
+    */
+    uint32_t encode(const std::string& value) {
+        const uint32_t* found = mCodes.find(value);
+        if (found) {
+            return *found;
+        }
+        const uint32_t code = static_cast<uint32_t>(mValues.size());
+        mValues.push_back(value);
+        mCodes.insert(value, code);
+        return code;
+    }
+
+    /*!
+     * Returns false if [value] has no code yet (i.e. no row can match it)
+    */
+    bool find(const std::string& value, uint32_t* code) const {
+        const uint32_t* found = mCodes.find(value);
+        if (!found) {
+            return false;
+        }
+        *code = *found;
+        return true;
+    }
+
+    inline const std::string& decode(uint32_t code) const {
+        return mValues[code];
+    }
+
+    inline size_t size() const {
+        return mValues.size();
+    }
+
+ private:
+    PersistentVector<std::string> mValues;
+    PersistentMap<uint32_t> mCodes;
+};
+
+/*!
+ * Calls [function] with the position of every row whose code in [codes] stands for [value]
+ * The value is looked up once; the scan itself only compares integers.
+ * e.g. forEachEqual(columns.categories, columns.category, "Drinks", [](size_t pos) {...});
+*/
+template <typename Function>
+void forEachEqual(const Dictionary& dictionary, const PersistentVector<uint32_t>& codes,
+                  const std::string& value, Function function) {
+    uint32_t code = 0;
+    if (!dictionary.find(value, &code)) {
+        return;
+    }
+    for (auto it = codes.begin(); it != codes.end(); ++it) {
+        if (*it == code) {
+            function(it.position());
+        }
+    }
+}
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_DICTIONARY_HPP_
@@ -0,0 +1,90 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "durablelog.hpp"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+namespace db {
+
+DurableLog::DurableLog(const std::string& checkpointPath, const std::string& logPath,
+                       size_t checkpointRecords, Sections sections)
+    : mCheckpointPath(checkpointPath), mLogPath(logPath), mCheckpointRecords(checkpointRecords),
+      mSections(std::move(sections)) {}
+
+uint64_t DurableLog::open(uint64_t checkpointLsn, const WriteAheadLog::Apply& apply,
+                          unsigned commitDelayUs) {
+    const uint64_t lsn = WriteAheadLog::replay(mLogPath, checkpointLsn, apply);
+    mWal.reset(new WriteAheadLog(mLogPath, lsn, commitDelayUs));
+    return lsn;
+}
+
+bool DurableLog::commit(uint64_t lsn, const std::function<void()>& upkeep) {
+    if (!mWal->commit(lsn)) {
+        return false;
+    }
+    if (!upkeep && (mWal->recordCount() < mCheckpointRecords)) {
+        return true;
+    }
+    // One committer does it; the others do not wait for it
+    std::unique_lock<std::mutex> lock(mCheckpointMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return true;
+    }
+    if (mWal->recordCount() >= mCheckpointRecords) {
+        writeCheckpoint();
+    }
+    if (upkeep) {
+        upkeep();
+    }
+    return true;
+}
+
+bool DurableLog::checkpoint() {
+    std::lock_guard<std::mutex> lock(mCheckpointMutex);
+    return writeCheckpoint();
+}
+
+std::unique_lock<std::mutex> DurableLog::lockCheckpoints() {
+    return std::unique_lock<std::mutex>(mCheckpointMutex);
+}
+
+bool DurableLog::writeCheckpoint() {
+    uint64_t lsn = 0;
+    const std::vector<Section> sections = mSections(&lsn);
+    CheckpointWriter writer(mCheckpointPath, lsn);
+    for (const Section& writeSection : sections) {
+        writeSection(&writer);
+    }
+    if (!writer.commit()) {
+        // Keep the log; it is still needed on top of the previous checkpoint
+        return false;
+    }
+    mWal->reset(lsn);
+    return true;
+}
+
+}  // namespace db
+}  // namespace dataprovider
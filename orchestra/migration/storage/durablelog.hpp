@@ -0,0 +1,198 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_DURABLELOG_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_DURABLELOG_HPP_
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "checkpoint.hpp"
+#include "rowcodec.hpp"
+#include "salescolumns.hpp"
+#include "wal.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Adds a logged stock change to the product row; the other rows have no stock
+*/
+template <typename Table, typename RowType>
+void addStock(const LogRecord&, Table*, const RowType*) {}
+
+template <typename Table>
+void addStock(const LogRecord& record, Table* table, const ProductTableItem*) {
+    int64_t quantity = 0;
+    ProductTableItem row;
+    if ((record.after.size() != 2) || !parseInteger(record.after[1], &quantity)
+        || !table->find(record.after[0], &row)) {
+        return;
+    }
+    row.stock = std::to_string(parseInteger(row.stock) + quantity);
+    table->update(row);
+}
+
+/*!
+ * Re-applies a logged mutation to its table
+ * Rows are matched by the primary key, or by their full contents if the table has none
+*/
+template <typename Table>
+void applyRecord(const LogRecord& record, Table* table) {
+    typedef typename Table::Row RowType;
+    typedef RowCodec<RowType> Codec;
+    if (record.table != Codec::TABLE) {
+        return;
+    }
+    const bool hasBefore = record.before.size() == Codec::FIELD_COUNT;
+    const bool hasAfter = record.after.size() == Codec::FIELD_COUNT;
+    const auto key = table->primaryKey();
+    switch (record.operation) {
+        case Mutation::INSERT:
+            if (hasAfter) {
+                table->insert(Codec::decode(record.after));
+            }
+            break;
+        case Mutation::UPDATE: {
+            if (!hasBefore || !hasAfter) {
+                break;
+            }
+            const RowType after = Codec::decode(record.after);
+            if (key && (Codec::decode(record.before).*key == after.*key)) {
+                table->update(after);
+                break;
+            }
+            table->updateIf([&record](const RowType& row) {
+                return Codec::encode(row) == record.before;
+            }, after);
+            break;
+        }
+        case Mutation::ERASE: {
+            if (!hasBefore) {
+                break;
+            }
+            if (key) {
+                table->erase(Codec::decode(record.before).*key);
+                break;
+            }
+            // Only one row per record; identical rows have a record each
+            bool isErased = false;
+            table->eraseIf([&record, &isErased](const RowType& row) {
+                if (isErased || (Codec::encode(row) != record.before)) {
+                    return false;
+                }
+                isErased = true;
+                return true;
+            });
+            break;
+        }
+        case Mutation::STOCK:
+            addStock(record, table, static_cast<const RowType*>(nullptr));
+            break;
+        case Mutation::BEGIN:
+        case Mutation::COMMIT:
+            // Handled by the log replay
+            break;
+    }
+}
+
+/*!
+ * The log record of a table mutation, as the table listener gets it
+*/
+template <typename RowType>
+LogRecord recordOf(Mutation operation, const RowType* before, const RowType* after) {
+    return LogRecord { 0, RowCodec<RowType>::TABLE, operation,
+                       before ? RowCodec<RowType>::encode(*before) : Fields(),
+                       after ? RowCodec<RowType>::encode(*after) : Fields() };
+}
+
+/*!
+ * Compacts [table] once [threshold] of its rows are erased; returns true if it was compacted
+*/
+template <typename Table>
+bool compactIfDue(Table* table, double threshold) {
+    return (table->erasedFraction() >= threshold) && table->compact();
+}
+
+/*!
+ * A write-ahead log and the checkpoint that bounds it; the persistence of StackDB and of
+ * each table shard
+ *
+ * The owner loads the checkpoint, and open() replays the log on top of it. commit() makes the
+ * log durable up to an LSN, then writes a checkpoint once the log reaches [checkpointRecords]:
+ * one committer writes it while the others go on. A checkpoint writes the image [sections]
+ * of the tables, taken at one log position, and drops the log records that the image holds.
+*/
+class DurableLog {
+ public:
+    typedef std::function<void(CheckpointWriter*)> Section;
+    /*!
+     * Snapshots the tables; returns the writers of their sections and sets [lsn] to the last
+     * LSN that the snapshots have
+    */
+    typedef std::function<std::vector<Section>(uint64_t* lsn)> Sections;
+
+    DurableLog(const std::string& checkpointPath, const std::string& logPath,
+               size_t checkpointRecords, Sections sections);
+
+    /*!
+     * Applies the log records after [checkpointLsn] and opens the log for appending
+     * Returns the last LSN of the log
+    */
+    uint64_t open(uint64_t checkpointLsn, const WriteAheadLog::Apply& apply,
+                  unsigned commitDelayUs);
+
+    inline WriteAheadLog& log() {
+        return *mWal;
+    }
+
+    /*!
+     * Blocks until every record up to [lsn] is durable; returns false if it could not be
+     * written
+     * Then the committer that is not beaten to it writes the checkpoint, if due, and runs
+     * [upkeep], e.g. compaction.
+    */
+    bool commit(uint64_t lsn, const std::function<void()>& upkeep = nullptr);
+    /*!
+     * Writes a checkpoint now
+    */
+    bool checkpoint();
+    /*!
+     * Holds off the checkpoints until the lock is released
+    */
+    std::unique_lock<std::mutex> lockCheckpoints();
+
+ private:
+    const std::string mCheckpointPath;
+    const std::string mLogPath;
+    const size_t mCheckpointRecords;
+    const Sections mSections;
+    std::unique_ptr<WriteAheadLog> mWal;
+    // checkpoints and upkeep, one at a time
+    std::mutex mCheckpointMutex;
+
+    bool writeCheckpoint();
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_DURABLELOG_HPP_
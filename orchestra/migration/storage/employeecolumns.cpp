@@ -0,0 +1,114 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "employeecolumns.hpp"
+
+namespace dataprovider {
+namespace db {
+
+void EmployeeColumns::append(const Row& row) {
+    employeeID.push_back(row.employeeID);
+    firstname.push_back(row.firstname);
+    middlename.push_back(row.middlename);
+    lastname.push_back(row.lastname);
+    birthdate.push_back(row.birthdate);
+    isSystemUser.push_back(row.isSystemUser ? 1 : 0);
+    gender.push_back(genders.encode(row.gender));
+    position.push_back(positions.encode(row.position));
+    status.push_back(statuses.encode(row.status));
+}
+
+void EmployeeColumns::set(size_t pos, const Row& row) {
+    employeeID.set(pos, row.employeeID);
+    firstname.set(pos, row.firstname);
+    middlename.set(pos, row.middlename);
+    lastname.set(pos, row.lastname);
+    birthdate.set(pos, row.birthdate);
+    isSystemUser.set(pos, row.isSystemUser ? 1 : 0);
+    gender.set(pos, genders.encode(row.gender));
+    position.set(pos, positions.encode(row.position));
+    status.set(pos, statuses.encode(row.status));
+}
+
+EmployeeColumns::Row EmployeeColumns::row(size_t pos) const {
+    Row out;
+    read(pos, &out);
+    return out;
+}
+
+void EmployeeColumns::read(size_t pos, Row* out) const {
+    out->employeeID = employeeID[pos];
+    out->firstname = firstname[pos];
+    out->middlename = middlename[pos];
+    out->lastname = lastname[pos];
+    out->birthdate = birthdate[pos];
+    out->gender = genders.decode(gender[pos]);
+    out->position = positions.decode(position[pos]);
+    out->status = statuses.decode(status[pos]);
+    out->isSystemUser = isSystemUser[pos] != 0;
+}
+
+const std::string& EmployeeColumns::field(std::string Row::*field, size_t pos,
+                                          std::string* buffer) const {
+    if (field == &Row::employeeID) {
+        return employeeID[pos];
+    } else if (field == &Row::firstname) {
+        return firstname[pos];
+    } else if (field == &Row::middlename) {
+        return middlename[pos];
+    } else if (field == &Row::lastname) {
+        return lastname[pos];
+    } else if (field == &Row::birthdate) {
+        return birthdate[pos];
+    } else if (field == &Row::gender) {
+        return genders.decode(gender[pos]);
+    } else if (field == &Row::position) {
+        return positions.decode(position[pos]);
+    }
+    // status
+    return statuses.decode(status[pos]);
+}
+
+void EmployeeColumns::move(size_t from, size_t to) {
+    employeeID.set(to, employeeID[from]);
+    firstname.set(to, firstname[from]);
+    middlename.set(to, middlename[from]);
+    lastname.set(to, lastname[from]);
+    birthdate.set(to, birthdate[from]);
+    isSystemUser.set(to, isSystemUser[from]);
+    gender.set(to, gender[from]);
+    position.set(to, position[from]);
+    status.set(to, status[from]);
+}
+
+void EmployeeColumns::resize(size_t size) {
+    employeeID.resize(size);
+    firstname.resize(size);
+    middlename.resize(size);
+    lastname.resize(size);
+    birthdate.resize(size);
+    isSystemUser.resize(size);
+    gender.resize(size);
+    position.resize(size);
+    status.resize(size);
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,94 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_EMPLOYEECOLUMNS_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_EMPLOYEECOLUMNS_HPP_
+#include <cstdint>
+#include <string>
+#include "dictionary.hpp"
+#include "persistentvector.hpp"
+#include "table.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Column storage of EmployeeTableItem
+ * gender, position and status hold dictionary codes (see ProductColumns)
+*/
+struct EmployeeColumns {
+    typedef EmployeeTableItem Row;
+    static constexpr std::string Row::*PRIMARY_KEY = &Row::employeeID;
+
+    PersistentVector<std::string> employeeID;
+    PersistentVector<std::string> firstname;
+    PersistentVector<std::string> middlename;
+    PersistentVector<std::string> lastname;
+    PersistentVector<std::string> birthdate;
+    // 0 or 1; a chunk cannot be a std::vector<bool>
+    PersistentVector<uint8_t> isSystemUser;
+    // dictionary codes
+    PersistentVector<uint32_t> gender;
+    PersistentVector<uint32_t> position;
+    PersistentVector<uint32_t> status;
+    Dictionary genders;
+    Dictionary positions;
+    Dictionary statuses;
+
+    inline size_t size() const {
+        return employeeID.size();
+    }
+
+    inline const std::string& key(size_t pos) const {
+        return employeeID[pos];
+    }
+
+    void append(const Row& row);
+    void set(size_t pos, const Row& row);
+    Row row(size_t pos) const;
+    /*!
+     * Copies the row at [pos] into [out], reusing the capacity of its strings
+     * A scan that reads every row into the same [out] stops allocating after a few rows.
+    */
+    void read(size_t pos, Row* out) const;
+    /*!
+     * One field of the row at [pos], read without building the row (see Selection)
+     * [buffer] holds the value if the column does not store it as text
+    */
+    const std::string& field(std::string Row::*field, size_t pos, std::string* buffer) const;
+    /*!
+     * The flag of the row at [pos]; isSystemUser is the only one
+    */
+    inline bool flag(bool Row::*, size_t pos) const {
+        return isSystemUser[pos] != 0;
+    }
+    void move(size_t from, size_t to);
+    void resize(size_t size);
+    inline void reindex() {}
+    inline void unindex(size_t) {}
+    // every field is stored as text
+    static inline bool isValid(const Row&) {
+        return true;
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_EMPLOYEECOLUMNS_HPP_
@@ -0,0 +1,741 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_INDEXEDTABLE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_INDEXEDTABLE_HPP_
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "persistentmap.hpp"
+#include "persistentvector.hpp"
+
+namespace dataprovider {
+namespace db {
+
+enum class Mutation : uint8_t {
+    INSERT = 0x00,
+    UPDATE = 0x01,
+    ERASE  = 0x02,
+    // log markers around the records of a transaction; never passed to a table listener
+    BEGIN  = 0x03,
+    COMMIT = 0x04,
+    // a change to the stock of a product, after = { barcode, quantity }; logged by
+    // StackDB::logStock() and never passed to a table listener
+    STOCK  = 0x05
+};
+
+typedef std::unique_lock<std::recursive_mutex> WriteLock;
+
+/*!
+ * Table storage with an optional primary-key hash index
+ *
+ * Rows are kept in insertion order so list screens see the same order as before.
+ * The index maps the primary key to the row position and is kept in sync by every
+ * mutation below. Mutate the table only through this class; never through the rows.
+ *
+ * Detail tables (e.g. address) can also have a non-unique secondary key that links
+ * the row to its owner; the secondary index maps that key to all its row positions.
+ *
+ * Concurrency: the rows and indexes form an immutable version that is shared by copy-on-write
+ * (see persistentvector.hpp). Readers take the current version without locking and are never
+ * blocked by writers; a writer builds the next version under the table's write lock and
+ * publishes it atomically. Every read call and every iteration sees one consistent version.
+ * An erased row leaves an empty slot (tombstone), so erasing is O(1) and the other positions
+ * stay valid; compact() reclaims the slots (StackDB runs it in the background).
+*/
+template <typename RowType>
+class IndexedTable {
+    struct Version;
+
+ public:
+    typedef RowType Row;
+    typedef std::string RowType::*KeyField;
+    /*!
+     * Called after every applied mutation, under the table's write lock
+     * [before] is null for INSERT; [after] is null for ERASE
+    */
+    typedef std::function<void(Mutation, const RowType* before, const RowType* after)> Listener;
+
+    /*!
+     * Iterates the rows of one version; keeps that version alive while in use
+    */
+    class const_iterator {
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef RowType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const RowType* pointer;
+        typedef const RowType& reference;
+
+        /*!
+         * Creates the end iterator
+        */
+        const_iterator() = default;
+
+        explicit const_iterator(std::shared_ptr<const Version> version)
+            : mVersion(std::move(version)), mSlot(mVersion->rows.begin()) {
+            skipErased();
+        }
+
+        inline const RowType& operator*() const {
+            return **mSlot;
+        }
+
+        inline const RowType* operator->() const {
+            return mSlot->get();
+        }
+
+        inline void read(RowType* out) const {
+            *out = **mSlot;
+        }
+
+        inline const_iterator& operator++() {
+            ++mSlot;
+            skipErased();
+            return *this;
+        }
+
+        inline bool operator==(const const_iterator& other) const {
+            if (isEnd() || other.isEnd()) {
+                return isEnd() == other.isEnd();
+            }
+            return mSlot == other.mSlot;
+        }
+
+        inline bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+     private:
+        std::shared_ptr<const Version> mVersion;
+        typename PersistentVector<std::shared_ptr<const RowType>>::const_iterator mSlot {
+            nullptr, 0 };
+
+        inline bool isEnd() const {
+            return !mVersion || (mSlot.position() >= mVersion->rows.size());
+        }
+
+        void skipErased() {
+            while (!isEnd() && !*mSlot) {
+                ++mSlot;
+            }
+        }
+    };
+
+    /*!
+     * Read-only view of the table at one point in time
+     * Mutations made after it was taken are not visible through it.
+    */
+    class Snapshot {
+     public:
+        typedef RowType Row;
+
+        explicit Snapshot(std::shared_ptr<const Version> version) : mVersion(std::move(version)) {}
+
+        inline const_iterator begin() const {
+            return const_iterator(mVersion);
+        }
+
+        inline const_iterator end() const {
+            return const_iterator();
+        }
+
+        inline size_t size() const {
+            return mVersion->rowCount;
+        }
+
+        inline bool empty() const {
+            return mVersion->rowCount == 0;
+        }
+
+        /*!
+         * Returns true if a row with the primary key exists
+        */
+        inline bool contains(const std::string& key) const {
+            return mVersion->index.contains(key);
+        }
+
+        /*!
+         * Copies the row with the primary key into [out]
+         * Returns false if the key is not found
+        */
+        bool find(const std::string& key, RowType* out) const {
+            const size_t* pos = mVersion->index.find(key);
+            if (!pos) {
+                return false;
+            }
+            if (out) {
+                *out = *mVersion->rows[*pos];
+            }
+            return true;
+        }
+
+        /*!
+         * Calls [function] for every row with the secondary key, in insertion order
+        */
+        template <typename Function>
+        void forEachOf(const std::string& key, Function function) const {
+            const std::vector<size_t>* positions = mVersion->secondaryIndex.find(key);
+            if (!positions) {
+                return;
+            }
+            for (const size_t pos : *positions) {
+                function(*mVersion->rows[pos]);
+            }
+        }
+
+        /*!
+         * Copies the first row with the secondary key into [out]
+         * Returns false if the key is not found
+        */
+        bool findFirstOf(const std::string& key, RowType* out) const {
+            const std::vector<size_t>* positions = mVersion->secondaryIndex.find(key);
+            if (!positions) {
+                return false;
+            }
+            if (out) {
+                *out = *mVersion->rows[positions->front()];
+            }
+            return true;
+        }
+
+     private:
+        std::shared_ptr<const Version> mVersion;
+    };
+
+    /*!
+     * Creates a table without a primary key (e.g. detail tables)
+    */
+    IndexedTable() = default;
+    /*!
+     * Creates a table indexed by the primary key field
+     * e.g. IndexedTable<ProductTableItem> table(&ProductTableItem::barcode);
+    */
+    explicit IndexedTable(KeyField primaryKey) : mPrimaryKey(primaryKey) {}
+    /*!
+     * Creates a table with a secondary (non-unique) key index
+     * e.g. IndexedTable<AddressTableItem> table(nullptr, &AddressTableItem::ID);
+    */
+    IndexedTable(KeyField primaryKey, KeyField secondaryKey)
+        : mPrimaryKey(primaryKey), mSecondaryKey(secondaryKey) {}
+    ~IndexedTable() = default;
+
+    /*!
+     * Returns the current version of the table; never blocks
+    */
+    inline Snapshot snapshot() const {
+        return Snapshot(current());
+    }
+
+    inline const_iterator begin() const {
+        return const_iterator(current());
+    }
+
+    inline const_iterator end() const {
+        return const_iterator();
+    }
+
+    inline size_t size() const {
+        return current()->rowCount;
+    }
+
+    inline bool empty() const {
+        return size() == 0;
+    }
+
+    inline KeyField primaryKey() const {
+        return mPrimaryKey;
+    }
+
+    inline KeyField secondaryKey() const {
+        return mSecondaryKey;
+    }
+
+    /*!
+     * Blocks the writers of this table while the lock is held
+     * e.g. to read the log position that matches a snapshot
+    */
+    inline WriteLock lockWrites() const {
+        return WriteLock(mWriteMutex);
+    }
+
+    /*!
+     * Sets the function that observes the mutations (e.g. the write-ahead log)
+    */
+    void setListener(const Listener& listener) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        mListener = listener;
+    }
+
+    /*!
+     * Keeps the writes from now on out of the published version until publishStaged()
+     * or discardStaged(); the writing thread must hold lockWrites() meanwhile
+     * Used by StackDB::Transaction to publish the changes of several tables together.
+     * The reads of the writing thread see the staged writes; the other threads do not.
+    */
+    void stageWrites() {
+        mStagingThread = std::this_thread::get_id();
+    }
+
+    void publishStaged() {
+        mStagingThread = std::thread::id();
+        if (mStaged) {
+            std::atomic_store(&mCurrent, std::move(mStaged));
+            mStaged.reset();
+        }
+    }
+
+    void discardStaged() {
+        mStagingThread = std::thread::id();
+        mStaged.reset();
+    }
+
+    /*!
+     * Share of the row slots that are erased (0 to 1)
+    */
+    double erasedFraction() const {
+        const std::shared_ptr<const Version> version = current();
+        const size_t slots = version->rows.size();
+        return (slots == 0) ? 0 : static_cast<double>(slots - version->rowCount) / slots;
+    }
+
+    /*!
+     * Reclaims the erased slots; returns false if there were none
+     * The compacted version is built without the write lock, from a snapshot. It is only
+     * rebuilt under the lock if the table was written meanwhile.
+    */
+    bool compact() {
+        const std::shared_ptr<const Version> version = current();
+        if (version->rowCount == version->rows.size()) {
+            return false;
+        }
+        Version compacted = compactedOf(*version);
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        const std::shared_ptr<const Version> latestVersion = latest();
+        if (latestVersion != version) {
+            compacted = compactedOf(*latestVersion);
+        }
+        publish(std::move(compacted));
+        return true;
+    }
+
+    inline bool contains(const std::string& key) const {
+        return snapshot().contains(key);
+    }
+
+    inline bool find(const std::string& key, RowType* out) const {
+        return snapshot().find(key, out);
+    }
+
+    template <typename Function>
+    inline void forEachOf(const std::string& key, Function function) const {
+        snapshot().forEachOf(key, function);
+    }
+
+    inline bool findFirstOf(const std::string& key, RowType* out) const {
+        return snapshot().findFirstOf(key, out);
+    }
+
+    /*!
+     * Appends the row
+     * Returns false if the primary key already exists
+    */
+    bool insert(const RowType& row) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const size_t pos = next.rows.size();
+        if (mPrimaryKey && !next.index.insert(row.*mPrimaryKey, pos)) {
+            return false;
+        }
+        if (mSecondaryKey) {
+            link(&next, row.*mSecondaryKey, pos);
+        }
+        const std::shared_ptr<const RowType> inserted = std::make_shared<const RowType>(row);
+        next.rows.push_back(inserted);
+        ++next.rowCount;
+        publish(std::move(next));
+        notify(Mutation::INSERT, nullptr, inserted.get());
+        return true;
+    }
+
+    /*!
+     * Inserts the rows as one new version (bulk import); listeners still get every row
+     * A row whose primary key already exists is skipped and its position in [rows] is added
+     * to [duplicates]. Returns how many rows were inserted.
+    */
+    size_t insertAll(const std::vector<RowType>& rows,
+                     std::vector<size_t>* duplicates = nullptr) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        if (mPrimaryKey) {
+            next.index.reserve(next.index.size() + rows.size());
+        }
+        std::vector<RowType> inserted;
+        inserted.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const size_t pos = next.rows.size() + inserted.size();
+            if (mPrimaryKey && !next.index.insert(rows[i].*mPrimaryKey, pos)) {
+                if (duplicates) {
+                    duplicates->push_back(i);
+                }
+                continue;
+            }
+            if (mSecondaryKey) {
+                link(&next, rows[i].*mSecondaryKey, pos);
+            }
+            inserted.push_back(rows[i]);
+        }
+        if (inserted.empty()) {
+            return 0;
+        }
+        const auto block = appendBlock(&next, std::move(inserted));
+        publish(std::move(next));
+        for (const RowType& row : *block) {
+            notify(Mutation::INSERT, nullptr, &row);
+        }
+        return block->size();
+    }
+
+    /*!
+     * Replaces the row that has the same primary key
+     * Returns false if the key is not found
+    */
+    bool update(const RowType& row) {
+        if (!mPrimaryKey) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const size_t* pos = next.index.find(row.*mPrimaryKey);
+        if (!pos) {
+            return false;
+        }
+        replaceAt(&next, *pos, row);
+        return true;
+    }
+
+    /*!
+     * Replaces the first row with the same secondary key as [row]
+     * Returns false if the key is not found
+    */
+    bool updateFirstOf(const RowType& row) {
+        if (!mSecondaryKey) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const std::vector<size_t>* positions = next.secondaryIndex.find(row.*mSecondaryKey);
+        if (!positions) {
+            return false;
+        }
+        const size_t pos = positions->front();
+        if (!rekey(&next, pos, row)) {
+            return false;
+        }
+        replaceAt(&next, pos, row);
+        return true;
+    }
+
+    /*!
+     * Replaces the first row that satisfies the predicate
+     * Used by tables without a primary key; keeps the index valid if the key is changed
+    */
+    template <typename Predicate>
+    bool updateIf(Predicate predicate, const RowType& row) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        for (size_t pos = 0; pos < next.rows.size(); ++pos) {
+            if (!next.rows[pos] || !predicate(*next.rows[pos])) {
+                continue;
+            }
+            if (!rekey(&next, pos, row)) {
+                return false;
+            }
+            replaceAt(&next, pos, row);
+            return true;
+        }
+        return false;
+    }
+
+    /*!
+     * Replaces all rows without notifying the listener (bulk load)
+     * Rows with a duplicate primary key are dropped
+    */
+    void assign(std::vector<RowType> rows) {
+        Version next;
+        if (mPrimaryKey) {
+            next.index.reserve(rows.size());
+        }
+        std::vector<RowType> kept;
+        kept.reserve(rows.size());
+        for (RowType& row : rows) {
+            if (mPrimaryKey && !next.index.insert(row.*mPrimaryKey, kept.size())) {
+                continue;
+            }
+            if (mSecondaryKey) {
+                link(&next, row.*mSecondaryKey, kept.size());
+            }
+            kept.emplace_back(std::move(row));
+        }
+        appendBlock(&next, std::move(kept));
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        publish(std::move(next));
+    }
+
+    /*!
+     * Removes the row with the primary key
+     * Returns false if the key is not found
+    */
+    bool erase(const std::string& key) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const size_t* pos = next.index.find(key);
+        if (!pos) {
+            return false;
+        }
+        const std::shared_ptr<const RowType> erased = removeAt(&next, *pos);
+        publish(std::move(next));
+        notify(Mutation::ERASE, erased.get(), nullptr);
+        return true;
+    }
+
+    /*!
+     * Removes all rows with the secondary key
+     * Returns the number of removed rows
+    */
+    size_t eraseAllOf(const std::string& key) {
+        if (!mSecondaryKey) {
+            return 0;
+        }
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        const std::vector<size_t>* found = next.secondaryIndex.find(key);
+        if (!found) {
+            return 0;
+        }
+        const std::vector<size_t> positions = *found;
+        std::vector<std::shared_ptr<const RowType>> erased;
+        for (const size_t pos : positions) {
+            erased.emplace_back(removeAt(&next, pos));
+        }
+        publish(std::move(next));
+        for (const std::shared_ptr<const RowType>& row : erased) {
+            notify(Mutation::ERASE, row.get(), nullptr);
+        }
+        return erased.size();
+    }
+
+    /*!
+     * Removes all rows that satisfy the predicate
+     * Returns the number of removed rows
+    */
+    template <typename Predicate>
+    size_t eraseIf(Predicate predicate) {
+        std::lock_guard<std::recursive_mutex> lock(mWriteMutex);
+        Version next(*latest());
+        std::vector<std::shared_ptr<const RowType>> erased;
+        for (size_t pos = 0; pos < next.rows.size(); ++pos) {
+            if (next.rows[pos] && predicate(*next.rows[pos])) {
+                erased.emplace_back(removeAt(&next, pos));
+            }
+        }
+        if (erased.empty()) {
+            return 0;
+        }
+        publish(std::move(next));
+        // Notify only when the table is consistent again
+        for (const std::shared_ptr<const RowType>& row : erased) {
+            notify(Mutation::ERASE, row.get(), nullptr);
+        }
+        return erased.size();
+    }
+
+ private:
+    /*!
+     * Rows and indexes of one point in time; immutable once published
+    */
+    struct Version {
+        // null where a row was erased
+        PersistentVector<std::shared_ptr<const RowType>> rows;
+        // primary key -> row position
+        PersistentMap<size_t> index;
+        // secondary key -> row positions (ascending)
+        PersistentMap<std::vector<size_t>> secondaryIndex;
+        // rows that are not erased
+        size_t rowCount = 0;
+    };
+
+    KeyField mPrimaryKey = nullptr;
+    KeyField mSecondaryKey = nullptr;
+    Listener mListener;
+    // recursive, so a transaction can hold it across the write calls
+    mutable std::recursive_mutex mWriteMutex;
+    // only read and replaced through std::atomic_load/std::atomic_store
+    std::shared_ptr<const Version> mCurrent = std::make_shared<const Version>();
+    // while staging: the writes that are not published yet (null if there are none)
+    std::shared_ptr<const Version> mStaged;
+    // the thread that stages its writes (none if not staging); only it touches mStaged
+    std::atomic<std::thread::id> mStagingThread { std::thread::id() };
+
+    /*!
+     * The version the readers see: the published one, or the staged one on the staging thread
+    */
+    inline std::shared_ptr<const Version> current() const {
+        if ((mStagingThread.load() == std::this_thread::get_id()) && mStaged) {
+            return mStaged;
+        }
+        return std::atomic_load(&mCurrent);
+    }
+
+    /*!
+     * The version the next write starts from; call with the write lock held
+    */
+    inline std::shared_ptr<const Version> latest() const {
+        return mStaged ? mStaged : current();
+    }
+
+    inline void publish(Version&& next) {
+        std::shared_ptr<const Version> version = std::make_shared<const Version>(std::move(next));
+        if (mStagingThread.load() != std::thread::id()) {
+            mStaged = std::move(version);
+            return;
+        }
+        std::atomic_store(&mCurrent, std::move(version));
+    }
+
+    /*!
+     * Appends bulk rows that share one allocation (an arena block), instead of one each
+     * The slots point into the block, so it is freed once the last of its rows is gone.
+    */
+    std::shared_ptr<const std::vector<RowType>> appendBlock(Version* next,
+                                                            std::vector<RowType> rows) const {
+        const auto block = std::make_shared<const std::vector<RowType>>(std::move(rows));
+        for (const RowType& row : *block) {
+            next->rows.push_back(std::shared_ptr<const RowType>(block, &row));
+        }
+        next->rowCount += block->size();
+        return block;
+    }
+
+    /*!
+     * Returns [version] without its erased slots; positions change, so both indexes are rebuilt
+    */
+    Version compactedOf(const Version& version) const {
+        Version compacted;
+        compacted.index.reserve(version.rowCount);
+        for (const std::shared_ptr<const RowType>& row : version.rows) {
+            if (!row) {
+                continue;
+            }
+            const size_t pos = compacted.rows.size();
+            if (mPrimaryKey) {
+                compacted.index.insert((*row).*mPrimaryKey, pos);
+            }
+            if (mSecondaryKey) {
+                link(&compacted, (*row).*mSecondaryKey, pos);
+            }
+            compacted.rows.push_back(row);
+        }
+        compacted.rowCount = compacted.rows.size();
+        return compacted;
+    }
+
+    void notify(Mutation mutation, const RowType* before, const RowType* after) const {
+        if (mListener) {
+            mListener(mutation, before, after);
+        }
+    }
+
+    /*!
+     * Overwrites the row at [pos] and publishes; the primary index must already have the key
+    */
+    void replaceAt(Version* next, size_t pos, const RowType& row) {
+        const std::shared_ptr<const RowType> before = next->rows[pos];
+        if (mSecondaryKey && ((*before).*mSecondaryKey != row.*mSecondaryKey)) {
+            // Moves the row position to the new secondary key list
+            unlink(next, (*before).*mSecondaryKey, pos);
+            link(next, row.*mSecondaryKey, pos);
+        }
+        const std::shared_ptr<const RowType> after = std::make_shared<const RowType>(row);
+        next->rows.set(pos, after);
+        publish(std::move(*next));
+        notify(Mutation::UPDATE, before.get(), after.get());
+    }
+
+    /*!
+     * Points the primary key of [row] to [pos] if the row at [pos] has another key
+     * Returns false if the new key belongs to another row
+    */
+    bool rekey(Version* next, size_t pos, const RowType& row) const {
+        if (!mPrimaryKey || ((*next->rows[pos]).*mPrimaryKey == row.*mPrimaryKey)) {
+            return true;
+        }
+        if (!next->index.insert(row.*mPrimaryKey, pos)) {
+            return false;
+        }
+        next->index.erase((*next->rows[pos]).*mPrimaryKey);
+        return true;
+    }
+
+    /*!
+     * Empties the slot at [pos]; returns the removed row
+    */
+    std::shared_ptr<const RowType> removeAt(Version* next, size_t pos) const {
+        std::shared_ptr<const RowType> row = next->rows[pos];
+        if (mPrimaryKey) {
+            next->index.erase((*row).*mPrimaryKey);
+        }
+        if (mSecondaryKey) {
+            unlink(next, (*row).*mSecondaryKey, pos);
+        }
+        next->rows.set(pos, nullptr);
+        --next->rowCount;
+        return row;
+    }
+
+    static void link(Version* next, const std::string& key, size_t pos) {
+        const std::vector<size_t>* found = next->secondaryIndex.find(key);
+        std::vector<size_t> positions = found ? *found : std::vector<size_t>();
+        positions.insert(std::upper_bound(positions.begin(), positions.end(), pos), pos);
+        next->secondaryIndex.assign(key, std::move(positions));
+    }
+
+    static void unlink(Version* next, const std::string& key, size_t pos) {
+        std::vector<size_t> positions = *next->secondaryIndex.find(key);
+        positions.erase(std::find(positions.begin(), positions.end(), pos));
+        if (positions.empty()) {
+            next->secondaryIndex.erase(key);
+        } else {
+            next->secondaryIndex.assign(key, std::move(positions));
+        }
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_INDEXEDTABLE_HPP_
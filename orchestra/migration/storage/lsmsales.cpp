@@ -0,0 +1,379 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "lsmsales.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "rowcodec.hpp"
+#include "salescolumns.hpp"
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+// row count of the table
+constexpr char COUNT_KEY[] = "n";
+// sales: "t" + date-time + ID -> row, "i" + ID -> row key
+constexpr char TIME_PREFIX = 't';
+constexpr char ID_PREFIX = 'i';
+// sale items: "r" + sale ID + '\0' + item number -> row
+constexpr char ITEM_PREFIX = 'r';
+// the first key after all the sales / sale items
+constexpr char TIME_END[] = "u";
+constexpr char ITEM_END[] = "s";
+
+/*!
+ * The fields of the row, each as [u32 size][bytes]
+*/
+template <typename Row>
+std::string encodeRow(const Row& row) {
+    std::string value;
+    for (const std::string& field : RowCodec<Row>::encode(row)) {
+        for (int i = 0; i < 4; ++i) {
+            value += static_cast<char>((field.size() >> (8 * i)) & 0xFF);
+        }
+        value += field;
+    }
+    return value;
+}
+
+template <typename Row>
+bool decodeRow(const std::string& value, Row* out) {
+    Fields fields;
+    for (size_t pos = 0; pos + 4 <= value.size();) {
+        size_t size = 0;
+        for (int i = 0; i < 4; ++i) {
+            size |= static_cast<size_t>(static_cast<uint8_t>(value[pos + i])) << (8 * i);
+        }
+        pos += 4;
+        if (pos + size > value.size()) {
+            return false;
+        }
+        fields.emplace_back(value, pos, size);
+        pos += size;
+    }
+    if (fields.size() != RowCodec<Row>::FIELD_COUNT) {
+        return false;
+    }
+    *out = RowCodec<Row>::decode(fields);
+    return true;
+}
+
+/*!
+ * Fixed-width hex, so that the keys sort like the numbers
+*/
+std::string toHex(uint64_t value, size_t digits) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string text(digits, '0');
+    for (size_t i = digits; i > 0; --i, value >>= 4) {
+        text[i - 1] = HEX[value & 0xF];
+    }
+    return text;
+}
+
+/*!
+ * Key of the date-time [seconds]; biased so that negative times sort first
+*/
+std::string timeKey(int64_t seconds) {
+    return TIME_PREFIX + toHex(static_cast<uint64_t>(seconds) ^ (1ULL << 63), 16);
+}
+
+std::string saleKey(const SalesTableItem& row) {
+    int64_t seconds = 0;
+    // like the sales columns, a date-time that cannot be read sorts as 0
+    if (!parseDateTime(row.date_time, &seconds)) {
+        seconds = 0;
+    }
+    return timeKey(seconds) + row.ID;
+}
+
+std::string itemPrefix(const std::string& saleID) {
+    return ITEM_PREFIX + saleID + '\0';
+}
+
+std::string itemEnd(const std::string& saleID) {
+    return ITEM_PREFIX + saleID + '\1';
+}
+
+size_t readCount(const LsmTree& tree) {
+    std::string value;
+    try {
+        return tree.get(COUNT_KEY, &value) ? std::stoul(value) : 0;
+    } catch (const std::exception& e) {
+        return 0;
+    }
+}
+
+/*!
+ * Decodes the rows of a key range
+*/
+template <typename Row>
+class TreeCursor : public Cursor<Row> {
+ public:
+    explicit TreeCursor(LsmTree::Cursor cursor) : mCursor(std::move(cursor)) {}
+
+    bool next(Row* out) override {
+        std::string key;
+        std::string value;
+        while (mCursor.next(&key, &value)) {
+            if (decodeRow(value, out)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    LsmTree::Cursor mCursor;
+};
+
+}  // namespace
+
+LsmSalesEngine::LsmSalesEngine(const std::string& directory, const LsmTree::Options& options)
+    : mTree(directory, options), mSize(readCount(mTree)) {}
+
+bool LsmSalesEngine::get(const std::string& key, SalesTableItem* out) const {
+    std::string rowKey;
+    std::string value;
+    SalesTableItem row;
+    if (!mTree.get(ID_PREFIX + key, &rowKey) || !mTree.get(rowKey, &value)
+        || !decodeRow(value, &row)) {
+        return false;
+    }
+    if (out) {
+        *out = std::move(row);
+    }
+    return true;
+}
+
+std::unique_ptr<Cursor<SalesTableItem>> LsmSalesEngine::scan() const {
+    return scanTime(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
+}
+
+std::unique_ptr<Cursor<SalesTableItem>> LsmSalesEngine::scanOf(const std::string& key) const {
+    std::vector<SalesTableItem> rows(1);
+    if (!get(key, &rows.front())) {
+        rows.clear();
+    }
+    return std::unique_ptr<Cursor<SalesTableItem>>(
+        new VectorCursor<SalesTableItem>(std::move(rows)));
+}
+
+std::unique_ptr<Cursor<SalesTableItem>> LsmSalesEngine::scanTime(int64_t first,
+                                                                 int64_t last) const {
+    // the keys of [last] end before those of last + 1, or at the end of the time prefix
+    const std::string end = (last == std::numeric_limits<int64_t>::max())
+                            ? TIME_END : timeKey(last + 1);
+    return std::unique_ptr<Cursor<SalesTableItem>>(
+        new TreeCursor<SalesTableItem>(mTree.scan(timeKey(first), end)));
+}
+
+bool LsmSalesEngine::insert(const SalesTableItem& row) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mTree.get(ID_PREFIX + row.ID, nullptr)) {
+        return false;
+    }
+    const std::string rowKey = saleKey(row);
+    if (!mTree.write({ { rowKey, encodeRow(row), false },
+                       { ID_PREFIX + row.ID, rowKey, false },
+                       { COUNT_KEY, std::to_string(mSize + 1), false } })) {
+        return false;
+    }
+    ++mSize;
+    return true;
+}
+
+bool LsmSalesEngine::update(const SalesTableItem& row) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string oldKey;
+    if (!mTree.get(ID_PREFIX + row.ID, &oldKey)) {
+        return false;
+    }
+    const std::string rowKey = saleKey(row);
+    std::vector<LsmEntry> batch { { rowKey, encodeRow(row), false } };
+    if (rowKey != oldKey) {
+        // the date-time changed
+        batch.push_back({ oldKey, "", true });
+        batch.push_back({ ID_PREFIX + row.ID, rowKey, false });
+    }
+    return mTree.write(batch);
+}
+
+size_t LsmSalesEngine::remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::string rowKey;
+    if (!mTree.get(ID_PREFIX + key, &rowKey)
+        || !mTree.write({ { rowKey, "", true }, { ID_PREFIX + key, "", true },
+                          { COUNT_KEY, std::to_string(mSize - 1), false } })) {
+        return 0;
+    }
+    --mSize;
+    return 1;
+}
+
+size_t LsmSalesEngine::removeOf(const std::string& key) {
+    return remove(key);
+}
+
+size_t LsmSalesEngine::removeIf(const Predicate& predicate) {
+    std::vector<std::string> keys;
+    const std::unique_ptr<Cursor<SalesTableItem>> cursor = scan();
+    for (SalesTableItem row; cursor->next(&row);) {
+        if (predicate(row)) {
+            keys.push_back(row.ID);
+        }
+    }
+    size_t count = 0;
+    for (const std::string& key : keys) {
+        count += remove(key);
+    }
+    return count;
+}
+
+size_t LsmSalesEngine::size() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSize;
+}
+
+bool LsmSalesEngine::flush() {
+    return mTree.commit();
+}
+
+LsmSalesItemEngine::LsmSalesItemEngine(const std::string& directory,
+                                       const LsmTree::Options& options)
+    : mTree(directory, options), mSize(readCount(mTree)) {}
+
+bool LsmSalesItemEngine::get(const std::string& key, SalesItemTableItem* out) const {
+    SalesItemTableItem row;
+    if (!scanOf(key)->next(&row)) {
+        return false;
+    }
+    if (out) {
+        *out = std::move(row);
+    }
+    return true;
+}
+
+std::unique_ptr<Cursor<SalesItemTableItem>> LsmSalesItemEngine::scan() const {
+    return std::unique_ptr<Cursor<SalesItemTableItem>>(new TreeCursor<SalesItemTableItem>(
+        mTree.scan(std::string(1, ITEM_PREFIX), ITEM_END)));
+}
+
+std::unique_ptr<Cursor<SalesItemTableItem>>
+LsmSalesItemEngine::scanOf(const std::string& key) const {
+    return std::unique_ptr<Cursor<SalesItemTableItem>>(
+        new TreeCursor<SalesItemTableItem>(mTree.scan(itemPrefix(key), itemEnd(key))));
+}
+
+bool LsmSalesItemEngine::insert(const SalesItemTableItem& row) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // numbered after the last item of the sale
+    const std::string prefix = itemPrefix(row.saleID);
+    LsmTree::Cursor cursor = mTree.scan(prefix, itemEnd(row.saleID));
+    std::string key;
+    std::string value;
+    std::string lastKey;
+    while (cursor.next(&key, &value)) {
+        lastKey = key;
+    }
+    uint64_t number = 0;
+    if (!lastKey.empty()) {
+        number = std::stoull(lastKey.substr(prefix.size()), nullptr, 16) + 1;
+    }
+    if (!mTree.write({ { prefix + toHex(number, 8), encodeRow(row), false },
+                       { COUNT_KEY, std::to_string(mSize + 1), false } })) {
+        return false;
+    }
+    ++mSize;
+    return true;
+}
+
+bool LsmSalesItemEngine::update(const SalesItemTableItem& row) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // the first item of the sale, like the StackDB table
+    std::string key;
+    std::string value;
+    LsmTree::Cursor cursor = mTree.scan(itemPrefix(row.saleID), itemEnd(row.saleID));
+    return cursor.next(&key, &value) && mTree.put(key, encodeRow(row));
+}
+
+size_t LsmSalesItemEngine::remove(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<LsmEntry> batch;
+    std::string itemKey;
+    std::string value;
+    for (LsmTree::Cursor cursor = mTree.scan(itemPrefix(key), itemEnd(key));
+         cursor.next(&itemKey, &value);) {
+        batch.push_back({ itemKey, "", true });
+    }
+    if (batch.empty()) {
+        return 0;
+    }
+    const size_t count = batch.size();
+    batch.push_back({ COUNT_KEY, std::to_string(mSize - count), false });
+    if (!mTree.write(batch)) {
+        return 0;
+    }
+    mSize -= count;
+    return count;
+}
+
+size_t LsmSalesItemEngine::removeOf(const std::string& key) {
+    return remove(key);
+}
+
+size_t LsmSalesItemEngine::removeIf(const Predicate& predicate) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<LsmEntry> batch;
+    std::string key;
+    std::string value;
+    LsmTree::Cursor cursor = mTree.scan(std::string(1, ITEM_PREFIX), ITEM_END);
+    for (SalesItemTableItem row; cursor.next(&key, &value);) {
+        if (decodeRow(value, &row) && predicate(row)) {
+            batch.push_back({ key, "", true });
+        }
+    }
+    if (batch.empty()) {
+        return 0;
+    }
+    const size_t count = batch.size();
+    batch.push_back({ COUNT_KEY, std::to_string(mSize - count), false });
+    if (!mTree.write(batch)) {
+        return 0;
+    }
+    mSize -= count;
+    return count;
+}
+
+size_t LsmSalesItemEngine::size() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSize;
+}
+
+bool LsmSalesItemEngine::flush() {
+    return mTree.commit();
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,109 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_LSMSALES_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_LSMSALES_HPP_
+#include <memory>
+#include <mutex>
+#include <string>
+#include "lsmtree.hpp"
+#include "storageengine.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Sales table in an LSM tree
+ *
+ * A checkout insert is one logged batch, so the table keeps up with a busy till. The rows are
+ * keyed by date-time + ID, so scanTime() reads one key range (the accounting reports);
+ * an index entry per ID leads from the ID to the row.
+ * Enabled with sales_engine=lsm in psdb.cfg (see StorageEngine::current()).
+*/
+class LsmSalesEngine : public SalesEngine {
+ public:
+    LsmSalesEngine(const std::string& directory, const LsmTree::Options& options);
+    ~LsmSalesEngine() override = default;
+
+    inline bool isOpen() const {
+        return mTree.isOpen();
+    }
+
+    inline LsmTree& tree() {
+        return mTree;
+    }
+
+    bool get(const std::string& key, SalesTableItem* out) const override;
+    std::unique_ptr<Cursor<SalesTableItem>> scan() const override;
+    std::unique_ptr<Cursor<SalesTableItem>> scanOf(const std::string& key) const override;
+    std::unique_ptr<Cursor<SalesTableItem>> scanTime(int64_t first,
+                                                     int64_t last) const override;
+    bool insert(const SalesTableItem& row) override;
+    bool update(const SalesTableItem& row) override;
+    size_t remove(const std::string& key) override;
+    size_t removeOf(const std::string& key) override;
+    size_t removeIf(const Predicate& predicate) override;
+    size_t size() const override;
+    bool flush() override;
+
+ private:
+    // serializes the writes; they read the tree before writing it
+    mutable std::mutex mMutex;
+    LsmTree mTree;
+    size_t mSize = 0;
+};
+
+/*!
+ * Sale items in an LSM tree, keyed by sale ID + item number
+ * The items of a sale are one key range, in the order they were inserted.
+*/
+class LsmSalesItemEngine : public TableEngine<SalesItemTableItem> {
+ public:
+    LsmSalesItemEngine(const std::string& directory, const LsmTree::Options& options);
+    ~LsmSalesItemEngine() override = default;
+
+    inline bool isOpen() const {
+        return mTree.isOpen();
+    }
+
+    inline LsmTree& tree() {
+        return mTree;
+    }
+
+    bool get(const std::string& key, SalesItemTableItem* out) const override;
+    std::unique_ptr<Cursor<SalesItemTableItem>> scan() const override;
+    std::unique_ptr<Cursor<SalesItemTableItem>> scanOf(const std::string& key) const override;
+    bool insert(const SalesItemTableItem& row) override;
+    bool update(const SalesItemTableItem& row) override;
+    size_t remove(const std::string& key) override;
+    size_t removeOf(const std::string& key) override;
+    size_t removeIf(const Predicate& predicate) override;
+    size_t size() const override;
+    bool flush() override;
+
+ private:
+    mutable std::mutex mMutex;
+    LsmTree mTree;
+    size_t mSize = 0;
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_LSMSALES_HPP_
@@ -0,0 +1,596 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "lsmtree.hpp"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <utility>
+#include "wal.hpp"
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr char MANIFEST_FILE[] = "MANIFEST";
+constexpr char RUN_EXTENSION[] = ".run";
+constexpr char LOG_EXTENSION[] = ".log";
+constexpr uint8_t ERASED_FLAG = 0x01;
+// [u32 payload size][u32 crc32 of payload]
+constexpr size_t FRAME_HEADER_SIZE = 8;
+// [u8 flags][u32 key size][u32 value size]
+constexpr size_t ENTRY_HEADER_SIZE = 9;
+// approximate memory of a memtable node besides the key and the value
+constexpr size_t SLOT_OVERHEAD = 64;
+
+void putU32(uint32_t value, std::string* out) {
+    for (int i = 0; i < 4; ++i) {
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+bool readFile(const std::string& path, std::string* contents) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    char buffer[64 * 1024];
+    contents->clear();
+    for (size_t size; (size = std::fread(buffer, 1, sizeof(buffer), in)) > 0;) {
+        contents->append(buffer, size);
+    }
+    std::fclose(in);
+    return true;
+}
+
+}  // namespace
+
+/*!
+ * K-way merge of sorted sources, newest first; the newest entry of a key wins
+*/
+class LsmTree::Cursor::Merger {
+ public:
+    void addEntries(std::vector<LsmEntry> entries) {
+        Source source;
+        source.entries = std::move(entries);
+        mSources.emplace_back(std::move(source));
+    }
+
+    void addRun(std::shared_ptr<SortedRun> run, const std::string& first) {
+        Source source;
+        source.it.reset(new SortedRun::Iterator(run->seek(first)));
+        source.run = std::move(run);
+        mSources.emplace_back(std::move(source));
+    }
+
+    /*!
+     * Copies the next key into [out], tombstones included
+    */
+    bool next(LsmEntry* out) {
+        Source* newest = nullptr;
+        for (Source& source : mSources) {
+            if (source.isValid() && (!newest || (source.entry().key < newest->entry().key))) {
+                newest = &source;
+            }
+        }
+        if (!newest) {
+            return false;
+        }
+        *out = newest->entry();
+        for (Source& source : mSources) {
+            if (source.isValid() && (source.entry().key == out->key)) {
+                source.advance();
+            }
+        }
+        return true;
+    }
+
+ private:
+    struct Source {
+        // a copy of a memtable range, or a run
+        std::vector<LsmEntry> entries;
+        size_t pos = 0;
+        std::shared_ptr<SortedRun> run;
+        std::unique_ptr<SortedRun::Iterator> it;
+
+        bool isValid() const {
+            return it ? it->isValid() : (pos < entries.size());
+        }
+
+        const LsmEntry& entry() const {
+            return it ? it->entry() : entries[pos];
+        }
+
+        void advance() {
+            if (it) {
+                it->advance();
+            } else {
+                ++pos;
+            }
+        }
+    };
+
+    std::vector<Source> mSources;
+};
+
+LsmTree::Cursor::Cursor(std::unique_ptr<Merger> merger, std::string end)
+    : mMerger(std::move(merger)), mEnd(std::move(end)) {}
+
+LsmTree::Cursor::Cursor(Cursor&&) = default;
+
+LsmTree::Cursor::~Cursor() = default;
+
+bool LsmTree::Cursor::next(std::string* key, std::string* value) {
+    for (LsmEntry entry; mMerger->next(&entry);) {
+        if (!mEnd.empty() && (entry.key >= mEnd)) {
+            return false;
+        }
+        if (!entry.isErased) {
+            *key = std::move(entry.key);
+            *value = std::move(entry.value);
+            return true;
+        }
+    }
+    return false;
+}
+
+LsmTree::LsmTree(const std::string& directory, const Options& options)
+    : mDirectory(directory), mOptions(options) {
+    // Fails harmlessly if the directory exists
+    makeDirectory(directory);
+    std::vector<uint64_t> logs;
+    if (!readManifest(&logs)) {
+        return;
+    }
+    for (const uint64_t log : logs) {
+        if (!replayLog(log)) {
+            return;
+        }
+    }
+    if (!mMemtable.empty()) {
+        // Writes the replayed records to a run, so that the new log starts empty
+        Cursor::Merger merger;
+        std::vector<LsmEntry> entries;
+        entries.reserve(mMemtable.size());
+        for (const auto& slot : mMemtable) {
+            entries.push_back({ slot.first, slot.second.value, slot.second.isErased });
+        }
+        merger.addEntries(std::move(entries));
+        std::shared_ptr<SortedRun> run;
+        if (!writeRun(&merger, false, &run)) {
+            return;
+        }
+        mRuns.insert(mRuns.begin(), { run, 0 });
+        mMemtable.clear();
+        mMemtableBytes = 0;
+    }
+    if (!openLog()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!writeManifest()) {
+        std::fclose(mLog);
+        mLog = nullptr;
+        return;
+    }
+    lock.unlock();
+    for (const uint64_t log : logs) {
+        std::remove(filePath(log, LOG_EXTENSION).c_str());
+    }
+    // Starts with a look for due merges
+    mIsWorking = true;
+    mWorker = std::thread(&LsmTree::work, this);
+}
+
+LsmTree::~LsmTree() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mChanged.notify_all();
+    if (mWorker.joinable()) {
+        mWorker.join();
+    }
+    if (mLog) {
+        std::fclose(mLog);
+    }
+}
+
+std::string LsmTree::filePath(uint64_t sequence, const char* extension) const {
+    return mDirectory + "/" + std::to_string(sequence) + extension;
+}
+
+bool LsmTree::readManifest(std::vector<uint64_t>* logs) {
+    std::string contents;
+    if (!readFile(mDirectory + "/" + MANIFEST_FILE, &contents)) {
+        // new tree
+        return true;
+    }
+    std::istringstream lines(contents);
+    for (std::string line; std::getline(lines, line);) {
+        std::istringstream fields(line);
+        std::string type;
+        uint64_t sequence = 0;
+        if (!(fields >> type >> sequence)) {
+            continue;
+        }
+        if (type == "next") {
+            mNextSequence = sequence;
+        } else if (type == "log") {
+            logs->push_back(sequence);
+        } else if (type == "run") {
+            unsigned tier = 0;
+            fields >> tier;
+            std::shared_ptr<SortedRun> run(
+                new SortedRun(filePath(sequence, RUN_EXTENSION), sequence));
+            if (!run->isOpen()) {
+                LOG_ERROR("Cannot open the LSM tree in %s", mDirectory.c_str());
+                return false;
+            }
+            mRuns.push_back({ std::move(run), tier });
+        }
+    }
+    return true;
+}
+
+bool LsmTree::writeManifest() const {
+    std::string contents = "next " + std::to_string(mNextSequence) + "\n";
+    for (const Run& run : mRuns) {
+        contents += "run " + std::to_string(run.run->sequence()) + " "
+                    + std::to_string(run.tier) + "\n";
+    }
+    if (mImmutable) {
+        contents += "log " + std::to_string(mImmutableLogSequence) + "\n";
+    }
+    contents += "log " + std::to_string(mLogSequence) + "\n";
+    if (!replaceFile(mDirectory + "/" + MANIFEST_FILE, contents)) {
+        LOG_ERROR("Cannot write the manifest of %s", mDirectory.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool LsmTree::replayLog(uint64_t sequence) {
+    std::string contents;
+    if (!readFile(filePath(sequence, LOG_EXTENSION), &contents)) {
+        // created but never written
+        return true;
+    }
+    for (size_t pos = 0; pos + FRAME_HEADER_SIZE <= contents.size();) {
+        const size_t size = getU32(contents.data() + pos);
+        const char* payload = contents.data() + pos + FRAME_HEADER_SIZE;
+        if ((pos + FRAME_HEADER_SIZE + size > contents.size())
+            || (crc32(payload, size) != getU32(contents.data() + pos + 4))) {
+            // torn tail, the batch was never committed
+            break;
+        }
+        std::vector<LsmEntry> batch;
+        for (size_t at = 0; at + ENTRY_HEADER_SIZE <= size;) {
+            const size_t keySize = getU32(payload + at + 1);
+            const size_t valueSize = getU32(payload + at + 5);
+            if (at + ENTRY_HEADER_SIZE + keySize + valueSize > size) {
+                return false;
+            }
+            LsmEntry entry;
+            entry.isErased = (payload[at] & ERASED_FLAG) != 0;
+            entry.key.assign(payload + at + ENTRY_HEADER_SIZE, keySize);
+            entry.value.assign(payload + at + ENTRY_HEADER_SIZE + keySize, valueSize);
+            batch.emplace_back(std::move(entry));
+            at += ENTRY_HEADER_SIZE + keySize + valueSize;
+        }
+        for (const LsmEntry& entry : batch) {
+            apply(entry);
+        }
+        pos += FRAME_HEADER_SIZE + size;
+    }
+    return true;
+}
+
+bool LsmTree::openLog() {
+    mLogSequence = mNextSequence++;
+    mLog = std::fopen(filePath(mLogSequence, LOG_EXTENSION).c_str(), "wb");
+    if (!mLog) {
+        LOG_ERROR("Cannot create a log in %s", mDirectory.c_str());
+        return false;
+    }
+    return true;
+}
+
+void LsmTree::apply(const LsmEntry& entry) {
+    mMemtableBytes += entry.key.size() + entry.value.size() + SLOT_OVERHEAD;
+    Slot& slot = mMemtable[entry.key];
+    slot.value = entry.value;
+    slot.isErased = entry.isErased;
+}
+
+bool LsmTree::get(const std::string& key, std::string* value) const {
+    std::vector<std::shared_ptr<SortedRun>> runs;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const Memtable* memtable : { &mMemtable, mImmutable.get() }) {
+            const auto it = memtable ? memtable->find(key) : mMemtable.end();
+            if (!memtable || (it == memtable->end())) {
+                continue;
+            }
+            if (!it->second.isErased && value) {
+                *value = it->second.value;
+            }
+            return !it->second.isErased;
+        }
+        runs.reserve(mRuns.size());
+        for (const Run& run : mRuns) {
+            runs.push_back(run.run);
+        }
+    }
+    LsmEntry entry;
+    for (const std::shared_ptr<SortedRun>& run : runs) {
+        if (run->find(key, &entry)) {
+            if (!entry.isErased && value) {
+                *value = std::move(entry.value);
+            }
+            return !entry.isErased;
+        }
+    }
+    return false;
+}
+
+bool LsmTree::put(const std::string& key, const std::string& value) {
+    return write({ { key, value, false } });
+}
+
+bool LsmTree::remove(const std::string& key) {
+    return write({ { key, "", true } });
+}
+
+bool LsmTree::write(const std::vector<LsmEntry>& batch) {
+    std::string payload;
+    for (const LsmEntry& entry : batch) {
+        payload.push_back(static_cast<char>(entry.isErased ? ERASED_FLAG : 0));
+        putU32(static_cast<uint32_t>(entry.key.size()), &payload);
+        putU32(static_cast<uint32_t>(entry.value.size()), &payload);
+        payload.append(entry.key);
+        payload.append(entry.value);
+    }
+    std::string frame;
+    putU32(static_cast<uint32_t>(payload.size()), &frame);
+    putU32(crc32(payload.data(), payload.size()), &frame);
+    frame.append(payload);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mLog || (std::fwrite(frame.data(), 1, frame.size(), mLog) != frame.size())) {
+        return false;
+    }
+    for (const LsmEntry& entry : batch) {
+        apply(entry);
+    }
+    // the batch is in, even if the next log cannot be created
+    switchMemtable(&lock, false);
+    return true;
+}
+
+LsmTree::Cursor LsmTree::scan(const std::string& first, const std::string& end) const {
+    std::unique_ptr<Cursor::Merger> merger(new Cursor::Merger());
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const Memtable* memtable : { &mMemtable, mImmutable.get() }) {
+        std::vector<LsmEntry> entries;
+        if (memtable) {
+            const auto last = end.empty() ? memtable->end() : memtable->lower_bound(end);
+            for (auto it = memtable->lower_bound(first); it != last; ++it) {
+                entries.push_back({ it->first, it->second.value, it->second.isErased });
+            }
+        }
+        merger->addEntries(std::move(entries));
+    }
+    for (const Run& run : mRuns) {
+        merger->addRun(run.run, first);
+    }
+    return Cursor(std::move(merger), end);
+}
+
+bool LsmTree::commit() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLog && syncFile(mLog);
+}
+
+void LsmTree::flush() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    switchMemtable(&lock, true);
+    mChanged.wait(lock, [this]() { return !mImmutable && !mIsWorking; });
+}
+
+size_t LsmTree::runCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mRuns.size();
+}
+
+bool LsmTree::switchMemtable(std::unique_lock<std::mutex>* lock, bool isForced) {
+    if (!isForced && (mMemtableBytes < mOptions.memtableBytes)) {
+        return true;
+    }
+    // Stalls until the previous memtable is written
+    mChanged.wait(*lock, [this]() { return !mImmutable || mIsStopping; });
+    if (mImmutable || mMemtable.empty() || !mLog
+        || (!isForced && (mMemtableBytes < mOptions.memtableBytes))) {
+        // stopping, or another writer switched meanwhile
+        return true;
+    }
+    // The writes in the log may be committed after the switch, by syncing the next log
+    if (!syncFile(mLog)) {
+        LOG_ERROR("Cannot sync the log of %s", mDirectory.c_str());
+    }
+    std::fclose(mLog);
+    mImmutable = std::make_shared<const Memtable>(std::move(mMemtable));
+    mImmutableLogSequence = mLogSequence;
+    mMemtable.clear();
+    mMemtableBytes = 0;
+    const bool isOpened = openLog();
+    writeManifest();
+    mChanged.notify_all();
+    return isOpened;
+}
+
+void LsmTree::work() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mChanged.wait(lock, [this]() { return mImmutable || mIsStopping || mIsWorking; });
+        if (mIsStopping) {
+            // an unwritten memtable is replayed from its log on the next open
+            break;
+        }
+        if (mImmutable) {
+            mIsWorking = true;
+            lock.unlock();
+            flushImmutable();
+            lock.lock();
+            continue;
+        }
+        lock.unlock();
+        const bool isMerged = mergeRuns();
+        lock.lock();
+        if (!isMerged) {
+            mIsWorking = false;
+            mChanged.notify_all();
+        }
+    }
+    mIsWorking = false;
+    mChanged.notify_all();
+}
+
+bool LsmTree::writeRun(Cursor::Merger* merger, bool dropErased,
+                       std::shared_ptr<SortedRun>* run) {
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        sequence = mNextSequence++;
+    }
+    const std::string path = filePath(sequence, RUN_EXTENSION);
+    {
+        RunWriter writer(path);
+        for (LsmEntry entry; merger->next(&entry);) {
+            if ((!dropErased || !entry.isErased) && !writer.add(entry)) {
+                LOG_ERROR("Cannot write the run %s", path.c_str());
+                return false;
+            }
+        }
+        if (writer.entryCount() == 0) {
+            run->reset();
+            return true;
+        }
+        if (!writer.finish()) {
+            LOG_ERROR("Cannot write the run %s", path.c_str());
+            return false;
+        }
+    }
+    run->reset(new SortedRun(path, sequence));
+    return (*run)->isOpen();
+}
+
+void LsmTree::flushImmutable() {
+    std::shared_ptr<const Memtable> memtable;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        memtable = mImmutable;
+    }
+    Cursor::Merger merger;
+    std::vector<LsmEntry> entries;
+    entries.reserve(memtable->size());
+    for (const auto& slot : *memtable) {
+        entries.push_back({ slot.first, slot.second.value, slot.second.isErased });
+    }
+    merger.addEntries(std::move(entries));
+    std::shared_ptr<SortedRun> run;
+    if (!writeRun(&merger, false, &run)) {
+        // Keeps the memtable and its log; retried after a pause
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        return;
+    }
+    uint64_t log = 0;
+    bool isListed = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (run) {
+            mRuns.insert(mRuns.begin(), { run, 0 });
+        }
+        mImmutable.reset();
+        log = mImmutableLogSequence;
+        isListed = writeManifest();
+    }
+    mChanged.notify_all();
+    if (isListed) {
+        std::remove(filePath(log, LOG_EXTENSION).c_str());
+    }
+}
+
+bool LsmTree::mergeRuns() {
+    std::vector<Run> window;
+    bool isOldest = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // from the oldest run, look for [mergeRuns] consecutive runs of one tier
+        size_t count = 0;
+        for (size_t i = mRuns.size(); (i > 0) && window.empty(); --i) {
+            count = ((count > 0) && (mRuns[i - 1].tier == mRuns[i].tier)) ? count + 1 : 1;
+            if (count >= std::max<size_t>(mOptions.mergeRuns, 2)) {
+                window.assign(mRuns.begin() + (i - 1), mRuns.begin() + (i - 1) + count);
+                isOldest = (i - 1 + count) == mRuns.size();
+            }
+        }
+    }
+    if (window.empty()) {
+        return false;
+    }
+    Cursor::Merger merger;
+    for (const Run& run : window) {
+        merger.addRun(run.run, "");
+    }
+    // Tombstones shadow older runs; once the oldest run is merged there is nothing to shadow
+    std::shared_ptr<SortedRun> merged;
+    if (!writeRun(&merger, isOldest, &merged)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Only this thread changes the runs, but new ones may have been added in front
+    const auto first = std::find_if(mRuns.begin(), mRuns.end(), [&window](const Run& run) {
+        return run.run == window.front().run;
+    });
+    const auto position = mRuns.erase(first, first + window.size());
+    if (merged) {
+        mRuns.insert(position, { merged, window.front().tier + 1 });
+    }
+    if (writeManifest()) {
+        for (const Run& run : window) {
+            run.run->markObsolete();
+        }
+    }
+    return true;
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,175 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_LSMTREE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_LSMTREE_HPP_
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sortedrun.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Log-structured merge tree of string keys and values, for append-heavy tables
+ *
+ * Writes go to a log file and to an in-memory sorted table (the memtable), so an insert costs
+ * one buffered append. A full memtable becomes immutable and a background thread writes it
+ * to a sorted run file; the thread also merges [mergeRuns] runs of the same size tier into
+ * one, so a lookup checks a few runs (most are skipped by their bloom filter).
+ * Writers only wait when the memtable fills before the previous one is written.
+ *
+ * The MANIFEST file lists the runs (newest first) and the logs to replay; it is replaced
+ * atomically. commit() syncs the log; on open the logs are replayed and written to a run.
+*/
+class LsmTree {
+ public:
+    struct Options {
+        // memtable size (keys + values) that triggers a flush
+        size_t memtableBytes = 4 * 1024 * 1024;
+        // runs of one tier that are merged into the next tier
+        size_t mergeRuns = 4;
+    };
+
+    /*!
+     * Reads a key range in order, from a consistent version of the tree
+     * Holds the runs it reads, so merges do not remove them meanwhile.
+    */
+    class Cursor {
+     public:
+        Cursor(Cursor&&);
+        ~Cursor();
+
+        /*!
+         * Copies the next entry into [key] and [value]; returns false at the end
+        */
+        bool next(std::string* key, std::string* value);
+
+     private:
+        friend class LsmTree;
+        class Merger;
+        Cursor(std::unique_ptr<Merger> merger, std::string end);
+
+        std::unique_ptr<Merger> mMerger;
+        const std::string mEnd;
+    };
+
+    /*!
+     * Opens the tree in [directory], or creates it
+    */
+    LsmTree(const std::string& directory, const Options& options);
+    ~LsmTree();
+    LsmTree(const LsmTree&) = delete;
+    LsmTree& operator=(const LsmTree&) = delete;
+
+    inline bool isOpen() const {
+        return mLog != nullptr;
+    }
+
+    bool get(const std::string& key, std::string* value) const;
+    bool put(const std::string& key, const std::string& value);
+    bool remove(const std::string& key);
+    /*!
+     * Applies the entries atomically: they are logged as one record
+    */
+    bool write(const std::vector<LsmEntry>& batch);
+    /*!
+     * The entries with first <= key < end, in key order; an empty [end] has no upper bound
+    */
+    Cursor scan(const std::string& first, const std::string& end) const;
+    /*!
+     * Makes the writes so far durable
+    */
+    bool commit();
+    /*!
+     * Writes the memtable to a run and waits until no merge is due (tests, benchmarks)
+    */
+    void flush();
+    size_t runCount() const;
+
+ private:
+    struct Slot {
+        std::string value;
+        bool isErased;
+    };
+    typedef std::map<std::string, Slot> Memtable;
+    struct Run {
+        std::shared_ptr<SortedRun> run;
+        // 0 for a flushed memtable; merging runs of tier N gives tier N + 1
+        unsigned tier;
+    };
+
+    const std::string mDirectory;
+    const Options mOptions;
+    mutable std::mutex mMutex;
+    // signals the background thread, and the writers waiting for a flush
+    std::condition_variable mChanged;
+    Memtable mMemtable;
+    size_t mMemtableBytes = 0;
+    std::shared_ptr<const Memtable> mImmutable;
+    // newest first
+    std::vector<Run> mRuns;
+    std::FILE* mLog = nullptr;
+    uint64_t mLogSequence = 0;
+    // log of mImmutable
+    uint64_t mImmutableLogSequence = 0;
+    uint64_t mNextSequence = 1;
+    bool mIsStopping = false;
+    // true while the background thread flushes or merges
+    bool mIsWorking = false;
+    std::thread mWorker;
+
+    std::string filePath(uint64_t sequence, const char* extension) const;
+    bool readManifest(std::vector<uint64_t>* logs);
+    /*!
+     * Caller holds mMutex
+    */
+    bool writeManifest() const;
+    bool replayLog(uint64_t sequence);
+    bool openLog();
+    void apply(const LsmEntry& entry);
+    /*!
+     * Makes the memtable immutable and starts a new log once the memtable is full, or if
+     * [isForced]; caller holds [lock]
+    */
+    bool switchMemtable(std::unique_lock<std::mutex>* lock, bool isForced);
+    void work();
+    /*!
+     * Writes the entries of [merger] to a new run; [dropErased] drops the tombstones
+     * [run] is null if no entry is left
+    */
+    bool writeRun(Cursor::Merger* merger, bool dropErased, std::shared_ptr<SortedRun>* run);
+    void flushImmutable();
+    /*!
+     * Merges the oldest [mergeRuns] consecutive runs of one tier; returns false if none
+    */
+    bool mergeRuns();
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_LSMTREE_HPP_
@@ -0,0 +1,224 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "pagefile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "wal.hpp"
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+// [magic][u32 synced page count][u32 crc32 of the bytes before]
+constexpr char JOURNAL_MAGIC[] = "PSJRNL01";
+constexpr size_t MAGIC_SIZE = 8;
+constexpr size_t JOURNAL_HEADER_SIZE = MAGIC_SIZE + 8;
+// [u32 crc32 of the rest][u32 page id][page]
+constexpr size_t JOURNAL_ENTRY_SIZE = 8 + PAGE_SIZE;
+
+void storeU32(uint32_t value, char* out) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint32_t loadU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+}  // namespace
+
+PageFile::PageFile(const std::string& path) : mJournalPath(path + "-journal") {
+    if (!rollBack(path)) {
+        LOG_ERROR("Cannot roll %s back to its last sync", path.c_str());
+        return;
+    }
+    mFile = std::fopen(path.c_str(), "r+b");
+    if (!mFile) {
+        mFile = std::fopen(path.c_str(), "w+b");
+    }
+    if (!mFile || (std::fseek(mFile, 0, SEEK_END) != 0)) {
+        return;
+    }
+    // A partly written last page is dropped
+    mPageCount = static_cast<PageID>(std::ftell(mFile) / PAGE_SIZE);
+    mSyncedCount = mPageCount;
+    // Empty until a synced page is written over
+    mJournal = std::fopen(mJournalPath.c_str(), "wb");
+}
+
+PageFile::~PageFile() {
+    if (mFile) {
+        std::fclose(mFile);
+    }
+    if (mJournal) {
+        std::fclose(mJournal);
+    }
+}
+
+bool PageFile::read(PageID id, char* page) {
+    if (!mFile || (id >= mPageCount)
+        || (std::fseek(mFile, static_cast<long>(id) * PAGE_SIZE, SEEK_SET) != 0)  // NOLINT
+        || (std::fread(page, 1, PAGE_SIZE, mFile) != PAGE_SIZE)) {
+        return false;
+    }
+    return crc32(page, PAGE_DATA_SIZE) == loadU32(page + PAGE_DATA_SIZE);
+}
+
+bool PageFile::write(PageID id, char* page) {
+    if ((id < mSyncedCount) && (mJournaled.count(id) == 0)
+        && !journal(std::vector<PageID> { id })) {
+        return false;
+    }
+    storeU32(crc32(page, PAGE_DATA_SIZE), page + PAGE_DATA_SIZE);
+    if (!mFile
+        || (std::fseek(mFile, static_cast<long>(id) * PAGE_SIZE, SEEK_SET) != 0)  // NOLINT
+        || (std::fwrite(page, 1, PAGE_SIZE, mFile) != PAGE_SIZE)) {
+        return false;
+    }
+    if (id >= mPageCount) {
+        mPageCount = id + 1;
+    }
+    return true;
+}
+
+bool PageFile::journal(const std::vector<PageID>& ids) {
+    std::string entries;
+    std::vector<PageID> saved;
+    std::string entry(JOURNAL_ENTRY_SIZE, '\0');
+    for (const PageID id : ids) {
+        if ((id >= mSyncedCount) || (mJournaled.count(id) > 0)
+            || (std::find(saved.begin(), saved.end(), id) != saved.end())) {
+            continue;
+        }
+        // As it is on the disk, even if it fails its checksum
+        if (!mFile
+            || (std::fseek(mFile, static_cast<long>(id) * PAGE_SIZE, SEEK_SET) != 0)  // NOLINT
+            || (std::fread(&entry[8], 1, PAGE_SIZE, mFile) != PAGE_SIZE)) {
+            return false;
+        }
+        storeU32(id, &entry[4]);
+        storeU32(crc32(&entry[4], JOURNAL_ENTRY_SIZE - 4), &entry[0]);
+        entries.append(entry);
+        saved.push_back(id);
+    }
+    if (saved.empty()) {
+        return true;
+    }
+    long end = 0;  // NOLINT(runtime/int)
+    if (mJournaled.empty()) {
+        char header[JOURNAL_HEADER_SIZE];
+        std::memcpy(header, JOURNAL_MAGIC, MAGIC_SIZE);
+        storeU32(mSyncedCount, header + MAGIC_SIZE);
+        storeU32(crc32(header, MAGIC_SIZE + 4), header + MAGIC_SIZE + 4);
+        entries.insert(0, header, JOURNAL_HEADER_SIZE);
+    } else {
+        end = static_cast<long>(JOURNAL_HEADER_SIZE  // NOLINT(runtime/int)
+                                + mJournaled.size() * JOURNAL_ENTRY_SIZE);
+    }
+    // After the whole entries, over what a failed write left
+    if (!mJournal || (std::fseek(mJournal, end, SEEK_SET) != 0)
+        || (std::fwrite(entries.data(), 1, entries.size(), mJournal) != entries.size())
+        || !syncFile(mJournal)) {
+        return false;
+    }
+    mJournaled.insert(saved.begin(), saved.end());
+    return true;
+}
+
+PageID PageFile::allocate() {
+    return mPageCount++;
+}
+
+bool PageFile::sync() {
+    if (!mFile || !syncFile(mFile)) {
+        return false;
+    }
+    if (!mJournaled.empty()) {
+        // The pages on the disk are whole; the journal is emptied for the next changes
+        std::fclose(mJournal);
+        mJournal = std::fopen(mJournalPath.c_str(), "wb");
+        if (!mJournal || !syncFile(mJournal)) {
+            return false;
+        }
+        mJournaled.clear();
+    }
+    mSyncedCount = mPageCount;
+    return true;
+}
+
+bool PageFile::rollBack(const std::string& path) {
+    std::FILE* journal = std::fopen(mJournalPath.c_str(), "rb");
+    if (!journal) {
+        return true;
+    }
+    char header[JOURNAL_HEADER_SIZE];
+    if ((std::fread(header, 1, JOURNAL_HEADER_SIZE, journal) != JOURNAL_HEADER_SIZE)
+        || (std::memcmp(header, JOURNAL_MAGIC, MAGIC_SIZE) != 0)
+        || (crc32(header, MAGIC_SIZE + 4) != loadU32(header + MAGIC_SIZE + 4))) {
+        // Empty, or the first page was not saved yet; nothing was written over
+        std::fclose(journal);
+        return true;
+    }
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    if (!file) {
+        std::fclose(journal);
+        return false;
+    }
+    size_t restored = 0;
+    std::string entry(JOURNAL_ENTRY_SIZE, '\0');
+    // A torn entry ends it; its page was not written over yet
+    while ((std::fread(&entry[0], 1, JOURNAL_ENTRY_SIZE, journal) == JOURNAL_ENTRY_SIZE)
+           && (crc32(&entry[4], JOURNAL_ENTRY_SIZE - 4) == loadU32(&entry[0]))) {
+        const long offset = static_cast<long>(loadU32(&entry[4])) * PAGE_SIZE;  // NOLINT
+        if ((std::fseek(file, offset, SEEK_SET) != 0)
+            || (std::fwrite(&entry[8], 1, PAGE_SIZE, file) != PAGE_SIZE)) {
+            std::fclose(journal);
+            std::fclose(file);
+            return false;
+        }
+        ++restored;
+    }
+    std::fclose(journal);
+    const bool isRestored = syncFile(file);
+    std::fclose(file);
+    if (!isRestored) {
+        return false;
+    }
+    // The pages added since are not reachable from the restored ones
+    const PageID syncedCount = loadU32(header + MAGIC_SIZE);
+    truncateFile(path, static_cast<int64_t>(syncedCount) * PAGE_SIZE);
+    LOG_INFO("Rolled %s back to its last sync (%s pages)", path.c_str(),
+             std::to_string(restored).c_str());
+    return true;
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,108 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_PAGEFILE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_PAGEFILE_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace dataprovider {
+namespace db {
+
+typedef uint32_t PageID;
+constexpr size_t PAGE_SIZE = 4096;
+// the last bytes of every page hold the crc32 of the rest
+constexpr size_t PAGE_DATA_SIZE = PAGE_SIZE - 4;
+
+/*!
+ * File of fixed-size pages that a crash takes back to its last sync()
+ *
+ * A page that was synced is saved to the journal ([path]-journal) before it is written over
+ * for the first time since; sync() ends the journal. Opening the file after a crash writes the
+ * saved pages back and drops the pages added since, so a change of several pages (e.g. a
+ * B+tree split) is on the disk completely or not at all.
+ * A torn or corrupted page fails its checksum and is not read.
+*/
+class PageFile {
+ public:
+    /*!
+     * Opens the file, or creates it if it does not exist
+    */
+    explicit PageFile(const std::string& path);
+    ~PageFile();
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    inline bool isOpen() const {
+        return mFile != nullptr;
+    }
+
+    inline PageID pageCount() const {
+        return mPageCount;
+    }
+
+    /*!
+     * Reads page [id] into [page] (PAGE_SIZE bytes)
+     * Returns false if the page does not exist or fails its checksum
+    */
+    bool read(PageID id, char* page);
+    /*!
+     * Writes [page] (PAGE_SIZE bytes) as page [id]; sets its checksum
+     * Saves the page to the journal first, unless journal() did.
+    */
+    bool write(PageID id, char* page);
+    /*!
+     * Saves the synced pages among [ids] to the journal, with one sync of it, e.g. before
+     * a batch of write()
+    */
+    bool journal(const std::vector<PageID>& ids);
+    /*!
+     * Returns the id of a new page at the end of the file
+    */
+    PageID allocate();
+    /*!
+     * Flushes the written pages to the disk and ends the journal
+    */
+    bool sync();
+
+ private:
+    const std::string mJournalPath;
+    std::FILE* mFile = nullptr;
+    std::FILE* mJournal = nullptr;
+    PageID mPageCount = 0;
+    // pages at the last sync(); the ones after are dropped by a roll back
+    PageID mSyncedCount = 0;
+    // pages saved to the journal since the last sync()
+    std::unordered_set<PageID> mJournaled;
+
+    /*!
+     * Writes the pages saved in the journal back to [path]; a crash left them half-written
+     * Returns false if they could not be written back.
+    */
+    bool rollBack(const std::string& path);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_PAGEFILE_HPP_
@@ -0,0 +1,188 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_PERSISTENTMAP_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_PERSISTENTMAP_HPP_
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "persistentvector.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Hash map from string keys whose copies share their storage, like PersistentVector
+ *
+ * The buckets are immutable; a change copies one bucket and the chunk that points to it.
+ * Copying the map is O(1), so an index can be part of every table version.
+*/
+template <typename Value>
+class PersistentMap {
+ public:
+    PersistentMap() = default;
+    ~PersistentMap() = default;
+
+    inline size_t size() const {
+        return mSize;
+    }
+
+    inline bool empty() const {
+        return mSize == 0;
+    }
+
+    /*!
+     * Returns null if the key is not found
+    */
+    const Value* find(const std::string& key) const {
+        if (mBuckets.empty()) {
+            return nullptr;
+        }
+        const Bucket* bucket = mBuckets[bucketOf(key)].get();
+        if (!bucket) {
+            return nullptr;
+        }
+        for (const Entry& entry : *bucket) {
+            if (entry.first == key) {
+                return &entry.second;
+            }
+        }
+        return nullptr;
+    }
+
+    inline bool contains(const std::string& key) const {
+        return find(key) != nullptr;
+    }
+
+    /*!
+     * Adds the entry; returns false (and keeps the old value) if the key exists
+    */
+    bool insert(const std::string& key, Value value) {
+        if (contains(key)) {
+            return false;
+        }
+        assign(key, std::move(value));
+        return true;
+    }
+
+    /*!
+     * Adds the entry or replaces the value of the key
+    */
+    void assign(const std::string& key, Value value) {
+        if (mSize + 1 > mBuckets.size() * MAX_LOAD) {
+            rehash(std::max(MIN_BUCKETS, mBuckets.size() * 2));
+        }
+        const size_t pos = bucketOf(key);
+        Bucket bucket = mBuckets[pos] ? *mBuckets[pos] : Bucket();
+        const auto it = std::find_if(bucket.begin(), bucket.end(),
+                                     [&key](const Entry& entry) { return entry.first == key; });
+        if (it != bucket.end()) {
+            it->second = std::move(value);
+        } else {
+            bucket.emplace_back(key, std::move(value));
+            ++mSize;
+        }
+        mBuckets.set(pos, std::make_shared<const Bucket>(std::move(bucket)));
+    }
+
+    /*!
+     * Returns false if the key is not found
+    */
+    bool erase(const std::string& key) {
+        if (!contains(key)) {
+            return false;
+        }
+        const size_t pos = bucketOf(key);
+        Bucket bucket = *mBuckets[pos];
+        bucket.erase(std::find_if(bucket.begin(), bucket.end(),
+                                  [&key](const Entry& entry) { return entry.first == key; }));
+        mBuckets.set(pos, bucket.empty() ? nullptr
+                                         : std::make_shared<const Bucket>(std::move(bucket)));
+        --mSize;
+        return true;
+    }
+
+    /*!
+     * Makes room for [size] entries (bulk load)
+    */
+    void reserve(size_t size) {
+        size_t bucketCount = std::max(MIN_BUCKETS, mBuckets.size());
+        while (size > bucketCount * MAX_LOAD) {
+            bucketCount *= 2;
+        }
+        if (bucketCount != mBuckets.size()) {
+            rehash(bucketCount);
+        }
+    }
+
+    void clear() {
+        mBuckets.clear();
+        mSize = 0;
+    }
+
+    /*!
+     * Calls [function] with every key and value, in no particular order
+    */
+    template <typename Function>
+    void forEach(Function function) const {
+        for (const std::shared_ptr<const Bucket>& bucket : mBuckets) {
+            if (!bucket) {
+                continue;
+            }
+            for (const Entry& entry : *bucket) {
+                function(entry.first, entry.second);
+            }
+        }
+    }
+
+ private:
+    typedef std::pair<std::string, Value> Entry;
+    typedef std::vector<Entry> Bucket;
+    static constexpr size_t MIN_BUCKETS = 64;
+    static constexpr size_t MAX_LOAD = 2;
+
+    PersistentVector<std::shared_ptr<const Bucket>> mBuckets;
+    size_t mSize = 0;
+
+    inline size_t bucketOf(const std::string& key) const {
+        // The bucket count is a power of two
+        return std::hash<std::string>()(key) & (mBuckets.size() - 1);
+    }
+
+    void rehash(size_t bucketCount) {
+        std::vector<Bucket> buckets(bucketCount);
+        forEach([&buckets, bucketCount](const std::string& key, const Value& value) {
+            buckets[std::hash<std::string>()(key) & (bucketCount - 1)].emplace_back(key, value);
+        });
+        PersistentVector<std::shared_ptr<const Bucket>> rehashed;
+        for (Bucket& bucket : buckets) {
+            rehashed.push_back(bucket.empty() ? nullptr
+                                              : std::make_shared<const Bucket>(std::move(bucket)));
+        }
+        mBuckets = std::move(rehashed);
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_PERSISTENTMAP_HPP_
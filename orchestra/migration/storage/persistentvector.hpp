@@ -0,0 +1,447 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_PERSISTENTVECTOR_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_PERSISTENTVECTOR_HPP_
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Returns a number that no other caller gets
+ * It marks the chunks that one container is allowed to change in place.
+*/
+inline uint64_t newEditToken() {
+    static std::atomic<uint64_t> next {0};
+    return next.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+/*!
+ * Vector whose copies share their storage (copy-on-write, per chunk)
+ *
+ * The elements are kept in a tree of 64-element chunks. Copying the vector is O(1); changing
+ * a copy copies only the chunks on the path to the element, so the other copies never change.
+ * This is what lets a table publish a new version while readers still use the previous one.
+ *
+ * Two cases avoid the copies:
+ *   - a chunk created by this copy (same edit token) is not shared and is changed in place,
+ *     so filling a new vector costs about the same as std::vector
+ *   - appending only writes past the end of every copy that shares the chunk, so the first
+ *     copy to append at a given position (see Node::claimed) extends the shared chunk in place
+ * Chunks never reallocate, since a reader may be using a shared one.
+*/
+template <typename T>
+class PersistentVector {
+    struct Node;
+
+ public:
+    /*!
+     * Walks the elements in order; stays on the current chunk until it is done
+    */
+    class const_iterator {
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator(const PersistentVector* vector, size_t pos) : mVector(vector), mPos(pos) {
+            loadChunk();
+        }
+
+        inline const T& operator*() const {
+            return mChunk[mPos & MASK];
+        }
+
+        inline const T* operator->() const {
+            return &mChunk[mPos & MASK];
+        }
+
+        inline const_iterator& operator++() {
+            if ((++mPos & MASK) == 0) {
+                loadChunk();
+            }
+            return *this;
+        }
+
+        inline size_t position() const {
+            return mPos;
+        }
+
+        inline bool operator==(const const_iterator& other) const {
+            return mPos == other.mPos;
+        }
+
+        inline bool operator!=(const const_iterator& other) const {
+            return mPos != other.mPos;
+        }
+
+     private:
+        const PersistentVector* mVector;
+        size_t mPos;
+        const T* mChunk = nullptr;
+
+        void loadChunk() {
+            const bool isInside = mVector && (mPos < mVector->mSize);
+            mChunk = isInside ? mVector->chunkOf(mPos)->values.data() : nullptr;
+        }
+    };
+
+    PersistentVector() : mEdit(newEditToken()) {}
+
+    PersistentVector(const PersistentVector& other)
+        : mRoot(other.mRoot), mSize(other.mSize), mShift(other.mShift), mEdit(newEditToken()) {
+        // The chunks are shared now; neither copy may change them in place
+        other.mEdit.store(newEditToken(), std::memory_order_relaxed);
+    }
+
+    PersistentVector(PersistentVector&& other) noexcept
+        : mRoot(std::move(other.mRoot)), mSize(other.mSize), mShift(other.mShift),
+          mEdit(other.mEdit.load(std::memory_order_relaxed)) {
+        other.mSize = 0;
+        other.mShift = 0;
+        other.mEdit.store(newEditToken(), std::memory_order_relaxed);
+    }
+
+    PersistentVector& operator=(const PersistentVector& other) {
+        if (this != &other) {
+            mRoot = other.mRoot;
+            mSize = other.mSize;
+            mShift = other.mShift;
+            mEdit.store(newEditToken(), std::memory_order_relaxed);
+            other.mEdit.store(newEditToken(), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    PersistentVector& operator=(PersistentVector&& other) noexcept {
+        if (this != &other) {
+            mRoot = std::move(other.mRoot);
+            mSize = other.mSize;
+            mShift = other.mShift;
+            mEdit.store(other.mEdit.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            other.mSize = 0;
+            other.mShift = 0;
+            other.mEdit.store(newEditToken(), std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    ~PersistentVector() = default;
+
+    inline const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    inline const_iterator end() const {
+        return const_iterator(this, mSize);
+    }
+
+    inline size_t size() const {
+        return mSize;
+    }
+
+    inline bool empty() const {
+        return mSize == 0;
+    }
+
+    inline const T& operator[](size_t pos) const {
+        return chunkOf(pos)->values[pos & MASK];
+    }
+
+    inline const T& back() const {
+        return (*this)[mSize - 1];
+    }
+
+    void push_back(T value) {
+        if (mSize == capacity()) {
+            grow();
+        }
+        mRoot = appendTo(mRoot, mShift, 0, &value);
+        ++mSize;
+    }
+
+    void pop_back() {
+        popFrom(editable(&mRoot, mShift, 0), mShift, 0);
+        if (--mSize == 0) {
+            clear();
+            return;
+        }
+        // Drop the levels that are not needed anymore
+        while ((mShift > 0) && (mRoot->children.size() == 1)) {
+            std::shared_ptr<Node> child = mRoot->children.front();
+            mRoot = std::move(child);
+            mShift -= BITS;
+        }
+    }
+
+    void set(size_t pos, T value) {
+        Node* node = editable(&mRoot, mShift, 0);
+        size_t base = 0;
+        for (unsigned shift = mShift; shift > 0; shift -= BITS) {
+            const size_t index = (pos >> shift) & MASK;
+            base += index << shift;
+            node = editable(&node->children[index], shift - BITS, base);
+        }
+        node->values[pos & MASK] = std::move(value);
+    }
+
+    void resize(size_t size) {
+        while (mSize > size) {
+            pop_back();
+        }
+        while (mSize < size) {
+            push_back(T());
+        }
+    }
+
+    /*!
+     * Inserts [value] before [pos]
+     * O(n - pos) like std::vector; meant for the rare out-of-order insert
+    */
+    void insert(size_t pos, T value) {
+        std::vector<T> tail = takeTail(pos);
+        push_back(std::move(value));
+        for (T& element : tail) {
+            push_back(std::move(element));
+        }
+    }
+
+    /*!
+     * Removes the element at [pos]; O(n - pos) like std::vector
+    */
+    void erase(size_t pos) {
+        std::vector<T> tail = takeTail(pos);
+        for (size_t i = 1; i < tail.size(); ++i) {
+            push_back(std::move(tail[i]));
+        }
+    }
+
+    void clear() {
+        mRoot.reset();
+        mSize = 0;
+        mShift = 0;
+    }
+
+ private:
+    static constexpr unsigned BITS = 6;
+    static constexpr size_t WIDTH = static_cast<size_t>(1) << BITS;
+    static constexpr size_t MASK = WIDTH - 1;
+
+    /*!
+     * A branch has children, a chunk (leaf, level 0) has values
+     * Only the first entries are used by a given copy of the vector; the ones after them
+     * may belong to a copy that appended in place.
+    */
+    struct Node {
+        Node(uint64_t token, unsigned shift) : edit(token) {
+            if (shift == 0) {
+                values.reserve(WIDTH);
+            } else {
+                children.reserve(WIDTH);
+            }
+        }
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        const uint64_t edit;
+        // entries handed out so far; the next appender takes the one at this index
+        std::atomic<size_t> claimed {0};
+        std::vector<std::shared_ptr<Node>> children;
+        std::vector<T> values;
+    };
+
+    std::shared_ptr<Node> mRoot;
+    size_t mSize = 0;
+    // level of the root (bits of the position below it); 0 if the root is a chunk
+    unsigned mShift = 0;
+    mutable std::atomic<uint64_t> mEdit;
+
+    inline uint64_t edit() const {
+        return mEdit.load(std::memory_order_relaxed);
+    }
+
+    inline size_t capacity() const {
+        return mRoot ? (WIDTH << mShift) : 0;
+    }
+
+    /*!
+     * Entries of this copy in the node at level [shift] whose first element is [base]
+    */
+    inline size_t usedBy(size_t base, unsigned shift) const {
+        if (mSize <= base) {
+            return 0;
+        }
+        return std::min(WIDTH, ((mSize - 1 - base) >> shift) + 1);
+    }
+
+    const Node* chunkOf(size_t pos) const {
+        const Node* node = mRoot.get();
+        for (unsigned shift = mShift; shift > 0; shift -= BITS) {
+            node = node->children[(pos >> shift) & MASK].get();
+        }
+        return node;
+    }
+
+    /*!
+     * Copies the first [used] entries; reads nothing another copy may be writing
+    */
+    std::shared_ptr<Node> cloneOf(const Node& node, unsigned shift, size_t used) const {
+        std::shared_ptr<Node> copy = std::make_shared<Node>(edit(), shift);
+        if (shift == 0) {
+            copy->values.assign(node.values.data(), node.values.data() + used);
+        } else {
+            copy->children.assign(node.children.data(), node.children.data() + used);
+        }
+        copy->claimed.store(used, std::memory_order_relaxed);
+        return copy;
+    }
+
+    /*!
+     * Returns the node to change, copying it first if it may be shared
+    */
+    Node* editable(std::shared_ptr<Node>* node, unsigned shift, size_t base) {
+        if ((*node)->edit != edit()) {
+            *node = cloneOf(**node, shift, usedBy(base, shift));
+        }
+        return node->get();
+    }
+
+    /*!
+     * Returns the node to append one entry to: [node] itself if it is ours or if no other
+     * copy appended after entry [used] yet, otherwise a copy
+    */
+    std::shared_ptr<Node> extensible(const std::shared_ptr<Node>& node, unsigned shift,
+                                     size_t used) {
+        if (node->edit == edit()) {
+            node->claimed.store(used + 1, std::memory_order_relaxed);
+            return node;
+        }
+        size_t expected = used;
+        if (node->claimed.compare_exchange_strong(expected, used + 1,
+                                                  std::memory_order_acq_rel)) {
+            return node;
+        }
+        std::shared_ptr<Node> copy = cloneOf(*node, shift, used);
+        copy->claimed.store(used + 1, std::memory_order_relaxed);
+        return copy;
+    }
+
+    /*!
+     * Appends [value] below [node] (level [shift], first element [base])
+     * Returns [node] if it was extended in place, or the copy that replaces it
+    */
+    std::shared_ptr<Node> appendTo(const std::shared_ptr<Node>& node, unsigned shift,
+                                   size_t base, T* value) {
+        const size_t used = usedBy(base, shift);
+        if (shift == 0) {
+            std::shared_ptr<Node> target = extensible(node, shift, used);
+            target->values.emplace_back(std::move(*value));
+            return target;
+        }
+        const size_t index = (mSize >> shift) & MASK;
+        if (index == used) {
+            std::shared_ptr<Node> target = extensible(node, shift, used);
+            target->children.emplace_back(newPath(shift - BITS, value));
+            return target;
+        }
+        // The last child has room
+        const std::shared_ptr<Node>& child = node->children[index];
+        std::shared_ptr<Node> appended = appendTo(child, shift - BITS, base + (index << shift),
+                                                  value);
+        if (appended == child) {
+            return node;
+        }
+        std::shared_ptr<Node> target = node;
+        editable(&target, shift, base)->children[index] = std::move(appended);
+        return target;
+    }
+
+    /*!
+     * Creates the nodes from level [shift] down to the chunk that holds [value]
+    */
+    std::shared_ptr<Node> newPath(unsigned shift, T* value) {
+        std::shared_ptr<Node> node = std::make_shared<Node>(edit(), shift);
+        node->claimed.store(1, std::memory_order_relaxed);
+        if (shift == 0) {
+            node->values.emplace_back(std::move(*value));
+        } else {
+            node->children.emplace_back(newPath(shift - BITS, value));
+        }
+        return node;
+    }
+
+    void grow() {
+        if (!mRoot) {
+            mRoot = std::make_shared<Node>(edit(), 0);
+            return;
+        }
+        std::shared_ptr<Node> root = std::make_shared<Node>(edit(), mShift + BITS);
+        root->children.emplace_back(std::move(mRoot));
+        root->claimed.store(1, std::memory_order_relaxed);
+        mRoot = std::move(root);
+        mShift += BITS;
+    }
+
+    /*!
+     * Removes the last element below [node], which is already ours
+    */
+    void popFrom(Node* node, unsigned shift, size_t base) {
+        if (shift == 0) {
+            node->values.pop_back();
+            node->claimed.store(node->values.size(), std::memory_order_relaxed);
+            return;
+        }
+        const size_t index = ((mSize - 1) >> shift) & MASK;
+        const size_t childBase = base + (index << shift);
+        Node* child = editable(&node->children[index], shift - BITS, childBase);
+        popFrom(child, shift - BITS, childBase);
+        if (child->children.empty() && child->values.empty()) {
+            node->children.pop_back();
+            node->claimed.store(node->children.size(), std::memory_order_relaxed);
+        }
+    }
+
+    /*!
+     * Removes and returns the elements from [pos] on
+    */
+    std::vector<T> takeTail(size_t pos) {
+        std::vector<T> tail;
+        tail.reserve(mSize - pos);
+        for (const_iterator it(this, pos); it != end(); ++it) {
+            tail.emplace_back(*it);
+        }
+        resize(pos);
+        return tail;
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_PERSISTENTVECTOR_HPP_
@@ -0,0 +1,144 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "productcolumns.hpp"
+
+namespace dataprovider {
+namespace db {
+
+void ProductColumns::append(const Row& row) {
+    barcode.push_back(row.barcode);
+    sku.push_back(row.sku);
+    name.push_back(row.name);
+    description.push_back(row.description);
+    stock.push_back(row.stock);
+    originalPrice.push_back(row.original_price);
+    sellPrice.push_back(row.sell_price);
+    supplierCode.push_back(row.supplier_code);
+    category.push_back(categories.encode(row.category));
+    brand.push_back(brands.encode(row.brand));
+    uom.push_back(uoms.encode(row.uom));
+    status.push_back(statuses.encode(row.status));
+    supplierName.push_back(supplierNames.encode(row.supplier_name));
+}
+
+void ProductColumns::set(size_t pos, const Row& row) {
+    barcode.set(pos, row.barcode);
+    sku.set(pos, row.sku);
+    name.set(pos, row.name);
+    description.set(pos, row.description);
+    stock.set(pos, row.stock);
+    originalPrice.set(pos, row.original_price);
+    sellPrice.set(pos, row.sell_price);
+    supplierCode.set(pos, row.supplier_code);
+    category.set(pos, categories.encode(row.category));
+    brand.set(pos, brands.encode(row.brand));
+    uom.set(pos, uoms.encode(row.uom));
+    status.set(pos, statuses.encode(row.status));
+    supplierName.set(pos, supplierNames.encode(row.supplier_name));
+}
+
+ProductColumns::Row ProductColumns::row(size_t pos) const {
+    Row out;
+    read(pos, &out);
+    return out;
+}
+
+void ProductColumns::read(size_t pos, Row* out) const {
+    out->barcode = barcode[pos];
+    out->sku = sku[pos];
+    out->name = name[pos];
+    out->description = description[pos];
+    out->category = categories.decode(category[pos]);
+    out->brand = brands.decode(brand[pos]);
+    out->uom = uoms.decode(uom[pos]);
+    out->stock = stock[pos];
+    out->status = statuses.decode(status[pos]);
+    out->original_price = originalPrice[pos];
+    out->sell_price = sellPrice[pos];
+    out->supplier_name = supplierNames.decode(supplierName[pos]);
+    out->supplier_code = supplierCode[pos];
+}
+
+const std::string& ProductColumns::field(std::string Row::*field, size_t pos,
+                                         std::string* buffer) const {
+    if (field == &Row::barcode) {
+        return barcode[pos];
+    } else if (field == &Row::sku) {
+        return sku[pos];
+    } else if (field == &Row::name) {
+        return name[pos];
+    } else if (field == &Row::description) {
+        return description[pos];
+    } else if (field == &Row::category) {
+        return categories.decode(category[pos]);
+    } else if (field == &Row::brand) {
+        return brands.decode(brand[pos]);
+    } else if (field == &Row::uom) {
+        return uoms.decode(uom[pos]);
+    } else if (field == &Row::stock) {
+        return stock[pos];
+    } else if (field == &Row::status) {
+        return statuses.decode(status[pos]);
+    } else if (field == &Row::original_price) {
+        return originalPrice[pos];
+    } else if (field == &Row::sell_price) {
+        return sellPrice[pos];
+    } else if (field == &Row::supplier_name) {
+        return supplierNames.decode(supplierName[pos]);
+    }
+    // supplier_code
+    return supplierCode[pos];
+}
+
+void ProductColumns::move(size_t from, size_t to) {
+    barcode.set(to, barcode[from]);
+    sku.set(to, sku[from]);
+    name.set(to, name[from]);
+    description.set(to, description[from]);
+    stock.set(to, stock[from]);
+    originalPrice.set(to, originalPrice[from]);
+    sellPrice.set(to, sellPrice[from]);
+    supplierCode.set(to, supplierCode[from]);
+    category.set(to, category[from]);
+    brand.set(to, brand[from]);
+    uom.set(to, uom[from]);
+    status.set(to, status[from]);
+    supplierName.set(to, supplierName[from]);
+}
+
+void ProductColumns::resize(size_t size) {
+    barcode.resize(size);
+    sku.resize(size);
+    name.resize(size);
+    description.resize(size);
+    stock.resize(size);
+    originalPrice.resize(size);
+    sellPrice.resize(size);
+    supplierCode.resize(size);
+    category.resize(size);
+    brand.resize(size);
+    uom.resize(size);
+    status.resize(size);
+    supplierName.resize(size);
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,98 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_PRODUCTCOLUMNS_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_PRODUCTCOLUMNS_HPP_
+#include <cstdint>
+#include <string>
+#include "dictionary.hpp"
+#include "persistentvector.hpp"
+#include "table.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Column storage of ProductTableItem
+ * The low-cardinality fields (category, brand, uom, status, supplier name) hold dictionary
+ * codes; each distinct string is stored once per table version chain.
+*/
+struct ProductColumns {
+    typedef ProductTableItem Row;
+    static constexpr std::string Row::*PRIMARY_KEY = &Row::barcode;
+
+    PersistentVector<std::string> barcode;
+    PersistentVector<std::string> sku;
+    PersistentVector<std::string> name;
+    PersistentVector<std::string> description;
+    PersistentVector<std::string> stock;
+    PersistentVector<std::string> originalPrice;
+    PersistentVector<std::string> sellPrice;
+    PersistentVector<std::string> supplierCode;
+    // dictionary codes
+    PersistentVector<uint32_t> category;
+    PersistentVector<uint32_t> brand;
+    PersistentVector<uint32_t> uom;
+    PersistentVector<uint32_t> status;
+    PersistentVector<uint32_t> supplierName;
+    Dictionary categories;
+    Dictionary brands;
+    Dictionary uoms;
+    Dictionary statuses;
+    Dictionary supplierNames;
+
+    inline size_t size() const {
+        return barcode.size();
+    }
+
+    inline const std::string& key(size_t pos) const {
+        return barcode[pos];
+    }
+
+    void append(const Row& row);
+    void set(size_t pos, const Row& row);
+    Row row(size_t pos) const;
+    /*!
+     * Copies the row at [pos] into [out], reusing the capacity of its strings
+     * A scan that reads every row into the same [out] stops allocating after a few rows.
+    */
+    void read(size_t pos, Row* out) const;
+    /*!
+     * One field of the row at [pos], read without building the row (see Selection)
+     * [buffer] holds the value if the column does not store it as text
+    */
+    const std::string& field(std::string Row::*field, size_t pos, std::string* buffer) const;
+    // the row has no flags
+    inline bool flag(bool Row::*, size_t) const {
+        return false;
+    }
+    void move(size_t from, size_t to);
+    void resize(size_t size);
+    inline void reindex() {}
+    inline void unindex(size_t) {}
+    // every field is stored as text
+    static inline bool isValid(const Row&) {
+        return true;
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_PRODUCTCOLUMNS_HPP_
@@ -0,0 +1,342 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_QUERY_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_QUERY_HPP_
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+namespace db {
+
+template <typename Row>
+class Cursor;
+template <typename Row>
+class TableEngine;
+
+/*!
+ * A text field of a table row, e.g. &ProductTableItem::barcode
+*/
+template <typename Row>
+using Field = std::string Row::*;
+
+/*!
+ * A flag of a table row, e.g. &EmployeeTableItem::isSystemUser
+*/
+template <typename Row>
+using Flag = bool Row::*;
+
+/*!
+ * A test on one field of a row; see column()
+*/
+template <typename Row>
+struct Condition {
+    Field<Row> field;
+    std::function<bool(const std::string&)> test;
+};
+
+/*!
+ * Builds the conditions on a field
+ * e.g. column(&ProductTableItem::category) == "Beverages"
+*/
+template <typename Row>
+class Column {
+ public:
+    explicit Column(Field<Row> field) : mField(field) {}
+
+    Condition<Row> operator==(std::string value) const {
+        return { mField, [value](const std::string& field) { return field == value; } };
+    }
+
+    Condition<Row> operator!=(std::string value) const {
+        return { mField, [value](const std::string& field) { return field != value; } };
+    }
+
+    Condition<Row> startsWith(std::string prefix) const {
+        return { mField, [prefix](const std::string& field) {
+            return field.compare(0, prefix.size(), prefix) == 0;
+        } };
+    }
+
+    Condition<Row> contains(std::string text) const {
+        return { mField, [text](const std::string& field) {
+            return field.find(text) != std::string::npos;
+        } };
+    }
+
+    /*!
+     * Any other test, e.g. a lookup in a set of keys
+    */
+    Condition<Row> matches(std::function<bool(const std::string&)> test) const {
+        return { mField, std::move(test) };
+    }
+
+ private:
+    const Field<Row> mField;
+};
+
+template <typename Row>
+Column<Row> column(std::string Row::*field) {
+    return Column<Row>(field);
+}
+
+/*!
+ * What a query reads: the rows that pass every condition, with the selected fields only
+ *
+ * The engines evaluate the conditions on their stored rows and copy out the matching rows
+ * only. The column tables go further and only read the fields of the conditions and of the
+ * projection. The fields that are not selected are left empty, and the flags that are not
+ * selected are false.
+*/
+template <typename Row>
+struct Selection {
+    std::vector<Condition<Row>> conditions;
+    // empty selects every field
+    std::vector<Field<Row>> fields;
+    // copied along with [fields]
+    std::vector<Flag<Row>> flags;
+
+    bool matches(const Row& row) const {
+        for (const Condition<Row>& condition : conditions) {
+            if (!condition.test(row.*condition.field)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*!
+     * Copies the selected fields of [row] into [out]
+    */
+    void project(const Row& row, Row* out) const {
+        if (fields.empty()) {
+            *out = row;
+            return;
+        }
+        *out = Row {};
+        for (const Field<Row> field : fields) {
+            (*out).*field = row.*field;
+        }
+        for (const Flag<Row> flag : flags) {
+            (*out).*flag = row.*flag;
+        }
+    }
+};
+
+/*!
+ * Filter and projection over a table engine
+ * e.g. const std::vector<ProductTableItem> products = db::scan(STORAGE().products())
+ *          .where(db::column(&ProductTableItem::category) == category)
+ *          .select({ &ProductTableItem::barcode, &ProductTableItem::name })
+ *          .rows();
+*/
+template <typename Row>
+class Query {
+ public:
+    explicit Query(const TableEngine<Row>& table) : mTable(table) {}
+
+    /*!
+     * Keeps the rows that pass [condition]; the conditions add up (AND)
+    */
+    Query& where(Condition<Row> condition) {
+        mSelection.conditions.emplace_back(std::move(condition));
+        return *this;
+    }
+
+    /*!
+     * Only copies [fields] and [flags] out of the table
+    */
+    Query& select(std::vector<Field<Row>> fields, std::vector<Flag<Row>> flags = {}) {
+        mSelection.fields = std::move(fields);
+        mSelection.flags = std::move(flags);
+        return *this;
+    }
+
+    std::unique_ptr<Cursor<Row>> cursor() const {
+        return mTable.select(mSelection);
+    }
+
+    std::vector<Row> rows() const {
+        std::vector<Row> rows;
+        const std::unique_ptr<Cursor<Row>> matches = cursor();
+        for (Row row; matches->next(&row);) {
+            rows.emplace_back(std::move(row));
+        }
+        return rows;
+    }
+
+ private:
+    const TableEngine<Row>& mTable;
+    Selection<Row> mSelection;
+};
+
+/*!
+ * Starts a query on [table]; see Query
+*/
+template <typename Row>
+Query<Row> scan(const TableEngine<Row>& table) {
+    return Query<Row>(table);
+}
+
+/*!
+ * One page of a table, in [sortBy] order then in [key] order
+ *
+ * The token of a page holds the position (sort value and key) of its last row, and the next
+ * page starts after it. A page then costs one pass over the sort and key fields plus the
+ * copy of its own rows, wherever it is in the table; rows written between two calls do not
+ * shift the pages that follow.
+*/
+template <typename Row>
+struct PageQuery {
+    // the primary key, which makes the order total
+    Field<Row> key = nullptr;
+    // null orders by the key only
+    Field<Row> sortBy = nullptr;
+    size_t size = 0;
+    // empty for the first page, else the nextToken of the previous page
+    std::string token;
+
+    const std::string& sortValue(const Row& row) const {
+        static const std::string none;
+        return sortBy ? row.*sortBy : none;
+    }
+};
+
+template <typename Row>
+struct RowPage {
+    std::vector<Row> rows;
+    // empty on the last page
+    std::string nextToken;
+};
+
+/*!
+ * Token of the position [sortValue, key]: "<length of sortValue>:<sortValue><key>"
+*/
+inline std::string encodePageToken(const std::string& sortValue, const std::string& key) {
+    return std::to_string(sortValue.size()) + ":" + sortValue + key;
+}
+
+/*!
+ * Returns false if [token] is empty or is not a page token
+*/
+inline bool decodePageToken(const std::string& token, std::string* sortValue,
+                            std::string* key) {
+    const size_t MAX_DIGITS = 9;
+    const size_t colon = token.find(':');
+    if (colon == 0 || colon > MAX_DIGITS || token.find_first_not_of("0123456789") != colon) {
+        return false;
+    }
+    const size_t length = std::stoul(token.substr(0, colon));
+    if (length > token.size() - colon - 1) {
+        return false;
+    }
+    *sortValue = token.substr(colon + 1, length);
+    *key = token.substr(colon + 1 + length);
+    return true;
+}
+
+/*!
+ * Keeps the rows of a page while the rows of the table are offered in any order
+ *
+ * A bounded max-heap of the [size] + 1 first positions after the token; the extra one tells
+ * whether another page follows. [Item] is what the engine needs to copy the row afterwards,
+ * e.g. a row position, so the rows that do not make the page are never copied.
+ * An invalid token reads the first page.
+*/
+template <typename Item>
+class PageWindow {
+ public:
+    PageWindow(const std::string& token, size_t size) : mSize(std::max<size_t>(size, 1)) {
+        mHasStart = decodePageToken(token, &mStart.first, &mStart.second);
+    }
+
+    /*!
+     * True if the row at [sortValue, key] is a candidate; test it before building its item
+    */
+    bool accepts(const std::string& sortValue, const std::string& key) const {
+        if (mHasStart && !isBefore(mStart.first, mStart.second, sortValue, key)) {
+            return false;
+        }
+        return mHeap.size() <= mSize
+               || isBefore(sortValue, key, mHeap.front().position.first,
+                           mHeap.front().position.second);
+    }
+
+    /*!
+     * Adds a row that accepts() took
+    */
+    void offer(const std::string& sortValue, const std::string& key, const Item& item) {
+        mHeap.push_back({ { sortValue, key }, item });
+        std::push_heap(mHeap.begin(), mHeap.end(), byPosition);
+        if (mHeap.size() > mSize + 1) {
+            std::pop_heap(mHeap.begin(), mHeap.end(), byPosition);
+            mHeap.pop_back();
+        }
+    }
+
+    /*!
+     * The items of the page, in order; sets [nextToken] (empty on the last page)
+    */
+    std::vector<Item> take(std::string* nextToken) {
+        std::sort_heap(mHeap.begin(), mHeap.end(), byPosition);
+        nextToken->clear();
+        if (mHeap.size() > mSize) {
+            mHeap.pop_back();
+            *nextToken = encodePageToken(mHeap.back().position.first,
+                                         mHeap.back().position.second);
+        }
+        std::vector<Item> items;
+        items.reserve(mHeap.size());
+        for (Entry& entry : mHeap) {
+            items.emplace_back(std::move(entry.item));
+        }
+        mHeap.clear();
+        return items;
+    }
+
+ private:
+    struct Entry {
+        std::pair<std::string, std::string> position;
+        Item item;
+    };
+
+    const size_t mSize;
+    bool mHasStart;
+    std::pair<std::string, std::string> mStart;
+    std::vector<Entry> mHeap;
+
+    static bool isBefore(const std::string& sortValue, const std::string& key,
+                         const std::string& otherSortValue, const std::string& otherKey) {
+        const int order = sortValue.compare(otherSortValue);
+        return order < 0 || (order == 0 && key < otherKey);
+    }
+
+    static bool byPosition(const Entry& first, const Entry& second) {
+        return first.position < second.position;
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_QUERY_HPP_
@@ -0,0 +1,201 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_ROWCODEC_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_ROWCODEC_HPP_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "table.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Identifies the StackDB table in persisted records
+ * Warning: values are written to disk; only append new tables at the end
+*/
+enum class TableID : uint8_t {
+    EMPLOYEES   = 0x00,
+    USERS       = 0x01,
+    ADDRESS     = 0x02,
+    CONTACTS    = 0x03,
+    PERSONAL_ID = 0x04,
+    PRODUCT     = 0x05,
+    CUSTOMER    = 0x06,
+    UOM         = 0x07,
+    CATEGORY    = 0x08,
+    SALES       = 0x09,
+    SALES_ITEM  = 0x0A
+};
+
+constexpr size_t TABLE_COUNT = 11;
+
+typedef std::vector<std::string> Fields;
+
+/*!
+ * Converts a table row to and from its list of fields, in declaration order
+ * Used by everything that persists or exchanges rows (log, checkpoint, import)
+*/
+template <typename RowType>
+struct RowCodec;
+
+template <>
+struct RowCodec<EmployeeTableItem> {
+    static constexpr TableID TABLE = TableID::EMPLOYEES;
+    static constexpr size_t FIELD_COUNT = 9;
+    static Fields encode(const EmployeeTableItem& row) {
+        return { row.employeeID, row.firstname, row.middlename, row.lastname, row.birthdate,
+                 row.gender, row.position, row.status, row.isSystemUser ? "1" : "0" };
+    }
+    static EmployeeTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[8] == "1" };
+    }
+};
+
+template <>
+struct RowCodec<UserTableItem> {
+    static constexpr TableID TABLE = TableID::USERS;
+    static constexpr size_t FIELD_COUNT = 5;
+    static Fields encode(const UserTableItem& row) {
+        return { row.userID, row.role, row.PIN, row.createdAt, row.employeeID };
+    }
+    static UserTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4] };
+    }
+};
+
+template <>
+struct RowCodec<AddressTableItem> {
+    static constexpr TableID TABLE = TableID::ADDRESS;
+    static constexpr size_t FIELD_COUNT = 6;
+    static Fields encode(const AddressTableItem& row) {
+        return { row.ID, row.line1, row.line2, row.city_town, row.province, row.zip };
+    }
+    static AddressTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5] };
+    }
+};
+
+template <>
+struct RowCodec<ContactDetailsTableItem> {
+    static constexpr TableID TABLE = TableID::CONTACTS;
+    static constexpr size_t FIELD_COUNT = 4;
+    static Fields encode(const ContactDetailsTableItem& row) {
+        return { row.ID, row.email, row.phone_number_1, row.phone_number_2 };
+    }
+    static ContactDetailsTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3] };
+    }
+};
+
+template <>
+struct RowCodec<PersonalIdTableItem> {
+    static constexpr TableID TABLE = TableID::PERSONAL_ID;
+    static constexpr size_t FIELD_COUNT = 3;
+    static Fields encode(const PersonalIdTableItem& row) {
+        return { row.ID, row.type, row.id_number };
+    }
+    static PersonalIdTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2] };
+    }
+};
+
+template <>
+struct RowCodec<ProductTableItem> {
+    static constexpr TableID TABLE = TableID::PRODUCT;
+    static constexpr size_t FIELD_COUNT = 13;
+    static Fields encode(const ProductTableItem& row) {
+        return { row.barcode, row.sku, row.name, row.description, row.category, row.brand,
+                 row.uom, row.stock, row.status, row.original_price, row.sell_price,
+                 row.supplier_name, row.supplier_code };
+    }
+    static ProductTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[8], f[9], f[10], f[11], f[12] };
+    }
+};
+
+template <>
+struct RowCodec<CustomerTableItem> {
+    static constexpr TableID TABLE = TableID::CUSTOMER;
+    static constexpr size_t FIELD_COUNT = 6;
+    static Fields encode(const CustomerTableItem& row) {
+        return { row.customerID, row.firstname, row.middlename, row.lastname, row.birthdate,
+                 row.gender };
+    }
+    static CustomerTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5] };
+    }
+};
+
+template <>
+struct RowCodec<UOMTableItem> {
+    static constexpr TableID TABLE = TableID::UOM;
+    static constexpr size_t FIELD_COUNT = 3;
+    static Fields encode(const UOMTableItem& row) {
+        return { row.ID, row.unit_name, row.abbreviation };
+    }
+    static UOMTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2] };
+    }
+};
+
+template <>
+struct RowCodec<CategoryTableItem> {
+    static constexpr TableID TABLE = TableID::CATEGORY;
+    static constexpr size_t FIELD_COUNT = 2;
+    static Fields encode(const CategoryTableItem& row) {
+        return { row.ID, row.category_name };
+    }
+    static CategoryTableItem decode(const Fields& f) {
+        return { f[0], f[1] };
+    }
+};
+
+template <>
+struct RowCodec<SalesTableItem> {
+    static constexpr TableID TABLE = TableID::SALES;
+    static constexpr size_t FIELD_COUNT = 12;
+    static Fields encode(const SalesTableItem& row) {
+        return { row.ID, row.date_time, row.subtotal, row.taxable_amount, row.vat, row.discount,
+                 row.total, row.amount_paid, row.payment_type, row.change, row.cashierID,
+                 row.customerID };
+    }
+    static SalesTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[8], f[9], f[10], f[11] };
+    }
+};
+
+template <>
+struct RowCodec<SalesItemTableItem> {
+    static constexpr TableID TABLE = TableID::SALES_ITEM;
+    static constexpr size_t FIELD_COUNT = 6;
+    static Fields encode(const SalesItemTableItem& row) {
+        return { row.saleID, row.productID, row.product_name, row.unit_price, row.quantity,
+                 row.total_price };
+    }
+    static SalesItemTableItem decode(const Fields& f) {
+        return { f[0], f[1], f[2], f[3], f[4], f[5] };
+    }
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_ROWCODEC_HPP_
@@ -0,0 +1,599 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "salescolumns.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr int64_t SECONDS_PER_DAY = 86400;
+
+/*!
+ * Returns the first index in [0, size) for which [isBefore] is false
+ * [isBefore] must be true for a prefix of the indexes only (binary search)
+*/
+template <typename Predicate>
+size_t partitionPoint(size_t size, Predicate isBefore) {
+    size_t first = 0;
+    while (size > 0) {
+        const size_t half = size / 2;
+        if (isBefore(first + half)) {
+            first += half + 1;
+            size -= half + 1;
+        } else {
+            size = half;
+        }
+    }
+    return first;
+}
+
+inline bool isDigit(char c) {
+    return (c >= '0') && (c <= '9');
+}
+
+/*!
+ * Reads [count] digits at [pos]; returns -1 if any of them is not a digit
+*/
+int readDigits(const std::string& text, size_t pos, size_t count) {
+    int value = 0;
+    for (size_t i = pos; i < pos + count; ++i) {
+        if (!isDigit(text[i])) {
+            return -1;
+        }
+        value = (value * 10) + (text[i] - '0');
+    }
+    return value;
+}
+
+bool isLeapYear(int64_t year) {
+    return ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0);
+}
+
+/*!
+ * True if a thousands group ("234" in "1,234.50") starts at [pos]
+*/
+bool isGroup(const std::string& text, size_t pos) {
+    return (pos + 3 <= text.size()) && (readDigits(text, pos, 3) >= 0)
+           && ((pos + 3 == text.size()) || (text[pos + 3] == ',') || (text[pos + 3] == '.'));
+}
+
+int daysInMonth(int64_t year, int month) {
+    static const int DAYS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    return ((month == 2) && isLeapYear(year)) ? 29 : DAYS[month - 1];
+}
+
+/**
+ * Date algorithms by Howard Hinnant
+ * http://howardhinnant.github.io/date_algorithms.html
+*/
+int64_t daysFromCivil(int64_t year, int64_t month, int64_t day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yoe = year - era * 400;
+    const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void civilFromDays(int64_t days, int64_t* year, int64_t* month, int64_t* day) {
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t doe = days - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp + (mp < 10 ? 3 : -9);
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+}  // namespace
+
+int64_t parseCents(const std::string& amount) {
+    // Not a number; same as utility::toDouble
+    int64_t cents = 0;
+    return parseCents(amount, &cents) ? cents : 0;
+}
+
+bool parseCents(const std::string& amount, int64_t* cents) {
+    if (amount.empty()) {
+        *cents = 0;
+        return true;
+    }
+    // Leaves room for the fraction and the rounding
+    constexpr int64_t MAX_WHOLE = (std::numeric_limits<int64_t>::max() / 100) - 1;
+    // Exact decimal parsing; going through double would turn 0.29 into 28 cents
+    size_t pos = (amount[0] == '-') ? 1 : 0;
+    const bool isNegative = pos == 1;
+    bool hasDigit = false;
+    int64_t whole = 0;
+    for (; pos < amount.size(); ++pos) {
+        if ((amount[pos] == ',') && hasDigit && isGroup(amount, pos + 1)) {
+            continue;
+        }
+        if (!isDigit(amount[pos])) {
+            break;
+        }
+        const int digit = amount[pos] - '0';
+        if (whole > (MAX_WHOLE - digit) / 10) {
+            return false;
+        }
+        whole = (whole * 10) + digit;
+        hasDigit = true;
+    }
+    int64_t fraction = 0;
+    int fractionDigits = 0;
+    bool isRoundedUp = false;
+    if ((pos < amount.size()) && (amount[pos] == '.')) {
+        for (++pos; (pos < amount.size()) && isDigit(amount[pos]); ++pos) {
+            if (fractionDigits < 2) {
+                fraction = (fraction * 10) + (amount[pos] - '0');
+                ++fractionDigits;
+            } else if (fractionDigits == 2) {
+                // Round half up on the third decimal, the rest is ignored
+                isRoundedUp = amount[pos] >= '5';
+                ++fractionDigits;
+            }
+            hasDigit = true;
+        }
+    }
+    if ((pos != amount.size()) || !hasDigit) {
+        return false;
+    }
+    for (; fractionDigits < 2; ++fractionDigits) {
+        fraction *= 10;
+    }
+    const int64_t magnitude = (whole * 100) + fraction + (isRoundedUp ? 1 : 0);
+    *cents = isNegative ? -magnitude : magnitude;
+    return true;
+}
+
+std::string formatCents(int64_t cents) {
+    std::string text;
+    formatCents(cents, &text);
+    return text;
+}
+
+void formatCents(int64_t cents, std::string* out) {
+    const uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents)
+                                         : static_cast<uint64_t>(cents);
+    const unsigned fraction = static_cast<unsigned>(magnitude % 100);
+    out->assign(cents < 0 ? "-" : "");
+    *out += std::to_string(magnitude / 100);
+    *out += '.';
+    *out += static_cast<char>('0' + fraction / 10);
+    *out += static_cast<char>('0' + fraction % 10);
+}
+
+int64_t parseInteger(const std::string& number) {
+    int64_t value = 0;
+    return parseInteger(number, &value) ? value : 0;
+}
+
+bool parseInteger(const std::string& number, int64_t* value) {
+    if (number.empty()) {
+        *value = 0;
+        return true;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const long long parsed = std::strtoll(number.c_str(), &end, 10);  // NOLINT(runtime/int)
+    if (!end || (*end != '\0') || (errno == ERANGE)) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+bool parseDateTime(const std::string& dateTime, int64_t* seconds) {
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    char separator = '-';
+    if (dateTime.size() == 19) {
+        hour = readDigits(dateTime, 11, 2);
+        minute = readDigits(dateTime, 14, 2);
+        second = readDigits(dateTime, 17, 2);
+        if ((dateTime[10] != ' ') || (dateTime[13] != ':') || (dateTime[16] != ':')
+            || (hour < 0) || (hour > 23) || (minute < 0) || (minute > 59)
+            || (second < 0) || (second > 59)) {
+            return false;
+        }
+    } else if (dateTime.size() == 10) {
+        separator = '/';
+    } else {
+        return false;
+    }
+    const int year = readDigits(dateTime, 0, 4);
+    const int month = readDigits(dateTime, 5, 2);
+    const int day = readDigits(dateTime, 8, 2);
+    if ((dateTime[4] != separator) || (dateTime[7] != separator) || (year < 0)
+        || (month < 1) || (month > 12) || (day < 1) || (day > daysInMonth(year, month))) {
+        return false;
+    }
+    *seconds = (daysFromCivil(year, month, day) * SECONDS_PER_DAY)
+               + (hour * 3600) + (minute * 60) + second;
+    return true;
+}
+
+std::string formatDateTime(int64_t seconds) {
+    std::string text;
+    formatDateTime(seconds, &text);
+    return text;
+}
+
+void formatDateTime(int64_t seconds, std::string* out) {
+    int64_t days = seconds / SECONDS_PER_DAY;
+    int64_t timeOfDay = seconds % SECONDS_PER_DAY;
+    if (timeOfDay < 0) {
+        timeOfDay += SECONDS_PER_DAY;
+        --days;
+    }
+    int64_t year = 0;
+    int64_t month = 0;
+    int64_t day = 0;
+    civilFromDays(days, &year, &month, &day);
+    char buffer[32];
+    const int size = snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d",
+                              static_cast<int>(year), static_cast<int>(month),
+                              static_cast<int>(day), static_cast<int>(timeOfDay / 3600),
+                              static_cast<int>((timeOfDay / 60) % 60),
+                              static_cast<int>(timeOfDay % 60));
+    out->assign(buffer, size);
+}
+
+size_t SalesColumns::lowerBound(int64_t seconds) const {
+    return partitionPoint(byTime.size(), [this, seconds](size_t i) {
+        return dateTime[byTime[i]] < seconds;
+    });
+}
+
+size_t SalesColumns::upperBound(int64_t seconds) const {
+    return partitionPoint(byTime.size(), [this, seconds](size_t i) {
+        return dateTime[byTime[i]] <= seconds;
+    });
+}
+
+void SalesColumns::indexTime(size_t pos) {
+    // Sales mostly arrive in time order, so this is usually an append
+    if (byTime.empty() || (dateTime[byTime.back()] <= dateTime[pos])) {
+        byTime.push_back(pos);
+        return;
+    }
+    byTime.insert(upperBound(dateTime[pos]), pos);
+}
+
+void SalesColumns::unindexTime(size_t pos) {
+    for (size_t i = lowerBound(dateTime[pos]); i < byTime.size(); ++i) {
+        if (byTime[i] == pos) {
+            byTime.erase(i);
+            return;
+        }
+    }
+}
+
+void SalesColumns::reindex() {
+    std::vector<size_t> sorted(size());
+    for (size_t pos = 0; pos < sorted.size(); ++pos) {
+        sorted[pos] = pos;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [this](size_t left, size_t right) { return dateTime[left] < dateTime[right]; });
+    byTime.clear();
+    for (const size_t pos : sorted) {
+        byTime.push_back(pos);
+    }
+}
+
+bool SalesColumns::isValid(const Row& row) {
+    int64_t value = 0;
+    if (!parseDateTime(row.date_time, &value)) {
+        LOG_WARN("Rejecting sale %s: \"%s\" is not a date-time", row.ID.c_str(),
+                 row.date_time.c_str());
+        return false;
+    }
+    for (const std::string* amount : { &row.subtotal, &row.taxable_amount, &row.vat,
+                                       &row.discount, &row.total, &row.amount_paid,
+                                       &row.change }) {
+        if (!parseCents(*amount, &value)) {
+            LOG_WARN("Rejecting sale %s: \"%s\" is not an amount", row.ID.c_str(),
+                     amount->c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void SalesColumns::append(const Row& row) {
+    // Pushes the parsed fields directly; set() would copy the chunk the new row was just put in
+    int64_t seconds = 0;
+    id.push_back(row.ID);
+    dateTime.push_back(parseDateTime(row.date_time, &seconds) ? seconds : 0);
+    subtotal.push_back(parseCents(row.subtotal));
+    taxableAmount.push_back(parseCents(row.taxable_amount));
+    vat.push_back(parseCents(row.vat));
+    discount.push_back(parseCents(row.discount));
+    total.push_back(parseCents(row.total));
+    amountPaid.push_back(parseCents(row.amount_paid));
+    change.push_back(parseCents(row.change));
+    paymentType.push_back(paymentTypes.encode(row.payment_type));
+    cashier.push_back(cashiers.encode(row.cashierID));
+    customer.push_back(customers.encode(row.customerID));
+    indexTime(size() - 1);
+}
+
+void SalesColumns::set(size_t pos, const Row& row) {
+    unindexTime(pos);
+    assignFields(pos, row);
+    indexTime(pos);
+}
+
+void SalesColumns::assignFields(size_t pos, const Row& row) {
+    id.set(pos, row.ID);
+    int64_t seconds = 0;
+    dateTime.set(pos, parseDateTime(row.date_time, &seconds) ? seconds : 0);
+    subtotal.set(pos, parseCents(row.subtotal));
+    taxableAmount.set(pos, parseCents(row.taxable_amount));
+    vat.set(pos, parseCents(row.vat));
+    discount.set(pos, parseCents(row.discount));
+    total.set(pos, parseCents(row.total));
+    amountPaid.set(pos, parseCents(row.amount_paid));
+    change.set(pos, parseCents(row.change));
+    paymentType.set(pos, paymentTypes.encode(row.payment_type));
+    cashier.set(pos, cashiers.encode(row.cashierID));
+    customer.set(pos, customers.encode(row.customerID));
+}
+
+SalesColumns::Row SalesColumns::row(size_t pos) const {
+    Row out;
+    read(pos, &out);
+    return out;
+}
+
+void SalesColumns::read(size_t pos, Row* out) const {
+    out->ID = id[pos];
+    formatDateTime(dateTime[pos], &out->date_time);
+    formatCents(subtotal[pos], &out->subtotal);
+    formatCents(taxableAmount[pos], &out->taxable_amount);
+    formatCents(vat[pos], &out->vat);
+    formatCents(discount[pos], &out->discount);
+    formatCents(total[pos], &out->total);
+    formatCents(amountPaid[pos], &out->amount_paid);
+    out->payment_type = paymentTypes.decode(paymentType[pos]);
+    formatCents(change[pos], &out->change);
+    out->cashierID = cashiers.decode(cashier[pos]);
+    out->customerID = customers.decode(customer[pos]);
+}
+
+const std::string& SalesColumns::field(std::string Row::*field, size_t pos,
+                                       std::string* buffer) const {
+    if (field == &Row::ID) {
+        return id[pos];
+    } else if (field == &Row::date_time) {
+        formatDateTime(dateTime[pos], buffer);
+    } else if (field == &Row::subtotal) {
+        formatCents(subtotal[pos], buffer);
+    } else if (field == &Row::taxable_amount) {
+        formatCents(taxableAmount[pos], buffer);
+    } else if (field == &Row::vat) {
+        formatCents(vat[pos], buffer);
+    } else if (field == &Row::discount) {
+        formatCents(discount[pos], buffer);
+    } else if (field == &Row::total) {
+        formatCents(total[pos], buffer);
+    } else if (field == &Row::amount_paid) {
+        formatCents(amountPaid[pos], buffer);
+    } else if (field == &Row::payment_type) {
+        return paymentTypes.decode(paymentType[pos]);
+    } else if (field == &Row::change) {
+        formatCents(change[pos], buffer);
+    } else if (field == &Row::cashierID) {
+        return cashiers.decode(cashier[pos]);
+    } else {
+        // customerID
+        return customers.decode(customer[pos]);
+    }
+    return *buffer;
+}
+
+void SalesColumns::move(size_t from, size_t to) {
+    id.set(to, id[from]);
+    dateTime.set(to, dateTime[from]);
+    subtotal.set(to, subtotal[from]);
+    taxableAmount.set(to, taxableAmount[from]);
+    vat.set(to, vat[from]);
+    discount.set(to, discount[from]);
+    total.set(to, total[from]);
+    amountPaid.set(to, amountPaid[from]);
+    change.set(to, change[from]);
+    paymentType.set(to, paymentType[from]);
+    cashier.set(to, cashier[from]);
+    customer.set(to, customer[from]);
+}
+
+void SalesColumns::resize(size_t size) {
+    id.resize(size);
+    dateTime.resize(size);
+    subtotal.resize(size);
+    taxableAmount.resize(size);
+    vat.resize(size);
+    discount.resize(size);
+    total.resize(size);
+    amountPaid.resize(size);
+    change.resize(size);
+    paymentType.resize(size);
+    cashier.resize(size);
+    customer.resize(size);
+}
+
+const std::vector<size_t>& SalesItemColumns::findSale(const std::string& id) const {
+    static const std::vector<size_t> none;
+    const std::vector<size_t>* found = bySale.find(id);
+    return found ? *found : none;
+}
+
+bool SalesItemColumns::isValid(const Row& row) {
+    int64_t value = 0;
+    if (!parseInteger(row.quantity, &value)) {
+        LOG_WARN("Rejecting an item of sale %s: \"%s\" is not a quantity", row.saleID.c_str(),
+                 row.quantity.c_str());
+        return false;
+    }
+    for (const std::string* amount : { &row.unit_price, &row.total_price }) {
+        if (!parseCents(*amount, &value)) {
+            LOG_WARN("Rejecting an item of sale %s: \"%s\" is not an amount",
+                     row.saleID.c_str(), amount->c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void SalesItemColumns::append(const Row& row) {
+    addToSale(row.saleID, size());
+    saleID.push_back(row.saleID);
+    productID.push_back(row.productID);
+    productName.push_back(row.product_name);
+    unitPrice.push_back(parseCents(row.unit_price));
+    quantity.push_back(parseInteger(row.quantity));
+    totalPrice.push_back(parseCents(row.total_price));
+}
+
+void SalesItemColumns::set(size_t pos, const Row& row) {
+    if (saleID[pos] != row.saleID) {
+        // Moved to another sale; it keeps its position
+        removeFromSale(saleID[pos], pos);
+        addToSale(row.saleID, pos);
+    }
+    assignFields(pos, row);
+}
+
+void SalesItemColumns::addToSale(const std::string& id, size_t pos) {
+    const std::vector<size_t>* found = bySale.find(id);
+    if (!found) {
+        bySale.insert(id, std::vector<size_t> { pos });
+        return;
+    }
+    std::vector<size_t> positions(*found);
+    positions.insert(std::upper_bound(positions.begin(), positions.end(), pos), pos);
+    bySale.assign(id, std::move(positions));
+}
+
+void SalesItemColumns::removeFromSale(const std::string& id, size_t pos) {
+    const std::vector<size_t>* found = bySale.find(id);
+    if (!found) {
+        return;
+    }
+    std::vector<size_t> positions(*found);
+    positions.erase(std::remove(positions.begin(), positions.end(), pos), positions.end());
+    if (positions.empty()) {
+        bySale.erase(id);
+    } else {
+        bySale.assign(id, std::move(positions));
+    }
+}
+
+void SalesItemColumns::assignFields(size_t pos, const Row& row) {
+    saleID.set(pos, row.saleID);
+    productID.set(pos, row.productID);
+    productName.set(pos, row.product_name);
+    unitPrice.set(pos, parseCents(row.unit_price));
+    quantity.set(pos, parseInteger(row.quantity));
+    totalPrice.set(pos, parseCents(row.total_price));
+}
+
+void SalesItemColumns::reindex() {
+    // Grouped first, so every list is stored once
+    std::unordered_map<std::string, std::vector<size_t>> sales;
+    for (size_t pos = 0; pos < size(); ++pos) {
+        sales[saleID[pos]].push_back(pos);
+    }
+    bySale.clear();
+    bySale.reserve(sales.size());
+    for (auto& sale : sales) {
+        bySale.insert(sale.first, std::move(sale.second));
+    }
+}
+
+SalesItemColumns::Row SalesItemColumns::row(size_t pos) const {
+    Row out;
+    read(pos, &out);
+    return out;
+}
+
+void SalesItemColumns::read(size_t pos, Row* out) const {
+    out->saleID = saleID[pos];
+    out->productID = productID[pos];
+    out->product_name = productName[pos];
+    formatCents(unitPrice[pos], &out->unit_price);
+    out->quantity = std::to_string(quantity[pos]);
+    formatCents(totalPrice[pos], &out->total_price);
+}
+
+const std::string& SalesItemColumns::field(std::string Row::*field, size_t pos,
+                                           std::string* buffer) const {
+    if (field == &Row::saleID) {
+        return saleID[pos];
+    } else if (field == &Row::productID) {
+        return productID[pos];
+    } else if (field == &Row::product_name) {
+        return productName[pos];
+    } else if (field == &Row::unit_price) {
+        formatCents(unitPrice[pos], buffer);
+    } else if (field == &Row::quantity) {
+        *buffer = std::to_string(quantity[pos]);
+    } else {
+        // total_price
+        formatCents(totalPrice[pos], buffer);
+    }
+    return *buffer;
+}
+
+void SalesItemColumns::move(size_t from, size_t to) {
+    saleID.set(to, saleID[from]);
+    productID.set(to, productID[from]);
+    productName.set(to, productName[from]);
+    unitPrice.set(to, unitPrice[from]);
+    quantity.set(to, quantity[from]);
+    totalPrice.set(to, totalPrice[from]);
+}
+
+void SalesItemColumns::resize(size_t size) {
+    saleID.resize(size);
+    productID.resize(size);
+    productName.resize(size);
+    unitPrice.resize(size);
+    quantity.resize(size);
+    totalPrice.resize(size);
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,223 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_SALESCOLUMNS_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_SALESCOLUMNS_HPP_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "dictionary.hpp"
+#include "persistentmap.hpp"
+#include "persistentvector.hpp"
+#include "table.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Text <-> typed value conversions of the sales columns
+ * Amounts are in cents, quantities are integers and date-times are seconds since
+ * 1970-01-01 00:00:00 of the same (local) clock the text was written in.
+*/
+int64_t parseCents(const std::string& amount);
+/*!
+ * Reads [amount] into [cents]; "1,234.50" is read with its group separators
+ * Returns false if it is not a number or does not fit. An empty amount is 0.
+*/
+bool parseCents(const std::string& amount, int64_t* cents);
+std::string formatCents(int64_t cents);
+/*!
+ * Same, into [out], reusing its capacity
+*/
+void formatCents(int64_t cents, std::string* out);
+int64_t parseInteger(const std::string& number);
+/*!
+ * Returns false if [number] is not an integer or does not fit; an empty number is 0
+*/
+bool parseInteger(const std::string& number, int64_t* value);
+/*!
+ * Parses "YYYY-MM-DD HH:MM:SS" (or "YYYY/MM/DD", as midnight)
+ * Returns false if [dateTime] is not a valid date-time
+*/
+bool parseDateTime(const std::string& dateTime, int64_t* seconds);
+/*!
+ * Returns the date-time in "YYYY-MM-DD HH:MM:SS" form
+*/
+std::string formatDateTime(int64_t seconds);
+void formatDateTime(int64_t seconds, std::string* out);
+
+/*!
+ * Column storage of SalesTableItem; one array per field
+ * byTime lists the row positions in date-time order, for range scans
+ * The arrays are copy-on-write, so copying the columns (a table version) is cheap.
+*/
+struct SalesColumns {
+    typedef SalesTableItem Row;
+    static constexpr std::string Row::*PRIMARY_KEY = &Row::ID;
+
+    PersistentVector<std::string> id;
+    PersistentVector<int64_t> dateTime;
+    PersistentVector<int64_t> subtotal;
+    PersistentVector<int64_t> taxableAmount;
+    PersistentVector<int64_t> vat;
+    PersistentVector<int64_t> discount;
+    PersistentVector<int64_t> total;
+    PersistentVector<int64_t> amountPaid;
+    PersistentVector<int64_t> change;
+    // dictionary codes
+    PersistentVector<uint32_t> paymentType;
+    PersistentVector<uint32_t> cashier;
+    PersistentVector<uint32_t> customer;
+    Dictionary paymentTypes;
+    Dictionary cashiers;
+    Dictionary customers;
+    // row positions sorted by dateTime (ties in insertion order)
+    PersistentVector<size_t> byTime;
+
+    inline size_t size() const {
+        return id.size();
+    }
+
+    /*!
+     * Index in byTime of the first sale at or after [seconds]
+    */
+    size_t lowerBound(int64_t seconds) const;
+    /*!
+     * Index in byTime of the first sale after [seconds]
+    */
+    size_t upperBound(int64_t seconds) const;
+
+    inline const std::string& key(size_t pos) const {
+        return id[pos];
+    }
+
+    void append(const Row& row);
+    void set(size_t pos, const Row& row);
+    Row row(size_t pos) const;
+    /*!
+     * Copies the row at [pos] into [out], reusing the capacity of its strings
+     * A scan that reads every row into the same [out] stops allocating after a few rows.
+    */
+    void read(size_t pos, Row* out) const;
+    /*!
+     * One field of the row at [pos], read without building the row (see Selection)
+     * [buffer] holds the value if the column does not store it as text
+    */
+    const std::string& field(std::string Row::*field, size_t pos, std::string* buffer) const;
+    // the row has no flags
+    inline bool flag(bool Row::*, size_t) const {
+        return false;
+    }
+    void move(size_t from, size_t to);
+    void resize(size_t size);
+    /*!
+     * Rebuilds byTime after rows were moved
+    */
+    void reindex();
+    /*!
+     * Drops an erased row from byTime
+    */
+    inline void unindex(size_t pos) {
+        unindexTime(pos);
+    }
+    /*!
+     * Returns false, and logs why, if the date-time or an amount of [row] cannot be read
+    */
+    static bool isValid(const Row& row);
+
+ private:
+    void assignFields(size_t pos, const Row& row);
+    void indexTime(size_t pos);
+    void unindexTime(size_t pos);
+};
+
+/*!
+ * Column storage of SalesItemTableItem
+ *
+ * Every item is appended at the end, also when registers write their sales interleaved;
+ * bySale lists the positions of the items of each sale, so a new line only copies the list of
+ * its own sale and the rows never move.
+*/
+struct SalesItemColumns {
+    typedef SalesItemTableItem Row;
+    static constexpr std::string Row::*PRIMARY_KEY = nullptr;
+
+    PersistentVector<std::string> saleID;
+    PersistentVector<std::string> productID;
+    PersistentVector<std::string> productName;
+    PersistentVector<int64_t> unitPrice;
+    PersistentVector<int64_t> quantity;
+    PersistentVector<int64_t> totalPrice;
+    // sale ID -> positions of its items (ascending)
+    PersistentMap<std::vector<size_t>> bySale;
+
+    inline size_t size() const {
+        return saleID.size();
+    }
+
+    inline const std::string& key(size_t pos) const {
+        return saleID[pos];
+    }
+
+    /*!
+     * Returns the item positions of the sale (ascending); empty if it has no items
+    */
+    const std::vector<size_t>& findSale(const std::string& id) const;
+
+    void append(const Row& row);
+    void set(size_t pos, const Row& row);
+    Row row(size_t pos) const;
+    /*!
+     * Copies the row at [pos] into [out], reusing the capacity of its strings
+     * A scan that reads every row into the same [out] stops allocating after a few rows.
+    */
+    void read(size_t pos, Row* out) const;
+    /*!
+     * One field of the row at [pos], read without building the row (see Selection)
+     * [buffer] holds the value if the column does not store it as text
+    */
+    const std::string& field(std::string Row::*field, size_t pos, std::string* buffer) const;
+    // the row has no flags
+    inline bool flag(bool Row::*, size_t) const {
+        return false;
+    }
+    void move(size_t from, size_t to);
+    void resize(size_t size);
+    /*!
+     * Rebuilds bySale after rows were moved
+    */
+    void reindex();
+    inline void unindex(size_t pos) {
+        removeFromSale(saleID[pos], pos);
+    }
+    /*!
+     * Returns false, and logs why, if an amount or the quantity of [row] cannot be read
+    */
+    static bool isValid(const Row& row);
+
+ private:
+    void assignFields(size_t pos, const Row& row);
+    void addToSale(const std::string& id, size_t pos);
+    void removeFromSale(const std::string& id, size_t pos);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_SALESCOLUMNS_HPP_
@@ -0,0 +1,114 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "shardedtables.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+// the shard count of a directory
+constexpr char SHARD_COUNT_FILE[] = "shards";
+
+int64_t secondsOf(const SalesTableItem& sale) {
+    int64_t seconds = 0;
+    parseDateTime(sale.date_time, &seconds);
+    return seconds;
+}
+
+}  // namespace
+
+size_t shardCountOf(const ShardOptions& options) {
+    if (options.count > 0) {
+        return options.count;
+    }
+    // hardware_concurrency() is 0 if unknown
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+size_t readShardCount(const std::string& directory) {
+    std::FILE* in = std::fopen((directory + "/" + SHARD_COUNT_FILE).c_str(), "rb");
+    if (!in) {
+        return 0;
+    }
+    unsigned long count = 0;  // NOLINT(runtime/int)
+    if (std::fscanf(in, "%lu", &count) != 1) {
+        count = 0;
+    }
+    std::fclose(in);
+    return count;
+}
+
+bool writeShardCount(const std::string& directory, size_t count) {
+    return replaceFile(directory + "/" + SHARD_COUNT_FILE, std::to_string(count) + "\n");
+}
+
+void removeShardFiles(const std::string& prefix) {
+    std::remove((prefix + SHARD_CHECKPOINT_SUFFIX).c_str());
+    std::remove((prefix + SHARD_LOG_SUFFIX).c_str());
+}
+
+ShardedProductEngine::ShardedProductEngine(std::shared_ptr<ShardSet<ProductColumns>> shards)
+    : ShardedTableEngine(shards, &ProductTableItem::barcode,
+                         shards->engines<StackProductEngine, ProductColumns>()) {}
+
+std::unique_ptr<Cursor<ProductTableItem>>
+ShardedProductEngine::scanRange(const std::string& first, const std::string& last) const {
+    std::vector<std::unique_ptr<Cursor<ProductTableItem>>> parts;
+    for (const std::unique_ptr<StackProductEngine>& shard : shards()) {
+        parts.emplace_back(shard->scanRange(first, last));
+    }
+    return std::unique_ptr<Cursor<ProductTableItem>>(new MergeCursor<ProductTableItem>(
+        std::move(parts), [](const ProductTableItem& left, const ProductTableItem& right) {
+            return left.barcode < right.barcode;
+        }));
+}
+
+ShardedSalesEngine::ShardedSalesEngine(std::shared_ptr<Shards> shards)
+    : ShardedTableEngine(shards, &SalesTableItem::ID,
+                         shards->engines<StackSalesEngine, SalesColumns>()) {}
+
+std::unique_ptr<Cursor<SalesTableItem>> ShardedSalesEngine::scanTime(int64_t first,
+                                                                     int64_t last) const {
+    std::vector<std::unique_ptr<Cursor<SalesTableItem>>> parts;
+    for (const std::unique_ptr<StackSalesEngine>& shard : shards()) {
+        parts.emplace_back(shard->scanTime(first, last));
+    }
+    return std::unique_ptr<Cursor<SalesTableItem>>(new MergeCursor<SalesTableItem>(
+        std::move(parts), [](const SalesTableItem& left, const SalesTableItem& right) {
+            return secondsOf(left) < secondsOf(right);
+        }));
+}
+
+ShardedSalesItemEngine::ShardedSalesItemEngine(
+        std::shared_ptr<ShardedSalesEngine::Shards> shards)
+    : ShardedTableEngine(shards, &SalesItemTableItem::saleID,
+                         shards->engines<StackSalesItemEngine, SalesItemColumns>()) {}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,489 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_SHARDEDTABLES_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_SHARDEDTABLES_HPP_
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "checkpoint.hpp"
+#include "columntable.hpp"
+#include "dbconfig.hpp"
+#include "durablelog.hpp"
+#include "productcolumns.hpp"
+#include "rowcodec.hpp"
+#include "salescolumns.hpp"
+#include "stackdbengine.hpp"
+#include "storageengine.hpp"
+#include "wal.hpp"
+
+namespace dataprovider {
+namespace db {
+
+// files of a shard, after its prefix
+constexpr char SHARD_CHECKPOINT_SUFFIX[] = "ckpt";
+constexpr char SHARD_LOG_SUFFIX[] = "wal";
+
+struct ShardOptions {
+    // 0 is one per core
+    size_t count = 0;
+    size_t checkpointRecords = DEFAULT_CHECKPOINT_RECORDS;
+    unsigned commitDelayUs = 0;
+    // a table is compacted once this share of its rows is erased; 0 never
+    double compactionThreshold = DEFAULT_COMPACTION_PERCENT / 100.0;
+};
+
+/*!
+ * Returns the shard count that [options] asks for
+*/
+size_t shardCountOf(const ShardOptions& options);
+/*!
+ * The shard count that [directory] was last laid out with; 0 if none
+*/
+size_t readShardCount(const std::string& directory);
+bool writeShardCount(const std::string& directory, size_t count);
+/*!
+ * Removes the checkpoint and log of the shard with the file [prefix]
+*/
+void removeShardFiles(const std::string& prefix);
+
+/*!
+ * One shard of a group of tables: column tables of its own (so its own write locks, indexes
+ * and column storage), with a log and a checkpoint of its own
+ *
+ * Writes to different shards never wait for each other, and every shard group-commits its
+ * own log, so the fsyncs of the shards also run side by side. A shard writes a checkpoint
+ * once its log reaches checkpointRecords records. An empty [prefix] keeps it in memory.
+*/
+template <typename... Columns>
+class TableShard {
+ public:
+    TableShard(const std::string& prefix, const ShardOptions& options)
+        : mCompactionThreshold(options.compactionThreshold) {
+        if (prefix.empty()) {
+            return;
+        }
+        const std::string checkpointPath = prefix + SHARD_CHECKPOINT_SUFFIX;
+        mLog.reset(new DurableLog(checkpointPath, prefix + SHARD_LOG_SUFFIX,
+                                  options.checkpointRecords,
+                                  [this](uint64_t* lsn) { return sections(lsn); }));
+        uint64_t lsn = 0;
+        {
+            const CheckpointImage image(checkpointPath);
+            if (image.isValid()) {
+                lsn = image.lsn();
+                // A corrupted table stays empty; load() logs it
+                (image.load(&table<Columns>()), ...);
+            }
+        }
+        mLog->open(lsn, [this](const LogRecord& record) {
+            (applyRecord(record, &table<Columns>()), ...);
+        }, options.commitDelayUs);
+        (attachLog(&table<Columns>()), ...);
+    }
+
+    ~TableShard() {
+        (table<Columns>().setListener(nullptr), ...);
+    }
+
+    template <typename TableColumns>
+    inline ColumnTable<TableColumns>& table() {
+        return std::get<ColumnTable<TableColumns>>(mTables);
+    }
+
+    /*!
+     * Blocks until the writes of the calling thread to this shard are durable
+     * Also writes the checkpoint and compacts the tables when they are due.
+    */
+    bool commit() {
+        std::unordered_map<const TableShard*, uint64_t>& pending = pendingLsns();
+        const auto found = pending.find(this);
+        if (found == pending.end()) {
+            return true;
+        }
+        // Can be left from a shard that had this address before
+        const uint64_t lsn = std::min(found->second, mLog->log().lastLsn());
+        const bool isDurable = mLog->commit(lsn, [this]() {
+            if (mCompactionThreshold > 0) {
+                (compactIfDue(&table<Columns>(), mCompactionThreshold), ...);
+            }
+        });
+        // Otherwise kept, so the next commit of this thread waits for them again
+        if (isDurable) {
+            pending.erase(found);
+        }
+        return isDurable;
+    }
+
+    /*!
+     * Writes the tables to a new checkpoint and drops the log records it holds
+    */
+    bool checkpoint() {
+        return mLog && mLog->checkpoint();
+    }
+
+ private:
+    const double mCompactionThreshold;
+    std::tuple<ColumnTable<Columns>...> mTables;
+    std::unique_ptr<DurableLog> mLog;
+
+    /*!
+     * LSN of the last write of this thread to each shard, until it commits it
+    */
+    static std::unordered_map<const TableShard*, uint64_t>& pendingLsns() {
+        static thread_local std::unordered_map<const TableShard*, uint64_t> lsns;
+        return lsns;
+    }
+
+    template <typename Table>
+    void attachLog(Table* table) {
+        typedef typename Table::Row RowType;
+        table->setListener([this](Mutation operation, const RowType* before,
+                                  const RowType* after) {
+            LogRecord record = recordOf(operation, before, after);
+            pendingLsns()[this] = mLog->log().append(record.table, operation,
+                                                     std::move(record.before),
+                                                     std::move(record.after));
+        });
+    }
+
+    /*!
+     * The checkpoint sections of the tables, at one log position
+    */
+    std::vector<DurableLog::Section> sections(uint64_t* lsn) {
+        const std::array<WriteLock, sizeof...(Columns)> locks {
+            table<Columns>().lockWrites()...
+        };
+        *lsn = mLog->log().lastLsn();
+        return { sectionOf(table<Columns>().snapshot())... };
+    }
+
+    template <typename Snapshot>
+    static DurableLog::Section sectionOf(Snapshot snapshot) {
+        return [snapshot](CheckpointWriter* writer) { writer->write(snapshot); };
+    }
+};
+
+/*!
+ * Which shard has a key, and the commit of all shards of a group; see ShardSet
+*/
+class ShardGroup {
+ public:
+    explicit ShardGroup(size_t count) : mCount(count) {}
+    virtual ~ShardGroup() = default;
+
+    inline size_t count() const {
+        return mCount;
+    }
+
+    inline size_t indexOf(const std::string& key) const {
+        return std::hash<std::string>()(key) % mCount;
+    }
+
+    /*!
+     * Blocks until the writes of the calling thread to any shard are durable
+     * Returns false if some could not be written
+    */
+    virtual bool commit() = 0;
+
+ private:
+    const size_t mCount;
+};
+
+/*!
+ * Tables split into shards by the hash of their key (see Columns::key())
+ *
+ * Every shard has all the tables of the group, so rows with the same key are in one shard:
+ * e.g. in ShardSet<SalesColumns, SalesItemColumns> a sale and its items (keyed by the sale ID)
+ * are written to one shard and committed with one log flush.
+ * The shards live in [directory], which records their count. The first time, they are filled
+ * from the tables that [sources] return (the StackDB tables; null for none), which are not
+ * called otherwise;
+ * opened with another count, the rows are moved from the old shards to the new ones.
+ * An empty [directory] keeps the shards in memory.
+*/
+template <typename... Columns>
+class ShardSet : public ShardGroup {
+ public:
+    typedef TableShard<Columns...> Shard;
+    template <typename SourceColumns>
+    using Source = std::function<const ColumnTable<SourceColumns>&()>;
+
+    ShardSet(const std::string& directory, const ShardOptions& options,
+             const Source<Columns>&... sources)
+        : ShardGroup(shardCountOf(options)) {
+        if (!directory.empty()) {
+            makeDirectory(directory);
+        }
+        const size_t oldCount = directory.empty() ? 0 : readShardCount(directory);
+        for (size_t i = 0; i < count(); ++i) {
+            mShards.emplace_back(new Shard(prefixOf(directory, count(), i), options));
+        }
+        if (!directory.empty() && (oldCount == count())) {
+            return;
+        }
+        if (oldCount == 0) {
+            (fill<Columns>(snapshotsOf<Columns>(sources)), ...);
+        } else {
+            // Resharding
+            std::vector<std::unique_ptr<Shard>> oldShards;
+            for (size_t i = 0; i < oldCount; ++i) {
+                oldShards.emplace_back(new Shard(prefixOf(directory, oldCount, i), options));
+            }
+            (fill<Columns>(snapshotsOf<Columns>(oldShards)), ...);
+        }
+        if (directory.empty()) {
+            return;
+        }
+        for (const std::unique_ptr<Shard>& shard : mShards) {
+            shard->checkpoint();
+        }
+        writeShardCount(directory, count());
+        for (size_t i = 0; i < oldCount; ++i) {
+            removeShardFiles(prefixOf(directory, oldCount, i));
+        }
+    }
+
+    inline Shard& operator[](size_t index) {
+        return *mShards[index];
+    }
+
+    bool commit() override {
+        bool isDurable = true;
+        for (const std::unique_ptr<Shard>& shard : mShards) {
+            isDurable = shard->commit() && isDurable;
+        }
+        return isDurable;
+    }
+
+    /*!
+     * A [ShardEngine] (e.g. ColumnTableEngine) over the [TableColumns] table of every shard
+    */
+    template <typename ShardEngine, typename TableColumns>
+    std::vector<std::unique_ptr<ShardEngine>> engines() {
+        std::vector<std::unique_ptr<ShardEngine>> engines;
+        for (const std::unique_ptr<Shard>& shard : mShards) {
+            engines.emplace_back(new ShardEngine(&shard->template table<TableColumns>()));
+        }
+        return engines;
+    }
+
+ private:
+    std::vector<std::unique_ptr<Shard>> mShards;
+
+    static std::string prefixOf(const std::string& directory, size_t count, size_t index) {
+        if (directory.empty()) {
+            return directory;
+        }
+        return directory + "/" + std::to_string(count) + "-" + std::to_string(index) + ".";
+    }
+
+    template <typename TableColumns>
+    static std::vector<typename ColumnTable<TableColumns>::Snapshot> snapshotsOf(
+            const std::vector<std::unique_ptr<Shard>>& shards) {
+        std::vector<typename ColumnTable<TableColumns>::Snapshot> snapshots;
+        for (const std::unique_ptr<Shard>& shard : shards) {
+            snapshots.emplace_back(shard->template table<TableColumns>().snapshot());
+        }
+        return snapshots;
+    }
+
+    template <typename TableColumns>
+    static std::vector<typename ColumnTable<TableColumns>::Snapshot> snapshotsOf(
+            const Source<TableColumns>& source) {
+        if (!source) {
+            return {};
+        }
+        return { source().snapshot() };
+    }
+
+    /*!
+     * Replaces the [TableColumns] table of every shard with its rows from [sources]
+    */
+    template <typename TableColumns>
+    void fill(const std::vector<typename ColumnTable<TableColumns>::Snapshot>& sources) {
+        std::vector<std::vector<typename TableColumns::Row>> rows(count());
+        for (const auto& source : sources) {
+            const TableColumns& columns = source.columns();
+            for (size_t pos = 0; pos < columns.size(); ++pos) {
+                if (!source.isErased(pos)) {
+                    rows[indexOf(columns.key(pos))].emplace_back(columns.row(pos));
+                }
+            }
+        }
+        for (size_t i = 0; i < count(); ++i) {
+            mShards[i]->template table<TableColumns>().assign(std::move(rows[i]));
+        }
+    }
+};
+
+/*!
+ * TableEngine over the shards of a ShardGroup; [ShardEngine] serves the table of one shard
+ *
+ * Reads and writes of one key go to the shard of the key ([shardKey] of a row); scans read
+ * every shard one after the other (scatter-gather), and page() merges the pages of the shards.
+ * flush() commits the shards that the calling thread wrote to.
+*/
+template <typename ShardEngine, typename Interface = TableEngine<typename ShardEngine::Row>>
+class ShardedTableEngine : public Interface {
+ public:
+    typedef typename ShardEngine::Row Row;
+
+    ShardedTableEngine(std::shared_ptr<ShardGroup> group, Field<Row> shardKey,
+                       std::vector<std::unique_ptr<ShardEngine>> shards)
+        : mGroup(std::move(group)), mShardKey(shardKey), mShards(std::move(shards)) {}
+
+    bool get(const std::string& key, Row* out) const override {
+        return shardOf(key).get(key, out);
+    }
+
+    std::unique_ptr<Cursor<Row>> scan() const override {
+        std::vector<std::unique_ptr<Cursor<Row>>> parts;
+        for (const std::unique_ptr<ShardEngine>& shard : mShards) {
+            parts.emplace_back(shard->scan());
+        }
+        return std::unique_ptr<Cursor<Row>>(new ChainCursor<Row>(std::move(parts)));
+    }
+
+    std::unique_ptr<Cursor<Row>> scanOf(const std::string& key) const override {
+        return shardOf(key).scanOf(key);
+    }
+
+    std::unique_ptr<Cursor<Row>> select(const Selection<Row>& selection) const override {
+        std::vector<std::unique_ptr<Cursor<Row>>> parts;
+        for (const std::unique_ptr<ShardEngine>& shard : mShards) {
+            parts.emplace_back(shard->select(selection));
+        }
+        return std::unique_ptr<Cursor<Row>>(new ChainCursor<Row>(std::move(parts)));
+    }
+
+    RowPage<Row> page(const PageQuery<Row>& query) const override {
+        // One row more from every shard, so the window sees if there is a next page
+        PageQuery<Row> shardQuery = query;
+        shardQuery.size = query.size + 1;
+        PageWindow<Row> window(query.token, query.size);
+        for (const std::unique_ptr<ShardEngine>& shard : mShards) {
+            for (const Row& row : shard->page(shardQuery).rows) {
+                if (window.accepts(query.sortValue(row), row.*query.key)) {
+                    window.offer(query.sortValue(row), row.*query.key, row);
+                }
+            }
+        }
+        RowPage<Row> page;
+        page.rows = window.take(&page.nextToken);
+        return page;
+    }
+
+    bool insert(const Row& row) override {
+        return shardOf(row.*mShardKey).insert(row);
+    }
+
+    bool update(const Row& row) override {
+        return shardOf(row.*mShardKey).update(row);
+    }
+
+    size_t remove(const std::string& key) override {
+        return shardOf(key).remove(key);
+    }
+
+    size_t removeOf(const std::string& key) override {
+        return shardOf(key).removeOf(key);
+    }
+
+    size_t removeIf(const typename TableEngine<Row>::Predicate& predicate) override {
+        size_t removed = 0;
+        for (const std::unique_ptr<ShardEngine>& shard : mShards) {
+            removed += shard->removeIf(predicate);
+        }
+        return removed;
+    }
+
+    size_t size() const override {
+        size_t rows = 0;
+        for (const std::unique_ptr<ShardEngine>& shard : mShards) {
+            rows += shard->size();
+        }
+        return rows;
+    }
+
+    bool flush() override {
+        return mGroup->commit();
+    }
+
+ protected:
+    inline const std::vector<std::unique_ptr<ShardEngine>>& shards() const {
+        return mShards;
+    }
+
+ private:
+    const std::shared_ptr<ShardGroup> mGroup;
+    const Field<Row> mShardKey;
+    const std::vector<std::unique_ptr<ShardEngine>> mShards;
+
+    inline ShardEngine& shardOf(const std::string& key) const {
+        return *mShards[mGroup->indexOf(key)];
+    }
+};
+
+/*!
+ * Products in shards by barcode; scanRange() merges the sorted ranges of the shards
+ * Enabled with product_engine=sharded in psdb.cfg (see StorageEngine::current()).
+*/
+class ShardedProductEngine : public ShardedTableEngine<StackProductEngine, ProductEngine> {
+ public:
+    ShardedProductEngine(std::shared_ptr<ShardSet<ProductColumns>> shards);
+
+    std::unique_ptr<Cursor<ProductTableItem>> scanRange(const std::string& first,
+                                                        const std::string& last) const override;
+};
+
+/*!
+ * Sales in shards by sale ID; scanTime() merges the time ranges of the shards
+ * Enabled with sales_engine=sharded in psdb.cfg, together with ShardedSalesItemEngine.
+*/
+class ShardedSalesEngine : public ShardedTableEngine<StackSalesEngine, SalesEngine> {
+ public:
+    typedef ShardSet<SalesColumns, SalesItemColumns> Shards;
+
+    explicit ShardedSalesEngine(std::shared_ptr<Shards> shards);
+
+    std::unique_ptr<Cursor<SalesTableItem>> scanTime(int64_t first,
+                                                     int64_t last) const override;
+};
+
+/*!
+ * Sale items in the shard of their sale
+*/
+class ShardedSalesItemEngine : public ShardedTableEngine<StackSalesItemEngine> {
+ public:
+    explicit ShardedSalesItemEngine(std::shared_ptr<ShardedSalesEngine::Shards> shards);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_SHARDEDTABLES_HPP_
@@ -0,0 +1,303 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "sortedrun.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include "wal.hpp"
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr char RUN_MAGIC[] = "PSLSMRN1";
+constexpr size_t MAGIC_SIZE = 8;
+// [u64 index offset][u32 index size][u64 bloom offset][u32 bloom size][u64 entry count]
+// [u32 crc32 of index + bloom][magic]
+constexpr size_t FOOTER_SIZE = 8 + 4 + 8 + 4 + 8 + 4 + MAGIC_SIZE;
+constexpr size_t ENTRY_HEADER_SIZE = 1 + 2 + 4;
+constexpr uint8_t ERASED_FLAG = 0x01;
+// 10 bits per key and 7 probes give ~1% false positives
+constexpr size_t BLOOM_BITS_PER_KEY = 10;
+constexpr size_t BLOOM_PROBES = 7;
+
+// Integers are stored little-endian regardless of the host
+void putInteger(uint64_t value, size_t size, std::string* out) {
+    for (size_t i = 0; i < size; ++i) {
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t getInteger(const char* data, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+// FNV-1a
+uint64_t hashKey(const std::string& key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : key) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*!
+ * Bit [probe] of the key; the probes are derived from one hash (double hashing)
+*/
+inline size_t bloomBit(uint64_t hash, size_t probe, size_t bits) {
+    const uint32_t low = static_cast<uint32_t>(hash);
+    const uint32_t high = static_cast<uint32_t>(hash >> 32) | 1U;
+    return (low + probe * static_cast<uint64_t>(high)) % bits;
+}
+
+}  // namespace
+
+RunWriter::RunWriter(const std::string& path) : mPath(path) {
+    mFile = std::fopen(path.c_str(), "wb");
+    if (!mFile) {
+        LOG_ERROR("Cannot create %s", path.c_str());
+    }
+}
+
+RunWriter::~RunWriter() {
+    if (mFile) {
+        std::fclose(mFile);
+    }
+    if (!mIsFinished) {
+        std::remove(mPath.c_str());
+    }
+}
+
+bool RunWriter::add(const LsmEntry& entry) {
+    if (!mFile || mIsFailed || mIsFinished || (entry.key.size() > MAX_KEY_SIZE)
+        || (!mHashes.empty() && (entry.key <= mLastKey))) {
+        return false;
+    }
+    if (mBlock.empty()) {
+        mBlockFirstKey = entry.key;
+    }
+    mBlock.push_back(static_cast<char>(entry.isErased ? ERASED_FLAG : 0));
+    putInteger(entry.key.size(), 2, &mBlock);
+    putInteger(entry.value.size(), 4, &mBlock);
+    mBlock.append(entry.key);
+    mBlock.append(entry.value);
+    mLastKey = entry.key;
+    mHashes.push_back(hashKey(entry.key));
+    return (mBlock.size() < BLOCK_SIZE) || writeBlock();
+}
+
+bool RunWriter::writeBlock() {
+    putInteger(mBlockFirstKey.size(), 2, &mIndex);
+    mIndex.append(mBlockFirstKey);
+    putInteger(mOffset, 8, &mIndex);
+    putInteger(mBlock.size(), 4, &mIndex);
+    putInteger(crc32(mBlock.data(), mBlock.size()), 4, &mIndex);
+    if (std::fwrite(mBlock.data(), 1, mBlock.size(), mFile) != mBlock.size()) {
+        mIsFailed = true;
+        return false;
+    }
+    mOffset += mBlock.size();
+    mBlock.clear();
+    return true;
+}
+
+bool RunWriter::finish() {
+    if (!mFile || mIsFailed || mIsFinished || (!mBlock.empty() && !writeBlock())) {
+        return false;
+    }
+    const size_t bloomBits = std::max<size_t>(64, mHashes.size() * BLOOM_BITS_PER_KEY);
+    std::string bloom((bloomBits + 7) / 8, '\0');
+    for (const uint64_t hash : mHashes) {
+        for (size_t probe = 0; probe < BLOOM_PROBES; ++probe) {
+            const size_t bit = bloomBit(hash, probe, bloom.size() * 8);
+            bloom[bit / 8] = static_cast<char>(bloom[bit / 8] | (1 << (bit % 8)));
+        }
+    }
+    // the index and the bloom filter are contiguous and share one checksum
+    std::string tail = mIndex + bloom;
+    const uint32_t crc = crc32(tail.data(), tail.size());
+    putInteger(mOffset, 8, &tail);
+    putInteger(mIndex.size(), 4, &tail);
+    putInteger(mOffset + mIndex.size(), 8, &tail);
+    putInteger(bloom.size(), 4, &tail);
+    putInteger(mHashes.size(), 8, &tail);
+    putInteger(crc, 4, &tail);
+    tail.append(RUN_MAGIC, MAGIC_SIZE);
+    if ((std::fwrite(tail.data(), 1, tail.size(), mFile) != tail.size()) || !syncFile(mFile)) {
+        mIsFailed = true;
+        return false;
+    }
+    const bool isClosed = std::fclose(mFile) == 0;
+    mFile = nullptr;
+    mIsFinished = isClosed;
+    return isClosed;
+}
+
+SortedRun::SortedRun(const std::string& path, uint64_t sequence)
+    : mPath(path), mSequence(sequence), mFile(new MappedFile(path)) {
+    if (!mFile->isOpen() || (mFile->size() < FOOTER_SIZE)) {
+        LOG_ERROR("Cannot read the sorted run %s", path.c_str());
+        return;
+    }
+    const char* data = mFile->data();
+    const char* footer = data + mFile->size() - FOOTER_SIZE;
+    const uint64_t indexOffset = getInteger(footer, 8);
+    const uint64_t indexSize = getInteger(footer + 8, 4);
+    const uint64_t bloomOffset = getInteger(footer + 12, 8);
+    const uint64_t bloomSize = getInteger(footer + 20, 4);
+    if ((std::memcmp(footer + 36, RUN_MAGIC, MAGIC_SIZE) != 0)
+        || (bloomOffset != indexOffset + indexSize) || (bloomSize == 0)
+        || (bloomOffset + bloomSize != mFile->size() - FOOTER_SIZE)
+        || (crc32(data + indexOffset, indexSize + bloomSize) != getInteger(footer + 32, 4))) {
+        LOG_ERROR("The sorted run %s is corrupted", path.c_str());
+        return;
+    }
+    for (size_t pos = indexOffset; pos < bloomOffset;) {
+        Block block;
+        const size_t keySize = getInteger(data + pos, 2);
+        block.firstKey.assign(data + pos + 2, keySize);
+        pos += 2 + keySize;
+        block.offset = getInteger(data + pos, 8);
+        block.size = static_cast<uint32_t>(getInteger(data + pos + 8, 4));
+        block.crc = static_cast<uint32_t>(getInteger(data + pos + 12, 4));
+        pos += 16;
+        mBlocks.emplace_back(std::move(block));
+    }
+    mBloom = data + bloomOffset;
+    mBloomBits = bloomSize * 8;
+    mEntryCount = getInteger(footer + 24, 8);
+    mIsOpen = true;
+}
+
+SortedRun::~SortedRun() {
+    // unmap before removing; windows cannot remove a mapped file
+    mFile.reset();
+    if (mIsObsolete) {
+        std::remove(mPath.c_str());
+    }
+}
+
+bool SortedRun::mayContain(const std::string& key) const {
+    const uint64_t hash = hashKey(key);
+    for (size_t probe = 0; probe < BLOOM_PROBES; ++probe) {
+        const size_t bit = bloomBit(hash, probe, mBloomBits);
+        if ((static_cast<uint8_t>(mBloom[bit / 8]) & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t SortedRun::blockOf(const std::string& key) const {
+    const auto it = std::upper_bound(mBlocks.begin(), mBlocks.end(), key,
+        [](const std::string& left, const Block& right) { return left < right.firstKey; });
+    return (it == mBlocks.begin()) ? 0 : static_cast<size_t>(it - mBlocks.begin()) - 1;
+}
+
+bool SortedRun::readBlock(size_t block, std::vector<LsmEntry>* entries) const {
+    entries->clear();
+    const Block& info = mBlocks[block];
+    if ((info.offset + info.size > mFile->size())
+        || (crc32(mFile->data() + info.offset, info.size) != info.crc)) {
+        LOG_ERROR("Block %s of the sorted run %s is corrupted", std::to_string(block).c_str(),
+                  mPath.c_str());
+        return false;
+    }
+    const char* data = mFile->data() + info.offset;
+    for (size_t pos = 0; pos + ENTRY_HEADER_SIZE <= info.size;) {
+        const size_t keySize = getInteger(data + pos + 1, 2);
+        const size_t valueSize = getInteger(data + pos + 3, 4);
+        if (pos + ENTRY_HEADER_SIZE + keySize + valueSize > info.size) {
+            return false;
+        }
+        LsmEntry entry;
+        entry.isErased = (data[pos] & ERASED_FLAG) != 0;
+        entry.key.assign(data + pos + ENTRY_HEADER_SIZE, keySize);
+        entry.value.assign(data + pos + ENTRY_HEADER_SIZE + keySize, valueSize);
+        entries->emplace_back(std::move(entry));
+        pos += ENTRY_HEADER_SIZE + keySize + valueSize;
+    }
+    return true;
+}
+
+bool SortedRun::find(const std::string& key, LsmEntry* out) const {
+    if (!mIsOpen || mBlocks.empty() || (key < mBlocks.front().firstKey) || !mayContain(key)) {
+        return false;
+    }
+    std::vector<LsmEntry> entries;
+    if (!readBlock(blockOf(key), &entries)) {
+        return false;
+    }
+    const auto it = std::lower_bound(entries.begin(), entries.end(), key,
+        [](const LsmEntry& left, const std::string& right) { return left.key < right; });
+    if ((it == entries.end()) || (it->key != key)) {
+        return false;
+    }
+    if (out) {
+        *out = std::move(*it);
+    }
+    return true;
+}
+
+SortedRun::Iterator SortedRun::seek(const std::string& first) const {
+    Iterator it(this, mIsOpen ? blockOf(first) : mBlocks.size());
+    while (it.isValid() && (it.entry().key < first)) {
+        it.advance();
+    }
+    return it;
+}
+
+SortedRun::Iterator::Iterator(const SortedRun* run, size_t block) : mRun(run), mBlock(block) {
+    load();
+}
+
+void SortedRun::Iterator::advance() {
+    if (++mPos >= mEntries.size()) {
+        ++mBlock;
+        load();
+    }
+}
+
+void SortedRun::Iterator::load() {
+    mEntries.clear();
+    mPos = 0;
+    for (; mBlock < mRun->mBlocks.size(); ++mBlock) {
+        if (!mRun->readBlock(mBlock, &mEntries)) {
+            // a corrupted block ends the run
+            mEntries.clear();
+            mBlock = mRun->mBlocks.size();
+            return;
+        }
+        if (!mEntries.empty()) {
+            return;
+        }
+    }
+}
+
+}  // namespace db
+}  // namespace dataprovider
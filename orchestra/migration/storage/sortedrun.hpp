@@ -0,0 +1,204 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_SORTEDRUN_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_SORTEDRUN_HPP_
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mappedfile.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * One key of an LSM tree; an erased key is kept as a tombstone until the oldest run is merged
+*/
+struct LsmEntry {
+    std::string key;
+    std::string value;
+    bool isErased = false;
+};
+
+/*!
+ * Writes a sorted run file; the entries are added in key order
+ *
+ * File layout:
+ * [data blocks][block index][bloom filter][footer]
+ * A data block holds ~BLOCK_SIZE bytes of entries, each [u8 flags][u16 key size]
+ * [u32 value size][key][value]. The index has the first key, offset, size and crc32 of
+ * every block. The file is removed unless finish() succeeds.
+*/
+class RunWriter {
+ public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    // keys are stored with a u16 size
+    static constexpr size_t MAX_KEY_SIZE = UINT16_MAX;
+
+    explicit RunWriter(const std::string& path);
+    ~RunWriter();
+    RunWriter(const RunWriter&) = delete;
+    RunWriter& operator=(const RunWriter&) = delete;
+
+    inline bool isOpen() const {
+        return mFile != nullptr;
+    }
+
+    /*!
+     * Returns false if the key is not after the previous one, or too large
+    */
+    bool add(const LsmEntry& entry);
+    /*!
+     * Writes the index, the bloom filter and the footer, and syncs the file
+    */
+    bool finish();
+
+    inline size_t entryCount() const {
+        return mHashes.size();
+    }
+
+ private:
+    const std::string mPath;
+    std::FILE* mFile = nullptr;
+    std::string mBlock;
+    std::string mBlockFirstKey;
+    std::string mLastKey;
+    std::string mIndex;
+    // key hash of every entry, for the bloom filter
+    std::vector<uint64_t> mHashes;
+    uint64_t mOffset = 0;
+    bool mIsFailed = false;
+    bool mIsFinished = false;
+
+    bool writeBlock();
+};
+
+/*!
+ * Read-only view of a sorted run file
+ *
+ * The file is memory-mapped, so only the blocks that are read are loaded. A bloom filter
+ * (~1% false positives) lets find() skip most runs that do not have the key.
+ * Runs are shared by the cursors that read them; a run replaced by a merge is marked
+ * obsolete, and its file is removed when the last reader lets it go.
+*/
+class SortedRun {
+ public:
+    /*!
+     * Reads the entries of a run in key order
+    */
+    class Iterator {
+     public:
+        inline bool isValid() const {
+            return mPos < mEntries.size();
+        }
+
+        inline const LsmEntry& entry() const {
+            return mEntries[mPos];
+        }
+
+        void advance();
+
+     private:
+        friend class SortedRun;
+        Iterator(const SortedRun* run, size_t block);
+
+        const SortedRun* mRun;
+        size_t mBlock;
+        // entries of the current block
+        std::vector<LsmEntry> mEntries;
+        size_t mPos = 0;
+
+        void load();
+    };
+
+    SortedRun(const std::string& path, uint64_t sequence);
+    ~SortedRun();
+    SortedRun(const SortedRun&) = delete;
+    SortedRun& operator=(const SortedRun&) = delete;
+
+    /*!
+     * True if the file is complete and its footer and index checksums match
+    */
+    inline bool isOpen() const {
+        return mIsOpen;
+    }
+
+    inline uint64_t sequence() const {
+        return mSequence;
+    }
+
+    inline uint64_t entryCount() const {
+        return mEntryCount;
+    }
+
+    inline size_t fileSize() const {
+        return mFile->size();
+    }
+
+    /*!
+     * Copies the entry of [key] (a value or a tombstone) into [out]
+     * Returns false if the run does not have the key
+    */
+    bool find(const std::string& key, LsmEntry* out) const;
+    /*!
+     * Entries with keys >= [first]
+    */
+    Iterator seek(const std::string& first) const;
+    /*!
+     * Removes the file once the run is destroyed
+    */
+    inline void markObsolete() {
+        mIsObsolete = true;
+    }
+
+ private:
+    struct Block {
+        std::string firstKey;
+        uint64_t offset;
+        uint32_t size;
+        uint32_t crc;
+    };
+
+    const std::string mPath;
+    const uint64_t mSequence;
+    std::unique_ptr<MappedFile> mFile;
+    std::vector<Block> mBlocks;
+    const char* mBloom = nullptr;
+    size_t mBloomBits = 0;
+    uint64_t mEntryCount = 0;
+    bool mIsOpen = false;
+    bool mIsObsolete = false;
+
+    bool mayContain(const std::string& key) const;
+    /*!
+     * The block where [key] belongs; mBlocks.size() if it is before the first key
+    */
+    size_t blockOf(const std::string& key) const;
+    /*!
+     * Decodes a block; returns false if it is corrupted
+    */
+    bool readBlock(size_t block, std::vector<LsmEntry>* entries) const;
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_SORTEDRUN_HPP_
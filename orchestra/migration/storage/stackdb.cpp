@@ -19,25 +19,436 @@
 *                                                                                                 *
 **************************************************************************************************/
 #include "stackdb.hpp"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <string>
+#include <utility>
+#include "checkpoint.hpp"
+#include "dbconfig.hpp"
+#include "durablelog.hpp"
+#include "rowcodec.hpp"
+#include <cfg/config.hpp>
+#include <logger/loghelper.hpp>
 
 namespace dataprovider {
 namespace db {
 
-std::vector<EmployeeTableItem> StackDB::EMPLOYEES_TABLE;
-std::vector<UserTableItem> StackDB::USERS_TABLE;
-std::vector<AddressTableItem> StackDB::ADDRESS_TABLE;
-std::vector<ContactDetailsTableItem> StackDB::CONTACTS_TABLE;
-std::vector<PersonalIdTableItem> StackDB::PERSONAL_ID_TABLE;
-std::vector<ProductTableItem> StackDB::PRODUCT_TABLE;
-std::vector<CustomerTableItem> StackDB::CUSTOMER_TABLE;
-std::vector<UOMTableItem> StackDB::UOM_TABLE;
-std::vector<CategoryTableItem> StackDB::CATEGORY_TABLE;
-std::vector<SalesTableItem> StackDB::SALES_TABLE;
-std::vector<SalesItemTableItem> StackDB::SALES_ITEM_TABLE;
+namespace {
+
+constexpr char CHECKPOINT_FILE[] = "stackdb.ckpt";
+constexpr char LOG_FILE[] = "stackdb.wal";
+constexpr size_t DEFAULT_COMPACTION_INTERVAL_MS = 1000;
+constexpr size_t DEFAULT_CHANGE_FEED_EVENTS = 65536;
+
+// log of the transaction running on this thread, if any
+thread_local std::vector<LogRecord>* tTransactionLog = nullptr;
+
+template <typename Table>
+constexpr TableID tableOf(const Table*) {
+    return RowCodec<typename Table::Row>::TABLE;
+}
+
+/*!
+ * Logs the mutations of [table] to [wal] and publishes them to [changes]; either can be off
+*/
+template <typename Table>
+void attachListener(WriteAheadLog* wal, ChangeFeed* changes, Table* table) {
+    typedef typename Table::Row RowType;
+    if (!wal && !(changes && changes->isActive())) {
+        table->setListener(nullptr);
+        return;
+    }
+    table->setListener([wal, changes](Mutation operation, const RowType* before,
+                                      const RowType* after) {
+        LogRecord record = recordOf(operation, before, after);
+        if (tTransactionLog) {
+            // Logged and published when the transaction ends
+            tTransactionLog->push_back(std::move(record));
+            return;
+        }
+        // The feed can go inactive before its listener is detached, with no log to write
+        if (!changes || !changes->isActive()) {
+            if (wal) {
+                wal->append(record.table, operation, std::move(record.before),
+                            std::move(record.after));
+            }
+            return;
+        }
+        if (wal) {
+            wal->append(record.table, operation, record.before, record.after);
+        }
+        changes->publish(std::move(record));
+    });
+}
+
+}  // namespace
+
+ColumnTable<EmployeeColumns> StackDB::EMPLOYEES_TABLE;
+IndexedTable<UserTableItem> StackDB::USERS_TABLE(&UserTableItem::userID,
+                                                 &UserTableItem::employeeID);
+IndexedTable<AddressTableItem> StackDB::ADDRESS_TABLE(nullptr, &AddressTableItem::ID);
+IndexedTable<ContactDetailsTableItem> StackDB::CONTACTS_TABLE(nullptr,
+                                                            &ContactDetailsTableItem::ID);
+IndexedTable<PersonalIdTableItem> StackDB::PERSONAL_ID_TABLE(nullptr, &PersonalIdTableItem::ID);
+ColumnTable<ProductColumns> StackDB::PRODUCT_TABLE;
+IndexedTable<CustomerTableItem> StackDB::CUSTOMER_TABLE(&CustomerTableItem::customerID);
+IndexedTable<UOMTableItem> StackDB::UOM_TABLE(&UOMTableItem::ID);
+IndexedTable<CategoryTableItem> StackDB::CATEGORY_TABLE;
+ColumnTable<SalesColumns> StackDB::SALES_TABLE;
+ColumnTable<SalesItemColumns> StackDB::SALES_ITEM_TABLE;
+
+StackDB::Snapshot::Snapshot()
+    : mEmployees(EMPLOYEES_TABLE.snapshot()),
+      mUsers(USERS_TABLE.snapshot()),
+      mAddress(ADDRESS_TABLE.snapshot()),
+      mContacts(CONTACTS_TABLE.snapshot()),
+      mPersonalId(PERSONAL_ID_TABLE.snapshot()),
+      mProduct(PRODUCT_TABLE.snapshot()),
+      mCustomer(CUSTOMER_TABLE.snapshot()),
+      mUom(UOM_TABLE.snapshot()),
+      mCategory(CATEGORY_TABLE.snapshot()),
+      mSales(SALES_TABLE.snapshot()),
+      mSalesItem(SALES_ITEM_TABLE.snapshot()) {}
 
 StackDB::StackDB() {
+    for (std::atomic<bool>& isLoaded : mIsLoaded) {
+        isLoaded = true;
+    }
+    open();
+    startCompactor();
+}
+
+template <typename Function>
+void StackDB::forEachTable(Function function) {
+    function(&EMPLOYEES_TABLE);
+    function(&USERS_TABLE);
+    function(&ADDRESS_TABLE);
+    function(&CONTACTS_TABLE);
+    function(&PERSONAL_ID_TABLE);
+    function(&PRODUCT_TABLE);
+    function(&CUSTOMER_TABLE);
+    function(&UOM_TABLE);
+    function(&CATEGORY_TABLE);
+    function(&SALES_TABLE);
+    function(&SALES_ITEM_TABLE);
+}
+
+StackDB::~StackDB() {
+    {
+        std::lock_guard<std::mutex> lock(mCompactorMutex);
+        mIsStopping = true;
+    }
+    mCompactorWakeup.notify_all();
+    if (mCompactor.joinable()) {
+        mCompactor.join();
+    }
+    // Tables outlive this instance; stop logging into the destroyed log
+    forEachTable([](auto* table) { attachListener(nullptr, nullptr, table); });
+}
+
+void StackDB::open() {
+    utility::Config config(DB_CONFIG);
+    mChanges = std::make_unique<ChangeFeed>(
+        toNumber(config.get("change_feed_events", ""), DEFAULT_CHANGE_FEED_EVENTS),
+        [this]() { attachListeners(); });
+    mDbPath = config.get("db_path", "");
+    if (mDbPath.empty()) {
+        // Memory only
+        populate();
+        return;
+    }
+    const size_t checkpointRecords = toNumber(config.get("checkpoint_records", ""),
+                                              DEFAULT_CHECKPOINT_RECORDS);
+    const size_t commitDelayUs = toNumber(config.get("commit_delay_us", ""), 0);
+    // Fails harmlessly if the directory exists
+    makeDirectory(mDbPath);
+
+    mDurableLog = std::make_unique<DurableLog>(filePath(CHECKPOINT_FILE), filePath(LOG_FILE),
+        checkpointRecords, [this](uint64_t* lsn) { return checkpointSections(lsn); });
+    mImage = std::make_shared<CheckpointImage>(filePath(CHECKPOINT_FILE));
+    const bool hasCheckpoint = mImage->isValid();
+    uint64_t lsn = 0;
+    if (hasCheckpoint) {
+        // Tables are decoded from the image on first use
+        lsn = mImage->lsn();
+        for (std::atomic<bool>& isLoaded : mIsLoaded) {
+            isLoaded = false;
+        }
+    } else {
+        // First run - start from the sample data
+        mImage.reset();
+        populate();
+    }
+
+    const WriteAheadLog::Apply apply = [this](const LogRecord& record) {
+        materialize(record.table);
+        forEachTable([&record](auto* table) { applyRecord(record, table); });
+    };
+    lsn = mDurableLog->open(lsn, apply, static_cast<unsigned>(commitDelayUs));
+    LOG_INFO("Recovered the database from %s up to log position %s", mDbPath.c_str(),
+             std::to_string(lsn).c_str());
+    if (!hasCheckpoint) {
+        checkpoint();
+    }
+    attachListeners();
+}
+
+void StackDB::attachListeners() {
+    WriteAheadLog* wal = mDurableLog ? &mDurableLog->log() : nullptr;
+    forEachTable([this, wal](auto* table) { attachListener(wal, mChanges.get(), table); });
+}
+
+void StackDB::startCompactor() {
+    utility::Config config(DB_CONFIG);
+    mCompactionPercent = toNumber(config.get("compaction_threshold", ""),
+                                  DEFAULT_COMPACTION_PERCENT);
+    mCompactionIntervalMs = toNumber(config.get("compaction_interval_ms", ""),
+                                     DEFAULT_COMPACTION_INTERVAL_MS);
+    if ((mCompactionPercent == 0) || (mCompactionIntervalMs == 0)) {
+        return;
+    }
+    mCompactor = std::thread(&StackDB::runCompactor, this);
+}
+
+void StackDB::runCompactor() {
+    const std::chrono::milliseconds interval(mCompactionIntervalMs);
+    std::unique_lock<std::mutex> lock(mCompactorMutex);
+    while (!mCompactorWakeup.wait_for(lock, interval, [this] { return mIsStopping; })) {
+        lock.unlock();
+        compact();
+        lock.lock();
+    }
+}
+
+size_t StackDB::compact() {
+    const double threshold = mCompactionPercent / 100.0;
+    size_t compacted = 0;
+    forEachTable([this, threshold, &compacted](auto* table) {
+        // A table that is not decoded yet has nothing erased
+        if (isLoaded(tableOf(table)) && compactIfDue(table, threshold)) {
+            ++compacted;
+        }
+    });
+    return compacted;
+}
+
+void StackDB::materialize(TableID id) const {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    if (isLoaded(id)) {
+        return;
+    }
+    forEachTable([this, id](auto* table) {
+        if (tableOf(table) == id) {
+            // A corrupted table stays empty; load() logs it
+            mImage->load(table);
+        }
+    });
+    mIsLoaded[static_cast<size_t>(id)].store(true, std::memory_order_release);
+}
+
+std::string StackDB::filePath(const std::string& fileName) const {
+    return mDbPath + "/" + fileName;
+}
+
+StackDB::Snapshot StackDB::snapshot() const {
+    // A table that is not decoded yet would look empty
+    forEachTable([this](auto* table) { loaded(table); });
+    const auto writeLocks = lockWrites();
+    return Snapshot();
+}
+
+std::vector<WriteLock> StackDB::lockWrites() {
+    // Always in the same order, so two callers cannot deadlock
+    std::vector<WriteLock> writeLocks;
+    forEachTable([&writeLocks](const auto* table) {
+        writeLocks.emplace_back(table->lockWrites());
+    });
+    return writeLocks;
+}
+
+bool StackDB::commit() {
+    if (!mDurableLog) {
+        return true;
+    }
+    return mDurableLog->commit(mDurableLog->log().lastLsn());
+}
+
+bool StackDB::checkpoint() {
+    return mDurableLog && mDurableLog->checkpoint();
+}
+
+std::vector<std::function<void(CheckpointWriter*)>> StackDB::checkpointSections(uint64_t* lsn) {
+#ifdef _WIN32
+    // A mapped file cannot be replaced on windows; decode the remaining tables and unmap it
+    forEachTable([this](const auto* table) { materialize(tableOf(table)); });
+    {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mImage.reset();
+    }
+#endif
+    return imageSections(lsn);
+}
+
+std::vector<std::function<void(CheckpointWriter*)>> StackDB::imageSections(uint64_t* lsn) {
+    // Snapshot every table at one log position; the writers only wait for the snapshots,
+    // not for the image to be written
+    std::vector<std::function<void(CheckpointWriter*)>> sections;
+    // Kept alive by the sections that copy from it; taken before the write locks, which
+    // materialize() waits for while it holds mLoadMutex
+    std::shared_ptr<const CheckpointImage> image;
+    {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        image = mImage;
+    }
+    const auto writeLocks = lockWrites();
+    {
+        // The logged stock changes go into the image; none are logged until [lsn] is read
+        std::lock_guard<std::mutex> lock(mStockMutex);
+        foldLoggedStock();
+        *lsn = mDurableLog ? mDurableLog->log().lastLsn() : 0;
+    }
+    forEachTable([this, &sections, &image](const auto* table) {
+        const TableID id = tableOf(table);
+        if (!isLoaded(id)) {
+            // Unchanged since the last checkpoint
+            sections.emplace_back([image, id](CheckpointWriter* writer) {
+                writer->copy(*image, id);
+            });
+            return;
+        }
+        const auto snapshot = table->snapshot();
+        sections.emplace_back([snapshot](CheckpointWriter* writer) {
+            writer->write(snapshot);
+        });
+    });
+    return sections;
+}
+
+void StackDB::logStock(const std::vector<StockChange>& changes) {
+    std::lock_guard<std::mutex> lock(mStockMutex);
+    for (const StockChange& change : changes) {
+        if (mDurableLog) {
+            mDurableLog->log().append(tableOf(&PRODUCT_TABLE), Mutation::STOCK, Fields(),
+                                      Fields { change.barcode, std::to_string(change.quantity) });
+        }
+        mUnfoldedStock[change.barcode] += change.quantity;
+    }
+}
+
+size_t StackDB::foldStock() {
+    if (tTransactionLog) {
+        return 0;
+    }
+    const WriteLock writeLock = PRODUCT_TABLE.lockWrites();
+    std::lock_guard<std::mutex> lock(mStockMutex);
+    return foldLoggedStock();
+}
+
+size_t StackDB::foldLoggedStock() {
+    // Only a decoded product table has counters, and so logged changes
+    if (mUnfoldedStock.empty() || !isLoaded(tableOf(&PRODUCT_TABLE))) {
+        return 0;
+    }
+    size_t written = 0;
+    ProductTableItem row;
+    for (const auto& change : mUnfoldedStock) {
+        if ((change.second != 0) && PRODUCT_TABLE.find(change.first, &row)) {
+            row.stock = std::to_string(parseInteger(row.stock) + change.second);
+            written += PRODUCT_TABLE.update(row) ? 1 : 0;
+        }
+    }
+    mUnfoldedStock.clear();
+    return written;
+}
+
+bool StackDB::backup(const std::string& path, size_t bytesPerSecond) {
+#ifdef _WIN32
+    // A checkpoint could not replace the image while the backup copies from it
+    forEachTable([this](const auto* table) { materialize(tableOf(table)); });
+#endif
+    uint64_t lsn = 0;
+    std::vector<std::function<void(CheckpointWriter*)>> sections;
+    {
+        // Only while the tables are snapshot; the sections hold what they write from
+        std::unique_lock<std::mutex> lock;
+        if (mDurableLog) {
+            lock = mDurableLog->lockCheckpoints();
+        }
+        sections = imageSections(&lsn);
+    }
+    CheckpointWriter writer(path, lsn);
+    writer.limitRate(bytesPerSecond);
+    for (const auto& writeSection : sections) {
+        writeSection(&writer);
+    }
+    return writer.commit();
+}
+
+Transaction::Transaction()
+    : mUncaughtExceptions(std::uncaught_exceptions()), mIsNested(tTransactionLog != nullptr) {
+    if (mIsNested) {
+        return;
+    }
+    StackDB& db = DATABASE();
+    // A table decoded from the checkpoint inside the transaction would log its rows as writes
+    StackDB::forEachTable([&db](auto* table) { db.loaded(table); });
+    mWriteLocks = StackDB::lockWrites();
+    StackDB::forEachTable([](auto* table) { table->stageWrites(); });
+    tTransactionLog = &mLog;
+}
+
+Transaction::~Transaction() {
+    if (mIsNested || mIsEnded) {
+        return;
+    }
+    if (std::uncaught_exceptions() > mUncaughtExceptions) {
+        mIsRolledBack = true;
+    }
+    commit();
+}
+
+bool Transaction::commit() {
+    if (mIsNested) {
+        return true;
+    }
+    StackDB& db = DATABASE();
+    if (!mIsEnded) {
+        mIsEnded = true;
+        tTransactionLog = nullptr;
+        if (mIsRolledBack) {
+            StackDB::forEachTable([](auto* table) { table->discardStaged(); });
+        } else {
+            // Logged before it is published, so a checkpoint never has half of it
+            if (db.mDurableLog && !mLog.empty()) {
+                mEndLsn = db.mDurableLog->log().appendTransaction(mLog);
+            }
+            StackDB::forEachTable([](auto* table) { table->publishStaged(); });
+            // Still in order with the other writes, which wait for the write locks
+            db.mChanges->publish(std::move(mLog));
+        }
+        mWriteLocks.clear();
+    }
+    if (mIsRolledBack) {
+        return false;
+    }
+    // Only up to its own writes; the ones logged after it are not waited for
+    return (mEndLsn == 0) || db.mDurableLog->commit(mEndLsn);
+}
+
+void Transaction::rollback() {
+    if (mIsNested || mIsEnded) {
+        return;
+    }
+    StackDB::forEachTable([](auto* table) { table->discardStaged(); });
+    StackDB::forEachTable([](auto* table) { table->stageWrites(); });
+    mLog.clear();
+    mIsRolledBack = true;
+}
+
+void StackDB::populate() {
     // Admin user
-    USERS_TABLE.emplace_back(UserTableItem {
+    USERS_TABLE.insert(UserTableItem {
             "2020202",                    // Unique User ID
             "Admin",                      // Role
             "1251",                       // PIN <!Unique> <!Empty if non-user>
@@ -55,7 +466,7 @@ void StackDB::populateEmployees() {
     // If you want to add a user/employee to our in-memory DB, put it here
 
     //------- Copy starting from the line below
-    EMPLOYEES_TABLE.emplace_back(EmployeeTableItem {
+    EMPLOYEES_TABLE.insert(EmployeeTableItem {
             "2014566",                    // Employee ID <!Make sure this is unique>
             "BenZiv",                     // First name
             "Hero",                       // Middle name
@@ -65,36 +476,36 @@ void StackDB::populateEmployees() {
             "Manager",                    // Position
             "ACTIVE",                     // Status - ACTIVE, ON-LEAVE or INACTIVE
             true});                       // System user
-    USERS_TABLE.emplace_back(UserTableItem {
+    USERS_TABLE.insert(UserTableItem {
             "BGAR123",                    // User ID <!Make sure this is unique>
             "Manager",                    // Role
             "2020",                       // PIN
             "2020-01-10 07:47:48",        // Created At
             "2014566"});                  // Link to employee ID
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "2014566",                    // Employee ID <!Same as employeeID>
             "Lot 5, Blk 10, Petunia St",  // Line 1
             "Camella Homes, Basak",       // Line 2
             "Lapu-Lapu City",             // City/Town
             "Cebu",                       // Province
             "6015"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "2014566",                    // Employee ID <!Same as employeeID>
             "test@gmail.com",             // Email
             "09123334567",                // Contact number 1
             "09987654321"});              // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2014566",                    // Employee ID <!Same as employeeID>
             "SSS",                        // Type
             "003-311-150-413"});          // ID-number
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2014566",                    // Employee ID <!Must be the same as above>
             "UMID",                       // Type
             "04-1511167-8"});             // ID-number
     //------- End here
 
     //------- 2019542
-    EMPLOYEES_TABLE.emplace_back(EmployeeTableItem {
+    EMPLOYEES_TABLE.insert(EmployeeTableItem {
             "2019542",                    // Employee ID <!Make sure this is unique>
             "Zandro",                     // First name
             "Slardar",                    // Middle name
@@ -104,31 +515,31 @@ void StackDB::populateEmployees() {
             "Cashier",                    // Position
             "ACTIVE",                     // Status - ACTIVE, ON-LEAVE or INACTIVE
             true});                       // System user
-    USERS_TABLE.emplace_back(UserTableItem {
+    USERS_TABLE.insert(UserTableItem {
             "BGAR567",                    // User ID <!Make sure this is unique>
             "Cashier",                    // Role
             "2021",                       // PIN
             "2020-10-02 08:47:48",        // Created At
             "2019542"});                  // Link to employee ID
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "2019542",                    // Employee ID <!Same as employeeID>
             "Bacbacan, San Francisco",    // Line 1
             "",                           // Line 2
             "Malayong Dapit",             // City/Town
             "Davao",                      // Province
             "6060"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "2019542",                    // Employee ID <!Same as employeeID>
             "zznn@gmail.com",             // Email
             "09123334567",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2019542",                    // Employee ID <!Same as employeeID>
             "Driver's License",           // Type
             "N04-10-021355"});            // ID-number
 
     //------- 2098472
-    EMPLOYEES_TABLE.emplace_back(EmployeeTableItem {
+    EMPLOYEES_TABLE.insert(EmployeeTableItem {
             "2098472",                    // Employee ID <!Make sure this is unique>
             "Juana",                      // First name
             "Santos",                     // Middle name
@@ -138,31 +549,31 @@ void StackDB::populateEmployees() {
             "Cashier",                    // Position
             "ACTIVE",                     // Status - ACTIVE, ON-LEAVE or INACTIVE
             true});                       // System user
-    USERS_TABLE.emplace_back(UserTableItem {
+    USERS_TABLE.insert(UserTableItem {
             "JDEL554",                    // User ID <!Make sure this is unique>
             "Cashier",                    // Role
             "2022",                       // PIN
             "2020-05-10 10:09:50",        // Created At
             "2098472"});                  // Link to employee ID
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "2098472",                    // Employee ID <!Same as employeeID>
             "BF Homes, Poblacion",        // Line 1
             "",                           // Line 2
             "Lapu-Lapu City",             // City/Town
             "Cebu",                       // Province
             "6015"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "2098472",                    // Employee ID <!Same as employeeID>
             "juana@gmail.com",            // Email
             "09123334567",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2098472",                    // Employee ID <!Same as employeeID>
             "Driver's License",           // Type
             "N04-10-0215655"});           // ID-number
 
     //------- 2054993
-    EMPLOYEES_TABLE.emplace_back(EmployeeTableItem {
+    EMPLOYEES_TABLE.insert(EmployeeTableItem {
             "2054993",                    // Employee ID <!Make sure this is unique>
             "Rodrigo",                    // First name
             "Roa",                        // Middle name
@@ -172,25 +583,25 @@ void StackDB::populateEmployees() {
             "Security Guard",             // Position
             "ACTIVE",                     // Status - ACTIVE, ON-LEAVE or INACTIVE
             false});                      // System user
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "2054993",                    // Employee ID <!Same as employeeID>
             "22 St. Andrews Hills",       // Line 1
             "Poblacion",                  // Line 2
             "Davao City",                 // City/Town
             "Davao Del Sur",              // Province
             "8080"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "2054993",                    // Employee ID <!Same as employeeID>
             "",                           // Email
             "09123334567",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2054993",                    // Employee ID <!Same as employeeID>
             "Driver's License",           // Type
             "N04-10-0215655"});           // ID-number
 
     //------- 2073155
-    EMPLOYEES_TABLE.emplace_back(EmployeeTableItem{
+    EMPLOYEES_TABLE.insert(EmployeeTableItem{
             "2073155",                    // Employee ID <!Make sure this is unique>
             "Manny",                      // First name
             "Pacman",                     // Middle name
@@ -200,19 +611,19 @@ void StackDB::populateEmployees() {
             "Delivery Personnel",         // Position
             "ACTIVE",                     // Status - ACTIVE, ON-LEAVE or INACTIVE
             false});                      // System user
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "2073155",                    // Employee ID <!Same as employeeID>
             "Palermo St., Mahayahay",     // Line 1
             "Opon",                       // Line 2
             "Lapu-Lapu City",             // City/Town
             "Cebu",                       // Province
             "6015"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "2073155",                    // Employee ID <!Same as employeeID>
             "",                           // Email
             "09123334567",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "2073155",                    // Employee ID <!Same as employeeID>
             "SSS",                        // Type
             "014-135-188-813"});          // ID-number
@@ -223,7 +634,7 @@ void StackDB::populateProducts() {
     // If you want to add a product to our in-memory DB, put it here
 
     //------- Copy starting from the line below
-    PRODUCT_TABLE.emplace_back(ProductTableItem {
+    PRODUCT_TABLE.insert(ProductTableItem {
             "1125478744",                 // Barcode <!Make sure this is unique>
             "JNJ-CHP-SML-RED",            // SKU
             "Chippy",                     // Name
@@ -239,7 +650,7 @@ void StackDB::populateProducts() {
             "AltSmkt6325"});              // Supplier code
     //------- End here
 
-    PRODUCT_TABLE.emplace_back(ProductTableItem {
+    PRODUCT_TABLE.insert(ProductTableItem {
             "1254854545",                 // Barcode <!Make sure this is unique>
             "NNN-COL-NNN-NNN",            // SKU
             "Mantika",                    // Name
@@ -254,7 +665,7 @@ void StackDB::populateProducts() {
             "Alturas Supermarket",        // Supplier name
             "AltSmkt6325"});              // Supplier code
 
-    PRODUCT_TABLE.emplace_back(ProductTableItem {
+    PRODUCT_TABLE.insert(ProductTableItem {
             "5554833345",                 // Barcode <!Make sure this is unique>
             "NNN-SUG-NNN-NNN",            // SKU
             "Asukal Puti",                // Name
@@ -269,7 +680,7 @@ void StackDB::populateProducts() {
             "Alturas Supermarket",        // Supplier name
             "AltSmkt6325"});              // Supplier code
 
-    PRODUCT_TABLE.emplace_back(ProductTableItem {
+    PRODUCT_TABLE.insert(ProductTableItem {
             "5684833847",                 // Barcode <!Make sure this is unique>
             "UNI-BIO-NNN-NNN",            // SKU
             "Biogesic",                   // Name
@@ -284,7 +695,7 @@ void StackDB::populateProducts() {
             "Sab Pharmacy",               // Supplier name
             "SABPHARM210"});              // Supplier code
 
-    PRODUCT_TABLE.emplace_back(ProductTableItem {
+    PRODUCT_TABLE.insert(ProductTableItem {
             "4844811887",                 // Barcode <!Make sure this is unique>
             "COK-COK-LAR-NNN",            // SKU
             "Coke 1L",                    // Name
@@ -304,123 +715,123 @@ void StackDB::populateCustomers() {
     // If you want to add a customer to our in-memory DB, put it here
 
     //------- Copy starting from the line below
-    CUSTOMER_TABLE.emplace_back(CustomerTableItem {
+    CUSTOMER_TABLE.insert(CustomerTableItem {
             "CMJD12AB56CD",               // Customer ID <!Make sure this is unique>
             "John",                       // First name
             "Trump",                      // Middle name
             "Doe",                        // Last name
             "1998/01/04",                 // B-date
             "M"});                        // Gender
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "CMJD12AB56CD",               // Customer ID <!Same as CustomerID above>
             "Back St., Boys Back",        // Line 1
             "Alright",                    // Line 2
             "Lapu-Lapu City",             // City/Town
             "Cebu",                       // Province
             "6015"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "CMJD12AB56CD",               // Customer ID <!Same as CustomerID above>
             "",                           // Email
             "09123334567",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "CMJD12AB56CD",               // Customer ID <!Same as CustomerID above>
             "SSS",                        // Type
             "014-135-188-813"});          // ID-number
     //------- End here
 
-    CUSTOMER_TABLE.emplace_back(CustomerTableItem {
+    CUSTOMER_TABLE.insert(CustomerTableItem {
             "CMTP25XB56ZD",               // Customer ID <!Make sure this is unique>
             "Thinking",                   // First name
             "TP",                         // Middle name
             "Pinoy",                      // Last name
             "1995/04/09",                 // B-date
             "M"});                        // Gender
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "CMTP25XB56ZD",               // Customer ID <!Same as CustomerID above>
             "Highland St., Longliner",    // Line 1
             "",                           // Line 2
             "Some City",                  // City/Town
             "Davao",                      // Province
             "6000"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "CMTP25XB56ZD",               // Customer ID <!Same as CustomerID above>
             "Tp_reach@gmail.com",         // Email
             "09181113245",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "CMTP25XB56ZD",               // Customer ID <!Same as CustomerID above>
             "SSS",                        // Type
             "014-135-188-813"});          // ID-number
 
-    CUSTOMER_TABLE.emplace_back(CustomerTableItem {
+    CUSTOMER_TABLE.insert(CustomerTableItem {
             "CMAR88TR15TC",               // Customer ID <!Make sure this is unique>
             "April",                      // First name
             "Boy",                        // Middle name
             "Regino",                     // Last name
             "1987/08/05",                 // B-date
             "M"});                        // Gender
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "CMAR88TR15TC",               // Customer ID <!Same as CustomerID above>
             "Tondo",                      // Line 1
             "",                           // Line 2
             "Metro Manila",               // City/Town
             "Manila",                     // Province
             "6000"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "CMAR88TR15TC",               // Customer ID <!Same as CustomerID above>
             "",                           // Email
             "09181113245",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "CMAR88TR15TC",               // Customer ID <!Same as CustomerID above>
             "SSS",                        // Type
             "014-135-188-813"});          // ID-number
 
-    CUSTOMER_TABLE.emplace_back(CustomerTableItem {
+    CUSTOMER_TABLE.insert(CustomerTableItem {
             "CMAA95TZ45FR",               // Customer ID <!Make sure this is unique>
             "Alexa",                      // First name
             "Speech",                     // Middle name
             "Amazon",                     // Last name
             "2001/10/03",                 // B-date
             "F"});                        // Gender
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "CMAA95TZ45FR",               // Customer ID <!Same as CustomerID above>
             "SamSam St., Local Area",     // Line 1
             "",                           // Line 2
             "Mandaue City",               // City/Town
             "Cebu",                       // Province
             "6014"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "CMAA95TZ45FR",               // Customer ID <!Same as CustomerID above>
             "",                           // Email
             "09181113245",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "CMAA95TZ45FR",               // Customer ID <!Same as CustomerID above>
             "SSS",                        // Type
             "014-135-188-813"});          // ID-number
 
-    CUSTOMER_TABLE.emplace_back(CustomerTableItem {
+    CUSTOMER_TABLE.insert(CustomerTableItem {
             "CMJB73YN64LB",               // Customer ID <!Make sure this is unique>
             "Jeff",                       // First name
             "Amazon",                     // Middle name
             "Bezos",                      // Last name
             "1975/01/12",                 // B-date
             "M"});                        // Gender
-    ADDRESS_TABLE.emplace_back(AddressTableItem {
+    ADDRESS_TABLE.insert(AddressTableItem {
             "CMJB73YN64LB",               // Customer ID <!Same as CustomerID above>
             "Tabon, Purok 7",             // Line 1
             "San Francisco",              // Line 2
             "Dubai",                      // City/Town
             "Bohol",                      // Province
             "6314"});                     // ZIP
-    CONTACTS_TABLE.emplace_back(ContactDetailsTableItem {
+    CONTACTS_TABLE.insert(ContactDetailsTableItem {
             "CMJB73YN64LB",               // Customer ID <!Same as CustomerID above>
             "",                           // Email
             "09181113245",                // Contact number 1
             ""});                         // Contact number 2
-    PERSONAL_ID_TABLE.emplace_back(PersonalIdTableItem {
+    PERSONAL_ID_TABLE.insert(PersonalIdTableItem {
             "CMJB73YN64LB",               // Customer ID <!Same as CustomerID above>
             "PWD",                        // Type
             "014-135-188-813"});          // ID-number
@@ -430,29 +841,29 @@ void StackDB::populateUOM() {
     // If you want to add a unit of measurement to our in-memory DB, put it here
 
     //------- Copy starting from the line below
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "1",                          // ID <!Make sure this is unique>
             "Liter",                      // Unit Name
             "L"});                        // Abbreviation
     //------- End here
 
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "2",                          // ID <!Make sure this is unique>
             "Milliliter",                 // Unit Name
             "mL"});                       // Abbreviation
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "3",                          // ID <!Make sure this is unique>
             "Kilogram",                   // Unit Name
             "kg"});                       // Abbreviation
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "4",                          // ID <!Make sure this is unique>
             "Gram",                       // Unit Name
             "g"});                        // Abbreviation
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "5",                          // ID <!Make sure this is unique>
             "Piece",                      // Unit Name
             "pc"});                       // Abbreviation
-    UOM_TABLE.emplace_back(UOMTableItem {
+    UOM_TABLE.insert(UOMTableItem {
             "6",                          // ID <!Make sure this is unique>
             "Cup",                        // Unit Name
             "cp"});                       // Abbreviation
@@ -463,7 +874,7 @@ void StackDB::populateSales() {
 
     //------- Copy starting from the line below
     // Transaction
-    SALES_TABLE.emplace_back(SalesTableItem {
+    SALES_TABLE.insert(SalesTableItem {
             "100000001",                  // SalesID <!Make sure this is unique>
             "2020-05-10 10:09:50",        // Date and time of transaction
             "112.00",                     // Subtotal
@@ -477,7 +888,7 @@ void StackDB::populateSales() {
             "2098472",                    // CashierID <!Make sure this is VALID>
             "CMJD12AB56CD"});             // CustomerID <!Make sure this is VALID>
     // Transaction items
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000001",                  // SalesID <!Make sure this is VALID>
             "1125478744",                 // Product ID or Barcode <!Make sure this is valid>
             "Chippy",                     // Product name <!Make sure this matches with inventory>
@@ -487,7 +898,7 @@ void StackDB::populateSales() {
     //------- End here
 
     // Transaction
-    SALES_TABLE.emplace_back(SalesTableItem {
+    SALES_TABLE.insert(SalesTableItem {
             "100000002",                  // SalesID <!Make sure this is unique>
             "2021-05-16 10:11:20",        // Date and time of transaction
             "56.00",                      // Subtotal
@@ -501,14 +912,14 @@ void StackDB::populateSales() {
             "2019542",                    // CashierID <!Make sure this is VALID>
             "CMAA95TZ45FR"});             // CustomerID <!Make sure this is VALID>
     // Transaction items
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000002",                  // SalesID <!Make sure this is VALID>
             "1125478744",                 // Product ID or Barcode <!Make sure this is valid>
             "Chippy",                     // Product name <!Make sure this matches with inventory>
             "10.00",                      // Product unit price <!Make sure this is valid>
             "2",                          // Number of items bought (quantity)
             "20.00"});                    // Total (unit price * quantity)
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000002",                  // SalesID <!Make sure this is VALID>
             "5684833847",                 // Product ID or Barcode <!Make sure this is valid>
             "Biogesic",                   // Product name <!Make sure this matches with inventory>
@@ -517,7 +928,7 @@ void StackDB::populateSales() {
             "30.00"});                    // Total (unit price * quantity)
 
     // Transaction
-    SALES_TABLE.emplace_back(SalesTableItem {
+    SALES_TABLE.insert(SalesTableItem {
             "100000003",                  // SalesID <!Make sure this is unique>
             "2021-05-16 10:12:20",        // Date and time of transaction
             "1000.00",                    // Subtotal
@@ -531,14 +942,14 @@ void StackDB::populateSales() {
             "2019542",                    // CashierID <!Make sure this is VALID>
             "CMJB73YN64LB"});             // CustomerID <!Make sure this is VALID>
     // Transaction items
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000003",                  // SalesID <!Make sure this is VALID>
             "1125478744",                 // Product ID or Barcode <!Make sure this is valid>
             "Chippy",                     // Product name <!Make sure this matches with inventory>
             "10.00",                      // Product unit price <!Make sure this is valid>
             "10",                         // Number of items bought (quantity)
             "100.00"});                   // Total (unit price * quantity)
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000003",                  // SalesID <!Make sure this is VALID>
             "4844811887",                 // Product ID or Barcode <!Make sure this is valid>
             "Coke 1L",                    // Product name <!Make sure this matches with inventory>
@@ -547,7 +958,7 @@ void StackDB::populateSales() {
             "900.00"});                   // Total (unit price * quantity)
 
     // Transaction
-    SALES_TABLE.emplace_back(SalesTableItem {
+    SALES_TABLE.insert(SalesTableItem {
             "100000004",                  // SalesID <!Make sure this is unique>
             "2021-05-22 12:45:20",        // Date and time of transaction
             "336.50",                     // Subtotal
@@ -561,28 +972,28 @@ void StackDB::populateSales() {
             "2019542",                    // CashierID <!Make sure this is VALID>
             "CMTP25XB56ZD"});             // CustomerID <!Make sure this is VALID>
     // Transaction items
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000004",                  // SalesID <!Make sure this is VALID>
             "5554833345",                 // Product ID or Barcode <!Make sure this is valid>
             "Asukal Puti",                // Product name <!Make sure this matches with inventory>
             "6.00",                       // Product unit price <!Make sure this is valid>
             "4",                          // Number of items bought (quantity)
             "24.00"});                    // Total (unit price * quantity)
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000004",                  // SalesID <!Make sure this is VALID>
             "1254854545",                 // Product ID or Barcode <!Make sure this is valid>
             "Mantika",                    // Product name <!Make sure this matches with inventory>
             "10.50",                      // Product unit price <!Make sure this is valid>
             "5",                          // Number of items bought (quantity)
             "52.50"});                    // Total (unit price * quantity)
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000004",                  // SalesID <!Make sure this is VALID>
             "5684833847",                 // Product ID or Barcode <!Make sure this is valid>
             "Biogesic",                   // Product name <!Make sure this matches with inventory>
             "6.00",                       // Product unit price <!Make sure this is valid>
             "10",                         // Number of items bought (quantity)
             "60.00"});                    // Total (unit price * quantity)
-    SALES_ITEM_TABLE.emplace_back(SalesItemTableItem {
+    SALES_ITEM_TABLE.insert(SalesItemTableItem {
             "100000004",                  // SalesID <!Make sure this is VALID>
             "4844811887",                 // Product ID or Barcode <!Make sure this is valid>
             "Coke 1L",                    // Product name <!Make sure this matches with inventory>
@@ -595,16 +1006,16 @@ void StackDB::populateCategory() {
     // If you want to add a category to our in-memory DB, put it here
 
     //------- Copy starting from the line below
-    CATEGORY_TABLE.emplace_back(CategoryTableItem {
+    CATEGORY_TABLE.insert(CategoryTableItem {
             "1",                          // ID <!Make sure this is unique>
             "Grocery"});                  // Category name
     //------- End here
 
-    CATEGORY_TABLE.emplace_back(CategoryTableItem {
+    CATEGORY_TABLE.insert(CategoryTableItem {
             "2",                          // ID <!Make sure this is unique>
             "Medicine"});                 // Category name
 
-    CATEGORY_TABLE.emplace_back(CategoryTableItem {
+    CATEGORY_TABLE.insert(CategoryTableItem {
             "3",                          // ID <!Make sure this is unique>
             "Beverage"});                 // Category name
 }
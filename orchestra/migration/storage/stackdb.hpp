@@ -20,9 +20,27 @@
 **************************************************************************************************/
 #ifndef ORCHESTRA_MIGRATION_STORAGE_STACKDB_HPP_
 #define ORCHESTRA_MIGRATION_STORAGE_STACKDB_HPP_
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include "changefeed.hpp"
+#include "checkpoint.hpp"
+#include "columntable.hpp"
+#include "employeecolumns.hpp"
+#include "indexedtable.hpp"
+#include "productcolumns.hpp"
+#include "rowcodec.hpp"
+#include "salescolumns.hpp"
+#include "storageengine.hpp"
 #include "table.hpp"
+#include "wal.hpp"
 
 #define VERSION 2.3
 
@@ -31,84 +49,292 @@
 namespace dataprovider {
 namespace db {
 
+// durablelog.hpp
+class DurableLog;
+
+/*!
+ * In-memory tables with optional persistence
+ *
+ * If psdb.cfg has a db_path, every table mutation is appended to a write-ahead log in that
+ * directory. On startup the last checkpoint is loaded and the log is replayed on top of it.
+ * A checkpoint is written once the log reaches checkpoint_records, which bounds recovery time.
+ * The checkpoint image is memory-mapped; each table is decoded on its first SELECT.
+ *
+ * The tables can be used from many threads: reads work on immutable table versions and never
+ * wait for writers; writes to the same table are serialized (see indexedtable.hpp).
+ *
+ * Erased rows are left as tombstones. Every compaction_interval_ms a background thread compacts
+ * the tables whose erased share reached compaction_threshold percent (0 turns it off).
+ *
+ * changes() streams the committed mutations to subscribers, e.g. caches that apply deltas
+ * instead of reading whole tables again. It keeps the last change_feed_events events.
+*/
 class StackDB {
  public:
-    ~StackDB() = default;
+    ~StackDB();
+
+    /*!
+     * Point-in-time view of all tables, for reports that read several of them
+     * Every table is taken at the same moment and never changes afterwards; writers keep going
+     * meanwhile. The table versions are freed with the last snapshot that uses them.
+     * e.g. const auto snapshot = DATABASE().snapshot();
+     *      snapshot.SELECT_SALES_TABLE().columns()
+    */
+    class Snapshot {
+     public:
+        inline const ColumnTable<EmployeeColumns>::Snapshot& SELECT_EMPLOYEES_TABLE() const {
+            return mEmployees;
+        }
+
+        inline const IndexedTable<UserTableItem>::Snapshot& SELECT_USERS_TABLE() const {
+            return mUsers;
+        }
+
+        inline const IndexedTable<AddressTableItem>::Snapshot& SELECT_ADDRESS_TABLE() const {
+            return mAddress;
+        }
+
+        inline const IndexedTable<ContactDetailsTableItem>::Snapshot&
+        SELECT_CONTACTS_TABLE() const {
+            return mContacts;
+        }
+
+        inline const IndexedTable<PersonalIdTableItem>::Snapshot& SELECT_PERSONAL_ID_TABLE() const {
+            return mPersonalId;
+        }
+
+        inline const ColumnTable<ProductColumns>::Snapshot& SELECT_PRODUCT_TABLE() const {
+            return mProduct;
+        }
+
+        inline const IndexedTable<CustomerTableItem>::Snapshot& SELECT_CUSTOMER_TABLE() const {
+            return mCustomer;
+        }
+
+        inline const IndexedTable<UOMTableItem>::Snapshot& SELECT_UOM_TABLE() const {
+            return mUom;
+        }
+
+        inline const IndexedTable<CategoryTableItem>::Snapshot& SELECT_CATEGORY_TABLE() const {
+            return mCategory;
+        }
+
+        inline const ColumnTable<SalesColumns>::Snapshot& SELECT_SALES_TABLE() const {
+            return mSales;
+        }
+
+        inline const ColumnTable<SalesItemColumns>::Snapshot& SELECT_SALES_ITEM_TABLE() const {
+            return mSalesItem;
+        }
+
+     private:
+        friend class StackDB;
+        // Called with the writes of every table locked
+        Snapshot();
+
+        const ColumnTable<EmployeeColumns>::Snapshot mEmployees;
+        const IndexedTable<UserTableItem>::Snapshot mUsers;
+        const IndexedTable<AddressTableItem>::Snapshot mAddress;
+        const IndexedTable<ContactDetailsTableItem>::Snapshot mContacts;
+        const IndexedTable<PersonalIdTableItem>::Snapshot mPersonalId;
+        const ColumnTable<ProductColumns>::Snapshot mProduct;
+        const IndexedTable<CustomerTableItem>::Snapshot mCustomer;
+        const IndexedTable<UOMTableItem>::Snapshot mUom;
+        const IndexedTable<CategoryTableItem>::Snapshot mCategory;
+        const ColumnTable<SalesColumns>::Snapshot mSales;
+        const ColumnTable<SalesItemColumns>::Snapshot mSalesItem;
+    };
 
     static StackDB& getDbInstance() {
         static StackDB instance;
         return instance;
     }
 
-    inline std::vector<EmployeeTableItem>& SELECT_EMPLOYEES_TABLE() const {
-        return EMPLOYEES_TABLE;
+    inline ColumnTable<EmployeeColumns>& SELECT_EMPLOYEES_TABLE() const {
+        return loaded(&EMPLOYEES_TABLE);
+    }
+
+    inline IndexedTable<UserTableItem>& SELECT_USERS_TABLE() const {
+        return loaded(&USERS_TABLE);
     }
 
-    inline std::vector<UserTableItem>& SELECT_USERS_TABLE() const {
-        return USERS_TABLE;
+    inline IndexedTable<AddressTableItem>& SELECT_ADDRESS_TABLE() const {
+        return loaded(&ADDRESS_TABLE);
     }
 
-    inline std::vector<AddressTableItem>& SELECT_ADDRESS_TABLE() const {
-        return ADDRESS_TABLE;
+    inline IndexedTable<ContactDetailsTableItem>& SELECT_CONTACTS_TABLE() const {
+        return loaded(&CONTACTS_TABLE);
     }
 
-    inline std::vector<ContactDetailsTableItem>& SELECT_CONTACTS_TABLE() const {
-        return CONTACTS_TABLE;
+    inline IndexedTable<PersonalIdTableItem>& SELECT_PERSONAL_ID_TABLE() const {
+        return loaded(&PERSONAL_ID_TABLE);
     }
 
-    inline std::vector<PersonalIdTableItem>& SELECT_PERSONAL_ID_TABLE() const {
-        return PERSONAL_ID_TABLE;
+    inline ColumnTable<ProductColumns>& SELECT_PRODUCT_TABLE() const {
+        return loaded(&PRODUCT_TABLE);
     }
 
-    inline std::vector<ProductTableItem>& SELECT_PRODUCT_TABLE() const {
-        return PRODUCT_TABLE;
+    inline IndexedTable<CustomerTableItem>& SELECT_CUSTOMER_TABLE() const {
+        return loaded(&CUSTOMER_TABLE);
     }
 
-    inline std::vector<CustomerTableItem>& SELECT_CUSTOMER_TABLE() const {
-        return CUSTOMER_TABLE;
+    inline IndexedTable<UOMTableItem>& SELECT_UOM_TABLE() const {
+        return loaded(&UOM_TABLE);
     }
 
-    inline std::vector<UOMTableItem>& SELECT_UOM_TABLE() const {
-        return UOM_TABLE;
+    inline IndexedTable<CategoryTableItem>& SELECT_CATEGORY_TABLE() const {
+        return loaded(&CATEGORY_TABLE);
     }
 
-    inline std::vector<CategoryTableItem>& SELECT_CATEGORY_TABLE() const {
-        return CATEGORY_TABLE;
+    inline ColumnTable<SalesColumns>& SELECT_SALES_TABLE() const {
+        return loaded(&SALES_TABLE);
     }
 
-    inline std::vector<SalesTableItem>& SELECT_SALES_TABLE() const {
-        return SALES_TABLE;
+    inline ColumnTable<SalesItemColumns>& SELECT_SALES_ITEM_TABLE() const {
+        return loaded(&SALES_ITEM_TABLE);
     }
 
-    inline std::vector<SalesItemTableItem>& SELECT_SALES_ITEM_TABLE() const {
-        return SALES_ITEM_TABLE;
+    /*!
+     * Returns a consistent view of all tables; see Snapshot
+    */
+    Snapshot snapshot() const;
+    /*!
+     * Blocks until the mutations so far are durable
+     * Concurrent callers share the same log flush; no-op if persistence is disabled
+     * Returns false if the log could not be written; the mutations are not durable then.
+    */
+    bool commit();
+    /*!
+     * Writes all tables to a new checkpoint and drops the log records it holds
+     * The tables stay writable while the checkpoint is written.
+    */
+    bool checkpoint();
+    /*!
+     * Writes a consistent image of all tables to [path] while they stay in use
+     * The writers and the checkpoints only wait while the tables are snapshot. The image is
+     * written at most at [bytesPerSecond] (0 is unlimited), so it does not crowd out the log
+     * flushes of the commits. It has the checkpoint format: restore it as stackdb.ckpt in an
+     * empty db_path.
+     * Only the StackDB tables are in it; see StorageEngine::isInStackDB().
+     * e.g. DATABASE().backup("/backup/stackdb.ckpt", 8 * 1024 * 1024);
+    */
+    bool backup(const std::string& path, size_t bytesPerSecond = 0);
+    /*!
+     * Logs changes to the stock of the products without writing their rows, so a commit
+     * neither waits for the product table nor writes it; see StockCounters
+     * The next commit() makes them durable. foldStock() and every checkpoint add them to the
+     * rows; recovery replays them.
+    */
+    void logStock(const std::vector<StockChange>& changes);
+    /*!
+     * Adds the logged stock changes to the product rows; returns the number of rows written
+     * The changes of a product that is gone are dropped. Nothing is written inside a
+     * transaction, which would log the rows with it.
+    */
+    size_t foldStock();
+    /*!
+     * Compacts the tables whose erased share reached the threshold; returns how many
+     * Called by the background compactor, and can be called directly
+    */
+    size_t compact();
+    /*!
+     * The change-data-capture stream of the tables; see ChangeFeed
+     * e.g. const auto subscription = DATABASE().changes().subscribe({ TableID::PRODUCT });
+     *      std::vector<ChangeEvent> events;
+     *      subscription->poll(&events, 100);
+    */
+    inline ChangeFeed& changes() {
+        return *mChanges;
     }
 
  private:
+    friend class Transaction;
     StackDB();
-    // employees storage
-    static std::vector<EmployeeTableItem> EMPLOYEES_TABLE;
-    // users storage
-    static std::vector<UserTableItem> USERS_TABLE;
-    // address storage - of all persons
-    static std::vector<AddressTableItem> ADDRESS_TABLE;
-    // contacts storage - of all persons
-    static std::vector<ContactDetailsTableItem> CONTACTS_TABLE;
-    // personal ID storage - of all persons
-    static std::vector<PersonalIdTableItem> PERSONAL_ID_TABLE;
-    // product storage
-    static std::vector<ProductTableItem> PRODUCT_TABLE;
-    // customer storage
-    static std::vector<CustomerTableItem> CUSTOMER_TABLE;
-    // unit of measurement storage
-    static std::vector<UOMTableItem> UOM_TABLE;
+    // the log and checkpoint in db_path; none in memory
+    std::unique_ptr<DurableLog> mDurableLog;
+    std::unique_ptr<ChangeFeed> mChanges;
+    // checkpoint image of the tables that are not decoded yet; shared with the backups
+    std::shared_ptr<CheckpointImage> mImage;
+    mutable std::mutex mLoadMutex;
+    mutable std::atomic<bool> mIsLoaded[TABLE_COUNT] {};
+    std::string mDbPath;
+    // background compaction
+    size_t mCompactionPercent = 0;
+    size_t mCompactionIntervalMs = 0;
+    std::thread mCompactor;
+    std::mutex mCompactorMutex;
+    std::condition_variable mCompactorWakeup;
+    bool mIsStopping = false;
+    // the logged stock changes that are not in the product rows yet, by barcode; taken after
+    // the product table lock
+    std::mutex mStockMutex;
+    std::unordered_map<std::string, int64_t> mUnfoldedStock;
+
+    // employees storage - typed columns, indexed by employee ID
+    static ColumnTable<EmployeeColumns> EMPLOYEES_TABLE;
+    // users storage - indexed by user ID and employee ID
+    static IndexedTable<UserTableItem> USERS_TABLE;
+    // address storage - of all persons, indexed by person ID
+    static IndexedTable<AddressTableItem> ADDRESS_TABLE;
+    // contacts storage - of all persons, indexed by person ID
+    static IndexedTable<ContactDetailsTableItem> CONTACTS_TABLE;
+    // personal ID storage - of all persons, indexed by person ID
+    static IndexedTable<PersonalIdTableItem> PERSONAL_ID_TABLE;
+    // product storage - typed columns, indexed by barcode
+    static ColumnTable<ProductColumns> PRODUCT_TABLE;
+    // customer storage - indexed by customer ID
+    static IndexedTable<CustomerTableItem> CUSTOMER_TABLE;
+    // unit of measurement storage - indexed by UOM ID
+    static IndexedTable<UOMTableItem> UOM_TABLE;
     // inventory category storage
-    static std::vector<CategoryTableItem> CATEGORY_TABLE;
-    // sales storage
-    static std::vector<SalesTableItem> SALES_TABLE;
-    // sales item storage
-    static std::vector<SalesItemTableItem> SALES_ITEM_TABLE;
+    static IndexedTable<CategoryTableItem> CATEGORY_TABLE;
+    // sales storage - typed columns, indexed by sale ID
+    static ColumnTable<SalesColumns> SALES_TABLE;
+    // sales item storage - typed columns
+    static ColumnTable<SalesItemColumns> SALES_ITEM_TABLE;
 
+    template <typename Table>
+    inline Table& loaded(Table* table) const {
+        const TableID id = RowCodec<typename Table::Row>::TABLE;
+        if (!isLoaded(id)) {
+            materialize(id);
+        }
+        return *table;
+    }
+
+    inline bool isLoaded(TableID table) const {
+        return mIsLoaded[static_cast<size_t>(table)].load(std::memory_order_acquire);
+    }
+
+    void materialize(TableID table) const;
+    /*!
+     * Stops the writes to every table, so their versions can be taken at one moment
+    */
+    static std::vector<WriteLock> lockWrites();
+    void open();
+    /*!
+     * Sets the table listeners that feed the log and the change feed; none if both are off
+    */
+    void attachListeners();
+    void startCompactor();
+    void runCompactor();
+    /*!
+     * Snapshots the tables and returns the writers of their image sections, and its [lsn]
+    */
+    std::vector<std::function<void(CheckpointWriter*)>> imageSections(uint64_t* lsn);
+    /*!
+     * imageSections() of a new checkpoint, which replaces the mapped image
+    */
+    std::vector<std::function<void(CheckpointWriter*)>> checkpointSections(uint64_t* lsn);
+    /*!
+     * foldStock() with the product table lock and mStockMutex held
+    */
+    size_t foldLoggedStock();
+    std::string filePath(const std::string& fileName) const;
+    template <typename Function>
+    static void forEachTable(Function function);
+
+    void populate();
     void populateEmployees();
     void populateProducts();
     void populateCustomers();
@@ -117,6 +343,77 @@ class StackDB {
     void populateCategory();
 };
 
+/*!
+ * Commits the storage engine when the data operation goes out of scope, on every return path
+ * e.g. const db::AutoCommit autoCommit;
+ * A caller that needs to know if its writes are durable calls commit() itself:
+ *      db::AutoCommit autoCommit;
+ *      ... writes ...
+ *      if (!autoCommit.commit()) { ... not saved ... }
+*/
+class AutoCommit {
+ public:
+    AutoCommit() = default;
+    ~AutoCommit() {
+        if (!mIsCommitted) {
+            STORAGE().commit();
+        }
+    }
+    /*!
+     * Commits now; returns false if the writes could not be made durable
+    */
+    bool commit() {
+        mIsCommitted = true;
+        return STORAGE().commit();
+    }
+
+ private:
+    bool mIsCommitted = false;
+};
+
+/*!
+ * Applies the writes to several tables as one unit, e.g. an employee and all its details
+ * e.g. const db::Transaction transaction;
+ *
+ * The writes of the other threads wait until the transaction goes out of scope. Then its
+ * writes are published to the readers together and logged as one group, which recovery
+ * replays completely or not at all, and it is committed like AutoCommit.
+ * It is rolled back instead if rollback() was called or if an exception leaves the scope.
+ * Reads on the thread of the transaction see its own writes; the other threads see them once
+ * it is published. A transaction started inside another one is part of the outer one.
+ * A caller that needs to know if its writes are durable calls commit() itself:
+ *      db::Transaction transaction;
+ *      ... writes ...
+ *      if (!transaction.commit()) { ... not saved ... }
+*/
+class Transaction {
+ public:
+    Transaction();
+    ~Transaction();
+    /*!
+     * Ends the transaction now and waits until its own writes are durable
+     * Returns false if they could not be made durable or if it was rolled back. Calling it
+     * again retries the log write. The writes that follow are not part of the transaction.
+     * A nested transaction returns true; the outer one commits its writes.
+    */
+    bool commit();
+    /*!
+     * Drops the writes made so far and the ones that follow
+    */
+    void rollback();
+
+ private:
+    std::vector<WriteLock> mWriteLocks;
+    // log records of the writes, appended to the log at the end
+    std::vector<LogRecord> mLog;
+    const int mUncaughtExceptions;
+    const bool mIsNested;
+    bool mIsRolledBack = false;
+    bool mIsEnded = false;
+    // LSN of the end of the logged writes; 0 if none were logged
+    uint64_t mEndLsn = 0;
+};
+
 }  // namespace db
 }  // namespace dataprovider
 #endif  // ORCHESTRA_MIGRATION_STORAGE_STACKDB_HPP_
\ No newline at end of file
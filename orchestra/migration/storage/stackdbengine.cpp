@@ -0,0 +1,438 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "stackdbengine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "btreeproducts.hpp"
+#include "dbconfig.hpp"
+#include "lsmsales.hpp"
+#include "shardedtables.hpp"
+#include <cfg/config.hpp>
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+/*!
+ * Walks the date-time index of a sales snapshot from [first] to [last] (exclusive)
+*/
+class TimeCursor : public Cursor<SalesTableItem> {
+ public:
+    TimeCursor(ColumnTable<SalesColumns>::Snapshot snapshot, size_t first, size_t last)
+        : mSnapshot(std::move(snapshot)), mPos(first), mLast(last) {}
+
+    bool next(SalesTableItem* out) override {
+        if (mPos >= mLast) {
+            return false;
+        }
+        const SalesColumns& columns = mSnapshot.columns();
+        columns.read(columns.byTime[mPos++], out);
+        return true;
+    }
+
+ private:
+    const ColumnTable<SalesColumns>::Snapshot mSnapshot;
+    size_t mPos;
+    const size_t mLast;
+};
+
+/*!
+ * Reads the rows of a column table snapshot at the given positions
+*/
+template <typename Columns>
+class PositionCursor : public Cursor<typename Columns::Row> {
+ public:
+    PositionCursor(typename ColumnTable<Columns>::Snapshot snapshot,
+                   std::vector<size_t> positions)
+        : mSnapshot(std::move(snapshot)), mPositions(std::move(positions)) {}
+
+    bool next(typename Columns::Row* out) override {
+        if (mPos >= mPositions.size()) {
+            return false;
+        }
+        mSnapshot.columns().read(mPositions[mPos++], out);
+        return true;
+    }
+
+ private:
+    const typename ColumnTable<Columns>::Snapshot mSnapshot;
+    const std::vector<size_t> mPositions;
+    size_t mPos = 0;
+};
+
+constexpr char PRODUCT_TREE_FILE[] = "products.btree";
+constexpr char SALES_TREE_DIRECTORY[] = "sales.lsm";
+constexpr char SALES_ITEM_TREE_DIRECTORY[] = "salesitems.lsm";
+constexpr char PRODUCT_SHARD_DIRECTORY[] = "product_shards";
+constexpr char SALES_SHARD_DIRECTORY[] = "sales_shards";
+// 4 MiB of product pages
+constexpr size_t DEFAULT_PRODUCT_CACHE_PAGES = 1024;
+constexpr size_t DEFAULT_LSM_MEMTABLE_KB = 4096;
+constexpr size_t DEFAULT_LSM_MERGE_RUNS = 4;
+
+/*!
+ * product_engine=btree keeps the products in a B+tree file in db_path, with a buffer pool of
+ * product_cache_pages pages; on first use the tree is filled from the StackDB product table.
+*/
+std::unique_ptr<ProductEngine> openProductTree(utility::Config* config,
+                                               const std::string& prefix) {
+    const std::string path = prefix + PRODUCT_TREE_FILE;
+    std::unique_ptr<BTreeProductEngine> products(new BTreeProductEngine(path,
+        toNumber(config->get("product_cache_pages", ""), DEFAULT_PRODUCT_CACHE_PAGES)));
+    if (!products->isOpen()) {
+        LOG_ERROR("Cannot open the product B+tree; using the in-memory product table");
+        return nullptr;
+    }
+    if (products->size() == 0) {
+        // Only then, so the StackDB table is not decoded into memory on every start
+        for (const ProductTableItem& row : DATABASE().SELECT_PRODUCT_TABLE()) {
+            products->insert(row);
+        }
+        products->flush();
+        LOG_INFO("Copied %s products to %s", std::to_string(products->size()).c_str(),
+                 path.c_str());
+    }
+    return std::move(products);
+}
+
+/*!
+ * sales_engine=lsm keeps the sales and their items in LSM trees in db_path, with memtables of
+ * lsm_memtable_kb KiB that are merged lsm_merge_runs runs at a time; on first use the trees
+ * are filled from the StackDB tables.
+*/
+void openSalesTrees(utility::Config* config, const std::string& prefix,
+                    ReplacedTables* replaced) {
+    LsmTree::Options options;
+    options.memtableBytes = toNumber(config->get("lsm_memtable_kb", ""),
+                                     DEFAULT_LSM_MEMTABLE_KB) * 1024;
+    options.mergeRuns = toNumber(config->get("lsm_merge_runs", ""), DEFAULT_LSM_MERGE_RUNS);
+    std::unique_ptr<LsmSalesEngine> sales(
+        new LsmSalesEngine(prefix + SALES_TREE_DIRECTORY, options));
+    std::unique_ptr<LsmSalesItemEngine> items(
+        new LsmSalesItemEngine(prefix + SALES_ITEM_TREE_DIRECTORY, options));
+    if (!sales->isOpen() || !items->isOpen()) {
+        LOG_ERROR("Cannot open the sales LSM trees; using the in-memory sales tables");
+        return;
+    }
+    if ((sales->size() == 0) && (items->size() == 0)) {
+        // Only then, so the StackDB tables are not decoded into memory on every start
+        for (const SalesTableItem& row : DATABASE().SELECT_SALES_TABLE()) {
+            sales->insert(row);
+        }
+        for (const SalesItemTableItem& row : DATABASE().SELECT_SALES_ITEM_TABLE()) {
+            items->insert(row);
+        }
+        sales->flush();
+        items->flush();
+        LOG_INFO("Copied %s sales and %s sale items to the LSM trees",
+                 std::to_string(sales->size()).c_str(), std::to_string(items->size()).c_str());
+    }
+    replaced->sales = std::move(sales);
+    replaced->salesItems = std::move(items);
+}
+
+/*!
+ * table_shards shards (0 is one per core), with the log settings of StackDB
+*/
+ShardOptions shardOptionsOf(utility::Config* config) {
+    ShardOptions options;
+    options.count = toNumber(config->get("table_shards", ""), 0);
+    options.checkpointRecords = toNumber(config->get("checkpoint_records", ""),
+                                         DEFAULT_CHECKPOINT_RECORDS);
+    options.commitDelayUs = static_cast<unsigned>(toNumber(config->get("commit_delay_us", ""), 0));
+    options.compactionThreshold = toNumber(config->get("compaction_threshold", ""),
+                                           DEFAULT_COMPACTION_PERCENT) / 100.0;
+    return options;
+}
+
+/*!
+ * product_engine=sharded splits the products by barcode into shards in db_path, each with its
+ * own lock, log and checkpoint; on first use the shards are filled from the StackDB table.
+*/
+std::unique_ptr<ProductEngine> openProductShards(utility::Config* config,
+                                                 const std::string& prefix) {
+    std::shared_ptr<ShardSet<ProductColumns>> shards(new ShardSet<ProductColumns>(
+        prefix + PRODUCT_SHARD_DIRECTORY, shardOptionsOf(config),
+        // Only read to fill new shards, so it is not decoded into memory on every start
+        []() -> const ColumnTable<ProductColumns>& { return DATABASE().SELECT_PRODUCT_TABLE(); }));
+    LOG_INFO("Products in %s shards", std::to_string(shards->count()).c_str());
+    return std::unique_ptr<ProductEngine>(new ShardedProductEngine(shards));
+}
+
+/*!
+ * sales_engine=sharded splits the sales by ID into shards in db_path; the items of a sale are
+ * in the shard of the sale, so a checkout writes and commits one shard only.
+*/
+void openSalesShards(utility::Config* config, const std::string& prefix,
+                     ReplacedTables* replaced) {
+    std::shared_ptr<ShardedSalesEngine::Shards> shards(new ShardedSalesEngine::Shards(
+        prefix + SALES_SHARD_DIRECTORY, shardOptionsOf(config),
+        // Only read to fill new shards, so they are not decoded into memory on every start
+        []() -> const ColumnTable<SalesColumns>& { return DATABASE().SELECT_SALES_TABLE(); },
+        []() -> const ColumnTable<SalesItemColumns>& {
+            return DATABASE().SELECT_SALES_ITEM_TABLE();
+        }));
+    LOG_INFO("Sales in %s shards", std::to_string(shards->count()).c_str());
+    replaced->sales.reset(new ShardedSalesEngine(shards));
+    replaced->salesItems.reset(new ShardedSalesItemEngine(shards));
+}
+
+/*!
+ * The engine configured in psdb.cfg; the tables that cannot be opened stay in StackDB
+*/
+std::unique_ptr<StorageEngine> createEngine() {
+    utility::Config config(DB_CONFIG);
+    const std::string productEngine = config.get("product_engine", "stackdb");
+    const std::string salesEngine = config.get("sales_engine", "stackdb");
+    const bool isProductTree = productEngine == "btree";
+    const bool isSalesTree = salesEngine == "lsm";
+    const bool isProductSharded = productEngine == "sharded";
+    const bool isSalesSharded = salesEngine == "sharded";
+    ReplacedTables replaced;
+    if (isProductTree || isSalesTree || isProductSharded || isSalesSharded) {
+        // Opens StackDB first, which creates db_path
+        DATABASE();
+        const std::string dbPath = config.get("db_path", "");
+        // the files go in db_path
+        const std::string prefix = dbPath.empty() ? dbPath : dbPath + "/";
+        if (isProductTree) {
+            replaced.products = openProductTree(&config, prefix);
+        }
+        if (isSalesTree) {
+            openSalesTrees(&config, prefix, &replaced);
+        }
+        if (isProductSharded) {
+            replaced.products = openProductShards(&config, prefix);
+        }
+        if (isSalesSharded) {
+            openSalesShards(&config, prefix, &replaced);
+        }
+    }
+    const unsigned stockFlushMs = static_cast<unsigned>(toNumber(
+        config.get("stock_flush_ms", ""), StackDBEngine::DEFAULT_STOCK_FLUSH_MS));
+    return std::unique_ptr<StorageEngine>(new StackDBEngine(std::move(replaced), stockFlushMs));
+}
+
+std::mutex gEngineMutex;
+std::unique_ptr<StorageEngine> gEngine;
+// gEngine, read without the lock
+std::atomic<StorageEngine*> gCurrentEngine { nullptr };
+
+}  // namespace
+
+std::unique_ptr<Cursor<ProductTableItem>>
+StackProductEngine::scanRange(const std::string& first, const std::string& last) const {
+    const ColumnTable<ProductColumns>::Snapshot snapshot = table().snapshot();
+    const ProductColumns& columns = snapshot.columns();
+    std::vector<size_t> positions;
+    for (size_t pos = 0; pos < columns.size(); ++pos) {
+        const std::string& barcode = columns.key(pos);
+        if (!snapshot.isErased(pos) && (barcode >= first) && (last.empty() || (barcode <= last))) {
+            positions.push_back(pos);
+        }
+    }
+    std::sort(positions.begin(), positions.end(), [&columns](size_t left, size_t right) {
+        return columns.key(left) < columns.key(right);
+    });
+    return std::unique_ptr<Cursor<ProductTableItem>>(
+        new PositionCursor<ProductColumns>(snapshot, std::move(positions)));
+}
+
+std::unique_ptr<Cursor<SalesTableItem>> StackSalesEngine::scanTime(int64_t first,
+                                                                   int64_t last) const {
+    const ColumnTable<SalesColumns>::Snapshot snapshot = table().snapshot();
+    const size_t begin = snapshot.columns().lowerBound(first);
+    const size_t end = snapshot.columns().upperBound(last);
+    return std::unique_ptr<Cursor<SalesTableItem>>(new TimeCursor(snapshot, begin, end));
+}
+
+bool StackSalesItemEngine::get(const std::string& key, SalesItemTableItem* out) const {
+    const ColumnTable<SalesItemColumns>::Snapshot snapshot = table().snapshot();
+    const std::vector<size_t>& positions = snapshot.columns().findSale(key);
+    if (positions.empty()) {
+        return false;
+    }
+    if (out) {
+        snapshot.columns().read(positions.front(), out);
+    }
+    return true;
+}
+
+std::unique_ptr<Cursor<SalesItemTableItem>>
+StackSalesItemEngine::scanOf(const std::string& key) const {
+    const ColumnTable<SalesItemColumns>::Snapshot snapshot = table().snapshot();
+    // The items are read in place; only their positions are copied up front
+    std::vector<size_t> positions = snapshot.columns().findSale(key);
+    return std::unique_ptr<Cursor<SalesItemTableItem>>(new PositionCursor<SalesItemColumns>(
+        snapshot, std::move(positions)));
+}
+
+bool StackSalesItemEngine::update(const SalesItemTableItem& row) {
+    return table().updateIf([&row](const SalesItemTableItem& item) {
+        return item.saleID == row.saleID;
+    }, row);
+}
+
+size_t StackSalesItemEngine::remove(const std::string& key) {
+    return table().eraseIf([&key](const SalesItemTableItem& item) {
+        return item.saleID == key;
+    });
+}
+
+constexpr unsigned StackDBEngine::DEFAULT_STOCK_FLUSH_MS;
+
+StackDBEngine::StackDBEngine(ReplacedTables replaced, unsigned stockFlushMs)
+    : mEmployees(&StackDB::SELECT_EMPLOYEES_TABLE),
+      mUsers(&StackDB::SELECT_USERS_TABLE),
+      mAddresses(&StackDB::SELECT_ADDRESS_TABLE),
+      mContacts(&StackDB::SELECT_CONTACTS_TABLE),
+      mPersonalIds(&StackDB::SELECT_PERSONAL_ID_TABLE),
+      mCustomers(&StackDB::SELECT_CUSTOMER_TABLE),
+      mUoms(&StackDB::SELECT_UOM_TABLE),
+      mCategories(&StackDB::SELECT_CATEGORY_TABLE),
+      mReplaced(std::move(replaced)),
+      mStock(this, stockFlushMs) {}
+
+TableEngine<EmployeeTableItem>& StackDBEngine::employees() {
+    return mEmployees;
+}
+
+TableEngine<UserTableItem>& StackDBEngine::users() {
+    return mUsers;
+}
+
+TableEngine<AddressTableItem>& StackDBEngine::addresses() {
+    return mAddresses;
+}
+
+TableEngine<ContactDetailsTableItem>& StackDBEngine::contacts() {
+    return mContacts;
+}
+
+TableEngine<PersonalIdTableItem>& StackDBEngine::personalIds() {
+    return mPersonalIds;
+}
+
+ProductEngine& StackDBEngine::products() {
+    if (mReplaced.products) {
+        return *mReplaced.products;
+    }
+    return mProducts;
+}
+
+TableEngine<CustomerTableItem>& StackDBEngine::customers() {
+    return mCustomers;
+}
+
+TableEngine<UOMTableItem>& StackDBEngine::uoms() {
+    return mUoms;
+}
+
+TableEngine<CategoryTableItem>& StackDBEngine::categories() {
+    return mCategories;
+}
+
+SalesEngine& StackDBEngine::sales() {
+    if (mReplaced.sales) {
+        return *mReplaced.sales;
+    }
+    return mSales;
+}
+
+TableEngine<SalesItemTableItem>& StackDBEngine::salesItems() {
+    if (mReplaced.salesItems) {
+        return *mReplaced.salesItems;
+    }
+    return mSalesItems;
+}
+
+StockCounters& StackDBEngine::stock() {
+    return mStock;
+}
+
+bool StackDBEngine::logStock(const std::vector<StockChange>& changes) {
+    if (mReplaced.products) {
+        return false;
+    }
+    DATABASE().logStock(changes);
+    return true;
+}
+
+size_t StackDBEngine::foldStock() {
+    return mReplaced.products ? 0 : DATABASE().foldStock();
+}
+
+std::unique_lock<std::recursive_mutex> StackDBEngine::lockProducts() {
+    if (mReplaced.products) {
+        return std::unique_lock<std::recursive_mutex>();
+    }
+    return DATABASE().SELECT_PRODUCT_TABLE().lockWrites();
+}
+
+bool StackDBEngine::commit() {
+    // Their logged stock changes are committed below
+    mStock.flushOwn();
+    mStock.flushIfDue();
+    bool isDurable = DATABASE().commit();
+    if (mReplaced.products) {
+        isDurable = mReplaced.products->flush() && isDurable;
+    }
+    if (mReplaced.sales) {
+        isDurable = mReplaced.sales->flush() && isDurable;
+    }
+    if (mReplaced.salesItems) {
+        isDurable = mReplaced.salesItems->flush() && isDurable;
+    }
+    return isDurable;
+}
+
+bool StackDBEngine::isInStackDB() const {
+    return !mReplaced.products && !mReplaced.sales && !mReplaced.salesItems;
+}
+
+StorageEngine& StorageEngine::current() {
+    StorageEngine* engine = gCurrentEngine.load(std::memory_order_acquire);
+    if (engine) {
+        return *engine;
+    }
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    if (!gEngine) {
+        gEngine = createEngine();
+        gCurrentEngine.store(gEngine.get(), std::memory_order_release);
+    }
+    return *gEngine;
+}
+
+void StorageEngine::install(std::unique_ptr<StorageEngine> engine) {
+    std::lock_guard<std::mutex> lock(gEngineMutex);
+    gEngine = std::move(engine);
+    gCurrentEngine.store(gEngine.get(), std::memory_order_release);
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,434 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_STACKDBENGINE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_STACKDBENGINE_HPP_
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "stackdb.hpp"
+#include "storageengine.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Cursor over a table snapshot (IndexedTable or ColumnTable)
+ * The rows are copied into the strings of [out], so a scan that reuses one row for every
+ * next() does not allocate per row.
+*/
+template <typename Snapshot>
+class SnapshotCursor : public Cursor<typename Snapshot::Row> {
+ public:
+    explicit SnapshotCursor(const Snapshot& snapshot)
+        : mIt(snapshot.begin()), mEnd(snapshot.end()) {}
+
+    bool next(typename Snapshot::Row* out) override {
+        if (mIt == mEnd) {
+            return false;
+        }
+        mIt.read(out);
+        ++mIt;
+        return true;
+    }
+
+ private:
+    // the iterators keep the table version alive
+    decltype(std::declval<const Snapshot&>().begin()) mIt;
+    decltype(std::declval<const Snapshot&>().end()) mEnd;
+};
+
+/*!
+ * Cursor over the rows of an IndexedTable snapshot that pass a selection
+ * The rows are tested where they are stored; only the matching ones are copied.
+*/
+template <typename Snapshot>
+class SelectSnapshotCursor : public Cursor<typename Snapshot::Row> {
+ public:
+    typedef typename Snapshot::Row Row;
+
+    SelectSnapshotCursor(const Snapshot& snapshot, Selection<Row> selection)
+        : mIt(snapshot.begin()), mEnd(snapshot.end()), mSelection(std::move(selection)) {}
+
+    bool next(Row* out) override {
+        for (; mIt != mEnd; ++mIt) {
+            if (mSelection.matches(*mIt)) {
+                mSelection.project(*mIt, out);
+                ++mIt;
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    decltype(std::declval<const Snapshot&>().begin()) mIt;
+    decltype(std::declval<const Snapshot&>().end()) mEnd;
+    const Selection<Row> mSelection;
+};
+
+/*!
+ * Cursor over the rows of a ColumnTable snapshot that pass a selection
+ * Only the columns of the conditions are read to test a row, and only the selected columns
+ * are copied out.
+*/
+template <typename Columns>
+class SelectColumnsCursor : public Cursor<typename Columns::Row> {
+ public:
+    typedef typename Columns::Row Row;
+
+    SelectColumnsCursor(typename ColumnTable<Columns>::Snapshot snapshot,
+                        Selection<Row> selection)
+        : mSnapshot(std::move(snapshot)), mSelection(std::move(selection)) {}
+
+    bool next(Row* out) override {
+        const Columns& columns = mSnapshot.columns();
+        for (; mPos < columns.size(); ++mPos) {
+            if (!mSnapshot.isErased(mPos) && matches(columns, mPos)) {
+                project(columns, mPos++, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    const typename ColumnTable<Columns>::Snapshot mSnapshot;
+    const Selection<Row> mSelection;
+    size_t mPos = 0;
+    // holds the fields that are not stored as text
+    std::string mBuffer;
+
+    bool matches(const Columns& columns, size_t pos) {
+        for (const Condition<Row>& condition : mSelection.conditions) {
+            if (!condition.test(columns.field(condition.field, pos, &mBuffer))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void project(const Columns& columns, size_t pos, Row* out) {
+        if (mSelection.fields.empty()) {
+            columns.read(pos, out);
+            return;
+        }
+        *out = Row {};
+        for (const Field<Row> field : mSelection.fields) {
+            (*out).*field = columns.field(field, pos, &mBuffer);
+        }
+        for (const Flag<Row> flag : mSelection.flags) {
+            (*out).*flag = columns.flag(flag, pos);
+        }
+    }
+};
+
+/*!
+ * TableEngine of an IndexedTable of StackDB
+ * [Select] is the StackDB accessor, so the table is loaded on first use like SELECT_*.
+*/
+template <typename Row>
+class IndexedTableEngine : public TableEngine<Row> {
+ public:
+    typedef IndexedTable<Row>& (StackDB::*Select)() const;
+
+    explicit IndexedTableEngine(Select select) : mSelect(select) {}
+
+    bool get(const std::string& key, Row* out) const override {
+        return table().primaryKey() ? table().find(key, out) : table().findFirstOf(key, out);
+    }
+
+    std::unique_ptr<Cursor<Row>> scan() const override {
+        return std::unique_ptr<Cursor<Row>>(
+            new SnapshotCursor<typename IndexedTable<Row>::Snapshot>(table().snapshot()));
+    }
+
+    std::unique_ptr<Cursor<Row>> scanOf(const std::string& key) const override {
+        std::vector<Row> rows;
+        if (table().secondaryKey()) {
+            table().forEachOf(key, [&rows](const Row& row) { rows.push_back(row); });
+        } else {
+            Row row;
+            if (get(key, &row)) {
+                rows.emplace_back(std::move(row));
+            }
+        }
+        return std::unique_ptr<Cursor<Row>>(new VectorCursor<Row>(std::move(rows)));
+    }
+
+    std::unique_ptr<Cursor<Row>> select(const Selection<Row>& selection) const override {
+        return std::unique_ptr<Cursor<Row>>(
+            new SelectSnapshotCursor<typename IndexedTable<Row>::Snapshot>(table().snapshot(),
+                                                                           selection));
+    }
+
+    RowPage<Row> page(const PageQuery<Row>& query) const override {
+        // the snapshot keeps the rows of the window alive
+        const typename IndexedTable<Row>::Snapshot snapshot = table().snapshot();
+        PageWindow<const Row*> window(query.token, query.size);
+        for (const Row& row : snapshot) {
+            if (window.accepts(query.sortValue(row), row.*query.key)) {
+                window.offer(query.sortValue(row), row.*query.key, &row);
+            }
+        }
+        RowPage<Row> page;
+        for (const Row* row : window.take(&page.nextToken)) {
+            page.rows.push_back(*row);
+        }
+        return page;
+    }
+
+    bool insert(const Row& row) override {
+        return table().insert(row);
+    }
+
+    size_t insertAll(const std::vector<Row>& rows, std::vector<size_t>* duplicates) override {
+        return table().insertAll(rows, duplicates);
+    }
+
+    bool update(const Row& row) override {
+        return table().primaryKey() ? table().update(row) : table().updateFirstOf(row);
+    }
+
+    size_t remove(const std::string& key) override {
+        return table().primaryKey() ? (table().erase(key) ? 1 : 0) : table().eraseAllOf(key);
+    }
+
+    size_t removeOf(const std::string& key) override {
+        return table().secondaryKey() ? table().eraseAllOf(key) : (table().erase(key) ? 1 : 0);
+    }
+
+    size_t removeIf(const typename TableEngine<Row>::Predicate& predicate) override {
+        return table().eraseIf(predicate);
+    }
+
+    size_t size() const override {
+        return table().size();
+    }
+
+ private:
+    const Select mSelect;
+
+    inline IndexedTable<Row>& table() const {
+        return (DATABASE().*mSelect)();
+    }
+};
+
+/*!
+ * TableEngine of a ColumnTable of StackDB; [Interface] is TableEngine or one derived from it
+ * The rows are built from the columns as they are read. It can also serve a column table
+ * outside StackDB, e.g. a shard (see shardedtables.hpp).
+*/
+template <typename Columns, typename Interface = TableEngine<typename Columns::Row>>
+class ColumnTableEngine : public Interface {
+ public:
+    typedef typename Columns::Row Row;
+    typedef ColumnTable<Columns>& (StackDB::*Select)() const;
+
+    explicit ColumnTableEngine(Select select) : mSelect(select) {}
+    explicit ColumnTableEngine(ColumnTable<Columns>* table) : mTable(table) {}
+
+    bool get(const std::string& key, Row* out) const override {
+        return table().find(key, out);
+    }
+
+    std::unique_ptr<Cursor<Row>> scan() const override {
+        return std::unique_ptr<Cursor<Row>>(
+            new SnapshotCursor<typename ColumnTable<Columns>::Snapshot>(table().snapshot()));
+    }
+
+    std::unique_ptr<Cursor<Row>> scanOf(const std::string& key) const override {
+        std::vector<Row> rows(1);
+        if (!get(key, &rows.front())) {
+            rows.clear();
+        }
+        return std::unique_ptr<Cursor<Row>>(new VectorCursor<Row>(std::move(rows)));
+    }
+
+    std::unique_ptr<Cursor<Row>> select(const Selection<Row>& selection) const override {
+        return std::unique_ptr<Cursor<Row>>(
+            new SelectColumnsCursor<Columns>(table().snapshot(), selection));
+    }
+
+    RowPage<Row> page(const PageQuery<Row>& query) const override {
+        // only the sort and key columns are read, and the rows of the page are built
+        const typename ColumnTable<Columns>::Snapshot snapshot = table().snapshot();
+        const Columns& columns = snapshot.columns();
+        static const std::string none;
+        std::string sortBuffer;
+        std::string keyBuffer;
+        PageWindow<size_t> window(query.token, query.size);
+        for (size_t pos = 0; pos < columns.size(); ++pos) {
+            if (snapshot.isErased(pos)) {
+                continue;
+            }
+            const std::string& sortValue =
+                query.sortBy ? columns.field(query.sortBy, pos, &sortBuffer) : none;
+            const std::string& key = columns.field(query.key, pos, &keyBuffer);
+            if (window.accepts(sortValue, key)) {
+                window.offer(sortValue, key, pos);
+            }
+        }
+        RowPage<Row> page;
+        for (const size_t pos : window.take(&page.nextToken)) {
+            page.rows.push_back(columns.row(pos));
+        }
+        return page;
+    }
+
+    bool insert(const Row& row) override {
+        return table().insert(row);
+    }
+
+    size_t insertAll(const std::vector<Row>& rows, std::vector<size_t>* duplicates) override {
+        return table().insertAll(rows, duplicates);
+    }
+
+    bool update(const Row& row) override {
+        return table().update(row);
+    }
+
+    size_t remove(const std::string& key) override {
+        return table().erase(key) ? 1 : 0;
+    }
+
+    size_t removeOf(const std::string& key) override {
+        return remove(key);
+    }
+
+    size_t removeIf(const typename Interface::Predicate& predicate) override {
+        return table().eraseIf(predicate);
+    }
+
+    size_t size() const override {
+        return table().size();
+    }
+
+ protected:
+    inline ColumnTable<Columns>& table() const {
+        return mTable ? *mTable : (DATABASE().*mSelect)();
+    }
+
+ private:
+    const Select mSelect = nullptr;
+    ColumnTable<Columns>* const mTable = nullptr;
+};
+
+/*!
+ * Reads barcode ranges by sorting the matching rows; the column table is hash-indexed
+*/
+class StackProductEngine : public ColumnTableEngine<ProductColumns, ProductEngine> {
+ public:
+    StackProductEngine() : ColumnTableEngine(&StackDB::SELECT_PRODUCT_TABLE) {}
+    explicit StackProductEngine(ColumnTable<ProductColumns>* table) : ColumnTableEngine(table) {}
+
+    std::unique_ptr<Cursor<ProductTableItem>> scanRange(const std::string& first,
+                                                        const std::string& last) const override;
+};
+
+/*!
+ * Reads time ranges through the date-time index of the sales columns
+*/
+class StackSalesEngine : public ColumnTableEngine<SalesColumns, SalesEngine> {
+ public:
+    StackSalesEngine() : ColumnTableEngine(&StackDB::SELECT_SALES_TABLE) {}
+    explicit StackSalesEngine(ColumnTable<SalesColumns>* table) : ColumnTableEngine(table) {}
+
+    std::unique_ptr<Cursor<SalesTableItem>> scanTime(int64_t first,
+                                                     int64_t last) const override;
+};
+
+/*!
+ * The items of a sale are found by their positions (SalesItemColumns::bySale); the key is the
+ * sale ID
+*/
+class StackSalesItemEngine : public ColumnTableEngine<SalesItemColumns> {
+ public:
+    StackSalesItemEngine() : ColumnTableEngine(&StackDB::SELECT_SALES_ITEM_TABLE) {}
+    explicit StackSalesItemEngine(ColumnTable<SalesItemColumns>* table)
+        : ColumnTableEngine(table) {}
+
+    bool get(const std::string& key, SalesItemTableItem* out) const override;
+    std::unique_ptr<Cursor<SalesItemTableItem>> scanOf(const std::string& key) const override;
+    bool update(const SalesItemTableItem& row) override;
+    size_t remove(const std::string& key) override;
+};
+
+/*!
+ * Tables that replace those of StackDB in a StackDBEngine; the null ones are kept in StackDB
+*/
+struct ReplacedTables {
+    // e.g. BTreeProductEngine
+    std::unique_ptr<ProductEngine> products;
+    // e.g. LsmSalesEngine and LsmSalesItemEngine
+    std::unique_ptr<SalesEngine> sales;
+    std::unique_ptr<TableEngine<SalesItemTableItem>> salesItems;
+};
+
+/*!
+ * StorageEngine of the StackDB tables; some can be replaced by tables of another engine
+*/
+class StackDBEngine : public StorageEngine {
+ public:
+    static constexpr unsigned DEFAULT_STOCK_FLUSH_MS = 1000;
+
+    explicit StackDBEngine(ReplacedTables replaced = ReplacedTables(),
+                           unsigned stockFlushMs = DEFAULT_STOCK_FLUSH_MS);
+    ~StackDBEngine() override = default;
+
+    TableEngine<EmployeeTableItem>& employees() override;
+    TableEngine<UserTableItem>& users() override;
+    TableEngine<AddressTableItem>& addresses() override;
+    TableEngine<ContactDetailsTableItem>& contacts() override;
+    TableEngine<PersonalIdTableItem>& personalIds() override;
+    ProductEngine& products() override;
+    TableEngine<CustomerTableItem>& customers() override;
+    TableEngine<UOMTableItem>& uoms() override;
+    TableEngine<CategoryTableItem>& categories() override;
+    SalesEngine& sales() override;
+    TableEngine<SalesItemTableItem>& salesItems() override;
+    StockCounters& stock() override;
+    bool logStock(const std::vector<StockChange>& changes) override;
+    size_t foldStock() override;
+    std::unique_lock<std::recursive_mutex> lockProducts() override;
+    bool commit() override;
+    bool isInStackDB() const override;
+
+ private:
+    ColumnTableEngine<EmployeeColumns> mEmployees;
+    IndexedTableEngine<UserTableItem> mUsers;
+    IndexedTableEngine<AddressTableItem> mAddresses;
+    IndexedTableEngine<ContactDetailsTableItem> mContacts;
+    IndexedTableEngine<PersonalIdTableItem> mPersonalIds;
+    StackProductEngine mProducts;
+    IndexedTableEngine<CustomerTableItem> mCustomers;
+    IndexedTableEngine<UOMTableItem> mUoms;
+    IndexedTableEngine<CategoryTableItem> mCategories;
+    StackSalesEngine mSales;
+    StackSalesItemEngine mSalesItems;
+    const ReplacedTables mReplaced;
+    StockCounters mStock;
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_STACKDBENGINE_HPP_
@@ -0,0 +1,292 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "stockcounters.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "salescolumns.hpp"
+#include "storageengine.hpp"
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+// slots of the first hash table; a power of two
+constexpr size_t INITIAL_SLOTS = 64;
+// counters that a thread keeps for its commit; past this its commit logs every counter
+constexpr size_t MAX_OWN_CHANGES = 1024;
+
+std::atomic<uint64_t> gLastCountersId { 0 };
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+constexpr int64_t StockCounters::UNKNOWN;
+
+StockCounters::StockCounters(StorageEngine* engine, unsigned flushIntervalMs)
+    : mEngine(engine), mId(++gLastCountersId), mFlushIntervalMs(flushIntervalMs),
+      mLastFlushMs(nowMs()) {
+    mSlotTables.emplace_back(new Slots(INITIAL_SLOTS));
+    mSlots.store(mSlotTables.back().get(), std::memory_order_release);
+}
+
+StockCounters::~StockCounters() = default;
+
+bool StockCounters::take(const std::string& barcode, int64_t quantity) {
+    Counter* counter = findOrAdd(barcode);
+    if (!counter || (quantity < 0)) {
+        return false;
+    }
+    for (int64_t stock = load(counter); stock != UNKNOWN;) {
+        if (stock < quantity) {
+            return false;
+        }
+        if (counter->stock.compare_exchange_weak(stock, stock - quantity)) {
+            changed(counter);
+            return true;
+        }
+        // Forgotten meanwhile
+        if (stock == UNKNOWN) {
+            stock = load(counter);
+        }
+    }
+    return false;
+}
+
+bool StockCounters::add(const std::string& barcode, int64_t quantity) {
+    Counter* counter = findOrAdd(barcode);
+    if (!counter || (quantity < 0)) {
+        return false;
+    }
+    for (int64_t stock = load(counter); stock != UNKNOWN;) {
+        if (counter->stock.compare_exchange_weak(stock, stock + quantity)) {
+            changed(counter);
+            return true;
+        }
+        if (stock == UNKNOWN) {
+            stock = load(counter);
+        }
+    }
+    return false;
+}
+
+bool StockCounters::read(const std::string& barcode, int64_t* out) const {
+    const Counter* counter = find(barcode);
+    if (!counter) {
+        return false;
+    }
+    const int64_t stock = counter->stock.load();
+    if (stock == UNKNOWN) {
+        return false;
+    }
+    *out = stock;
+    return true;
+}
+
+bool StockCounters::write(const ProductTableItem& row) {
+    // The changes logged so far go to the row first; none are logged until the counter
+    // follows it
+    const auto productsLock = mEngine->lockProducts();
+    std::lock_guard<std::mutex> lock(mLogMutex);
+    mEngine->foldStock();
+    if (!mEngine->products().update(row)) {
+        return false;
+    }
+    Counter* counter = find(row.barcode);
+    if (counter) {
+        // The changes that are not logged yet are replaced by the new stock
+        const int64_t stock = parseInteger(row.stock);
+        counter->logged = stock;
+        counter->stock.store(stock);
+    }
+    return true;
+}
+
+void StockCounters::forget(const std::string& barcode) {
+    Counter* counter = find(barcode);
+    if (!counter) {
+        return;
+    }
+    // The changes logged so far go to the row that they were made on, if it is still there
+    const auto productsLock = mEngine->lockProducts();
+    std::lock_guard<std::mutex> lock(mLogMutex);
+    mEngine->foldStock();
+    counter->stock.store(UNKNOWN);
+    counter->logged = UNKNOWN;
+}
+
+size_t StockCounters::flush() {
+    mLastFlushMs.store(nowMs());
+    const size_t written = logChanges(allCounters());
+    return written + mEngine->foldStock();
+}
+
+size_t StockCounters::flushOwn() {
+    const std::vector<Counter*>* own = ownChanges();
+    if (own->empty()) {
+        return 0;
+    }
+    // A thread that changed more counters than it keeps logs them all
+    const size_t written = (own->size() < MAX_OWN_CHANGES) ? logChanges(*own)
+                                                           : logChanges(allCounters());
+    ownChanges(true);
+    return written;
+}
+
+void StockCounters::flushIfDue() {
+    const int64_t now = nowMs();
+    int64_t last = mLastFlushMs.load();
+    // One committer flushes; the others do not wait for it
+    if ((now - last < mFlushIntervalMs) || !mLastFlushMs.compare_exchange_strong(last, now)) {
+        return;
+    }
+    logChanges(allCounters());
+    mEngine->foldStock();
+}
+
+StockCounters::Counter* StockCounters::find(const std::string& barcode) const {
+    const Slots* slots = mSlots.load(std::memory_order_acquire);
+    // Never full, so an empty slot ends the probe
+    for (size_t i = std::hash<std::string>()(barcode) & slots->mask;; i = (i + 1) & slots->mask) {
+        Counter* counter = slots->counters[i].load(std::memory_order_acquire);
+        if (!counter || (counter->barcode == barcode)) {
+            return counter;
+        }
+    }
+}
+
+StockCounters::Counter* StockCounters::findOrAdd(const std::string& barcode) {
+    Counter* counter = find(barcode);
+    if (counter) {
+        return counter;
+    }
+    std::lock_guard<std::mutex> lock(mAddMutex);
+    counter = find(barcode);
+    // No counters for unknown barcodes, e.g. mistyped ones
+    if (counter || !mEngine->products().get(barcode, nullptr)) {
+        return counter;
+    }
+    mCounters.emplace_back(new Counter(barcode));
+    counter = mCounters.back().get();
+    Slots* slots = mSlots.load(std::memory_order_relaxed);
+    const bool isFull = mCounters.size() * 2 > slots->mask + 1;
+    if (isFull) {
+        // The readers of the full table go on with it; it is freed with the counters
+        mSlotTables.emplace_back(new Slots((slots->mask + 1) * 2));
+        slots = mSlotTables.back().get();
+    }
+    for (size_t added = isFull ? 0 : mCounters.size() - 1; added < mCounters.size(); ++added) {
+        Counter* adding = mCounters[added].get();
+        size_t i = std::hash<std::string>()(adding->barcode) & slots->mask;
+        while (slots->counters[i].load(std::memory_order_relaxed)) {
+            i = (i + 1) & slots->mask;
+        }
+        slots->counters[i].store(adding, std::memory_order_release);
+    }
+    mSlots.store(slots, std::memory_order_release);
+    return counter;
+}
+
+int64_t StockCounters::load(Counter* counter) {
+    int64_t stock = counter->stock.load();
+    if (stock != UNKNOWN) {
+        return stock;
+    }
+    // Not while a write() or forget() changes the row
+    std::lock_guard<std::mutex> lock(mLogMutex);
+    stock = counter->stock.load();
+    ProductTableItem row;
+    // Unless another thread loaded or wrote it first
+    if ((stock != UNKNOWN) || !mEngine->products().get(counter->barcode, &row)) {
+        return stock;
+    }
+    stock = parseInteger(row.stock);
+    counter->logged = stock;
+    counter->stock.store(stock);
+    return stock;
+}
+
+void StockCounters::changed(Counter* counter) {
+    std::vector<Counter*>* own = ownChanges();
+    // e.g. the same hot item sold again; past MAX_OWN_CHANGES the commit logs every counter
+    if ((own->empty() || (own->back() != counter)) && (own->size() < MAX_OWN_CHANGES)) {
+        own->push_back(counter);
+    }
+}
+
+std::vector<StockCounters::Counter*>* StockCounters::ownChanges(bool isDropped) {
+    // By the id, as the counters can be gone, and their address taken again, by then
+    thread_local std::unordered_map<uint64_t, std::vector<Counter*>> changes;
+    if (isDropped) {
+        changes.erase(mId);
+        return nullptr;
+    }
+    return &changes[mId];
+}
+
+std::vector<StockCounters::Counter*> StockCounters::allCounters() {
+    std::lock_guard<std::mutex> lock(mAddMutex);
+    std::vector<Counter*> counters;
+    counters.reserve(mCounters.size());
+    for (const std::unique_ptr<Counter>& counter : mCounters) {
+        counters.push_back(counter.get());
+    }
+    return counters;
+}
+
+size_t StockCounters::logChanges(const std::vector<Counter*>& counters) {
+    std::lock_guard<std::mutex> lock(mLogMutex);
+    std::vector<StockChange> changes;
+    for (Counter* counter : counters) {
+        // Read once: the changes made meanwhile are logged the next time
+        const int64_t stock = counter->stock.load();
+        if ((stock == UNKNOWN) || (stock == counter->logged)) {
+            continue;
+        }
+        changes.push_back(StockChange { counter->barcode, stock - counter->logged });
+        counter->logged = stock;
+    }
+    if (changes.empty() || mEngine->logStock(changes)) {
+        return 0;
+    }
+    // Under the lock, so a row write does not lose a change of another one
+    size_t written = 0;
+    ProductTableItem row;
+    for (const StockChange& change : changes) {
+        if (mEngine->products().get(change.barcode, &row)) {
+            row.stock = std::to_string(parseInteger(row.stock) + change.quantity);
+            written += mEngine->products().update(row) ? 1 : 0;
+        }
+    }
+    return written;
+}
+
+}  // namespace db
+}  // namespace dataprovider
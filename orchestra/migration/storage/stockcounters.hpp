@@ -0,0 +1,171 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_STOCKCOUNTERS_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_STOCKCOUNTERS_HPP_
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "table.hpp"
+
+namespace dataprovider {
+namespace db {
+
+// storageengine.hpp
+class StorageEngine;
+
+/*!
+ * A change to the stock of a product, e.g. -2 for two items sold
+*/
+struct StockChange {
+    std::string barcode;
+    int64_t quantity;
+};
+
+/*!
+ * The stock on hand of the products, as atomic counters by barcode
+ *
+ * take() and add() change the stock of a product with one atomic operation and without a
+ * table lock, so the registers can sell the same (hot) items side by side; take() never lets
+ * the stock go below zero. The counters are found without a lock too: they are never freed,
+ * and a bigger hash table replaces the full one.
+ * A counter starts from the stock of its product row the first time the barcode is used.
+ * StorageEngine::commit() logs what the counters that its thread changed moved since they were
+ * last logged (StorageEngine::logStock()), so a committed take() or add() is as durable as the
+ * commit; one logged change covers the changes of every thread made so far. flush() logs the
+ * changes that are not committed as well, then adds the logged changes to the product rows
+ * (StorageEngine::foldStock()); StorageEngine::commit() calls it every stock_flush_ms (see
+ * psdb.cfg). An engine that does not log them has its rows written instead.
+ * Write the product rows with write(), so that their counters follow the new stock.
+ * e.g. if (!STORAGE().stock().take(barcode, quantity)) { ... not enough stock ... }
+*/
+class StockCounters {
+ public:
+    StockCounters(StorageEngine* engine, unsigned flushIntervalMs);
+    ~StockCounters();
+
+    /*!
+     * Takes [quantity] from the stock of the product
+     * Returns false, and takes nothing, if the product is not found or has less in stock
+    */
+    bool take(const std::string& barcode, int64_t quantity);
+    /*!
+     * Puts [quantity] back into the stock of the product, e.g. a returned item
+     * Returns false, and adds nothing, if the product is not found or [quantity] is negative
+    */
+    bool add(const std::string& barcode, int64_t quantity);
+    /*!
+     * Copies the stock of the product into [out] if it has a counter
+     * Returns false if it has none; then the stock of its row is current.
+    */
+    bool read(const std::string& barcode, int64_t* out) const;
+    /*!
+     * Updates the product row and starts its counter again from the stock of [row]
+     * Returns false if the product is not found
+    */
+    bool write(const ProductTableItem& row);
+    /*!
+     * Drops the counter of the product, e.g. once the product is removed or inserted again
+    */
+    void forget(const std::string& barcode);
+    /*!
+     * Logs the changes of every counter and adds the logged changes to their product rows
+     * Returns the number of rows written
+    */
+    size_t flush();
+    /*!
+     * Logs the changes of the counters that the calling thread changed, unless another thread
+     * logged them since
+     * Returns the number of rows written, if the engine does not log them
+    */
+    size_t flushOwn();
+    /*!
+     * Calls flush() if the flush interval has passed and no other thread is flushing
+    */
+    void flushIfDue();
+
+ private:
+    // a counter that is not read from its row yet
+    static constexpr int64_t UNKNOWN = std::numeric_limits<int64_t>::min();
+
+    struct Counter {
+        explicit Counter(const std::string& key) : barcode(key) {}
+        const std::string barcode;
+        std::atomic<int64_t> stock { UNKNOWN };
+        // the stock when it was last logged; guarded by mLogMutex
+        int64_t logged = UNKNOWN;
+    };
+
+    /*!
+     * Open-addressing hash table of the counters; at most half full
+    */
+    struct Slots {
+        explicit Slots(size_t capacity)
+            : counters(new std::atomic<Counter*>[capacity]()), mask(capacity - 1) {}
+        const std::unique_ptr<std::atomic<Counter*>[]> counters;
+        const size_t mask;
+    };
+
+    StorageEngine* const mEngine;
+    // tells the counters apart in the changes of each thread, see flushOwn()
+    const uint64_t mId;
+    const int64_t mFlushIntervalMs;
+    std::atomic<Slots*> mSlots;
+    // adding counters, one at a time
+    std::mutex mAddMutex;
+    std::vector<std::unique_ptr<Counter>> mCounters;
+    // every hash table so far; the last one is mSlots
+    std::vector<std::unique_ptr<Slots>> mSlotTables;
+    // logging the changes, and loading and writing the counters, one at a time; taken after
+    // the product table lock, see write()
+    std::mutex mLogMutex;
+    std::atomic<int64_t> mLastFlushMs;
+
+    Counter* find(const std::string& barcode) const;
+    Counter* findOrAdd(const std::string& barcode);
+    /*!
+     * The stock of the counter, read from its row if it is not known yet
+     * Returns UNKNOWN if the product is not found
+    */
+    int64_t load(Counter* counter);
+    /*!
+     * Keeps the changed counter for flushOwn()
+    */
+    void changed(Counter* counter);
+    /*!
+     * The counters that the calling thread changed; [isDropped] drops them
+    */
+    std::vector<Counter*>* ownChanges(bool isDropped = false);
+    std::vector<Counter*> allCounters();
+    /*!
+     * Logs what the counters moved since they were last logged, or adds it to their rows if
+     * the engine does not log it
+     * Returns the number of rows written
+    */
+    size_t logChanges(const std::vector<Counter*>& counters);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_STOCKCOUNTERS_HPP_
@@ -0,0 +1,381 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_STORAGEENGINE_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_STORAGEENGINE_HPP_
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "query.hpp"
+#include "stockcounters.hpp"
+#include "table.hpp"
+
+#define STORAGE() dataprovider::db::StorageEngine::current()
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * Forward-only iteration over the rows of a table
+ * A cursor reads one consistent version of the table; writes made while it is open are not
+ * seen, and they do not invalidate it.
+ * e.g. const auto cursor = STORAGE().products().scan();
+ *      for (ProductTableItem row; cursor->next(&row);) { ... }
+*/
+template <typename Row>
+class Cursor {
+ public:
+    virtual ~Cursor() = default;
+    /*!
+     * Copies the next row into [out]
+     * Returns false at the end
+    */
+    virtual bool next(Row* out) = 0;
+};
+
+/*!
+ * Cursor over rows that are already copied, e.g. a lookup result
+*/
+template <typename Row>
+class VectorCursor : public Cursor<Row> {
+ public:
+    explicit VectorCursor(std::vector<Row> rows) : mRows(std::move(rows)) {}
+
+    bool next(Row* out) override {
+        if (mPos >= mRows.size()) {
+            return false;
+        }
+        *out = std::move(mRows[mPos++]);
+        return true;
+    }
+
+ private:
+    std::vector<Row> mRows;
+    size_t mPos = 0;
+};
+
+/*!
+ * Filters and projects the rows of another cursor; see Selection
+*/
+template <typename Row>
+class SelectCursor : public Cursor<Row> {
+ public:
+    SelectCursor(std::unique_ptr<Cursor<Row>> rows, Selection<Row> selection)
+        : mRows(std::move(rows)), mSelection(std::move(selection)) {}
+
+    bool next(Row* out) override {
+        for (Row row; mRows->next(&row);) {
+            if (mSelection.matches(row)) {
+                mSelection.project(row, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    const std::unique_ptr<Cursor<Row>> mRows;
+    const Selection<Row> mSelection;
+};
+
+/*!
+ * Reads several cursors one after the other, e.g. the shards of a table
+*/
+template <typename Row>
+class ChainCursor : public Cursor<Row> {
+ public:
+    explicit ChainCursor(std::vector<std::unique_ptr<Cursor<Row>>> parts)
+        : mParts(std::move(parts)) {}
+
+    bool next(Row* out) override {
+        for (; mPos < mParts.size(); ++mPos) {
+            if (mParts[mPos]->next(out)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+ private:
+    const std::vector<std::unique_ptr<Cursor<Row>>> mParts;
+    size_t mPos = 0;
+};
+
+/*!
+ * Merges cursors that are each in [less] order into one cursor in that order
+ * e.g. the time ranges of the sales shards into one time range
+*/
+template <typename Row>
+class MergeCursor : public Cursor<Row> {
+ public:
+    typedef std::function<bool(const Row&, const Row&)> Less;
+
+    MergeCursor(std::vector<std::unique_ptr<Cursor<Row>>> parts, Less less)
+        : mParts(std::move(parts)), mHeads(mParts.size()), mLess(std::move(less)) {
+        for (size_t i = 0; i < mParts.size(); ++i) {
+            if (mParts[i]->next(&mHeads[i])) {
+                mHeap.push_back(i);
+            }
+        }
+        std::make_heap(mHeap.begin(), mHeap.end(), heapOrder());
+    }
+
+    bool next(Row* out) override {
+        if (mHeap.empty()) {
+            return false;
+        }
+        std::pop_heap(mHeap.begin(), mHeap.end(), heapOrder());
+        const size_t part = mHeap.back();
+        std::swap(*out, mHeads[part]);
+        if (mParts[part]->next(&mHeads[part])) {
+            std::push_heap(mHeap.begin(), mHeap.end(), heapOrder());
+        } else {
+            mHeap.pop_back();
+        }
+        return true;
+    }
+
+ private:
+    const std::vector<std::unique_ptr<Cursor<Row>>> mParts;
+    // the next row of every part
+    std::vector<Row> mHeads;
+    // the parts that have rows left, as a min-heap of their heads
+    std::vector<size_t> mHeap;
+    const Less mLess;
+
+    inline auto heapOrder() const {
+        return [this](size_t left, size_t right) { return mLess(mHeads[right], mHeads[left]); };
+    }
+};
+
+/*!
+ * Typed access to one table of a storage engine
+ *
+ * The [key] of get/update/remove is the primary key of the table. The detail tables have no
+ * primary key (address, contacts, personal IDs, sale items); their key is the ID of the row
+ * they belong to, and get/update work on the first row of that ID.
+ * scanOf/removeOf use the secondary key: the employee ID of a user, the person ID of a
+ * detail row, the sale ID of a sale item. Tables without one match the key instead.
+*/
+template <typename RowType>
+class TableEngine {
+ public:
+    typedef RowType Row;
+    typedef std::function<bool(const Row&)> Predicate;
+
+    virtual ~TableEngine() = default;
+
+    /*!
+     * Copies the row with the key into [out]; [out] can be null to only check for it
+     * Returns false if the key is not found
+    */
+    virtual bool get(const std::string& key, Row* out) const = 0;
+    /*!
+     * All rows, in the order of the engine
+    */
+    virtual std::unique_ptr<Cursor<Row>> scan() const = 0;
+    /*!
+     * The rows with the secondary key
+    */
+    virtual std::unique_ptr<Cursor<Row>> scanOf(const std::string& key) const = 0;
+    /*!
+     * The rows that pass the conditions, with the selected fields; see Query
+     * By default the rows are scanned and filtered as they are copied out. The engines that
+     * can test their stored rows in place override it.
+    */
+    virtual std::unique_ptr<Cursor<Row>> select(const Selection<Row>& selection) const {
+        return std::unique_ptr<Cursor<Row>>(new SelectCursor<Row>(scan(), selection));
+    }
+    /*!
+     * One page of the rows; see PageQuery
+     * By default every row is scanned and the page ones are kept. The engines override it to
+     * only read the sort and key fields of the rows that do not make the page.
+    */
+    virtual RowPage<Row> page(const PageQuery<Row>& query) const {
+        PageWindow<Row> window(query.token, query.size);
+        const std::unique_ptr<Cursor<Row>> rows = scan();
+        for (Row row; rows->next(&row);) {
+            if (window.accepts(query.sortValue(row), row.*query.key)) {
+                window.offer(query.sortValue(row), row.*query.key, row);
+            }
+        }
+        RowPage<Row> page;
+        page.rows = window.take(&page.nextToken);
+        return page;
+    }
+    /*!
+     * Returns false if the primary key exists already
+    */
+    virtual bool insert(const Row& row) = 0;
+    /*!
+     * Inserts the rows, e.g. a bulk import; returns how many were inserted
+     * A row whose primary key exists already is skipped and its position in [rows] is added
+     * to [duplicates]. By default the rows are inserted one at a time.
+    */
+    virtual size_t insertAll(const std::vector<Row>& rows,
+                             std::vector<size_t>* duplicates = nullptr) {
+        size_t inserted = 0;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (insert(rows[i])) {
+                ++inserted;
+            } else if (duplicates) {
+                duplicates->push_back(i);
+            }
+        }
+        return inserted;
+    }
+    /*!
+     * Replaces the row with the same key; returns false if it is not found
+    */
+    virtual bool update(const Row& row) = 0;
+    /*!
+     * Removes the row(s) with the key; returns the number of removed rows
+    */
+    virtual size_t remove(const std::string& key) = 0;
+    /*!
+     * Removes the rows with the secondary key; returns the number of removed rows
+    */
+    virtual size_t removeOf(const std::string& key) = 0;
+    /*!
+     * Removes the rows that satisfy the predicate; returns the number of removed rows
+    */
+    virtual size_t removeIf(const Predicate& predicate) = 0;
+    virtual size_t size() const = 0;
+    /*!
+     * Makes the writes so far durable, for tables that keep their own files
+     * Called by StorageEngine::commit(); the StackDB tables are committed with its log.
+    */
+    virtual bool flush() {
+        return true;
+    }
+};
+
+/*!
+ * The product table; also reads barcode ranges in order, e.g. for the inventory screen
+*/
+class ProductEngine : public TableEngine<ProductTableItem> {
+ public:
+    /*!
+     * The products with first <= barcode <= last, in barcode order; an empty [last] has no
+     * upper bound
+    */
+    virtual std::unique_ptr<Cursor<ProductTableItem>> scanRange(const std::string& first,
+                                                                const std::string& last) const = 0;
+};
+
+/*!
+ * The sales table; also reads the sales of a time range
+*/
+class SalesEngine : public TableEngine<SalesTableItem> {
+ public:
+    /*!
+     * The sales with first <= date-time <= last (seconds, see parseDateTime), in time order
+    */
+    virtual std::unique_ptr<Cursor<SalesTableItem>> scanTime(int64_t first,
+                                                             int64_t last) const = 0;
+};
+
+/*!
+ * The tables behind the data providers
+ *
+ * The data providers reach the tables through STORAGE(), so an engine can be replaced without
+ * touching them. StackDBEngine (the in-memory StackDB) is the default; another engine can
+ * derive from it and replace some of the tables only, e.g. to benchmark them side by side.
+ * db::Transaction and db::AutoCommit group and commit the writes to the StackDB tables;
+ * engines with their own tables flush them in commit().
+*/
+class StorageEngine {
+ public:
+    virtual ~StorageEngine() = default;
+
+    virtual TableEngine<EmployeeTableItem>& employees() = 0;
+    virtual TableEngine<UserTableItem>& users() = 0;
+    virtual TableEngine<AddressTableItem>& addresses() = 0;
+    virtual TableEngine<ContactDetailsTableItem>& contacts() = 0;
+    virtual TableEngine<PersonalIdTableItem>& personalIds() = 0;
+    virtual ProductEngine& products() = 0;
+    virtual TableEngine<CustomerTableItem>& customers() = 0;
+    virtual TableEngine<UOMTableItem>& uoms() = 0;
+    virtual TableEngine<CategoryTableItem>& categories() = 0;
+    virtual SalesEngine& sales() = 0;
+    virtual TableEngine<SalesItemTableItem>& salesItems() = 0;
+    /*!
+     * The stock of the products() as atomic counters, e.g. for the checkouts
+    */
+    virtual StockCounters& stock() = 0;
+    /*!
+     * Logs changes to the stock of the products() instead of writing their rows; the next
+     * commit() makes them durable, and foldStock() adds them to the rows
+     * Returns false, and logs nothing, if the engine does not log them; the stock counters
+     * write the rows then.
+    */
+    virtual bool logStock(const std::vector<StockChange>& changes) {
+        return false;
+    }
+    /*!
+     * Adds the logged stock changes to the product rows; returns the number of rows written
+    */
+    virtual size_t foldStock() {
+        return 0;
+    }
+    /*!
+     * Holds off the writes to the products(), e.g. while the stock counters write a row;
+     * an empty lock if they have no such lock
+    */
+    virtual std::unique_lock<std::recursive_mutex> lockProducts() {
+        return std::unique_lock<std::recursive_mutex>();
+    }
+    /*!
+     * Blocks until the writes so far are durable
+     * Also logs the stock changes of the calling thread, and flushes the stock counters when
+     * they are due.
+     * Returns false if some writes could not be made durable.
+    */
+    virtual bool commit() = 0;
+    /*!
+     * Returns true if every table is a StackDB table, so that DATABASE() and its files hold
+     * all the data, e.g. for a backup of them
+    */
+    virtual bool isInStackDB() const {
+        return false;
+    }
+
+    /*!
+     * The engine behind STORAGE(); unless another one was installed, a StackDBEngine with
+     * the product and sales tables that psdb.cfg selects (product_engine=stackdb, btree or
+     * sharded, sales_engine=stackdb, lsm or sharded)
+    */
+    static StorageEngine& current();
+    /*!
+     * Replaces the engine behind STORAGE()
+     * Call it before the data providers are used (e.g. at startup); the engine it replaces
+     * is destroyed. A null engine brings the configured one back.
+    */
+    static void install(std::unique_ptr<StorageEngine> engine);
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_STORAGEENGINE_HPP_
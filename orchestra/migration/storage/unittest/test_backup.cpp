@@ -0,0 +1,183 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// code under test
+#include <storage/checkpoint.hpp>
+#include <storage/columntable.hpp>
+#include <storage/productcolumns.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char BACKUP_FILE[] = "backup_test.ckpt";
+
+class TestBackup : public testing::Test {
+ public:
+    TestBackup() = default;
+    ~TestBackup() = default;
+    void SetUp() {}
+    void TearDown() {
+        std::remove(BACKUP_FILE);
+    }
+
+    static ProductTableItem productOf(int id) {
+        return ProductTableItem { "B" + std::to_string(id), "SKU", "name " + std::to_string(id),
+                                  "a description long enough to fill the image quickly", "cat",
+                                  "brand", "pc", std::to_string(id), "ACTIVE", "1.00", "2.00",
+                                  "supplier", "S1" };
+    }
+};
+
+TEST_F(TestBackup, ImageHasEveryTable) {
+    ASSERT_TRUE(DATABASE().backup(BACKUP_FILE));
+    const CheckpointImage image(BACKUP_FILE);
+    ASSERT_TRUE(image.isValid());
+    const CheckpointSection* customers = image.section(TableID::CUSTOMER);
+    ASSERT_NE(customers, nullptr);
+    EXPECT_EQ(customers->rowCount, DATABASE().SELECT_CUSTOMER_TABLE().size());
+
+    IndexedTable<CustomerTableItem> restored(&CustomerTableItem::customerID);
+    image.load(&restored);
+    for (const CustomerTableItem& customer : DATABASE().SELECT_CUSTOMER_TABLE()) {
+        CustomerTableItem found;
+        ASSERT_TRUE(restored.find(customer.customerID, &found));
+        EXPECT_EQ(found.lastname, customer.lastname);
+    }
+}
+
+TEST_F(TestBackup, LimitedRateIsKept) {
+    ColumnTable<ProductColumns> products;
+    for (int i = 0; i < 2000; ++i) {
+        products.insert(productOf(i));
+    }
+    constexpr size_t BYTES_PER_SECOND = 1024 * 1024;
+    const auto start = std::chrono::steady_clock::now();
+    CheckpointWriter writer(BACKUP_FILE, 0);
+    writer.limitRate(BYTES_PER_SECOND);
+    writer.write(products.snapshot());
+    ASSERT_TRUE(writer.commit());
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    std::FILE* file = std::fopen(BACKUP_FILE, "rb");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, 0, SEEK_END);
+    const long bytes = std::ftell(file);  // NOLINT(runtime/int)
+    std::fclose(file);
+    // Only the last partial step is not waited for
+    const auto expected = std::chrono::microseconds((bytes - 64 * 1024) * 1000000
+                                                    / BYTES_PER_SECOND);
+    EXPECT_GE(elapsed, expected);
+
+    const CheckpointImage image(BACKUP_FILE);
+    ASSERT_TRUE(image.isValid());
+    ColumnTable<ProductColumns> restored;
+    image.load(&restored);
+    ASSERT_EQ(restored.size(), products.size());
+    ProductTableItem found;
+    ASSERT_TRUE(restored.find("B1999", &found));
+    EXPECT_EQ(found.name, "name 1999");
+}
+
+TEST_F(TestBackup, CorruptedTableIsNotLoaded) {
+    constexpr char COPY_FILE[] = "backup_test_copy.ckpt";
+    ColumnTable<ProductColumns> products;
+    for (int i = 0; i < 100; ++i) {
+        products.insert(productOf(i));
+    }
+    {
+        CheckpointWriter writer(BACKUP_FILE, 0);
+        writer.write(products.snapshot());
+        ASSERT_TRUE(writer.commit());
+    }
+    uint64_t dataOffset = 0;
+    {
+        // A copied table keeps its checksum
+        const CheckpointImage image(BACKUP_FILE);
+        CheckpointWriter writer(COPY_FILE, 0);
+        writer.copy(image, TableID::PRODUCT);
+        ASSERT_TRUE(writer.commit());
+        const CheckpointImage copied(COPY_FILE);
+        ASSERT_TRUE(copied.isValid());
+        ColumnTable<ProductColumns> restored;
+        ASSERT_TRUE(copied.load(&restored));
+        EXPECT_EQ(restored.size(), products.size());
+        dataOffset = copied.section(TableID::PRODUCT)->dataOffset;
+    }
+    // One flipped byte in the rows; the directory is intact
+    std::FILE* file = std::fopen(COPY_FILE, "r+b");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, static_cast<long>(dataOffset + 10), SEEK_SET);  // NOLINT(runtime/int)
+    const int byte = std::fgetc(file);
+    std::fseek(file, static_cast<long>(dataOffset + 10), SEEK_SET);  // NOLINT(runtime/int)
+    std::fputc(byte ^ 0x01, file);
+    std::fclose(file);
+
+    {
+        const CheckpointImage image(COPY_FILE);
+        ASSERT_TRUE(image.isValid());
+        ColumnTable<ProductColumns> restored;
+        EXPECT_FALSE(image.load(&restored));
+        EXPECT_TRUE(restored.empty());
+    }
+    std::remove(COPY_FILE);
+}
+
+TEST_F(TestBackup, CheckpointDoesNotWaitForTheCopy) {
+    constexpr int PRODUCTS = 2000;
+    for (int i = 0; i < PRODUCTS; ++i) {
+        ASSERT_TRUE(DATABASE().SELECT_PRODUCT_TABLE().insert(productOf(i)));
+    }
+    DATABASE().commit();
+    // Over a second at this rate
+    std::atomic<bool> isCopied { false };
+    std::thread backup([&isCopied]() {
+        EXPECT_TRUE(DATABASE().backup(BACKUP_FILE, 256 * 1024));
+        isCopied = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_TRUE(DATABASE().checkpoint());
+    EXPECT_FALSE(isCopied.load());
+    backup.join();
+
+    const CheckpointImage image(BACKUP_FILE);
+    ASSERT_TRUE(image.isValid());
+    ColumnTable<ProductColumns> restored;
+    image.load(&restored);
+    EXPECT_TRUE(restored.find("B1999", nullptr));
+    DATABASE().SELECT_PRODUCT_TABLE().eraseIf([](const ProductTableItem& row) {
+        return (row.barcode[0] == 'B')
+            && (row.barcode.find_first_not_of("0123456789", 1) == std::string::npos);
+    });
+    DATABASE().commit();
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,250 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/btree.hpp>
+#include <storage/btreeproducts.hpp>
+#include <storage/bufferpool.hpp>
+#include <storage/pagefile.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char TREE_PATH[] = "test_btree.db";
+constexpr char JOURNAL_PATH[] = "test_btree.db-journal";
+
+std::string keyOf(int i) {
+    char key[16];
+    std::snprintf(key, sizeof(key), "K%07d", i);
+    return key;
+}
+
+class TestBTree : public testing::Test {
+ public:
+    TestBTree() = default;
+    ~TestBTree() = default;
+    void SetUp() {
+        std::remove(TREE_PATH);
+        std::remove(JOURNAL_PATH);
+    }
+    void TearDown() {
+        std::remove(TREE_PATH);
+        std::remove(JOURNAL_PATH);
+    }
+};
+
+TEST_F(TestBTree, BufferPoolEvictsTheLeastRecentlyUsedPage) {
+    PageFile file(TREE_PATH);
+    BufferPool pool(&file, 2);
+    PageID first = 0;
+    PageID second = 0;
+    {
+        BufferPool::Page page = pool.create();
+        first = page.id();
+        page.mutableData()[0] = 'a';
+    }
+    {
+        BufferPool::Page page = pool.create();
+        second = page.id();
+        page.mutableData()[0] = 'b';
+    }
+    // Touch the first page, so the second one is evicted for the third
+    EXPECT_EQ(pool.fetch(first).data()[0], 'a');
+    pool.create().mutableData()[0] = 'c';
+    EXPECT_EQ(pool.evictions(), 1U);
+    const size_t misses = pool.misses();
+    EXPECT_EQ(pool.fetch(first).data()[0], 'a');
+    EXPECT_EQ(pool.misses(), misses);
+    // Written back when evicted, read back from the file
+    EXPECT_EQ(pool.fetch(second).data()[0], 'b');
+    EXPECT_EQ(pool.misses(), misses + 1);
+}
+
+TEST_F(TestBTree, BufferPoolRefusesWhenAllPagesArePinned) {
+    PageFile file(TREE_PATH);
+    BufferPool pool(&file, 2);
+    const BufferPool::Page first = pool.create();
+    const BufferPool::Page second = pool.create();
+    EXPECT_FALSE(pool.create().isValid());
+}
+
+TEST_F(TestBTree, PageFileRollsBackToItsLastSync) {
+    std::vector<char> page(PAGE_SIZE, 0);
+    {
+        PageFile file(TREE_PATH);
+        page[0] = 'a';
+        ASSERT_TRUE(file.write(file.allocate(), page.data()));
+        page[0] = 'b';
+        ASSERT_TRUE(file.write(file.allocate(), page.data()));
+        ASSERT_TRUE(file.sync());
+        // Half of a change: page 0 written over and a page added, then closed without sync()
+        page[0] = 'x';
+        ASSERT_TRUE(file.write(0, page.data()));
+        page[0] = 'c';
+        ASSERT_TRUE(file.write(file.allocate(), page.data()));
+    }
+    PageFile file(TREE_PATH);
+    ASSERT_TRUE(file.read(0, page.data()));
+    EXPECT_EQ(page[0], 'a');
+    ASSERT_TRUE(file.read(1, page.data()));
+    EXPECT_EQ(page[0], 'b');
+    EXPECT_FALSE(file.read(2, page.data()));
+    EXPECT_EQ(file.allocate(), 2U);
+}
+
+TEST_F(TestBTree, KeepsKeysInOrderAcrossSplitsAndReopen) {
+    const int count = 5000;
+    {
+        // A small pool, so most pages are written out and read back
+        BTree tree(TREE_PATH, 8);
+        ASSERT_TRUE(tree.isOpen());
+        // Insert out of order
+        for (int i = 0; i < count; ++i) {
+            const int key = (i * 7919) % count;
+            ASSERT_TRUE(tree.insert(keyOf(key), "value " + std::to_string(key)));
+        }
+        EXPECT_FALSE(tree.insert(keyOf(42), "again"));
+        EXPECT_FALSE(tree.insert("big", std::string(BTree::MAX_ENTRY_SIZE, 'x')));
+        EXPECT_EQ(tree.size(), static_cast<size_t>(count));
+        EXPECT_GT(tree.pageReads(), 0U);
+    }
+    BTree tree(TREE_PATH, 8);
+    ASSERT_TRUE(tree.isOpen());
+    EXPECT_EQ(tree.size(), static_cast<size_t>(count));
+    std::string value;
+    ASSERT_TRUE(tree.find(keyOf(1234), &value));
+    EXPECT_EQ(value, "value 1234");
+    EXPECT_FALSE(tree.find("K", nullptr));
+
+    BTree::Cursor cursor = tree.seek(keyOf(100));
+    std::string key;
+    for (int i = 100; i < count; ++i) {
+        ASSERT_TRUE(cursor.next(&key, &value));
+        ASSERT_EQ(key, keyOf(i));
+    }
+    EXPECT_FALSE(cursor.next(&key, &value));
+}
+
+TEST_F(TestBTree, UpdatesAndErases) {
+    BTree tree(TREE_PATH, 16);
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(tree.insert(keyOf(i), "v"));
+    }
+    // Growing values split the leaves again
+    for (int i = 0; i < 1000; i += 2) {
+        ASSERT_TRUE(tree.update(keyOf(i), std::string(200, 'u')));
+    }
+    EXPECT_FALSE(tree.update("missing", "v"));
+    for (int i = 0; i < 1000; i += 3) {
+        ASSERT_TRUE(tree.erase(keyOf(i)));
+    }
+    EXPECT_FALSE(tree.erase(keyOf(0)));
+
+    size_t seen = 0;
+    BTree::Cursor cursor = tree.seek("");
+    std::string key;
+    std::string value;
+    std::string previous;
+    while (cursor.next(&key, &value)) {
+        EXPECT_LT(previous, key);
+        const int i = std::stoi(key.substr(1));
+        EXPECT_NE(i % 3, 0);
+        EXPECT_EQ(value.size(), (i % 2 == 0) ? 200U : 1U);
+        previous = key;
+        ++seen;
+    }
+    EXPECT_EQ(seen, tree.size());
+    EXPECT_EQ(seen, 1000U - 334U);
+}
+
+TEST_F(TestBTree, CursorSeesWritesAheadOfIt) {
+    BTree tree(TREE_PATH, 16);
+    for (int i = 0; i < 2000; i += 2) {
+        ASSERT_TRUE(tree.insert(keyOf(i), "v"));
+    }
+    BTree::Cursor cursor = tree.seek("");
+    std::string key;
+    std::string value;
+    ASSERT_TRUE(cursor.next(&key, &value));
+    // Splits the leaves ahead of the cursor; no key is skipped or returned twice
+    for (int i = 1; i < 2000; i += 2) {
+        ASSERT_TRUE(tree.insert(keyOf(i), std::string(100, 'n')));
+    }
+    std::string previous = key;
+    int even = 1;
+    while (cursor.next(&key, &value)) {
+        ASSERT_LT(previous, key);
+        const int i = std::stoi(key.substr(1));
+        if (i % 2 == 0) {
+            ++even;
+        }
+        previous = key;
+    }
+    EXPECT_EQ(even, 1000);
+    // The leaves after the first one are read after the inserts
+    EXPECT_EQ(previous, keyOf(1999));
+}
+
+TEST_F(TestBTree, ProductEngineRoundTrip) {
+    BTreeProductEngine products(TREE_PATH, 16);
+    ASSERT_TRUE(products.isOpen());
+    for (int i = 0; i < 300; ++i) {
+        ASSERT_TRUE(products.insert(ProductTableItem { keyOf(i), "SKU", "Product, large",
+                                                       "", "Grocery", "Brand", "pc",
+                                                       std::to_string(i), "ACTIVE", "1.00",
+                                                       "2.00", "Supplier", "S1" }));
+    }
+    ProductTableItem product;
+    ASSERT_TRUE(products.get(keyOf(7), &product));
+    EXPECT_EQ(product.name, "Product, large");
+    EXPECT_EQ(product.stock, "7");
+    EXPECT_EQ(product.supplier_code, "S1");
+
+    product.stock = "70";
+    EXPECT_TRUE(products.update(product));
+    ASSERT_TRUE(products.get(keyOf(7), &product));
+    EXPECT_EQ(product.stock, "70");
+
+    const auto range = products.scanRange(keyOf(10), keyOf(19));
+    std::vector<std::string> barcodes;
+    for (ProductTableItem row; range->next(&row);) {
+        barcodes.push_back(row.barcode);
+    }
+    ASSERT_EQ(barcodes.size(), 10U);
+    EXPECT_EQ(barcodes.front(), keyOf(10));
+    EXPECT_EQ(barcodes.back(), keyOf(19));
+
+    EXPECT_EQ(products.removeIf([](const ProductTableItem& row) {
+        return std::stoi(row.stock) >= 100;
+    }), 200U);
+    EXPECT_EQ(products.size(), 100U);
+    EXPECT_TRUE(products.flush());
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
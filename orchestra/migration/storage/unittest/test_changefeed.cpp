@@ -0,0 +1,145 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// code under test
+#include <storage/changefeed.hpp>
+#include <storage/stackdb.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char FEED_CUSTOMER_ID[] = "CDC-CUSTOMER";
+
+class TestChangeFeed : public testing::Test {
+ public:
+    TestChangeFeed() = default;
+    ~TestChangeFeed() = default;
+    void SetUp() {}
+    void TearDown() {
+        DATABASE().SELECT_CUSTOMER_TABLE().erase(FEED_CUSTOMER_ID);
+        DATABASE().SELECT_ADDRESS_TABLE().eraseAllOf(FEED_CUSTOMER_ID);
+    }
+
+    static CustomerTableItem customerOf(const std::string& lastname) {
+        return CustomerTableItem { FEED_CUSTOMER_ID, "first", "", lastname, "2000-01-01", "F" };
+    }
+
+    static LogRecord recordOf(TableID table) {
+        return LogRecord { 0, table, Mutation::INSERT, {}, { "row" } };
+    }
+};
+
+TEST_F(TestChangeFeed, StreamsTheMutationsInOrder) {
+    const auto subscription = DATABASE().changes().subscribe({ TableID::CUSTOMER });
+    IndexedTable<CustomerTableItem>& customers = DATABASE().SELECT_CUSTOMER_TABLE();
+    ASSERT_TRUE(customers.insert(customerOf("one")));
+    ASSERT_TRUE(customers.update(customerOf("two")));
+    // Not subscribed
+    DATABASE().SELECT_ADDRESS_TABLE().insert(AddressTableItem {
+        FEED_CUSTOMER_ID, "line 1", "", "city", "province", "6000" });
+    ASSERT_TRUE(customers.erase(FEED_CUSTOMER_ID));
+
+    std::vector<ChangeEvent> events;
+    ASSERT_TRUE(subscription->poll(&events, 10));
+    ASSERT_EQ(events.size(), 3U);
+    EXPECT_EQ(events[0].operation, Mutation::INSERT);
+    EXPECT_EQ(RowCodec<CustomerTableItem>::decode(events[0].after).lastname, "one");
+    EXPECT_EQ(events[1].operation, Mutation::UPDATE);
+    EXPECT_EQ(RowCodec<CustomerTableItem>::decode(events[1].before).lastname, "one");
+    EXPECT_EQ(RowCodec<CustomerTableItem>::decode(events[1].after).lastname, "two");
+    EXPECT_EQ(events[2].operation, Mutation::ERASE);
+    EXPECT_TRUE(events[2].after.empty());
+    EXPECT_LT(events[0].sequence, events[1].sequence);
+    // The address event was skipped
+    EXPECT_EQ(events[2].sequence, events[1].sequence + 2);
+    EXPECT_EQ(subscription->position(), events[2].sequence);
+
+    events.clear();
+    ASSERT_TRUE(subscription->poll(&events, 10));
+    EXPECT_TRUE(events.empty());
+}
+
+TEST_F(TestChangeFeed, TransactionsAppearWhenTheyEnd) {
+    const auto subscription = DATABASE().changes().subscribe();
+    std::vector<ChangeEvent> events;
+    {
+        Transaction transaction;
+        DATABASE().SELECT_CUSTOMER_TABLE().insert(customerOf("rolled back"));
+        transaction.rollback();
+    }
+    {
+        const Transaction transaction;
+        DATABASE().SELECT_CUSTOMER_TABLE().insert(customerOf("committed"));
+        DATABASE().SELECT_ADDRESS_TABLE().insert(AddressTableItem {
+            FEED_CUSTOMER_ID, "line 1", "", "city", "province", "6000" });
+        ASSERT_TRUE(subscription->poll(&events, 10));
+        EXPECT_TRUE(events.empty());
+    }
+    ASSERT_TRUE(subscription->poll(&events, 10));
+    ASSERT_EQ(events.size(), 2U);
+    EXPECT_EQ(events[0].table, TableID::CUSTOMER);
+    EXPECT_EQ(RowCodec<CustomerTableItem>::decode(events[0].after).lastname, "committed");
+    EXPECT_EQ(events[1].table, TableID::ADDRESS);
+}
+
+TEST_F(TestChangeFeed, SlowSubscribersGetAGap) {
+    size_t activityChanges = 0;
+    ChangeFeed feed(2, [&activityChanges]() { ++activityChanges; });
+    // Nothing is kept without subscribers
+    feed.publish(recordOf(TableID::PRODUCT));
+    EXPECT_EQ(feed.lastSequence(), 0U);
+    {
+        const auto subscription = feed.subscribe();
+        EXPECT_TRUE(feed.isActive());
+        for (int i = 0; i < 3; ++i) {
+            feed.publish(recordOf(TableID::PRODUCT));
+        }
+        std::vector<ChangeEvent> events;
+        // The first event was dropped
+        EXPECT_FALSE(subscription->poll(&events, 10));
+        EXPECT_TRUE(events.empty());
+        EXPECT_EQ(subscription->position(), 3U);
+
+        // A poll waits for the next event
+        std::thread writer([&feed]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            feed.publish(recordOf(TableID::SALES));
+        });
+        EXPECT_TRUE(subscription->poll(&events, 10, std::chrono::milliseconds(5000)));
+        writer.join();
+        ASSERT_EQ(events.size(), 1U);
+        EXPECT_EQ(events[0].sequence, 4U);
+        EXPECT_EQ(events[0].table, TableID::SALES);
+    }
+    EXPECT_FALSE(feed.isActive());
+    EXPECT_EQ(activityChanges, 2U);
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
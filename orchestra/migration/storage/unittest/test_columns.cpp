@@ -0,0 +1,250 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/columntable.hpp>
+#include <storage/employeecolumns.hpp>
+#include <storage/indexedtable.hpp>
+#include <storage/productcolumns.hpp>
+#include <storage/salescolumns.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+class TestColumns : public testing::Test {
+ public:
+    TestColumns() = default;
+    ~TestColumns() = default;
+    void SetUp() {
+        const std::vector<std::string> categories { "Drinks", "Snacks", "Drinks", "Frozen" };
+        for (size_t i = 0; i < categories.size(); ++i) {
+            products.insert(ProductTableItem { "B" + std::to_string(i), "SKU", "name", "desc",
+                                               categories[i], "brand", "pc", "10", "ACTIVE",
+                                               "1.00", "2.00", "supplier", "S1" });
+        }
+    }
+    void TearDown() {}
+
+    ColumnTable<ProductColumns> products;
+};
+
+TEST_F(TestColumns, RowsAreRebuiltFromTheDictionaries) {
+    ProductTableItem found;
+    ASSERT_TRUE(products.find("B2", &found));
+    EXPECT_EQ(found.category, "Drinks");
+    EXPECT_EQ(found.brand, "brand");
+    EXPECT_EQ(found.uom, "pc");
+    EXPECT_EQ(found.status, "ACTIVE");
+    EXPECT_EQ(found.supplier_name, "supplier");
+    EXPECT_EQ(found.supplier_code, "S1");
+
+    // Each distinct value is stored once
+    const auto snapshot = products.snapshot();
+    EXPECT_EQ(snapshot.columns().categories.size(), 3);
+    EXPECT_EQ(snapshot.columns().statuses.size(), 1);
+}
+
+TEST_F(TestColumns, FilterMatchesCodes) {
+    const auto snapshot = products.snapshot();
+    const ProductColumns& columns = snapshot.columns();
+    std::vector<std::string> drinks;
+    forEachEqual(columns.categories, columns.category, "Drinks", [&columns, &drinks](size_t pos) {
+        drinks.push_back(columns.barcode[pos]);
+    });
+    EXPECT_EQ(drinks, std::vector<std::string>({ "B0", "B2" }));
+
+    size_t unknown = 0;
+    forEachEqual(columns.categories, columns.category, "Toys", [&unknown](size_t) { ++unknown; });
+    EXPECT_EQ(unknown, 0);
+}
+
+TEST_F(TestColumns, UpdateReencodesTheRow) {
+    ProductTableItem product;
+    ASSERT_TRUE(products.find("B1", &product));
+    product.category = "Toys";
+    product.status = "INACTIVE";
+    ASSERT_TRUE(products.update(product));
+
+    ProductTableItem found;
+    ASSERT_TRUE(products.find("B1", &found));
+    EXPECT_EQ(found.category, "Toys");
+    EXPECT_EQ(found.status, "INACTIVE");
+}
+
+TEST_F(TestColumns, EraseKeepsTheOrderAndTheIndex) {
+    ASSERT_TRUE(products.erase("B1"));
+    EXPECT_FALSE(products.erase("B1"));
+    EXPECT_FALSE(products.contains("B1"));
+
+    std::vector<std::string> barcodes;
+    for (const ProductTableItem& product : products) {
+        barcodes.push_back(product.barcode);
+    }
+    EXPECT_EQ(barcodes, std::vector<std::string>({ "B0", "B2", "B3" }));
+    ProductTableItem found;
+    ASSERT_TRUE(products.find("B3", &found));
+    EXPECT_EQ(found.category, "Frozen");
+}
+
+TEST_F(TestColumns, ReadReusesTheRowStrings) {
+    const std::string description(64, 'd');
+    products.update(ProductTableItem { "B0", "SKU", "name", description, "Drinks", "brand", "pc",
+                                       "10", "ACTIVE", "1.00", "2.00", "supplier", "S1" });
+    products.update(ProductTableItem { "B2", "SKU", "name", description, "Drinks", "brand", "pc",
+                                       "10", "ACTIVE", "1.00", "2.00", "supplier", "S1" });
+    const auto snapshot = products.snapshot();
+    auto it = snapshot.begin();
+    ProductTableItem row;
+    it.read(&row);
+    const char* buffer = row.description.data();
+    ++it;
+    it.read(&row);
+    ++it;
+    it.read(&row);
+    EXPECT_EQ(row.barcode, "B2");
+    EXPECT_EQ(row.description, description);
+    // Read into the same allocation
+    EXPECT_EQ(row.description.data(), buffer);
+}
+
+TEST(TestIndexedTable, BulkRowsShareOneBlock) {
+    IndexedTable<CustomerTableItem> customers(&CustomerTableItem::customerID);
+    std::vector<CustomerTableItem> rows;
+    for (int i = 0; i < 4; ++i) {
+        rows.push_back(CustomerTableItem { "C" + std::to_string(i), "first", "", "last",
+                                           "2000/01/01", "F" });
+    }
+    customers.assign(rows);
+    ASSERT_EQ(customers.size(), 4);
+    std::vector<const CustomerTableItem*> addresses;
+    for (auto it = customers.begin(); it != customers.end(); ++it) {
+        addresses.push_back(&*it);
+    }
+    for (size_t i = 1; i < addresses.size(); ++i) {
+        EXPECT_EQ(addresses[i], addresses[0] + i);
+    }
+    // The rest of the block outlives an erased row
+    ASSERT_TRUE(customers.erase("C1"));
+    CustomerTableItem found;
+    ASSERT_TRUE(customers.find("C3", &found));
+    EXPECT_EQ(found.customerID, "C3");
+
+    rows[0].customerID = "C4";
+    rows[1].customerID = "C5";
+    EXPECT_EQ(customers.insertAll(rows), 2);
+    ASSERT_TRUE(customers.find("C5", &found));
+    EXPECT_EQ(customers.size(), 5);
+}
+
+TEST(TestEmployeeColumns, RoundTrip) {
+    ColumnTable<EmployeeColumns> employees;
+    employees.insert(EmployeeTableItem { "E1", "first", "middle", "last", "2000/01/01", "F",
+                                         "Cashier", "ACTIVE", true });
+    employees.insert(EmployeeTableItem { "E2", "first", "middle", "last", "2000/01/01", "M",
+                                         "Cashier", "ON-LEAVE", false });
+    EmployeeTableItem found;
+    ASSERT_TRUE(employees.find("E1", &found));
+    EXPECT_EQ(found.gender, "F");
+    EXPECT_EQ(found.position, "Cashier");
+    EXPECT_EQ(found.status, "ACTIVE");
+    EXPECT_TRUE(found.isSystemUser);
+    ASSERT_TRUE(employees.find("E2", &found));
+    EXPECT_FALSE(found.isSystemUser);
+    EXPECT_EQ(employees.snapshot().columns().positions.size(), 1);
+}
+
+TEST(TestSalesItemColumns, InterleavedSalesAppendInPlace) {
+    ColumnTable<SalesItemColumns> items;
+    // Two registers writing their sales line by line
+    for (int line = 0; line < 3; ++line) {
+        for (const char* sale : { "S1", "S2" }) {
+            items.insert(SalesItemTableItem { sale, "P" + std::to_string(line), "name", "1.00",
+                                              "1", "1.00" });
+        }
+    }
+    const auto snapshot = items.snapshot();
+    const SalesItemColumns& columns = snapshot.columns();
+    EXPECT_EQ(columns.findSale("S1"), std::vector<size_t>({ 0, 2, 4 }));
+    EXPECT_EQ(columns.findSale("S2"), std::vector<size_t>({ 1, 3, 5 }));
+    EXPECT_EQ(columns.productID[3], "P1");
+    EXPECT_TRUE(columns.findSale("S3").empty());
+
+    // Compacting keeps the lists in step with the moved rows
+    EXPECT_EQ(items.eraseIf([](const SalesItemTableItem& item) {
+        return (item.saleID == "S1") && (item.productID == "P0");
+    }), 1U);
+    items.compact();
+    const auto compactedSnapshot = items.snapshot();
+    const SalesItemColumns& compacted = compactedSnapshot.columns();
+    EXPECT_EQ(compacted.findSale("S1"), std::vector<size_t>({ 1, 3 }));
+    EXPECT_EQ(compacted.findSale("S2"), std::vector<size_t>({ 0, 2, 4 }));
+    EXPECT_EQ(compacted.productID[3], "P2");
+}
+
+TEST(TestSalesColumns, AmountsAreReadExactly) {
+    int64_t cents = 0;
+    ASSERT_TRUE(parseCents("1,234.50", &cents));
+    EXPECT_EQ(cents, 123450);
+    ASSERT_TRUE(parseCents("-1,000,000", &cents));
+    EXPECT_EQ(cents, -100000000);
+    ASSERT_TRUE(parseCents("0.295", &cents));
+    EXPECT_EQ(cents, 30);
+    ASSERT_TRUE(parseCents("", &cents));
+    EXPECT_EQ(cents, 0);
+    EXPECT_FALSE(parseCents("1,23.50", &cents));
+    EXPECT_FALSE(parseCents(",123", &cents));
+    EXPECT_FALSE(parseCents("12a", &cents));
+    EXPECT_FALSE(parseCents("99999999999999999999", &cents));
+    EXPECT_EQ(parseCents("99999999999999999999"), 0);
+}
+
+TEST(TestSalesColumns, UnreadableRowsAreNotStored) {
+    ColumnTable<SalesColumns> sales;
+    const SalesTableItem sale { "S1", "2021-05-01 09:00:00", "1,234.50", "1.00", "0.12", "0",
+                                "1.00", "1.00", "Cash", "0", "C1", "CU1" };
+    ASSERT_TRUE(sales.insert(sale));
+    SalesTableItem badDate = sale;
+    badDate.ID = "S2";
+    badDate.date_time = "2021-13-01 09:00:00";
+    EXPECT_FALSE(sales.insert(badDate));
+    SalesTableItem badAmount = sale;
+    badAmount.total = "1.2.3";
+    EXPECT_FALSE(sales.update(badAmount));
+    EXPECT_EQ(sales.insertAll({ badDate }), 0);
+    EXPECT_EQ(sales.size(), 1);
+    SalesTableItem found;
+    ASSERT_TRUE(sales.find("S1", &found));
+    EXPECT_EQ(found.subtotal, "1234.50");
+    EXPECT_EQ(found.total, "1.00");
+
+    ColumnTable<SalesItemColumns> items;
+    EXPECT_FALSE(items.insert(SalesItemTableItem { "S1", "P1", "name", "1.00", "one",
+                                                   "1.00" }));
+    EXPECT_TRUE(items.empty());
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
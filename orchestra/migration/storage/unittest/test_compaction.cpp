@@ -0,0 +1,171 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// code under test
+#include <storage/columntable.hpp>
+#include <storage/indexedtable.hpp>
+#include <storage/productcolumns.hpp>
+#include <storage/salescolumns.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+ProductTableItem productOf(int id) {
+    return ProductTableItem { "B" + std::to_string(id), "SKU", "name", "desc", "cat", "brand",
+                              "pc", std::to_string(id), "ACTIVE", "1.00", "2.00", "supplier",
+                              "S1" };
+}
+
+SalesTableItem saleOf(int id, const std::string& dateTime) {
+    return SalesTableItem { "S" + std::to_string(id), dateTime, "1.00", "1.00", "0.12", "0",
+                            "1.00", "1.00", "Cash", "0", "C1", "CU1" };
+}
+
+TEST(TestCompaction, EraseLeavesATombstoneUntilCompacted) {
+    ColumnTable<ProductColumns> products;
+    for (int i = 0; i < 4; ++i) {
+        products.insert(productOf(i));
+    }
+    ASSERT_TRUE(products.erase("B1"));
+    const auto before = products.snapshot();
+    EXPECT_EQ(before.size(), 3);
+    EXPECT_EQ(before.columns().size(), 4);
+    EXPECT_TRUE(before.isErased(1));
+    EXPECT_FALSE(before.isErased(2));
+    EXPECT_DOUBLE_EQ(products.erasedFraction(), 0.25);
+
+    // The slot is not reused by an insert
+    products.insert(productOf(4));
+    ASSERT_TRUE(products.compact());
+    EXPECT_FALSE(products.compact());
+    EXPECT_DOUBLE_EQ(products.erasedFraction(), 0);
+
+    const auto after = products.snapshot();
+    EXPECT_EQ(after.columns().size(), 4);
+    std::vector<std::string> barcodes;
+    for (const ProductTableItem& product : products) {
+        barcodes.push_back(product.barcode);
+    }
+    EXPECT_EQ(barcodes, std::vector<std::string>({ "B0", "B2", "B3", "B4" }));
+    ProductTableItem found;
+    ASSERT_TRUE(products.find("B4", &found));
+    EXPECT_EQ(found.stock, "4");
+    EXPECT_FALSE(products.contains("B1"));
+    // The snapshot taken before still has the tombstone
+    EXPECT_EQ(before.columns().size(), 4);
+    EXPECT_TRUE(before.isErased(1));
+}
+
+TEST(TestCompaction, ErasedSaleLeavesTheTimeIndex) {
+    ColumnTable<SalesColumns> sales;
+    sales.insert(saleOf(1, "2021-05-16 10:00:00"));
+    sales.insert(saleOf(2, "2021-05-16 11:00:00"));
+    sales.insert(saleOf(3, "2021-05-16 12:00:00"));
+    ASSERT_TRUE(sales.erase("S2"));
+
+    const auto tombstoned = sales.snapshot();
+    ASSERT_EQ(tombstoned.columns().byTime.size(), 2);
+    for (size_t i = 0; i < tombstoned.columns().byTime.size(); ++i) {
+        EXPECT_FALSE(tombstoned.isErased(tombstoned.columns().byTime[i]));
+    }
+
+    ASSERT_TRUE(sales.compact());
+    const auto compacted = sales.snapshot();
+    const SalesColumns& columns = compacted.columns();
+    ASSERT_EQ(columns.byTime.size(), 2);
+    EXPECT_EQ(columns.id[columns.byTime[0]], "S1");
+    EXPECT_EQ(columns.id[columns.byTime[1]], "S3");
+}
+
+TEST(TestCompaction, EraseIfLeavesTombstonesToo) {
+    ColumnTable<SalesItemColumns> items;
+    for (const char* sale : { "S1", "S2", "S1", "S2" }) {
+        items.insert(SalesItemTableItem { sale, "P1", "name", "1.00", "1", "1.00" });
+    }
+    EXPECT_EQ(items.eraseIf([](const SalesItemTableItem& item) { return item.saleID == "S1"; }),
+              2);
+    const auto tombstoned = items.snapshot();
+    // Not compacted: the other rows keep their positions until the compactor runs
+    EXPECT_EQ(tombstoned.columns().size(), 4);
+    EXPECT_EQ(tombstoned.size(), 2);
+    EXPECT_DOUBLE_EQ(items.erasedFraction(), 0.5);
+    EXPECT_TRUE(tombstoned.columns().findSale("S1").empty());
+    EXPECT_EQ(tombstoned.columns().findSale("S2"), std::vector<size_t>({ 1, 3 }));
+
+    ASSERT_TRUE(items.compact());
+    EXPECT_EQ(items.snapshot().columns().findSale("S2"), std::vector<size_t>({ 0, 1 }));
+}
+
+TEST(TestCompaction, IndexedTableReclaimsErasedSlots) {
+    IndexedTable<ProductTableItem> table(&ProductTableItem::barcode, &ProductTableItem::stock);
+    for (int i = 0; i < 10; ++i) {
+        table.insert(productOf(i));
+    }
+    for (int i = 0; i < 10; i += 2) {
+        ASSERT_TRUE(table.erase("B" + std::to_string(i)));
+    }
+    EXPECT_DOUBLE_EQ(table.erasedFraction(), 0.5);
+    ASSERT_TRUE(table.compact());
+    EXPECT_DOUBLE_EQ(table.erasedFraction(), 0);
+    EXPECT_EQ(table.size(), 5);
+    ProductTableItem found;
+    ASSERT_TRUE(table.find("B7", &found));
+    EXPECT_EQ(found.stock, "7");
+}
+
+TEST(TestCompaction, CompactionRunsDuringWrites) {
+    ColumnTable<ProductColumns> products;
+    std::atomic<bool> isWriting { true };
+    std::thread writer([&products, &isWriting]() {
+        for (int i = 0; i < 2000; ++i) {
+            products.insert(productOf(i));
+            if (i % 2 == 1) {
+                products.erase("B" + std::to_string(i - 1));
+            }
+        }
+        isWriting = false;
+    });
+    while (isWriting) {
+        products.compact();
+    }
+    writer.join();
+    products.compact();
+
+    // Exactly the odd rows are left, each still found by its key
+    const auto snapshot = products.snapshot();
+    EXPECT_EQ(snapshot.size(), 1000);
+    EXPECT_EQ(snapshot.columns().size(), 1000);
+    for (int i = 1; i < 2000; i += 2) {
+        ProductTableItem found;
+        ASSERT_TRUE(products.find("B" + std::to_string(i), &found));
+        EXPECT_EQ(found.stock, std::to_string(i));
+    }
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
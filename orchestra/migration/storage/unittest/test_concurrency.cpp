@@ -0,0 +1,265 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// code under test
+#include <storage/columntable.hpp>
+#include <storage/indexedtable.hpp>
+#include <storage/persistentvector.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/stackdb.hpp>
+
+/*!
+ * Readers and writers running at the same time; build with -DSANITIZE_THREAD=ON to have
+ * ThreadSanitizer check them for data races
+*/
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr int ROWS = 2000;
+
+ProductTableItem product(int id, int revision) {
+    // sku and stock always carry the same revision, so a torn row is easy to spot
+    const std::string value = std::to_string(revision);
+    return ProductTableItem { "B" + std::to_string(id), value, "name", "", "cat", "brand", "pc",
+                              value, "ok", "1.00", "2.00", "supplier", "S1" };
+}
+
+SalesItemTableItem saleItem(int sale, int item) {
+    return SalesItemTableItem { "S" + std::to_string(sale), "B" + std::to_string(item),
+                                "name", "1.00", "1", "1.00" };
+}
+
+TEST(TestConcurrency, PersistentVectorCopiesAppendIndependently) {
+    PersistentVector<int> shared;
+    for (int i = 0; i < 100; ++i) {
+        shared.push_back(i);
+    }
+    // Both copies end at 100 and race for the same free slots of the shared chunk
+    PersistentVector<int> first(shared);
+    PersistentVector<int> second(shared);
+    std::thread writer([&first]() {
+        for (int i = 0; i < ROWS; ++i) {
+            first.push_back(-i);
+        }
+    });
+    for (int i = 0; i < ROWS; ++i) {
+        second.push_back(i);
+    }
+    writer.join();
+
+    ASSERT_EQ(shared.size(), 100);
+    ASSERT_EQ(first.size(), 100 + ROWS);
+    ASSERT_EQ(second.size(), 100 + ROWS);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(shared[i], i);
+        ASSERT_EQ(first[i], i);
+        ASSERT_EQ(second[i], i);
+    }
+    for (int i = 0; i < ROWS; ++i) {
+        ASSERT_EQ(first[100 + i], -i);
+        ASSERT_EQ(second[100 + i], i);
+    }
+}
+
+TEST(TestConcurrency, ProductReadersNeverSeeTornRows) {
+    IndexedTable<ProductTableItem> table(&ProductTableItem::barcode,
+                                         &ProductTableItem::category);
+    std::atomic<bool> isWriting { true };
+    std::thread writer([&table, &isWriting]() {
+        for (int i = 0; i < ROWS; ++i) {
+            table.insert(product(i, 0));
+            table.update(product(i / 2, i));
+        }
+        table.eraseIf([](const ProductTableItem& row) { return row.sku == "0"; });
+        isWriting = false;
+    });
+
+    std::vector<std::thread> readers;
+    std::atomic<int> failures { 0 };
+    for (int r = 0; r < 2; ++r) {
+        readers.emplace_back([&table, &isWriting, &failures]() {
+            do {
+                const auto snapshot = table.snapshot();
+                size_t count = 0;
+                for (const ProductTableItem& row : snapshot) {
+                    failures += (row.sku != row.stock);
+                    ++count;
+                }
+                failures += (count != snapshot.size());
+                ProductTableItem found;
+                if (table.find("B0", &found)) {
+                    failures += (found.sku != found.stock);
+                }
+            } while (isWriting);
+        });
+    }
+    writer.join();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(table.size(), ROWS / 2);
+}
+
+TEST(TestConcurrency, WriterFinishesWhileSnapshotIsHeld) {
+    IndexedTable<ProductTableItem> table(&ProductTableItem::barcode);
+    for (int i = 0; i < 10; ++i) {
+        table.insert(product(i, 1));
+    }
+    const auto snapshot = table.snapshot();
+
+    // The writer must not wait for the snapshot to be released
+    std::thread writer([&table]() {
+        for (int i = 10; i < ROWS; ++i) {
+            table.insert(product(i, 2));
+        }
+        table.update(product(0, 3));
+        table.erase("B1");
+    });
+    writer.join();
+
+    EXPECT_EQ(snapshot.size(), 10);
+    EXPECT_TRUE(snapshot.contains("B1"));
+    ProductTableItem found;
+    ASSERT_TRUE(snapshot.find("B0", &found));
+    EXPECT_EQ(found.sku, "1");
+    EXPECT_EQ(table.size(), ROWS - 1);
+    ASSERT_TRUE(table.find("B0", &found));
+    EXPECT_EQ(found.sku, "3");
+}
+
+TEST(TestConcurrency, SaleItemReadersSeeWholeSales) {
+    ColumnTable<SalesItemColumns> table;
+    constexpr int ITEMS_PER_SALE = 3;
+    std::atomic<bool> isWriting { true };
+    std::thread writer([&table, &isWriting]() {
+        for (int sale = 0; sale < ROWS / ITEMS_PER_SALE; ++sale) {
+            // Interleave two sales so the items are inserted into the middle of the columns
+            for (int item = 0; item < ITEMS_PER_SALE; ++item) {
+                table.insert(saleItem(sale, item));
+                table.insert(saleItem(sale + ROWS, item));
+            }
+        }
+        isWriting = false;
+    });
+
+    std::atomic<int> failures { 0 };
+    std::thread reader([&table, &isWriting, &failures]() {
+        do {
+            const auto snapshot = table.snapshot();
+            const SalesItemColumns& columns = snapshot.columns();
+            failures += (columns.productID.size() != columns.saleID.size());
+            failures += (columns.totalPrice.size() != columns.saleID.size());
+            const std::string id = "S" + std::to_string(snapshot.size() / (2 * ITEMS_PER_SALE));
+            for (const size_t pos : columns.findSale(id)) {
+                failures += (columns.saleID[pos] != id);
+            }
+        } while (isWriting);
+    });
+    writer.join();
+    reader.join();
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(table.size(), 2 * (ROWS / ITEMS_PER_SALE) * ITEMS_PER_SALE);
+}
+
+TEST(TestConcurrency, SalesScansRunDuringInserts) {
+    ColumnTable<SalesColumns> table;
+    std::atomic<bool> isWriting { true };
+    std::thread writer([&table, &isWriting]() {
+        for (int i = 0; i < ROWS; ++i) {
+            table.insert(SalesTableItem { "S" + std::to_string(i), "2021-05-16 10:11:20",
+                                          "1.00", "1.00", "0.12", "0", "1.00", "1.00", "Cash",
+                                          "0", "C1", "CU" + std::to_string(i % 10) });
+        }
+        isWriting = false;
+    });
+
+    std::atomic<int> failures { 0 };
+    std::thread reader([&table, &isWriting, &failures]() {
+        do {
+            const auto snapshot = table.snapshot();
+            const SalesColumns& columns = snapshot.columns();
+            int64_t total = 0;
+            for (size_t pos = 0; pos < columns.size(); ++pos) {
+                total += columns.total[pos];
+            }
+            failures += (total != static_cast<int64_t>(100 * columns.size()));
+            failures += (columns.byTime.size() != columns.size());
+        } while (isWriting);
+    });
+    writer.join();
+    reader.join();
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(table.size(), ROWS);
+}
+
+TEST(TestConcurrency, DatabaseSnapshotIsConsistentAcrossTables) {
+    ColumnTable<SalesColumns>& sales = DATABASE().SELECT_SALES_TABLE();
+    ColumnTable<SalesItemColumns>& items = DATABASE().SELECT_SALES_ITEM_TABLE();
+    std::atomic<bool> isWriting { true };
+    std::thread writer([&sales, &items, &isWriting]() {
+        // Like the POS: the items go in first, then the sale that refers to them
+        for (int sale = 0; sale < ROWS / 4; ++sale) {
+            const std::string id = "MVCC" + std::to_string(sale);
+            items.insert(SalesItemTableItem { id, "B1", "name", "1.00", "1", "1.00" });
+            sales.insert(SalesTableItem { id, "2021-05-16 10:11:20", "1.00", "1.00", "0.12",
+                                          "0", "1.00", "1.00", "Cash", "0", "C1", "CU1" });
+        }
+        isWriting = false;
+    });
+
+    std::atomic<int> failures { 0 };
+    std::thread reader([&isWriting, &failures]() {
+        do {
+            const auto snapshot = DATABASE().snapshot();
+            const SalesColumns& saleColumns = snapshot.SELECT_SALES_TABLE().columns();
+            const SalesItemColumns& itemColumns = snapshot.SELECT_SALES_ITEM_TABLE().columns();
+            // A sale is never seen without its items
+            for (size_t pos = 0; pos < saleColumns.size(); ++pos) {
+                const std::string& id = saleColumns.id[pos];
+                if (id.compare(0, 4, "MVCC") == 0) {
+                    failures += (itemColumns.findSale(id).empty());
+                }
+            }
+        } while (isWriting);
+    });
+    writer.join();
+    reader.join();
+    EXPECT_EQ(failures, 0);
+
+    const auto snapshot = DATABASE().snapshot();
+    sales.eraseIf([](const SalesTableItem& row) { return row.ID.compare(0, 4, "MVCC") == 0; });
+    items.eraseIf([](const SalesItemTableItem& row) {
+        return row.saleID.compare(0, 4, "MVCC") == 0;
+    });
+    EXPECT_TRUE(snapshot.SELECT_SALES_TABLE().contains("MVCC0"));
+    EXPECT_FALSE(sales.contains("MVCC0"));
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
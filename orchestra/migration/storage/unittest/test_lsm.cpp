@@ -0,0 +1,258 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/lsmsales.hpp>
+#include <storage/lsmtree.hpp>
+#include <storage/salescolumns.hpp>
+#include <storage/sortedrun.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char RUN_PATH[] = "test_lsm.run";
+constexpr char TREE_DIRECTORY[] = "test_lsm";
+constexpr char ITEM_TREE_DIRECTORY[] = "test_lsm_items";
+
+std::string entryKey(int i) {
+    char key[16];
+    std::snprintf(key, sizeof(key), "K%07d", i);
+    return key;
+}
+
+/*!
+ * Removes the files that the manifest can have numbered, then the directory
+*/
+void removeTree(const std::string& directory) {
+    std::ifstream manifest(directory + "/MANIFEST");
+    std::string type;
+    uint64_t next = 0;
+    manifest >> type >> next;
+    manifest.close();
+    for (uint64_t sequence = 0; sequence < next; ++sequence) {
+        std::remove((directory + "/" + std::to_string(sequence) + ".run").c_str());
+        std::remove((directory + "/" + std::to_string(sequence) + ".log").c_str());
+    }
+    std::remove((directory + "/MANIFEST").c_str());
+    std::remove(directory.c_str());
+}
+
+LsmTree::Options smallOptions(size_t mergeRuns) {
+    LsmTree::Options options;
+    // a few hundred keys per memtable
+    options.memtableBytes = 16 * 1024;
+    options.mergeRuns = mergeRuns;
+    return options;
+}
+
+SalesTableItem saleOf(const std::string& id, const std::string& dateTime) {
+    return SalesTableItem { id, dateTime, "1.00", "1.00", "0.12", "0", "1.00", "1.00", "Cash",
+                            "0", "C1", "CU1" };
+}
+
+class TestLsm : public testing::Test {
+ public:
+    TestLsm() = default;
+    ~TestLsm() = default;
+    void SetUp() {
+        TearDown();
+    }
+    void TearDown() {
+        std::remove(RUN_PATH);
+        removeTree(TREE_DIRECTORY);
+        removeTree(ITEM_TREE_DIRECTORY);
+    }
+};
+
+TEST_F(TestLsm, SortedRunFindsKeysAndReadsThemInOrder) {
+    const int count = 3000;
+    {
+        RunWriter writer(RUN_PATH);
+        ASSERT_TRUE(writer.isOpen());
+        for (int i = 0; i < count; ++i) {
+            ASSERT_TRUE(writer.add(LsmEntry { entryKey(i), "value " + std::to_string(i),
+                                              i % 10 == 0 }));
+        }
+        // Out of order
+        EXPECT_FALSE(writer.add(LsmEntry { entryKey(5), "", false }));
+        ASSERT_TRUE(writer.finish());
+    }
+    SortedRun run(RUN_PATH, 1);
+    ASSERT_TRUE(run.isOpen());
+    EXPECT_EQ(run.entryCount(), static_cast<uint64_t>(count));
+    // More than one block
+    EXPECT_GT(run.fileSize(), 2 * RunWriter::BLOCK_SIZE);
+
+    LsmEntry entry;
+    ASSERT_TRUE(run.find(entryKey(1234), &entry));
+    EXPECT_EQ(entry.value, "value 1234");
+    EXPECT_FALSE(entry.isErased);
+    ASSERT_TRUE(run.find(entryKey(1230), &entry));
+    EXPECT_TRUE(entry.isErased);
+    EXPECT_FALSE(run.find("K", nullptr));
+    EXPECT_FALSE(run.find(entryKey(count), nullptr));
+
+    SortedRun::Iterator it = run.seek(entryKey(2500) + "x");
+    for (int i = 2501; i < count; ++i, it.advance()) {
+        ASSERT_TRUE(it.isValid());
+        ASSERT_EQ(it.entry().key, entryKey(i));
+    }
+    EXPECT_FALSE(it.isValid());
+}
+
+TEST_F(TestLsm, ReadsTheNewestVersionAcrossFlushesMergesAndReopen) {
+    const int count = 4000;
+    {
+        LsmTree tree(TREE_DIRECTORY, smallOptions(2));
+        ASSERT_TRUE(tree.isOpen());
+        for (int i = 0; i < count; ++i) {
+            ASSERT_TRUE(tree.put(entryKey(i), "first " + std::to_string(i)));
+        }
+        // Newer versions and tombstones shadow the flushed ones
+        for (int i = 0; i < count; i += 3) {
+            ASSERT_TRUE(tree.put(entryKey(i), "second " + std::to_string(i)));
+        }
+        for (int i = 1; i < count; i += 3) {
+            ASSERT_TRUE(tree.remove(entryKey(i)));
+        }
+        tree.flush();
+        // Merged two at a time, so the run count stays logarithmic
+        EXPECT_GE(tree.runCount(), 1U);
+        EXPECT_LE(tree.runCount(), 8U);
+        ASSERT_TRUE(tree.commit());
+    }
+    LsmTree tree(TREE_DIRECTORY, smallOptions(2));
+    ASSERT_TRUE(tree.isOpen());
+    std::string value;
+    ASSERT_TRUE(tree.get(entryKey(300), &value));
+    EXPECT_EQ(value, "second 300");
+    ASSERT_TRUE(tree.get(entryKey(302), &value));
+    EXPECT_EQ(value, "first 302");
+    EXPECT_FALSE(tree.get(entryKey(301), &value));
+
+    LsmTree::Cursor cursor = tree.scan(entryKey(1000), entryKey(2000));
+    // A cursor reads the version of the tree it was opened on
+    ASSERT_TRUE(tree.put(entryKey(1001), "after the scan"));
+    std::string key;
+    int rows = 0;
+    for (int i = 1000; i < 2000; ++i) {
+        if (i % 3 == 1) {
+            continue;
+        }
+        ASSERT_TRUE(cursor.next(&key, &value));
+        ASSERT_EQ(key, entryKey(i));
+        ++rows;
+    }
+    EXPECT_FALSE(cursor.next(&key, &value));
+    EXPECT_GT(rows, 600);
+}
+
+TEST_F(TestLsm, ReplaysTheCommittedWritesOfTheLog) {
+    {
+        LsmTree tree(TREE_DIRECTORY, LsmTree::Options());
+        ASSERT_TRUE(tree.isOpen());
+        ASSERT_TRUE(tree.write({ { "a", "1", false }, { "b", "2", false } }));
+        ASSERT_TRUE(tree.remove("a"));
+        ASSERT_TRUE(tree.commit());
+        // Still in the memtable; the log is all there is on the disk
+        EXPECT_EQ(tree.runCount(), 0U);
+    }
+    LsmTree tree(TREE_DIRECTORY, LsmTree::Options());
+    ASSERT_TRUE(tree.isOpen());
+    std::string value;
+    EXPECT_FALSE(tree.get("a", &value));
+    ASSERT_TRUE(tree.get("b", &value));
+    EXPECT_EQ(value, "2");
+}
+
+TEST_F(TestLsm, SalesEngineReadsTimeRangesAndKeepsItsCount) {
+    {
+        LsmSalesEngine sales(TREE_DIRECTORY, smallOptions(4));
+        ASSERT_TRUE(sales.isOpen());
+        ASSERT_TRUE(sales.insert(saleOf("S3", "2021-05-03 09:00:00")));
+        ASSERT_TRUE(sales.insert(saleOf("S1", "2021-05-01 09:00:00")));
+        ASSERT_TRUE(sales.insert(saleOf("S2", "2021-05-02 09:00:00")));
+        ASSERT_TRUE(sales.insert(saleOf("S4", "2021-05-04 09:00:00")));
+        EXPECT_FALSE(sales.insert(saleOf("S2", "2021-05-09 09:00:00")));
+        // Moves the sale to another day
+        ASSERT_TRUE(sales.update(saleOf("S4", "2021-04-30 09:00:00")));
+        EXPECT_EQ(sales.remove("S3"), 1U);
+        EXPECT_EQ(sales.remove("S3"), 0U);
+        EXPECT_TRUE(sales.flush());
+    }
+    LsmSalesEngine sales(TREE_DIRECTORY, smallOptions(4));
+    ASSERT_TRUE(sales.isOpen());
+    EXPECT_EQ(sales.size(), 3U);
+    SalesTableItem row;
+    ASSERT_TRUE(sales.get("S4", &row));
+    EXPECT_EQ(row.date_time, "2021-04-30 09:00:00");
+
+    int64_t first = 0;
+    int64_t last = 0;
+    ASSERT_TRUE(parseDateTime("2021-05-01 09:00:00", &first));
+    ASSERT_TRUE(parseDateTime("2021-05-03 09:00:00", &last));
+    std::vector<std::string> ids;
+    const std::unique_ptr<Cursor<SalesTableItem>> cursor = sales.scanTime(first, last);
+    while (cursor->next(&row)) {
+        ids.push_back(row.ID);
+    }
+    EXPECT_EQ(ids, (std::vector<std::string> { "S1", "S2" }));
+    EXPECT_EQ(sales.removeIf([](const SalesTableItem& sale) { return sale.ID != "S1"; }), 2U);
+    EXPECT_EQ(sales.size(), 1U);
+}
+
+TEST_F(TestLsm, SalesItemEngineKeepsTheItemsOfASaleInOrder) {
+    LsmSalesItemEngine items(ITEM_TREE_DIRECTORY, smallOptions(4));
+    ASSERT_TRUE(items.isOpen());
+    for (const char* product : { "P3", "P1", "P2" }) {
+        ASSERT_TRUE(items.insert(SalesItemTableItem { "S1", product, "Item", "1.00", "1",
+                                                      "1.00" }));
+    }
+    ASSERT_TRUE(items.insert(SalesItemTableItem { "S10", "P9", "Item", "1.00", "1", "1.00" }));
+    EXPECT_EQ(items.size(), 4U);
+
+    std::vector<std::string> products;
+    const std::unique_ptr<Cursor<SalesItemTableItem>> cursor = items.scanOf("S1");
+    for (SalesItemTableItem row; cursor->next(&row);) {
+        products.push_back(row.productID);
+    }
+    EXPECT_EQ(products, (std::vector<std::string> { "P3", "P1", "P2" }));
+    SalesItemTableItem first;
+    ASSERT_TRUE(items.get("S1", &first));
+    EXPECT_EQ(first.productID, "P3");
+
+    EXPECT_EQ(items.remove("S1"), 3U);
+    EXPECT_FALSE(items.get("S1", nullptr));
+    ASSERT_TRUE(items.get("S10", nullptr));
+    EXPECT_EQ(items.size(), 1U);
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,62 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#else
+#include <unistd.h>
+#endif
+#include <storage/dbconfig.hpp>
+#include <storage/wal.hpp>
+#include <cfg/config.hpp>
+
+namespace {
+
+// The tests run here, on a new database of the sample data, whatever the current directory
+// configures
+constexpr char TEST_DIRECTORY[] = "storage_unittest_db";
+
+bool enterTestDirectory() {
+    // Fails harmlessly if the directory exists
+    dataprovider::db::makeDirectory(TEST_DIRECTORY);
+    if (chdir(TEST_DIRECTORY) != 0) {
+        return false;
+    }
+    utility::Config config(dataprovider::db::DB_CONFIG);
+    config.set("db_path", "data");
+    // Left by the previous run
+    std::remove("data/stackdb.ckpt");
+    std::remove("data/stackdb.wal");
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  if (!enterTestDirectory()) {
+    std::fprintf(stderr, "Cannot enter %s\n", TEST_DIRECTORY);
+    return 1;
+  }
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,249 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/btreeproducts.hpp>
+#include <storage/query.hpp>
+#include <storage/storageengine.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char QUERY_TREE_PATH[] = "test_query.btree";
+constexpr char QUERY_JOURNAL_PATH[] = "test_query.btree-journal";
+
+ProductTableItem productOf(const std::string& barcode, const std::string& category) {
+    return ProductTableItem { barcode, "SKU" + barcode, "Name " + barcode, "Description",
+                              category, "Brand", "PC", "10", "Active", "1.00", "2.00",
+                              "Supplier", "SUP1" };
+}
+
+/*!
+ * Reads every page of [query]; checks that no page is larger than asked
+*/
+template <typename Row>
+std::vector<Row> readPages(const TableEngine<Row>& table, PageQuery<Row> query) {
+    std::vector<Row> rows;
+    do {
+        RowPage<Row> page = table.page(query);
+        EXPECT_LE(page.rows.size(), query.size);
+        rows.insert(rows.end(), page.rows.begin(), page.rows.end());
+        query.token = page.nextToken;
+    } while (!query.token.empty());
+    return rows;
+}
+
+template <typename Row>
+std::vector<std::string> keysOf(const std::vector<Row>& rows, Field<Row> key) {
+    std::vector<std::string> keys;
+    for (const Row& row : rows) {
+        if ((row.*key).compare(0, 3, "TQ-") == 0) {
+            keys.push_back(row.*key);
+        }
+    }
+    return keys;
+}
+
+class TestQuery : public testing::Test {
+ public:
+    TestQuery() = default;
+    ~TestQuery() = default;
+    void SetUp() {
+        TearDown();
+    }
+    void TearDown() {
+        STORAGE().products().removeIf([](const ProductTableItem& row) {
+            return row.barcode.compare(0, 3, "TQ-") == 0;
+        });
+        STORAGE().customers().removeIf([](const CustomerTableItem& row) {
+            return row.customerID.compare(0, 3, "TQ-") == 0;
+        });
+        STORAGE().employees().removeIf([](const EmployeeTableItem& row) {
+            return row.employeeID.compare(0, 3, "TQ-") == 0;
+        });
+        std::remove(QUERY_TREE_PATH);
+        std::remove(QUERY_JOURNAL_PATH);
+    }
+};
+
+TEST_F(TestQuery, ColumnTableFiltersAndProjects) {
+    ProductEngine& products = STORAGE().products();
+    ASSERT_TRUE(products.insert(productOf("TQ-1", "Snacks")));
+    ASSERT_TRUE(products.insert(productOf("TQ-2", "Drinks")));
+    ASSERT_TRUE(products.insert(productOf("TQ-3", "Snacks")));
+
+    const std::vector<ProductTableItem> rows = scan(products)
+        .where(column(&ProductTableItem::category) == "Snacks")
+        .where(column(&ProductTableItem::barcode).startsWith("TQ-"))
+        .select({ &ProductTableItem::barcode, &ProductTableItem::sell_price })
+        .rows();
+    ASSERT_EQ(rows.size(), 2U);
+    EXPECT_EQ(rows[0].barcode, "TQ-1");
+    EXPECT_EQ(rows[1].barcode, "TQ-3");
+    EXPECT_EQ(rows[0].sell_price, "2.00");
+    // Not selected
+    EXPECT_TRUE(rows[0].name.empty());
+    EXPECT_TRUE(rows[0].category.empty());
+
+    // An erased row is not read; without a projection every field is copied
+    products.remove("TQ-1");
+    const std::vector<ProductTableItem> snacks = scan(products)
+        .where(column(&ProductTableItem::category) == "Snacks")
+        .where(column(&ProductTableItem::barcode).startsWith("TQ-"))
+        .rows();
+    ASSERT_EQ(snacks.size(), 1U);
+    EXPECT_EQ(snacks[0].name, "Name TQ-3");
+}
+
+TEST_F(TestQuery, IndexedTableFiltersInPlace) {
+    TableEngine<CustomerTableItem>& customers = STORAGE().customers();
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C1", "Ana", "", "Cruz", "", "F" }));
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C2", "Ben", "", "Reyes", "", "M" }));
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C3", "Cy", "", "Cruzado", "", "M" }));
+
+    const std::unique_ptr<Cursor<CustomerTableItem>> cursor = scan(customers)
+        .where(column(&CustomerTableItem::lastname).contains("Cruz"))
+        .where(column(&CustomerTableItem::gender) != "F")
+        .select({ &CustomerTableItem::customerID })
+        .cursor();
+    CustomerTableItem row;
+    ASSERT_TRUE(cursor->next(&row));
+    EXPECT_EQ(row.customerID, "TQ-C3");
+    EXPECT_TRUE(row.lastname.empty());
+    EXPECT_FALSE(cursor->next(&row));
+}
+
+TEST_F(TestQuery, SelectedFlagsAreCopied) {
+    TableEngine<EmployeeTableItem>& employees = STORAGE().employees();
+    ASSERT_TRUE(employees.insert(EmployeeTableItem { "TQ-E1", "Ana", "", "Cruz", "", "F",
+                                                     "Cashier", "Active", true }));
+    ASSERT_TRUE(employees.insert(EmployeeTableItem { "TQ-E2", "Ben", "", "Reyes", "", "M",
+                                                     "Cashier", "Active", false }));
+
+    const std::vector<EmployeeTableItem> rows = scan(employees)
+        .where(column(&EmployeeTableItem::employeeID).startsWith("TQ-"))
+        .select({ &EmployeeTableItem::employeeID }, { &EmployeeTableItem::isSystemUser })
+        .rows();
+    ASSERT_EQ(rows.size(), 2U);
+    EXPECT_EQ(rows[0].employeeID, "TQ-E1");
+    EXPECT_TRUE(rows[0].isSystemUser);
+    EXPECT_FALSE(rows[1].isSystemUser);
+    EXPECT_TRUE(rows[0].lastname.empty());
+
+    // Not selected
+    const std::vector<EmployeeTableItem> ids = scan(employees)
+        .where(column(&EmployeeTableItem::employeeID) == "TQ-E1")
+        .select({ &EmployeeTableItem::employeeID })
+        .rows();
+    ASSERT_EQ(ids.size(), 1U);
+    EXPECT_FALSE(ids[0].isSystemUser);
+}
+
+TEST_F(TestQuery, OtherEnginesFilterTheScannedRows) {
+    BTreeProductEngine products(QUERY_TREE_PATH, 16);
+    ASSERT_TRUE(products.isOpen());
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(products.insert(productOf("TQ-" + std::to_string(100 + i),
+                                              (i % 4 == 0) ? "Snacks" : "Drinks")));
+    }
+    const std::vector<ProductTableItem> rows = scan(products)
+        .where(column(&ProductTableItem::category) == "Snacks")
+        .select({ &ProductTableItem::barcode })
+        .rows();
+    ASSERT_EQ(rows.size(), 25U);
+    EXPECT_EQ(rows.front().barcode, "TQ-100");
+    EXPECT_TRUE(rows.front().sku.empty());
+}
+
+TEST_F(TestQuery, PagesFollowTheSortOrder) {
+    ProductEngine& products = STORAGE().products();
+    ASSERT_TRUE(products.insert(productOf("TQ-1", "Snacks")));
+    ASSERT_TRUE(products.insert(productOf("TQ-2", "Drinks")));
+    ASSERT_TRUE(products.insert(productOf("TQ-3", "Snacks")));
+    ASSERT_TRUE(products.insert(productOf("TQ-4", "Candy")));
+
+    PageQuery<ProductTableItem> query;
+    query.key = &ProductTableItem::barcode;
+    query.sortBy = &ProductTableItem::category;
+    query.size = 1;
+    std::vector<std::string> keys = keysOf(readPages(products, query), query.key);
+    EXPECT_EQ(keys, std::vector<std::string>({ "TQ-4", "TQ-2", "TQ-1", "TQ-3" }));
+
+    // A token holds a position; the rows written meanwhile do not shift the next pages
+    query.sortBy = nullptr;
+    query.size = 2;
+    query.token.clear();
+    RowPage<ProductTableItem> page;
+    do {
+        page = products.page(query);
+        query.token = page.nextToken;
+    } while (!page.nextToken.empty() && keysOf(page.rows, query.key).empty());
+    ASSERT_FALSE(page.nextToken.empty());
+    const std::string last = page.rows.back().barcode;
+    ASSERT_TRUE(products.insert(productOf("TQ-0", "Candy")));
+    products.remove("TQ-4");
+    keys = keysOf(readPages(products, query), query.key);
+    ASSERT_FALSE(keys.empty());
+    EXPECT_GT(keys.front(), last);
+    EXPECT_EQ(keys.back(), "TQ-3");
+}
+
+TEST_F(TestQuery, PagesOfEveryEngineMatch) {
+    TableEngine<CustomerTableItem>& customers = STORAGE().customers();
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C1", "Ana", "", "Cruz", "", "F" }));
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C2", "Ben", "", "Abad", "", "M" }));
+    ASSERT_TRUE(customers.insert(CustomerTableItem { "TQ-C3", "Cy", "", "Cruz", "", "M" }));
+    PageQuery<CustomerTableItem> byName;
+    byName.key = &CustomerTableItem::customerID;
+    byName.sortBy = &CustomerTableItem::lastname;
+    byName.size = 2;
+    EXPECT_EQ(keysOf(readPages(customers, byName), byName.key),
+              std::vector<std::string>({ "TQ-C2", "TQ-C1", "TQ-C3" }));
+
+    BTreeProductEngine products(QUERY_TREE_PATH, 16);
+    ASSERT_TRUE(products.isOpen());
+    std::vector<std::string> expected;
+    for (int i = 0; i < 100; ++i) {
+        expected.push_back("TQ-" + std::to_string(100 + i));
+        ASSERT_TRUE(products.insert(productOf(expected.back(), "Snacks")));
+    }
+    // In key order the tree reads the leaves after the token
+    PageQuery<ProductTableItem> query;
+    query.key = &ProductTableItem::barcode;
+    query.size = 7;
+    EXPECT_EQ(keysOf(readPages(products, query), query.key), expected);
+    // Otherwise it scans like the default engine
+    query.sortBy = &ProductTableItem::category;
+    EXPECT_EQ(keysOf(readPages(products, query), query.key), expected);
+    // A page token that was not made by page() reads the first page
+    query.token = "not a token";
+    EXPECT_EQ(products.page(query).rows.front().barcode, "TQ-100");
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,187 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// code under test
+#include <storage/checkpoint.hpp>
+#include <storage/productcolumns.hpp>
+#include <storage/shardedtables.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+// A shard recovers like StackDB: it loads its checkpoint, then replays its log on top of it
+constexpr char RECOVERY_PREFIX[] = "test_recovery.";
+constexpr char RECOVERY_CHECKPOINT[] = "test_recovery.ckpt";
+constexpr char RECOVERY_LOG[] = "test_recovery.wal";
+
+typedef TableShard<ProductColumns> ProductShard;
+
+class TestRecovery : public testing::Test {
+ public:
+    TestRecovery() = default;
+    ~TestRecovery() = default;
+    void SetUp() {
+        TearDown();
+    }
+    void TearDown() {
+        removeShardFiles(RECOVERY_PREFIX);
+    }
+
+    static std::unique_ptr<ProductShard> open() {
+        ShardOptions options;
+        // Only the checkpoints that a test writes
+        options.checkpointRecords = 1000000;
+        return std::make_unique<ProductShard>(RECOVERY_PREFIX, options);
+    }
+
+    static ProductTableItem productOf(int id) {
+        return ProductTableItem { "B" + std::to_string(id), "SKU", "name", "desc", "cat",
+                                  "brand", "pc", std::to_string(id), "ACTIVE", "1.00", "2.00",
+                                  "supplier", "S1" };
+    }
+
+    static long logSize() {  // NOLINT(runtime/int)
+        std::FILE* file = std::fopen(RECOVERY_LOG, "rb");
+        if (!file) {
+            return 0;
+        }
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);  // NOLINT(runtime/int)
+        std::fclose(file);
+        return size;
+    }
+};
+
+TEST_F(TestRecovery, CheckpointAndLogTailAreRecovered) {
+    {
+        const auto shard = open();
+        ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+        for (int i = 0; i < 10; ++i) {
+            ASSERT_TRUE(products.insert(productOf(i)));
+        }
+        ASSERT_TRUE(shard->commit());
+        ASSERT_TRUE(shard->checkpoint());
+        // Only in the log
+        for (int i = 10; i < 15; ++i) {
+            ASSERT_TRUE(products.insert(productOf(i)));
+        }
+        ASSERT_TRUE(products.erase("B3"));
+        ProductTableItem changed = productOf(0);
+        changed.stock = "99";
+        ASSERT_TRUE(products.update(changed));
+        ASSERT_TRUE(shard->commit());
+    }
+    {
+        const CheckpointImage image(RECOVERY_CHECKPOINT);
+        ASSERT_TRUE(image.isValid());
+        ColumnTable<ProductColumns> checkpointed;
+        ASSERT_TRUE(image.load(&checkpointed));
+        EXPECT_EQ(checkpointed.size(), 10);
+    }
+
+    const auto shard = open();
+    const ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+    EXPECT_EQ(products.size(), 14);
+    EXPECT_FALSE(products.contains("B3"));
+    EXPECT_TRUE(products.contains("B14"));
+    ProductTableItem found;
+    ASSERT_TRUE(products.find("B0", &found));
+    EXPECT_EQ(found.stock, "99");
+}
+
+TEST_F(TestRecovery, TornLogTailIsCutOff) {
+    {
+        const auto shard = open();
+        for (int i = 0; i < 5; ++i) {
+            ASSERT_TRUE(shard->table<ProductColumns>().insert(productOf(i)));
+        }
+        ASSERT_TRUE(shard->commit());
+    }
+    // Crash while the last frame was written
+    const long size = logSize();  // NOLINT(runtime/int)
+    ASSERT_GT(size, 0);
+    {
+        std::FILE* file = std::fopen(RECOVERY_LOG, "rb");
+        ASSERT_NE(file, nullptr);
+        std::string contents(static_cast<size_t>(size), '\0');
+        ASSERT_EQ(std::fread(&contents[0], 1, contents.size(), file), contents.size());
+        std::fclose(file);
+        file = std::fopen(RECOVERY_LOG, "wb");
+        ASSERT_NE(file, nullptr);
+        std::fwrite(contents.data(), 1, contents.size() - 3, file);
+        std::fclose(file);
+    }
+    {
+        const auto shard = open();
+        ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+        EXPECT_EQ(products.size(), 4);
+        EXPECT_FALSE(products.contains("B4"));
+        // Written after the valid records, not after the torn frame
+        ASSERT_TRUE(products.insert(productOf(5)));
+        ASSERT_TRUE(shard->commit());
+    }
+    const auto shard = open();
+    const ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+    EXPECT_EQ(products.size(), 5);
+    EXPECT_TRUE(products.contains("B3"));
+    EXPECT_TRUE(products.contains("B5"));
+}
+
+TEST_F(TestRecovery, CorruptedLogFrameEndsTheReplay) {
+    long goodSize = 0;  // NOLINT(runtime/int)
+    {
+        const auto shard = open();
+        ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+        ASSERT_TRUE(products.insert(productOf(0)));
+        ASSERT_TRUE(products.insert(productOf(1)));
+        ASSERT_TRUE(shard->commit());
+        goodSize = logSize();
+        ASSERT_TRUE(products.insert(productOf(2)));
+        ASSERT_TRUE(products.insert(productOf(3)));
+        ASSERT_TRUE(shard->commit());
+    }
+    // One flipped byte in the payload of the third record
+    std::FILE* file = std::fopen(RECOVERY_LOG, "r+b");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, goodSize + 12, SEEK_SET);
+    const int byte = std::fgetc(file);
+    std::fseek(file, goodSize + 12, SEEK_SET);
+    std::fputc(byte ^ 0x01, file);
+    std::fclose(file);
+
+    const auto shard = open();
+    const ColumnTable<ProductColumns>& products = shard->table<ProductColumns>();
+    EXPECT_EQ(products.size(), 2);
+    EXPECT_TRUE(products.contains("B1"));
+    EXPECT_FALSE(products.contains("B2"));
+    // The records after the bad frame cannot be trusted either
+    EXPECT_FALSE(products.contains("B3"));
+    EXPECT_EQ(logSize(), goodSize);
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
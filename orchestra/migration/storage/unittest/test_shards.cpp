@@ -0,0 +1,249 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/shardedtables.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char SHARD_DIRECTORY[] = "test_shards";
+constexpr int PRODUCTS = 300;
+
+ProductTableItem shardProduct(int id) {
+    char barcode[16];
+    std::snprintf(barcode, sizeof(barcode), "B%05d", id);
+    return ProductTableItem { barcode, "SKU", "name", "", "cat", "brand", "pc",
+                              std::to_string(id), "ACTIVE", "1.00", "2.00", "supplier", "S1" };
+}
+
+SalesTableItem shardSale(int id, int day) {
+    char dateTime[32];
+    std::snprintf(dateTime, sizeof(dateTime), "2021-05-%02d 09:00:00", day);
+    return SalesTableItem { "S" + std::to_string(id), dateTime, "1.00", "1.00", "0.12", "0",
+                            "1.00", "1.00", "Cash", "0", "C1", "CU1" };
+}
+
+ShardOptions shardOptions(size_t count) {
+    ShardOptions options;
+    options.count = count;
+    // a checkpoint every few writes
+    options.checkpointRecords = 50;
+    return options;
+}
+
+template <typename Row>
+std::vector<std::string> shardKeys(Cursor<Row>* cursor, std::string Row::*key) {
+    std::vector<std::string> keys;
+    for (Row row; cursor->next(&row);) {
+        keys.push_back(row.*key);
+    }
+    return keys;
+}
+
+std::vector<std::string> shardProductKeys(int count) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < count; ++i) {
+        keys.push_back(shardProduct(i).barcode);
+    }
+    return keys;
+}
+
+class TestShards : public testing::Test {
+ public:
+    TestShards() = default;
+    ~TestShards() = default;
+    void SetUp() {
+        TearDown();
+    }
+    void TearDown() {
+        for (size_t count = 1; count <= 8; ++count) {
+            for (size_t i = 0; i < count; ++i) {
+                removeShardFiles(std::string(SHARD_DIRECTORY) + "/" + std::to_string(count) + "-"
+                                 + std::to_string(i) + ".");
+            }
+        }
+        std::remove((std::string(SHARD_DIRECTORY) + "/shards").c_str());
+        std::remove(SHARD_DIRECTORY);
+    }
+
+    static std::shared_ptr<ShardSet<ProductColumns>> productShards(const std::string& directory,
+                                                                   size_t count) {
+        return std::make_shared<ShardSet<ProductColumns>>(directory, shardOptions(count),
+                                                          nullptr);
+    }
+};
+
+TEST_F(TestShards, RoutesRowsToTheShardOfTheirKey) {
+    const auto shards = productShards("", 4);
+    ShardedProductEngine products(shards);
+    for (int i = PRODUCTS - 1; i >= 0; --i) {
+        ASSERT_TRUE(products.insert(shardProduct(i)));
+    }
+    EXPECT_FALSE(products.insert(shardProduct(7)));
+    EXPECT_EQ(products.size(), static_cast<size_t>(PRODUCTS));
+    for (size_t i = 0; i < shards->count(); ++i) {
+        const ColumnTable<ProductColumns>& table = (*shards)[i].table<ProductColumns>();
+        // Spread over every shard
+        EXPECT_GT(table.size(), 0U);
+        for (const ProductTableItem& row : table) {
+            EXPECT_EQ(shards->indexOf(row.barcode), i);
+        }
+    }
+    ProductTableItem row;
+    ASSERT_TRUE(products.get(shardProduct(42).barcode, &row));
+    EXPECT_EQ(row.stock, "42");
+    row.stock = "0";
+    EXPECT_TRUE(products.update(row));
+    ASSERT_TRUE(products.get(row.barcode, &row));
+    EXPECT_EQ(row.stock, "0");
+    EXPECT_EQ(products.remove(row.barcode), 1U);
+    EXPECT_FALSE(products.get(row.barcode, nullptr));
+    EXPECT_EQ(products.removeIf([](const ProductTableItem& product) {
+        return product.barcode >= shardProduct(100).barcode;
+    }), static_cast<size_t>(PRODUCTS - 100));
+    EXPECT_EQ(products.size(), 99U);
+}
+
+TEST_F(TestShards, ScansGatherEveryShardInOrder) {
+    ShardedProductEngine products(productShards("", 3));
+    for (int i = PRODUCTS - 1; i >= 0; --i) {
+        ASSERT_TRUE(products.insert(shardProduct(i)));
+    }
+    EXPECT_EQ(shardKeys(products.scan().get(), &ProductTableItem::barcode).size(),
+              static_cast<size_t>(PRODUCTS));
+    // Merged by barcode across the shards
+    const std::vector<std::string> all = shardProductKeys(PRODUCTS);
+    EXPECT_EQ(shardKeys(products.scanRange("", "").get(), &ProductTableItem::barcode), all);
+    EXPECT_EQ(shardKeys(products.scanRange(all[10], all[19]).get(), &ProductTableItem::barcode),
+              std::vector<std::string>(all.begin() + 10, all.begin() + 20));
+    // Pages across the shards
+    PageQuery<ProductTableItem> query;
+    query.key = &ProductTableItem::barcode;
+    query.size = 7;
+    std::vector<std::string> paged;
+    do {
+        const RowPage<ProductTableItem> page = products.page(query);
+        EXPECT_LE(page.rows.size(), query.size);
+        for (const ProductTableItem& row : page.rows) {
+            paged.push_back(row.barcode);
+        }
+        query.token = page.nextToken;
+    } while (!query.token.empty());
+    EXPECT_EQ(paged, all);
+}
+
+TEST_F(TestShards, SaleAndItsItemsShareAShard) {
+    const auto shards = std::make_shared<ShardedSalesEngine::Shards>("", shardOptions(4),
+                                                                     nullptr, nullptr);
+    ShardedSalesEngine sales(shards);
+    ShardedSalesItemEngine items(shards);
+    for (int i = 0; i < 40; ++i) {
+        // Days out of order
+        ASSERT_TRUE(sales.insert(shardSale(i, 1 + (i * 7) % 28)));
+        ASSERT_TRUE(items.insert(SalesItemTableItem { "S" + std::to_string(i), "B1", "name",
+                                                      "1.00", "1", "1.00" }));
+    }
+    for (size_t i = 0; i < shards->count(); ++i) {
+        auto& shard = (*shards)[i];
+        for (const SalesItemTableItem& item : shard.table<SalesItemColumns>()) {
+            EXPECT_TRUE(shard.table<SalesColumns>().find(item.saleID, nullptr));
+        }
+    }
+    EXPECT_EQ(shardKeys(items.scanOf("S5").get(), &SalesItemTableItem::saleID),
+              std::vector<std::string>({ "S5" }));
+    int64_t first = 0;
+    int64_t last = 0;
+    ASSERT_TRUE(parseDateTime("2021-05-01 00:00:00", &first));
+    ASSERT_TRUE(parseDateTime("2021-05-29 00:00:00", &last));
+    std::vector<std::string> times;
+    const std::unique_ptr<Cursor<SalesTableItem>> cursor = sales.scanTime(first, last);
+    for (SalesTableItem sale; cursor->next(&sale);) {
+        times.push_back(sale.date_time);
+    }
+    EXPECT_EQ(times.size(), 40U);
+    EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+}
+
+TEST_F(TestShards, ReopensAndReshardsFromTheirFiles) {
+    ColumnTable<ProductColumns> source;
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_TRUE(source.insert(shardProduct(i)));
+    }
+    {
+        // Filled from the source the first time
+        ShardedProductEngine products(std::make_shared<ShardSet<ProductColumns>>(
+            SHARD_DIRECTORY, shardOptions(4),
+            [&source]() -> const ColumnTable<ProductColumns>& { return source; }));
+        EXPECT_EQ(products.size(), 20U);
+        for (int i = 20; i < PRODUCTS; ++i) {
+            ASSERT_TRUE(products.insert(shardProduct(i)));
+            // Committed every few writes, with a checkpoint every 50 records
+            if (i % 16 == 0) {
+                ASSERT_TRUE(products.flush());
+            }
+        }
+        EXPECT_EQ(products.remove(shardProduct(3).barcode), 1U);
+        ASSERT_TRUE(products.flush());
+    }
+    ASSERT_TRUE(source.insert(shardProduct(PRODUCTS)));
+    std::vector<std::string> expected = shardProductKeys(PRODUCTS);
+    expected.erase(expected.begin() + 3);
+    {
+        // From the checkpoints and the logs; the source is only read the first time
+        bool isSourceRead = false;
+        ShardedProductEngine products(std::make_shared<ShardSet<ProductColumns>>(
+            SHARD_DIRECTORY, shardOptions(4),
+            [&source, &isSourceRead]() -> const ColumnTable<ProductColumns>& {
+                isSourceRead = true;
+                return source;
+            }));
+        EXPECT_FALSE(isSourceRead);
+        EXPECT_EQ(shardKeys(products.scanRange("", "").get(), &ProductTableItem::barcode),
+                  expected);
+    }
+    {
+        ShardedProductEngine products(productShards(SHARD_DIRECTORY, 3));
+        EXPECT_EQ(shardKeys(products.scanRange("", "").get(), &ProductTableItem::barcode),
+                  expected);
+    }
+    EXPECT_EQ(readShardCount(SHARD_DIRECTORY), 3U);
+    // The old shards are removed
+    std::FILE* oldShard = std::fopen((std::string(SHARD_DIRECTORY) + "/4-0.ckpt").c_str(), "rb");
+    EXPECT_EQ(oldShard, nullptr);
+    if (oldShard) {
+        std::fclose(oldShard);
+    }
+    ShardedProductEngine products(productShards(SHARD_DIRECTORY, 3));
+    EXPECT_EQ(products.size(), expected.size());
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
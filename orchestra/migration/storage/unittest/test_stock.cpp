@@ -0,0 +1,209 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// code under test
+#include <storage/durablelog.hpp>
+#include <storage/stackdbengine.hpp>
+#include <storage/stockcounters.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char STOCK_PREFIX[] = "SC-";
+// never flushed by commit() unless a test asks for it
+constexpr unsigned NO_FLUSH_MS = 3600 * 1000;
+
+ProductTableItem stockedProduct(int id, const std::string& stock) {
+    return ProductTableItem { STOCK_PREFIX + std::to_string(id), "SKU", "bread", "", "cat",
+                              "brand", "pc", stock, "ACTIVE", "1.00", "2.00", "supplier", "S1" };
+}
+
+class TestStockCounters : public testing::Test {
+ public:
+    TestStockCounters() = default;
+    ~TestStockCounters() = default;
+    void SetUp() {
+        TearDown();
+    }
+    void TearDown() {
+        StackDBEngine().products().removeIf([](const ProductTableItem& row) {
+            return row.barcode.compare(0, sizeof(STOCK_PREFIX) - 1, STOCK_PREFIX) == 0;
+        });
+    }
+};
+
+TEST_F(TestStockCounters, TakesOnlyWhatIsInStock) {
+    StackDBEngine engine(ReplacedTables(), NO_FLUSH_MS);
+    ASSERT_TRUE(engine.products().insert(stockedProduct(1, "10")));
+    StockCounters& stock = engine.stock();
+    int64_t value = 0;
+    // No counter until the product is used
+    EXPECT_FALSE(stock.read(stockedProduct(1, "").barcode, &value));
+
+    const std::string barcode = stockedProduct(1, "").barcode;
+    EXPECT_TRUE(stock.take(barcode, 3));
+    ASSERT_TRUE(stock.read(barcode, &value));
+    EXPECT_EQ(value, 7);
+    EXPECT_FALSE(stock.take(barcode, 8));
+    EXPECT_TRUE(stock.take(barcode, 7));
+    EXPECT_FALSE(stock.take(barcode, 1));
+    EXPECT_TRUE(stock.add(barcode, 2));
+    ASSERT_TRUE(stock.read(barcode, &value));
+    EXPECT_EQ(value, 2);
+    EXPECT_FALSE(stock.take("SC-unknown", 1));
+    EXPECT_FALSE(stock.add("SC-unknown", 1));
+    EXPECT_FALSE(stock.add(barcode, -1));
+    EXPECT_FALSE(stock.take(barcode, -1));
+
+    // The row is behind until the counters are flushed
+    ProductTableItem row;
+    ASSERT_TRUE(engine.products().get(barcode, &row));
+    EXPECT_EQ(row.stock, "10");
+    EXPECT_EQ(stock.flush(), 1U);
+    ASSERT_TRUE(engine.products().get(barcode, &row));
+    EXPECT_EQ(row.stock, "2");
+    EXPECT_EQ(stock.flush(), 0U);
+
+    // A written row sets the counter
+    row.stock = "40";
+    ASSERT_TRUE(stock.write(row));
+    ASSERT_TRUE(stock.read(barcode, &value));
+    EXPECT_EQ(value, 40);
+    // A forgotten counter reads its row again
+    ASSERT_TRUE(stock.take(barcode, 1));
+    stock.forget(barcode);
+    EXPECT_FALSE(stock.read(barcode, &value));
+    ASSERT_TRUE(stock.take(barcode, 40));
+    EXPECT_EQ(engine.products().remove(barcode), 1U);
+    stock.forget(barcode);
+    EXPECT_FALSE(stock.take(barcode, 0));
+}
+
+TEST_F(TestStockCounters, ConcurrentCheckoutsNeverOversell) {
+    StackDBEngine engine(ReplacedTables(), NO_FLUSH_MS);
+    constexpr int IN_STOCK = 20000;
+    const std::string hot = stockedProduct(0, "").barcode;
+    ASSERT_TRUE(engine.products().insert(stockedProduct(0, std::to_string(IN_STOCK))));
+    for (int i = 1; i <= 300; ++i) {
+        ASSERT_TRUE(engine.products().insert(stockedProduct(i, "1")));
+    }
+    std::atomic<int> sold { 0 };
+    std::vector<std::thread> registers;
+    for (int i = 0; i < 4; ++i) {
+        registers.emplace_back([&engine, &sold, &hot, i]() {
+            int taken = 0;
+            for (int n = 0; engine.stock().take(hot, 1); ++n) {
+                ++taken;
+                // The other items add counters (and grow the table) meanwhile
+                if (n % 64 == i) {
+                    engine.stock().take(stockedProduct(1 + (n / 64) % 300, "").barcode, 1);
+                }
+            }
+            sold += taken;
+        });
+    }
+    for (std::thread& thread : registers) {
+        thread.join();
+    }
+    EXPECT_EQ(sold.load(), IN_STOCK);
+    int64_t value = -1;
+    ASSERT_TRUE(engine.stock().read(hot, &value));
+    EXPECT_EQ(value, 0);
+    // Every other item was sold at most once
+    for (int i = 1; i <= 300; ++i) {
+        if (engine.stock().read(stockedProduct(i, "").barcode, &value)) {
+            EXPECT_EQ(value, 0);
+        }
+    }
+}
+
+TEST_F(TestStockCounters, CommitFlushesWhenDue) {
+    StackDBEngine engine(ReplacedTables(), 0);
+    ASSERT_TRUE(engine.products().insert(stockedProduct(1, "5")));
+    const std::string barcode = stockedProduct(1, "").barcode;
+    ASSERT_TRUE(engine.stock().take(barcode, 2));
+    engine.commit();
+    ProductTableItem row;
+    ASSERT_TRUE(engine.products().get(barcode, &row));
+    EXPECT_EQ(row.stock, "3");
+}
+
+TEST_F(TestStockCounters, CommitLogsItsOwnChanges) {
+    StackDBEngine engine(ReplacedTables(), NO_FLUSH_MS);
+    ASSERT_TRUE(engine.products().insert(stockedProduct(1, "5")));
+    ASSERT_TRUE(engine.products().insert(stockedProduct(2, "5")));
+    const std::string mine = stockedProduct(1, "").barcode;
+    const std::string other = stockedProduct(2, "").barcode;
+    std::thread([&engine, &other]() { ASSERT_TRUE(engine.stock().take(other, 1)); }).join();
+    ASSERT_TRUE(engine.stock().take(mine, 2));
+    ASSERT_TRUE(engine.stock().add(mine, 1));
+    EXPECT_TRUE(engine.commit());
+    // Logged, not written to the row
+    ProductTableItem row;
+    ASSERT_TRUE(engine.products().get(mine, &row));
+    EXPECT_EQ(row.stock, "5");
+    EXPECT_EQ(engine.stock().flushOwn(), 0U);
+    // The flush logs the changes of the other thread, which did not commit, and writes both
+    EXPECT_EQ(engine.stock().flush(), 2U);
+    ASSERT_TRUE(engine.products().get(mine, &row));
+    EXPECT_EQ(row.stock, "4");
+    ASSERT_TRUE(engine.products().get(other, &row));
+    EXPECT_EQ(row.stock, "4");
+    EXPECT_EQ(engine.stock().flush(), 0U);
+}
+
+TEST_F(TestStockCounters, WrittenRowReplacesTheLoggedChanges) {
+    StackDBEngine engine(ReplacedTables(), NO_FLUSH_MS);
+    ASSERT_TRUE(engine.products().insert(stockedProduct(1, "5")));
+    const std::string barcode = stockedProduct(1, "").barcode;
+    ASSERT_TRUE(engine.stock().take(barcode, 2));
+    EXPECT_TRUE(engine.commit());
+    ASSERT_TRUE(engine.stock().write(stockedProduct(1, "20")));
+    ASSERT_TRUE(engine.stock().take(barcode, 1));
+    engine.stock().flush();
+    ProductTableItem row;
+    ASSERT_TRUE(engine.products().get(barcode, &row));
+    EXPECT_EQ(row.stock, "19");
+}
+
+TEST_F(TestStockCounters, LoggedChangesAreReplayed) {
+    ColumnTable<ProductColumns> products;
+    ASSERT_TRUE(products.insert(stockedProduct(1, "5")));
+    const std::string barcode = stockedProduct(1, "").barcode;
+    applyRecord(LogRecord { 1, TableID::PRODUCT, Mutation::STOCK, Fields(),
+                            Fields { barcode, "-3" } }, &products);
+    applyRecord(LogRecord { 2, TableID::PRODUCT, Mutation::STOCK, Fields(),
+                            Fields { "SC-unknown", "1" } }, &products);
+    ProductTableItem row;
+    ASSERT_TRUE(products.find(barcode, &row));
+    EXPECT_EQ(row.stock, "2");
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,246 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// code under test
+#include <storage/stackdbengine.hpp>
+#include <storage/storageengine.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+template <typename Row>
+std::vector<Row> readAll(Cursor<Row>* cursor) {
+    std::vector<Row> rows;
+    for (Row row; cursor->next(&row);) {
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+/*!
+ * Product table of another engine, for swapping one table
+*/
+class MapProducts : public ProductEngine {
+ public:
+    bool get(const std::string& key, ProductTableItem* out) const override {
+        const auto it = mRows.find(key);
+        if (it == mRows.end()) {
+            return false;
+        }
+        if (out) {
+            *out = it->second;
+        }
+        return true;
+    }
+
+    std::unique_ptr<Cursor<ProductTableItem>> scan() const override {
+        std::vector<ProductTableItem> rows;
+        for (const auto& row : mRows) {
+            rows.push_back(row.second);
+        }
+        return std::unique_ptr<Cursor<ProductTableItem>>(
+            new VectorCursor<ProductTableItem>(std::move(rows)));
+    }
+
+    std::unique_ptr<Cursor<ProductTableItem>> scanRange(const std::string& first,
+                                                        const std::string& last) const override {
+        std::vector<ProductTableItem> rows;
+        for (auto it = mRows.lower_bound(first); it != mRows.end(); ++it) {
+            if (!last.empty() && (it->first > last)) {
+                break;
+            }
+            rows.push_back(it->second);
+        }
+        return std::unique_ptr<Cursor<ProductTableItem>>(
+            new VectorCursor<ProductTableItem>(std::move(rows)));
+    }
+
+    std::unique_ptr<Cursor<ProductTableItem>> scanOf(const std::string& key) const override {
+        std::vector<ProductTableItem> rows(1);
+        if (!get(key, &rows.front())) {
+            rows.clear();
+        }
+        return std::unique_ptr<Cursor<ProductTableItem>>(
+            new VectorCursor<ProductTableItem>(std::move(rows)));
+    }
+
+    bool insert(const ProductTableItem& row) override {
+        return mRows.emplace(row.barcode, row).second;
+    }
+
+    bool update(const ProductTableItem& row) override {
+        const auto it = mRows.find(row.barcode);
+        if (it == mRows.end()) {
+            return false;
+        }
+        it->second = row;
+        return true;
+    }
+
+    size_t remove(const std::string& key) override {
+        return mRows.erase(key);
+    }
+
+    size_t removeOf(const std::string& key) override {
+        return remove(key);
+    }
+
+    size_t removeIf(const Predicate& predicate) override {
+        size_t count = 0;
+        for (auto it = mRows.begin(); it != mRows.end();) {
+            if (predicate(it->second)) {
+                it = mRows.erase(it);
+                ++count;
+            } else {
+                ++it;
+            }
+        }
+        return count;
+    }
+
+    size_t size() const override {
+        return mRows.size();
+    }
+
+ private:
+    std::map<std::string, ProductTableItem> mRows;
+};
+
+class MapProductsEngine : public StackDBEngine {
+ public:
+    MapProductsEngine() : StackDBEngine(withMapProducts()) {}
+
+ private:
+    static ReplacedTables withMapProducts() {
+        ReplacedTables replaced;
+        replaced.products.reset(new MapProducts());
+        return replaced;
+    }
+};
+
+TEST(TestStorageEngine, TablesWithAndWithoutPrimaryKey) {
+    StorageEngine& engine = STORAGE();
+    ASSERT_TRUE(engine.customers().insert(CustomerTableItem { "SE-C1", "Ana", "", "Cruz",
+                                                              "1990/01/01", "F" }));
+    EXPECT_FALSE(engine.customers().insert(CustomerTableItem { "SE-C1", "Dup", "", "", "", "" }));
+    EXPECT_TRUE(engine.personalIds().insert(PersonalIdTableItem { "SE-C1", "SSS", "1" }));
+    EXPECT_TRUE(engine.personalIds().insert(PersonalIdTableItem { "SE-C1", "TIN", "2" }));
+
+    CustomerTableItem customer;
+    ASSERT_TRUE(engine.customers().get("SE-C1", &customer));
+    EXPECT_EQ(customer.firstname, "Ana");
+    // Detail tables are keyed by the person ID; update replaces the first row
+    EXPECT_TRUE(engine.personalIds().update(PersonalIdTableItem { "SE-C1", "UMID", "3" }));
+    const auto ids = engine.personalIds().scanOf("SE-C1");
+    const std::vector<PersonalIdTableItem> rows = readAll(ids.get());
+    ASSERT_EQ(rows.size(), 2U);
+    EXPECT_EQ(rows[0].type, "UMID");
+    EXPECT_EQ(rows[1].type, "TIN");
+
+    EXPECT_EQ(engine.personalIds().remove("SE-C1"), 2U);
+    EXPECT_EQ(engine.customers().remove("SE-C1"), 1U);
+    EXPECT_FALSE(engine.customers().get("SE-C1", nullptr));
+}
+
+TEST(TestStorageEngine, CursorReadsOneVersion) {
+    StorageEngine& engine = STORAGE();
+    const size_t before = engine.uoms().size();
+    ASSERT_TRUE(engine.uoms().insert(UOMTableItem { "SE-U1", "unit", "u" }));
+    const auto cursor = engine.uoms().scan();
+    // Writes after the cursor opened are not seen
+    ASSERT_TRUE(engine.uoms().insert(UOMTableItem { "SE-U2", "unit", "u" }));
+    EXPECT_EQ(readAll(cursor.get()).size(), before + 1);
+    EXPECT_EQ(engine.uoms().removeIf([](const UOMTableItem& uom) {
+        return uom.ID.compare(0, 3, "SE-") == 0;
+    }), 2U);
+}
+
+TEST(TestStorageEngine, SalesByTimeAndItemsBySale) {
+    StorageEngine& engine = STORAGE();
+    const std::vector<std::string> times { "2041-05-02 09:00:00", "2041-05-01 10:00:00",
+                                           "2041-05-03 11:00:00" };
+    for (size_t i = 0; i < times.size(); ++i) {
+        const std::string id = "SE-S" + std::to_string(i);
+        ASSERT_TRUE(engine.sales().insert(SalesTableItem { id, times[i], "2.00", "1.79", "0.21",
+                                                           "0.00", "2.00", "2.00", "Cash",
+                                                           "0.00", "E1", "C1" }));
+        engine.salesItems().insert(SalesItemTableItem { id, "P1", "Water", "1.00", "2", "2.00" });
+    }
+    int64_t first = 0;
+    int64_t last = 0;
+    ASSERT_TRUE(parseDateTime("2041-05-01 00:00:00", &first));
+    ASSERT_TRUE(parseDateTime("2041-05-02 23:59:59", &last));
+    const auto cursor = engine.sales().scanTime(first, last);
+    const std::vector<SalesTableItem> sales = readAll(cursor.get());
+    ASSERT_EQ(sales.size(), 2U);
+    EXPECT_EQ(sales[0].ID, "SE-S1");
+    EXPECT_EQ(sales[1].ID, "SE-S0");
+
+    const auto items = engine.salesItems().scanOf("SE-S1");
+    const std::vector<SalesItemTableItem> rows = readAll(items.get());
+    ASSERT_EQ(rows.size(), 1U);
+    EXPECT_EQ(rows[0].quantity, "2");
+
+    for (size_t i = 0; i < times.size(); ++i) {
+        const std::string id = "SE-S" + std::to_string(i);
+        EXPECT_EQ(engine.sales().remove(id), 1U);
+        EXPECT_EQ(engine.salesItems().remove(id), 1U);
+    }
+}
+
+TEST(TestStorageEngine, InstalledEngineReplacesOneTable) {
+    StorageEngine::install(std::unique_ptr<StorageEngine>(new MapProductsEngine()));
+    EXPECT_EQ(STORAGE().products().size(), 0U);
+    ASSERT_TRUE(STORAGE().products().insert(ProductTableItem { "SE-P1", "SKU", "Water", "",
+                                                               "Beverage", "Brand", "L", "1",
+                                                               "ACTIVE", "1.00", "2.00", "",
+                                                               "" }));
+    EXPECT_FALSE(DATABASE().SELECT_PRODUCT_TABLE().contains("SE-P1"));
+    // The other tables are still the StackDB ones
+    EXPECT_EQ(STORAGE().categories().size(), DATABASE().SELECT_CATEGORY_TABLE().size());
+    EXPECT_FALSE(STORAGE().isInStackDB());
+    // Bulk inserts reach the replaced table too
+    std::vector<ProductTableItem> rows(2, ProductTableItem { "SE-P1", "SKU", "Water", "",
+                                                             "Beverage", "Brand", "L", "1",
+                                                             "ACTIVE", "1.00", "2.00", "",
+                                                             "" });
+    rows[1].barcode = "SE-P2";
+    std::vector<size_t> duplicates;
+    EXPECT_EQ(STORAGE().products().insertAll(rows, &duplicates), 1U);
+    EXPECT_EQ(duplicates, std::vector<size_t>({ 0 }));
+    EXPECT_EQ(STORAGE().products().size(), 2U);
+
+    // Back to the default engine
+    StorageEngine::install(nullptr);
+    EXPECT_TRUE(STORAGE().isInStackDB());
+    EXPECT_FALSE(STORAGE().products().get("SE-P1", nullptr));
+    EXPECT_EQ(STORAGE().products().size(), DATABASE().SELECT_PRODUCT_TABLE().size());
+}
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
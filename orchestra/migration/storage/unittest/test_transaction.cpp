@@ -0,0 +1,249 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/resource.h>
+#endif
+
+// code under test
+#include <storage/stackdb.hpp>
+#include <storage/wal.hpp>
+
+namespace dataprovider {
+namespace db {
+namespace test {
+
+constexpr char LOG_PATH[] = "test_transaction.wal";
+
+class TestTransaction : public testing::Test {
+ public:
+    TestTransaction() = default;
+    ~TestTransaction() = default;
+    void SetUp() {}
+    void TearDown() {
+        DATABASE().SELECT_CUSTOMER_TABLE().erase(CUSTOMER_ID);
+        DATABASE().SELECT_ADDRESS_TABLE().eraseAllOf(CUSTOMER_ID);
+        std::remove(LOG_PATH);
+    }
+
+    void createCustomer() {
+        DATABASE().SELECT_CUSTOMER_TABLE().insert(CustomerTableItem {
+            CUSTOMER_ID, "first", "middle", "last", "2000-01-01", "F" });
+        DATABASE().SELECT_ADDRESS_TABLE().insert(AddressTableItem {
+            CUSTOMER_ID, "line 1", "line 2", "city", "province", "6000" });
+    }
+
+    bool hasCustomer() const {
+        return DATABASE().SELECT_CUSTOMER_TABLE().contains(CUSTOMER_ID);
+    }
+
+    bool hasAddress() const {
+        AddressTableItem address;
+        return DATABASE().SELECT_ADDRESS_TABLE().findFirstOf(CUSTOMER_ID, &address);
+    }
+
+    // What a reader on another thread sees
+    bool othersSeeCustomer() const {
+        return std::async(std::launch::async, [this]() { return hasCustomer(); }).get();
+    }
+
+    bool othersSeeAddress() const {
+        return std::async(std::launch::async, [this]() { return hasAddress(); }).get();
+    }
+
+    const std::string CUSTOMER_ID = "TXN-CUSTOMER";
+};
+
+TEST_F(TestTransaction, WritesArePublishedTogetherAtTheEnd) {
+    {
+        const Transaction transaction;
+        createCustomer();
+        // Not visible to the other readers yet
+        EXPECT_FALSE(othersSeeCustomer());
+        EXPECT_FALSE(othersSeeAddress());
+    }
+    EXPECT_TRUE(othersSeeCustomer());
+    EXPECT_TRUE(othersSeeAddress());
+}
+
+TEST_F(TestTransaction, ReadsSeeTheirOwnWrites) {
+    const Transaction transaction;
+    createCustomer();
+    EXPECT_TRUE(hasCustomer());
+    EXPECT_TRUE(hasAddress());
+    CustomerTableItem customer;
+    ASSERT_TRUE(DATABASE().SELECT_CUSTOMER_TABLE().find(CUSTOMER_ID, &customer));
+    EXPECT_EQ(customer.firstname, "first");
+    DATABASE().SELECT_CUSTOMER_TABLE().erase(CUSTOMER_ID);
+    EXPECT_FALSE(hasCustomer());
+}
+
+TEST_F(TestTransaction, CommitEndsTheTransactionNow) {
+    Transaction transaction;
+    createCustomer();
+    EXPECT_FALSE(othersSeeCustomer());
+    EXPECT_TRUE(transaction.commit());
+    EXPECT_TRUE(othersSeeCustomer());
+    EXPECT_TRUE(othersSeeAddress());
+    // Not part of the committed transaction anymore
+    transaction.rollback();
+    EXPECT_TRUE(othersSeeCustomer());
+}
+
+TEST_F(TestTransaction, RolledBackTransactionIsNotCommitted) {
+    Transaction transaction;
+    createCustomer();
+    transaction.rollback();
+    EXPECT_FALSE(transaction.commit());
+    EXPECT_FALSE(hasCustomer());
+}
+
+TEST_F(TestTransaction, RollbackDropsTheWritesOfEveryTable) {
+    createCustomer();
+    {
+        Transaction transaction;
+        DATABASE().SELECT_CUSTOMER_TABLE().erase(CUSTOMER_ID);
+        DATABASE().SELECT_ADDRESS_TABLE().eraseAllOf(CUSTOMER_ID);
+        transaction.rollback();
+    }
+    EXPECT_TRUE(hasCustomer());
+    EXPECT_TRUE(hasAddress());
+}
+
+TEST_F(TestTransaction, ExceptionRollsBack) {
+    try {
+        const Transaction transaction;
+        createCustomer();
+        throw std::runtime_error("interrupted");
+    } catch (const std::runtime_error&) {
+    }
+    EXPECT_FALSE(hasCustomer());
+    EXPECT_FALSE(hasAddress());
+}
+
+TEST_F(TestTransaction, NestedTransactionIsPartOfTheOuterOne) {
+    {
+        const Transaction transaction;
+        {
+            const Transaction nested;
+            createCustomer();
+        }
+        EXPECT_FALSE(othersSeeCustomer());
+    }
+    EXPECT_TRUE(othersSeeCustomer());
+}
+
+TEST_F(TestTransaction, ReplaySkipsTransactionWithoutCommit) {
+    const std::vector<LogRecord> records {
+        LogRecord { 0, TableID::CUSTOMER, Mutation::INSERT, {}, { "C1" } },
+        LogRecord { 0, TableID::ADDRESS, Mutation::INSERT, {}, { "C1" } },
+    };
+    long committedSize = 0;  // NOLINT(runtime/int)
+    {
+        WriteAheadLog wal(LOG_PATH, 0, 0);
+        wal.append(TableID::UOM, Mutation::INSERT, {}, { "U1" });
+        wal.appendTransaction(records);
+        wal.sync();
+        std::FILE* file = std::fopen(LOG_PATH, "rb");
+        ASSERT_NE(file, nullptr);
+        std::fseek(file, 0, SEEK_END);
+        committedSize = std::ftell(file);
+        std::fclose(file);
+        // Crash while writing the second transaction: its COMMIT marker is lost
+        wal.appendTransaction(records);
+        wal.sync();
+    }
+    std::FILE* file = std::fopen(LOG_PATH, "rb");
+    ASSERT_NE(file, nullptr);
+    std::string contents(1024, '\0');
+    contents.resize(std::fread(&contents[0], 1, contents.size(), file));
+    std::fclose(file);
+    // Frame header, LSN, table and operation, two empty field lists
+    const size_t markerSize = 8 + 8 + 2 + 4 + 4;
+    file = std::fopen(LOG_PATH, "wb");
+    std::fwrite(contents.data(), 1, contents.size() - markerSize, file);
+    std::fclose(file);
+
+    std::vector<TableID> applied;
+    const uint64_t lastLsn = WriteAheadLog::replay(LOG_PATH, 0, [&applied](const LogRecord& r) {
+        applied.push_back(r.table);
+    });
+    EXPECT_EQ(applied, std::vector<TableID>({ TableID::UOM, TableID::CUSTOMER,
+                                              TableID::ADDRESS }));
+    // BEGIN, two records, COMMIT after the single record
+    EXPECT_EQ(lastLsn, 5);
+
+    // The incomplete transaction was cut off, so the next records follow the committed ones
+    file = std::fopen(LOG_PATH, "rb");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, 0, SEEK_END);
+    EXPECT_EQ(std::ftell(file), committedSize);
+    std::fclose(file);
+}
+
+#ifndef _WIN32
+TEST_F(TestTransaction, FailedWriteIsNotDurableAndIsWrittenAgain) {
+    WriteAheadLog wal(LOG_PATH, 0, 0);
+    wal.append(TableID::UOM, Mutation::INSERT, {}, { "U1" });
+    ASSERT_TRUE(wal.sync());
+    std::FILE* file = std::fopen(LOG_PATH, "rb");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, 0, SEEK_END);
+    const long goodSize = std::ftell(file);  // NOLINT(runtime/int)
+    std::fclose(file);
+
+    // The disk fills up in the middle of the next record
+    rlimit limit {};
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &limit), 0);
+    const rlimit original = limit;
+    limit.rlim_cur = static_cast<rlim_t>(goodSize + 100);
+    const auto previousHandler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    const uint64_t lsn = wal.append(TableID::UOM, Mutation::INSERT, {}, {
+        std::string(4096, 'x') });
+    const bool isCommitted = wal.commit(lsn);
+    setrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, previousHandler);
+    EXPECT_FALSE(isCommitted);
+
+    // The torn part was cut off, and the record is written by the next commit
+    file = std::fopen(LOG_PATH, "rb");
+    ASSERT_NE(file, nullptr);
+    std::fseek(file, 0, SEEK_END);
+    EXPECT_EQ(std::ftell(file), goodSize);
+    std::fclose(file);
+    const uint64_t nextLsn = wal.append(TableID::UOM, Mutation::INSERT, {}, { "U3" });
+    EXPECT_TRUE(wal.commit(nextLsn));
+    std::vector<uint64_t> lsns;
+    WriteAheadLog::replay(LOG_PATH, 0, [&lsns](const LogRecord& r) { lsns.push_back(r.lsn); });
+    EXPECT_EQ(lsns, std::vector<uint64_t>({ 1, lsn, nextLsn }));
+}
+#endif
+
+}  // namespace test
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,489 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#include "wal.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <logger/loghelper.hpp>
+
+namespace dataprovider {
+namespace db {
+
+namespace {
+
+constexpr size_t FRAME_HEADER_SIZE = 8;
+// A frame bigger than this can only be garbage
+constexpr uint32_t MAX_PAYLOAD_SIZE = 64 * 1024 * 1024;
+
+// Integers are stored little-endian regardless of the host
+void putU32(uint32_t value, std::string* out) {
+    for (int i = 0; i < 4; ++i) {
+        out->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void putU64(uint64_t value, std::string* out) {
+    putU32(static_cast<uint32_t>(value & 0xFFFFFFFFU), out);
+    putU32(static_cast<uint32_t>(value >> 32), out);
+}
+
+void putFields(const Fields& fields, std::string* out) {
+    putU32(static_cast<uint32_t>(fields.size()), out);
+    for (const std::string& field : fields) {
+        putU32(static_cast<uint32_t>(field.size()), out);
+        out->append(field);
+    }
+}
+
+class PayloadReader {
+ public:
+    explicit PayloadReader(const std::string& payload) : mPayload(payload) {}
+
+    bool getU8(uint8_t* value) {
+        if (mPos + 1 > mPayload.size()) {
+            return false;
+        }
+        *value = static_cast<uint8_t>(mPayload[mPos++]);
+        return true;
+    }
+
+    bool getU32(uint32_t* value) {
+        if (mPos + 4 > mPayload.size()) {
+            return false;
+        }
+        *value = 0;
+        for (int i = 0; i < 4; ++i) {
+            *value |= static_cast<uint32_t>(static_cast<uint8_t>(mPayload[mPos++])) << (8 * i);
+        }
+        return true;
+    }
+
+    bool getU64(uint64_t* value) {
+        uint32_t low = 0;
+        uint32_t high = 0;
+        if (!getU32(&low) || !getU32(&high)) {
+            return false;
+        }
+        *value = (static_cast<uint64_t>(high) << 32) | low;
+        return true;
+    }
+
+    bool getFields(Fields* fields) {
+        uint32_t count = 0;
+        if (!getU32(&count)) {
+            return false;
+        }
+        fields->clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t size = 0;
+            if (!getU32(&size) || (mPos + size > mPayload.size())) {
+                return false;
+            }
+            fields->emplace_back(mPayload, mPos, size);
+            mPos += size;
+        }
+        return true;
+    }
+
+ private:
+    const std::string& mPayload;
+    size_t mPos = 0;
+};
+
+uint32_t readU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+/*!
+ * Keeps only the records after [lsn]
+*/
+bool dropRecords(const std::string& path, uint64_t lsn) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    std::string kept;
+    LogRecord record;
+    while (readRecord(in, &record)) {
+        if (record.lsn > lsn) {
+            kept.append(encodeRecord(record));
+        }
+    }
+    std::fclose(in);
+    return replaceFile(path, kept);
+}
+
+// 0 without a file
+int64_t sizeOf(std::FILE* file) {
+    if (!file || (std::fseek(file, 0, SEEK_END) != 0)) {
+        return 0;
+    }
+    return std::ftell(file);
+}
+
+}  // namespace
+
+uint32_t crc32(const char* data, size_t size, uint32_t crc) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t {};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc ^= 0xFFFFFFFFU;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFU;
+}
+
+std::string encodeRecord(const LogRecord& record) {
+    std::string payload;
+    putU64(record.lsn, &payload);
+    payload.push_back(static_cast<char>(record.table));
+    payload.push_back(static_cast<char>(record.operation));
+    putFields(record.before, &payload);
+    putFields(record.after, &payload);
+
+    std::string frame;
+    frame.reserve(FRAME_HEADER_SIZE + payload.size());
+    putU32(static_cast<uint32_t>(payload.size()), &frame);
+    putU32(crc32(payload.data(), payload.size()), &frame);
+    frame.append(payload);
+    return frame;
+}
+
+bool readRecord(std::FILE* file, LogRecord* record) {
+    char header[FRAME_HEADER_SIZE];
+    if (std::fread(header, 1, FRAME_HEADER_SIZE, file) != FRAME_HEADER_SIZE) {
+        return false;
+    }
+    const uint32_t size = readU32(header);
+    const uint32_t checksum = readU32(header + 4);
+    if (size > MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    std::string payload(size, '\0');
+    if ((std::fread(&payload[0], 1, size, file) != size)
+        || (crc32(payload.data(), payload.size()) != checksum)) {
+        return false;
+    }
+    PayloadReader reader(payload);
+    uint8_t table = 0;
+    uint8_t operation = 0;
+    if (!reader.getU64(&record->lsn) || !reader.getU8(&table) || !reader.getU8(&operation)
+        || !reader.getFields(&record->before) || !reader.getFields(&record->after)) {
+        return false;
+    }
+    record->table = static_cast<TableID>(table);
+    record->operation = static_cast<Mutation>(operation);
+    return true;
+}
+
+bool truncateFile(const std::string& path, int64_t size) {
+#ifdef _WIN32
+    const int fd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool isTruncated = _chsize_s(fd, size) == 0;
+    _close(fd);
+    return isTruncated;
+#else
+    return truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool syncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool replaceFile(const std::string& path, const std::string& contents) {
+    const std::string temp = path + ".tmp";
+    std::FILE* out = std::fopen(temp.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    const size_t written = std::fwrite(contents.data(), 1, contents.size(), out);
+    const bool isWritten = (written == contents.size()) && syncFile(out);
+    std::fclose(out);
+    if (!isWritten) {
+        std::remove(temp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on windows
+    std::remove(path.c_str());
+#endif
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t lastLsn, unsigned commitDelayUs)
+    : mPath(path), mCommitDelayUs(commitDelayUs), mLastLsn(lastLsn), mDurableLsn(lastLsn),
+      mResetLsn(lastLsn) {
+    mFile = std::fopen(mPath.c_str(), "ab");
+    if (!mFile) {
+        LOG_ERROR("Cannot open the write-ahead log %s", mPath.c_str());
+    }
+    mFileSize = sizeOf(mFile);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    sync();
+    if (mFile) {
+        std::fclose(mFile);
+    }
+}
+
+uint64_t WriteAheadLog::append(TableID table, Mutation operation, Fields before, Fields after) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    const LogRecord record { ++mLastLsn, table, operation, std::move(before), std::move(after) };
+    mBuffer.append(encodeRecord(record));
+    return record.lsn;
+}
+
+uint64_t WriteAheadLog::appendTransaction(const std::vector<LogRecord>& records) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // The table of a marker is not used
+    const bool isGroup = records.size() > 1;
+    if (isGroup) {
+        mBuffer.append(encodeRecord(LogRecord { ++mLastLsn, TableID {}, Mutation::BEGIN }));
+    }
+    for (const LogRecord& record : records) {
+        mBuffer.append(encodeRecord(LogRecord { ++mLastLsn, record.table, record.operation,
+                                                record.before, record.after }));
+    }
+    if (isGroup) {
+        mBuffer.append(encodeRecord(LogRecord { ++mLastLsn, TableID {}, Mutation::COMMIT }));
+    }
+    return mLastLsn;
+}
+
+bool WriteAheadLog::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mDurableLsn < lsn) {
+        if (mFlushing) {
+            // Another committer is writing; its batch may already include our records
+            mFlushed.wait(lock);
+            continue;
+        }
+        if (!flush(&lock)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteAheadLog::sync() {
+    return commit(lastLsn());
+}
+
+bool WriteAheadLog::flush(std::unique_lock<std::mutex>* lock) {
+    mFlushing = true;
+    if (mCommitDelayUs > 0) {
+        // Give the other writers a chance to join this batch
+        lock->unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(mCommitDelayUs));
+        lock->lock();
+    }
+    std::string batch;
+    batch.swap(mBuffer);
+    const uint64_t batchLsn = mLastLsn;
+    lock->unlock();
+
+    // Writers keep appending to mBuffer while we are on the disk
+    const bool isWritten = writeBatch(batch);
+
+    lock->lock();
+    if (isWritten) {
+        mDurableLsn = batchLsn;
+    } else {
+        // Ahead of the records appended meanwhile, for the next commit to write again
+        mBuffer.insert(0, batch);
+    }
+    mFlushing = false;
+    mFlushed.notify_all();
+    return isWritten;
+}
+
+bool WriteAheadLog::writeBatch(const std::string& batch) {
+    if (mIsTorn) {
+        cutTornFrame();
+    }
+    if (!mIsTorn && mFile && (std::fwrite(batch.data(), 1, batch.size(), mFile) == batch.size())
+        && syncFile(mFile)) {
+        mFileSize += static_cast<int64_t>(batch.size());
+        return true;
+    }
+    LOG_ERROR("Failed to write %u bytes to %s", static_cast<unsigned>(batch.size()),
+              mPath.c_str());
+    // A torn frame would end the replay before the records written after it
+    mIsTorn = true;
+    cutTornFrame();
+    return false;
+}
+
+void WriteAheadLog::cutTornFrame() {
+    if (mFile) {
+        std::fclose(mFile);
+    }
+    mIsTorn = !truncateFile(mPath, mFileSize);
+    mFile = std::fopen(mPath.c_str(), "ab");
+    if (mIsTorn || !mFile) {
+        LOG_ERROR("Cannot cut the failed write off %s", mPath.c_str());
+    }
+}
+
+void WriteAheadLog::reset(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    // Take the file from the committers, like flush() does
+    mFlushed.wait(lock, [this] { return !mFlushing; });
+    mFlushing = true;
+    std::string batch;
+    batch.swap(mBuffer);
+    const uint64_t batchLsn = mLastLsn;
+    lock.unlock();
+
+    // Writers keep appending to mBuffer meanwhile; the file is rewritten without the records
+    // that the checkpoint has, so the ones appended while it was written are kept
+    const bool isWritten = writeBatch(batch);
+    if (mFile) {
+        std::fclose(mFile);
+    }
+    // Only the whole records are kept, so this also drops a torn frame
+    const bool isReset = dropRecords(mPath, lsn);
+    mIsTorn = mIsTorn && !isReset;
+    mFile = std::fopen(mPath.c_str(), "ab");
+    mFileSize = sizeOf(mFile);
+    if (!isReset || !mFile) {
+        // The log still replays correctly on top of the checkpoint, it is only longer
+        LOG_ERROR("Cannot reset the write-ahead log %s", mPath.c_str());
+    }
+
+    lock.lock();
+    if (isWritten) {
+        mDurableLsn = batchLsn;
+    } else {
+        mBuffer.insert(0, batch);
+    }
+    mResetLsn = std::max(mResetLsn, lsn);
+    mFlushing = false;
+    mFlushed.notify_all();
+}
+
+uint64_t WriteAheadLog::lastLsn() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLastLsn;
+}
+
+size_t WriteAheadLog::recordCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return static_cast<size_t>(mLastLsn - mResetLsn);
+}
+
+uint64_t WriteAheadLog::replay(const std::string& path, uint64_t afterLsn, const Apply& apply) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        // No log yet
+        return afterLsn;
+    }
+    uint64_t lastLsn = afterLsn;
+    long validSize = 0;  // NOLINT(runtime/int)
+    LogRecord record;
+    // records of the open transaction, if any
+    std::vector<LogRecord> group;
+    bool isInGroup = false;
+    while (readRecord(file, &record)) {
+        if (record.operation == Mutation::BEGIN) {
+            isInGroup = true;
+            group.clear();
+            continue;
+        }
+        if (isInGroup && (record.operation != Mutation::COMMIT)) {
+            group.push_back(record);
+            continue;
+        }
+        // A whole transaction or a single record
+        if (isInGroup) {
+            isInGroup = false;
+        } else {
+            group.assign(1, record);
+        }
+        validSize = std::ftell(file);
+        if (record.lsn <= afterLsn) {
+            // Already in the checkpoint (crash between checkpoint and log reset)
+            continue;
+        }
+        for (const LogRecord& grouped : group) {
+            apply(grouped);
+        }
+        lastLsn = record.lsn;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const long fileSize = std::ftell(file);  // NOLINT(runtime/int)
+    std::fclose(file);
+
+    if (validSize < fileSize) {
+        LOG_WARN("Discarding %ld bytes of torn log tail in %s", fileSize - validSize, path.c_str());
+        if (!truncateFile(path, validSize)) {
+            LOG_ERROR("Cannot truncate %s", path.c_str());
+        }
+    }
+    return lastLsn;
+}
+
+}  // namespace db
+}  // namespace dataprovider
@@ -0,0 +1,178 @@
+/**************************************************************************************************
+*                                            PSCORE                                               *
+*                               Copyright (C) 2021 Pointon Software                               *
+*                                                                                                 *
+*           This program is free software: you can redistribute it and/or modify                  *
+*           it under the terms of the GNU Affero General Public License as published              *
+*           by the Free Software Foundation, either version 3 of the License, or                  *
+*           (at your option) any later version.                                                   *
+*                                                                                                 *
+*           This program is distributed in the hope that it will be useful,                       *
+*           but WITHOUT ANY WARRANTY; without even the implied warranty of                        *
+*           MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                         *
+*           GNU Affero General Public License for more details.                                   *
+*                                                                                                 *
+*           You should have received a copy of the GNU Affero General Public License              *
+*           along with this program.  If not, see <https://www.gnu.org/licenses/>.                *
+*                                                                                                 *
+*           Ben Ziv <pointonsoftware@gmail.com>                                                   *
+*                                                                                                 *
+**************************************************************************************************/
+#ifndef ORCHESTRA_MIGRATION_STORAGE_WAL_HPP_
+#define ORCHESTRA_MIGRATION_STORAGE_WAL_HPP_
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "indexedtable.hpp"
+#include "rowcodec.hpp"
+
+namespace dataprovider {
+namespace db {
+
+/*!
+ * One table mutation
+ * [before] is empty for INSERT; [after] is empty for ERASE
+*/
+struct LogRecord {
+    uint64_t lsn;
+    TableID table;
+    Mutation operation;
+    Fields before;
+    Fields after;
+};
+
+/*!
+ * Framed record format shared by the log and the checkpoint
+ * [u32 payload size][u32 crc32 of payload][payload]
+*/
+std::string encodeRecord(const LogRecord& record);
+/*!
+ * Reads the next frame from [file]
+ * Returns false at the end of the file or at a torn/corrupted frame
+*/
+bool readRecord(std::FILE* file, LogRecord* record);
+/*!
+ * Returns the CRC-32 of [data], continuing [crc], the CRC-32 of the bytes before it
+ * e.g. crc32(b, n, crc32(a, m)) is the CRC-32 of a followed by b
+*/
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0);
+/*!
+ * Flushes the stdio buffers and the OS cache of [file] to the disk
+*/
+bool syncFile(std::FILE* file);
+/*!
+ * Keeps only the first [size] bytes of the file
+*/
+bool truncateFile(const std::string& path, int64_t size);
+/*!
+ * Atomically replaces the file with [contents]
+ * Written to a temporary file that is renamed over it, so a crash leaves the old or the new
+ * contents, never a mix
+*/
+bool replaceFile(const std::string& path, const std::string& contents);
+/*!
+ * Returns false if the directory cannot be created, or exists already
+*/
+bool makeDirectory(const std::string& path);
+
+/*!
+ * Append-only log of table mutations
+ *
+ * append() only buffers the record and is cheap. commit() makes every record up to the LSN
+ * durable; concurrent committers share one write + fsync (group commit): the first caller
+ * becomes the leader and flushes everything buffered so far, the rest wait for it.
+ * The optional commit delay lets the leader wait for more records before flushing.
+ * A batch that fails to write is cut off the file again and kept in memory; commit() reports
+ * the failure, and the next commit() writes the batch again.
+*/
+class WriteAheadLog {
+ public:
+    typedef std::function<void(const LogRecord&)> Apply;
+
+    /*!
+     * Opens the log for appending; [lastLsn] is the last LSN already in the log or checkpoint
+    */
+    WriteAheadLog(const std::string& path, uint64_t lastLsn, unsigned commitDelayUs);
+    ~WriteAheadLog();
+
+    inline bool isOpen() const {
+        return mFile != nullptr;
+    }
+
+    /*!
+     * Buffers the record and returns its LSN
+    */
+    uint64_t append(TableID table, Mutation operation, Fields before, Fields after);
+    /*!
+     * Buffers the records of a transaction as one group and returns the LSN of its end
+     * The group is enclosed in BEGIN/COMMIT markers; replay() skips a group without COMMIT.
+    */
+    uint64_t appendTransaction(const std::vector<LogRecord>& records);
+    /*!
+     * Blocks until every record up to [lsn] is on the disk
+     * Returns false if they could not be written; they are not durable then.
+    */
+    bool commit(uint64_t lsn);
+    /*!
+     * Blocks until every appended record is on the disk; returns false like commit()
+    */
+    bool sync();
+    /*!
+     * Drops the records up to [lsn]; only call once a checkpoint holds them
+     * Records appended after [lsn] (while the checkpoint was written) are kept.
+    */
+    void reset(uint64_t lsn);
+    uint64_t lastLsn() const;
+    /*!
+     * Number of records appended since the log was opened or reset
+    */
+    size_t recordCount() const;
+
+    /*!
+     * Calls [apply] for every record after [afterLsn], in log order
+     * The records of a transaction are only applied once its COMMIT marker is read.
+     * A torn tail (crash while writing) is cut off so that new records follow valid ones
+     * Returns the last LSN found in the log, or [afterLsn] if there is none
+    */
+    static uint64_t replay(const std::string& path, uint64_t afterLsn, const Apply& apply);
+
+ private:
+    const std::string mPath;
+    const unsigned mCommitDelayUs;
+    std::FILE* mFile = nullptr;
+    mutable std::mutex mMutex;
+    std::condition_variable mFlushed;
+    // encoded records that are not written yet
+    std::string mBuffer;
+    uint64_t mLastLsn;
+    uint64_t mDurableLsn;
+    // LSN of the last open/reset; the LSNs are consecutive, so this gives the record count
+    uint64_t mResetLsn;
+    // true while one thread owns mFile
+    bool mFlushing = false;
+    // bytes of the file that hold whole records; owned with mFile
+    int64_t mFileSize = 0;
+    // a failed write left a torn frame after mFileSize that could not be cut off yet
+    bool mIsTorn = false;
+
+    /*!
+     * Writes the buffered records; on failure they are back in the buffer
+    */
+    bool flush(std::unique_lock<std::mutex>* lock);
+    /*!
+     * Appends [batch] to the file and syncs it, or cuts the file back to mFileSize
+    */
+    bool writeBatch(const std::string& batch);
+    /*!
+     * Cuts the file back to mFileSize and opens it again
+    */
+    void cutTornFrame();
+};
+
+}  // namespace db
+}  // namespace dataprovider
+#endif  // ORCHESTRA_MIGRATION_STORAGE_WAL_HPP_
@@ -36,26 +36,9 @@ std::string generateCustomerID(const std::string& p1, const std::string& p2) {
     return "CM" + toUpper(p1.at(0) + p2.substr(0, 2)) + generateChars(6);
 }
 
-/**
- * Code based-from StackOverflow by Galik
- * Author profile: https://stackoverflow.com/users/3807729/galik
- *
- * Original question: https://stackoverflow.com/q/440133/3975468
- * Answer: https://stackoverflow.com/a/24586587/3975468
-*/
 std::string generateChars(const uint8_t len) {
-    static auto& chrs = "0123456789"
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
     thread_local static std::mt19937 rg {std::random_device {}()};
-    thread_local static
-        std::uniform_int_distribution<std::string::size_type> pick(0, sizeof(chrs) - 2);
-
-    std::string temp;
-    temp.reserve(len);
-    for (int i = 0; i < len; ++i) {
-        temp += chrs[pick(rg)];
-    }
-    return temp;
+    return generateChars(len, &rg);
 }
 
 }  // namespace chargenerator
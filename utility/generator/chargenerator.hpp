@@ -20,6 +20,8 @@
 **************************************************************************************************/
 #ifndef UTILITY_GENERATOR_CHARGENERATOR_HPP_
 #define UTILITY_GENERATOR_CHARGENERATOR_HPP_
+#include <cstdint>
+#include <random>
 #include <string>
 
 namespace utility {
@@ -46,6 +48,29 @@ extern std::string generateCustomerID(const std::string& p1, const std::string&
  * Generates random alphanumeric strings
 */
 extern std::string generateChars(const uint8_t len);
+/*!
+ * Generates alphanumeric strings from the given random engine, e.g. a seeded one for
+ * reproducible test data
+*/
+/**
+ * Code based-from StackOverflow by Galik
+ * Author profile: https://stackoverflow.com/users/3807729/galik
+ *
+ * Original question: https://stackoverflow.com/q/440133/3975468
+ * Answer: https://stackoverflow.com/a/24586587/3975468
+*/
+template <typename Engine>
+std::string generateChars(const uint8_t len, Engine* engine) {
+    static constexpr char chrs[] = "0123456789"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::uniform_int_distribution<size_t> pick(0, sizeof(chrs) - 2);
+    std::string temp;
+    temp.reserve(len);
+    for (int i = 0; i < len; ++i) {
+        temp += chrs[pick(*engine)];
+    }
+    return temp;
+}
 }  // namespace chargenerator
 }  // namespace utility
 #endif  // UTILITY_GENERATOR_CHARGENERATOR_HPP_